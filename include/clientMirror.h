@@ -0,0 +1,71 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Client state mirror: the program each client is known to have, so a program
+// change it already has (a MIDI controller repeating the same PC, a footswitch
+// pressed twice) is not sent again.
+//
+// A program becomes known when every frame queued to the client since it was
+// sent has been reported delivered by the send callback, or when the client's
+// status reply (DATA, commandType STATUS_REQUEST, commandValue = program) says
+// so. A failed delivery, a missing callback (CLIENT_MIRROR_ACK_TIMEOUT_MS), a
+// pairing request from the client (reconnect) or age (CLIENT_MIRROR_MAX_AGE_MS)
+// makes the state unknown again, and the next program change is sent.
+//
+// A repeat of a program that is still in flight is collapsed into it; if that
+// frame then fails, the program is sent once more from serviceClientMirror().
+#pragma once
+#include <Arduino.h>
+
+enum ClientMirrorDecision : uint8_t {
+    CLIENT_MIRROR_SEND,
+    CLIENT_MIRROR_SUPPRESS,     // Client confirmed on this program
+    CLIENT_MIRROR_COLLAPSE      // Same program already in flight
+};
+
+struct ClientMirrorStats {
+    uint32_t checked;           // Program changes looked at
+    uint32_t suppressed;
+    uint32_t collapsed;
+    uint32_t resent;            // Collapsed repeats sent again after a failed delivery
+    uint32_t confirmed;         // Programs confirmed by delivery
+    uint32_t statusReplies;     // Programs confirmed by a status reply
+    uint32_t failures;          // Failed deliveries that made a client unknown
+    uint32_t timeouts;          // Missing send callbacks
+    uint32_t expired;           // Confirmed state aged out
+    uint32_t reconnects;        // Pairing requests from a known client
+    uint64_t airtimeSavedUs;    // CLIENT_MIRROR_FRAME_AIRTIME_US per frame not sent
+};
+
+// Decide whether a program change to this client goes out. Counts the outcome.
+ClientMirrorDecision clientMirrorCheck(const uint8_t* clientMac, uint8_t program);
+
+// Bookkeeping for every frame handed to the driver (espnow.cpp) and every send
+// callback (WiFi task); frames to MACs that are not paired clients are ignored.
+// A frame counts as in flight before the send, so a callback that beats the
+// send's return still finds it; OnSendRefused rolls it back on a driver error.
+void clientMirrorOnQueued(const uint8_t* mac, const uint8_t* data, size_t length);
+void clientMirrorOnSendRefused(const uint8_t* mac);
+void clientMirrorOnSendResult(const uint8_t* mac, bool delivered);
+void clientMirrorOnStatus(const uint8_t* mac, uint8_t program);
+
+void clientMirrorInvalidate(const uint8_t* mac);   // nullptr = every client
+void serviceClientMirror();     // Call from loop(): timeouts, ageing, resends
+
+void setClientMirrorEnabled(bool enabled);
+bool isClientMirrorEnabled();
+uint8_t clientMirrorProgram(const uint8_t* mac);   // Confirmed program, 0xFF if unknown
+const ClientMirrorStats& getClientMirrorStats();
+void resetClientMirrorStats();
+void printClientMirror();
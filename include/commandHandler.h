@@ -19,7 +19,6 @@
 // Button control functions
 void checkPairingButtons();
 void handleLedFeedback(unsigned long held, const char* buttonName);
-void updateLedPatterns();
 
 // Button simulation functions
 void simulateButton1Press();
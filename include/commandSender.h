@@ -20,6 +20,9 @@
 // Command sending functions
 bool sendCommandToClient(const uint8_t* clientMac, uint8_t commandType, uint8_t commandValue);
 bool sendCommandToAllClients(uint8_t commandType, uint8_t commandValue);
+// The last sendCommandToClient() handed a frame to the driver (false when the
+// client mirror skipped it or the client was unknown)
+bool lastCommandFrameSent();
 
 // Specific command helpers
 bool sendChannelChange(const uint8_t* clientMac, uint8_t channel);
@@ -29,9 +32,6 @@ bool sendAllChannelsOffToAll();
 bool sendStatusRequest(const uint8_t* clientMac);
 bool sendStatusRequestToAll();
 
-// MIDI forwarding: broadcast a MIDI Program Change (program 0-127 will be interpreted by clients)
+// MIDI forwarding: a Program Change to every client, remapped per client (programRemap.h)
 bool forwardMidiProgramToAll(uint8_t programNumber);
 
-// Serial command interface
-void handleSendCommand(const String& cmd);
-void printSendCommandHelp();
@@ -44,17 +44,17 @@
 #define PAIRING_BUTTON_PIN 0
 #endif
 
-// LEDC Configuration
-#ifndef LEDC_CHANNEL_0
-#define LEDC_CHANNEL_0 0
+// Status LED (LEDC). Channel 0-7 keep the Arduino and IDF channel numbers equal.
+#ifndef PAIRING_LED_CHANNEL
+#define PAIRING_LED_CHANNEL 0
 #endif
 
-#ifndef LEDC_TIMER_13_BIT
-#define LEDC_TIMER_13_BIT 13
+#ifndef PAIRING_LED_RESOLUTION_BITS
+#define PAIRING_LED_RESOLUTION_BITS 13   // Duty 0-8191
 #endif
 
-#ifndef LEDC_BASE_FREQ
-#define LEDC_BASE_FREQ 1000
+#ifndef PAIRING_LED_FREQ
+#define PAIRING_LED_FREQ 1000
 #endif
 
 
@@ -110,8 +110,158 @@
 #define STORAGE_VERSION 1
 #endif
 
+#ifndef NVS_COMMIT_QUIET_MS
+#define NVS_COMMIT_QUIET_MS 2000      // Pending config changes are written after this long without edits
+#endif
+
+// Live rig state resync after boot
+#ifndef RIG_RESYNC_INTERVAL_MS
+#define RIG_RESYNC_INTERVAL_MS 1000   // Resend period for clients that have not acknowledged their program
+#endif
+
+#ifndef RIG_RESYNC_WINDOW_MS
+#define RIG_RESYNC_WINDOW_MS 120000   // Give up on clients still unreachable this long after boot
+#endif
+
+// Client state mirror: program changes a client already has are not re-sent
+#ifndef CLIENT_MIRROR_ENABLED
+#define CLIENT_MIRROR_ENABLED true    // Default of the runtime switch ('mirror on|off')
+#endif
+
+#ifndef CLIENT_MIRROR_ACK_TIMEOUT_MS
+#define CLIENT_MIRROR_ACK_TIMEOUT_MS 500   // No send callback this long after a frame: client state unknown
+#endif
+
+#ifndef CLIENT_MIRROR_MAX_AGE_MS
+#define CLIENT_MIRROR_MAX_AGE_MS 30000     // Confirmed state is trusted this long (0 = until invalidated)
+#endif
+
+#ifndef CLIENT_MIRROR_FRAME_AIRTIME_US
+#define CLIENT_MIRROR_FRAME_AIRTIME_US 1180 // Command frame at 1 Mbit/s: preamble, frame, ACK, DIFS, mean backoff
+#endif
+
+// Client status collection ('clients')
+#ifndef STATUS_COLLECT_DEADLINE_MS
+#define STATUS_COLLECT_DEADLINE_MS 300     // Clients that have not replied by then are marked missing
+#endif
+
+#ifndef STATUS_COLLECT_REQUESTS_PER_PASS
+#define STATUS_COLLECT_REQUESTS_PER_PASS 2 // Status requests queued per loop pass (no delay between them)
+#endif
+
+#ifndef STATUS_COLLECT_MAX_PENDING
+#define STATUS_COLLECT_MAX_PENDING 8       // Requests awaiting a reply; below the driver's 10-frame TX queue
+#endif
+
+// Scenes ('scene')
+#ifndef SCENE_RECALL_RETRY_MS
+#define SCENE_RECALL_RETRY_MS 200          // Client sends the driver refused (queue full) are retried this long
+#endif
+
+#ifndef SCENE_RECALL_TIMEOUT_MS
+#define SCENE_RECALL_TIMEOUT_MS 1000       // Recall timing stops waiting for delivery reports after this
+#endif
+
+// Live OTA: web updater on a softAP (ESP-NOW channel) while switching keeps running
+#ifndef LIVE_OTA_AP_SSID
+#define LIVE_OTA_AP_SSID "GuitarSwitcher-OTA"
+#endif
+
+#ifndef LIVE_OTA_AP_PASSWORD
+#define LIVE_OTA_AP_PASSWORD "12345678"   // WPA2 needs at least 8 characters
+#endif
+
+#ifndef LIVE_OTA_IDLE_TIMEOUT_MS
+#define LIVE_OTA_IDLE_TIMEOUT_MS 600000   // Shut the AP down if no upload starts within this time
+#endif
+
+#ifndef LIVE_OTA_LATENCY_BUDGET_US
+#define LIVE_OTA_LATENCY_BUDGET_US 5000   // Max loop gap tolerated during an upload
+#endif
+
+#ifndef LIVE_OTA_MIN_PAUSE_MS
+#define LIVE_OTA_MIN_PAUSE_MS 2           // Pause after each flash chunk (adapted between min and max)
+#endif
+
+#ifndef LIVE_OTA_MAX_PAUSE_MS
+#define LIVE_OTA_MAX_PAUSE_MS 100
+#endif
+
+// Firmware push to ESP-NOW clients
+#ifndef FW_PUSH_POLL_TIMEOUT_MS
+#define FW_PUSH_POLL_TIMEOUT_MS 100   // Wait for STATUS replies after each window of chunks
+#endif
+
+#ifndef FW_PUSH_OFFER_TIMEOUT_MS
+#define FW_PUSH_OFFER_TIMEOUT_MS 3000   // Keep offering before streaming to the clients that answered
+#endif
+
+#ifndef FW_PUSH_MAX_MISSED_POLLS
+#define FW_PUSH_MAX_MISSED_POLLS 20   // Unanswered polls before a client stops holding back the window
+#endif
+
+#ifndef FW_PUSH_SEND_TIMEOUT_MS
+#define FW_PUSH_SEND_TIMEOUT_MS 20   // Longest wait for a send callback before the next frame
+#endif
+
+#ifndef FW_PUSH_MAX_FAILURES
+#define FW_PUSH_MAX_FAILURES 2   // Image CRC failures before a client is given up
+#endif
+
+// ESP-NOW capture ring ('capture on', exported as pcap by 'capture dump')
+#ifndef ESPNOW_CAPTURE_RECORDS
+#define ESPNOW_CAPTURE_RECORDS 256    // Must be a power of two; about 48 bytes each
+#endif
+
+#ifndef ESPNOW_CAPTURE_BYTES
+#define ESPNOW_CAPTURE_BYTES 32       // Frame bytes kept per record (whole command/data frames)
+#endif
+
+// Session recorder ('session start', replayed by the native build)
+#ifndef SESSION_RECORD_BYTES
+#define SESSION_RECORD_BYTES 32768    // Allocated on the first 'session start'; 8 bytes per record + payload
+#endif
+
+// Serial console input
+#ifndef SERIAL_LINE_MAX_LEN
+#define SERIAL_LINE_MAX_LEN 128       // Longest accepted console line (longer lines are discarded)
+#endif
+
+#ifndef SERIAL_RX_BYTES_PER_LOOP
+#define SERIAL_RX_BYTES_PER_LOOP 64   // Max bytes consumed per checkSerialCommands() call
+#endif
+
+#ifndef CONTROL_FRAME_BYTE_TIMEOUT_MS
+#define CONTROL_FRAME_BYTE_TIMEOUT_MS 10  // A control frame with no new byte for this long is dropped (back to text)
+#endif
+
+// Deferred logging (hot-path log records formatted by a background task)
+#ifndef DEFERRED_LOG_SLOTS
+#define DEFERRED_LOG_SLOTS 32         // Ring capacity in records, must be a power of two
+#endif
+
+#ifndef DEFERRED_LOG_MAX_ARGS
+#define DEFERRED_LOG_MAX_ARGS 10      // Arguments per record; more fail the build (MAC logs take 9)
+#endif
+
+#ifndef DEFERRED_LOG_STRING_BYTES
+#define DEFERRED_LOG_STRING_BYTES 32  // Inline storage for copied %s arguments per record
+#endif
+
+#ifndef DEFERRED_LOG_DRAIN_INTERVAL_MS
+#define DEFERRED_LOG_DRAIN_INTERVAL_MS 20
+#endif
+
+// Heap fragmentation history (free vs. largest free block, shown by 'memory frag')
+#ifndef MEMORY_FRAG_SAMPLE_INTERVAL_MS
+#define MEMORY_FRAG_SAMPLE_INTERVAL_MS 600000   // 10 minutes
+#endif
+
+#ifndef MEMORY_FRAG_SAMPLES
+#define MEMORY_FRAG_SAMPLES 48                  // Ring capacity: 8 hours at the default interval
+#endif
+
 // Function declarations
 uint8_t* parsePinArray(const char* pinString);
-String getServerTypeString();
 void printServerConfiguration();
 void initializeServerConfiguration();
@@ -0,0 +1,88 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Packed configuration image: every persisted setting in one CRC-protected
+// blob. The layout is fixed (independent of MAX_CLIENTS etc. in config.h) and
+// has no Arduino dependencies so it can be inspected on a host.
+//
+// Images are kept in two slots (A/B). A save writes the slot not currently in
+// use with the next generation number; the newest valid slot is the active one,
+// so an interrupted write leaves the previous configuration intact.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONFIG_IMAGE_MAGIC 0x31474643u   // "CFG1" little endian
+#define CONFIG_IMAGE_VERSION 1
+
+#ifndef CONFIG_IMAGE_MAX_PEERS
+#define CONFIG_IMAGE_MAX_PEERS 10     // Changes the image size: images of other builds read as invalid
+#endif
+#define CONFIG_IMAGE_NAME_LEN 32
+#define CONFIG_IMAGE_RELAY_SLOTS 8
+#define CONFIG_IMAGE_BUTTON_SLOTS 8
+
+struct ConfigPeerRecord {
+    uint8_t mac[6];
+    char name[CONFIG_IMAGE_NAME_LEN];   // Not necessarily NUL terminated
+};
+
+struct ConfigImage {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                      // sizeof(ConfigImage) when written
+    uint32_t crc;                       // CRC-32 of everything after this field
+    uint8_t logLevel;
+    uint8_t wifiChannel;                // 0 = not set
+    uint8_t midiChannel;                // 0 = omni
+    uint8_t relayMapCount;
+    uint8_t relayMap[CONFIG_IMAGE_RELAY_SLOTS];
+    uint8_t buttonCount;
+    uint8_t buttonMap[CONFIG_IMAGE_BUTTON_SLOTS];
+    uint8_t peerCount;
+    uint16_t generation;                // Incremented on every slot write (wraps)
+    ConfigPeerRecord peers[CONFIG_IMAGE_MAX_PEERS];
+};
+
+// CRC-32 (IEEE 802.3, reflected, init/xorout 0xFFFFFFFF)
+uint32_t configCrc32(const void* data, size_t length, uint32_t crc = 0);
+
+// Fill the header and CRC
+void configImageSeal(ConfigImage& image);
+
+// True if a blob of storedLength bytes holds an intact image of this version
+bool configImageValid(const ConfigImage& image, size_t storedLength);
+
+#define CONFIG_SLOT_COUNT 2
+
+// Storage backend for the slots. nvsManager binds it to Preferences; a host
+// test can bind it to a RAM array to simulate torn or corrupted writes.
+struct ConfigSlotStore {
+    size_t (*read)(uint8_t slot, ConfigImage& out);         // Stored length, 0 if absent
+    bool (*write)(uint8_t slot, const ConfigImage& image);
+};
+
+// True if generation a was written after b (wraparound safe)
+bool configGenerationNewer(uint16_t a, uint16_t b);
+
+// Index of the newest valid image, or -1 if neither is valid
+int configSelectSlot(const ConfigImage images[CONFIG_SLOT_COUNT], const size_t lengths[CONFIG_SLOT_COUNT]);
+
+// Read both slots and copy the newest valid image to out. Returns its slot or -1.
+int configLoadSlots(const ConfigSlotStore& store, ConfigImage& out);
+
+// Seal image with the next generation, write it to the slot that is not active
+// (activeSlot -1 = nothing stored yet) and read it back. Returns the new active
+// slot, or -1 with image unchanged if the write could not be verified.
+int configCommitSlot(const ConfigSlotStore& store, ConfigImage& image, int activeSlot);
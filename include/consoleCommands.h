@@ -0,0 +1,44 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Serial console: the command tables and their handlers. Tokenizing and lookup
+// live in consoleParser.h; help text is generated from the tables.
+#pragma once
+#include <Arduino.h>
+#include <consoleParser.h>
+
+enum ConsoleGroup : uint8_t {
+    CMD_GROUP_SYSTEM,
+    CMD_GROUP_CONTROL,
+    CMD_GROUP_PAIRING,
+    CMD_GROUP_SEND,
+    CMD_GROUP_RELAY,
+    CMD_GROUP_TEST,
+    CMD_GROUP_DEBUG,
+    CMD_GROUP_COUNT
+};
+
+// Dispatch a complete console line (modified in place)
+void dispatchConsoleLine(char* line);
+
+// Help generated from the command tables
+void printConsoleHelp();
+void printSendCommandHelp();
+
+// Tokenize and look up iterations sample lines (subcommands too) without running
+// the handlers; returns the lookups that hit. The parse benchmark times this.
+uint32_t consoleParseSamples(uint32_t iterations);
+
+// Parse-only throughput benchmark (tokenize + table lookup)
+void runConsoleParseBenchmark(uint32_t iterations);
@@ -0,0 +1,68 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Console line parsing: in-place tokenizer, sorted command tables and integer
+// arguments. Plain C++ with no Arduino dependencies, so the native build links
+// and benchmarks the same code; parsing and lookup never allocate.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CONSOLE_MAX_ARGS
+#define CONSOLE_MAX_ARGS 8
+#endif
+
+struct ConsoleArgs {
+    int argc;
+    char* argv[CONSOLE_MAX_ARGS];
+};
+
+typedef void (*ConsoleHandler)(ConsoleArgs& args);
+
+struct ConsoleCommand {
+    const char* name;       // Lower-case; tables are sorted by name (checked at compile time)
+    ConsoleHandler handler;
+    uint8_t group;          // ConsoleGroup (top-level table only)
+    const char* usage;      // Shown in help; nullptr hides aliases
+    const char* help;
+};
+
+// ---- Compile-time table checks ----
+static constexpr int consoleConstStrCmp(const char* a, const char* b) {
+    return (*a != *b) ? ((unsigned char)*a < (unsigned char)*b ? -1 : 1)
+                      : (*a == '\0' ? 0 : consoleConstStrCmp(a + 1, b + 1));
+}
+
+// static_assert(consoleTableSorted(table), ...) next to each command table
+template <size_t N>
+constexpr bool consoleTableSorted(const ConsoleCommand (&table)[N], size_t i = 1) {
+    return i >= N ? true
+                  : (consoleConstStrCmp(table[i - 1].name, table[i].name) < 0 && consoleTableSorted(table, i + 1));
+}
+
+// Tokenize a line in place (splits on spaces/tabs, lower-cases the command word)
+int consoleTokenize(char* line, ConsoleArgs& args);
+
+// Binary search over a sorted command table
+const ConsoleCommand* consoleFind(const ConsoleCommand* table, size_t count, const char* name);
+
+// Look up argv[0]; "setlog3"/"ch2" style words that miss are split into name +
+// numeric argument (argv shifts up by one) when the name alone is in the table
+const ConsoleCommand* consoleResolve(const ConsoleCommand* table, size_t count, ConsoleArgs& args);
+
+// Shift args so that a subcommand handler sees its own name at argv[0]
+void consoleShift(ConsoleArgs& args);
+
+// Strict integer argument parsing; returns false if missing or malformed
+bool consoleArgInt(const ConsoleArgs& args, int index, int& out);
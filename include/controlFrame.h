@@ -0,0 +1,88 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Binary control protocol wire format, shared by the firmware and the host
+// client in tools/control-client (no Arduino dependencies in this header).
+//
+// On the wire every frame is COBS encoded and wrapped in 0x00 delimiters:
+//   0x00 <COBS(frame)> 0x00
+// Console text never contains 0x00, so frames and text share the USB CDC port.
+//
+// Decoded request:  [seq lo][seq hi][opcode][payload...][crc lo][crc hi]
+// Decoded response: [seq lo][seq hi][opcode|0x80][status][payload...][crc lo][crc hi]
+// CRC is CRC-16/CCITT-FALSE over everything before it. Multi-byte fields are
+// little endian. Responses echo the request seq, so requests may be pipelined.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTROL_PROTOCOL_VERSION 1
+
+#ifndef CONTROL_FRAME_MAX_LEN
+#define CONTROL_FRAME_MAX_LEN 128     // Largest decoded frame (header + payload + CRC)
+#endif
+
+#define CONTROL_FRAME_HEADER_LEN 3
+#define CONTROL_FRAME_CRC_LEN 2
+#define CONTROL_FRAME_MIN_LEN (CONTROL_FRAME_HEADER_LEN + CONTROL_FRAME_CRC_LEN)
+#define CONTROL_FRAME_MAX_PAYLOAD (CONTROL_FRAME_MAX_LEN - CONTROL_FRAME_MIN_LEN)
+#define CONTROL_RESPONSE_FLAG 0x80
+
+// Worst-case COBS output for n input bytes, plus both 0x00 delimiters
+#define COBS_MAX_ENCODED_LEN(n) ((n) + ((n) / 254) + 1)
+#define CONTROL_WIRE_MAX_LEN (COBS_MAX_ENCODED_LEN(CONTROL_FRAME_MAX_LEN) + 2)
+
+enum ControlOpcode : uint8_t {
+    CTRL_OP_PING             = 0x01, // -> [version][uptime ms u32]
+    CTRL_OP_STATS            = 0x02, // -> see controlProtocol.cpp handleStats()
+    CTRL_OP_RELAY_SET        = 0x10, // [channel 0-N]           -> [channel][mask]
+    CTRL_OP_RELAY_MASK       = 0x11, // [mask]                  -> [channel][mask]
+    CTRL_OP_RELAY_GET        = 0x12, //                         -> [channel][mask]
+    CTRL_OP_SEND_CLIENT      = 0x20, // [client idx][type][value]
+    CTRL_OP_SEND_ALL         = 0x21, // [type][value]
+    CTRL_OP_MAP_GET          = 0x30, // -> [midi ch][relay count][relay map...][button count][button map...]
+    CTRL_OP_MAP_SET_RELAY    = 0x31, // [relay idx][program]
+    CTRL_OP_MAP_SET_BUTTON   = 0x32, // [button idx][program]
+    CTRL_OP_MIDI_CHANNEL     = 0x33, // [channel 0-16]
+    CTRL_OP_MAP_SAVE         = 0x34, // persist channel and maps to NVS
+    CTRL_OP_BATCH            = 0x40  // {[opcode][len][payload...]}* -> [count][status...]
+};
+
+enum ControlStatus : uint8_t {
+    CTRL_STATUS_OK = 0,
+    CTRL_STATUS_UNKNOWN_OPCODE,
+    CTRL_STATUS_BAD_LENGTH,
+    CTRL_STATUS_BAD_ARGUMENT,
+    CTRL_STATUS_FAILED,
+    CTRL_STATUS_UNSUPPORTED
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t controlCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+// COBS encode; out must hold COBS_MAX_ENCODED_LEN(length) bytes. Returns encoded length.
+size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out);
+
+// COBS decode (input without delimiters). Returns false on malformed input or overflow.
+bool cobsDecode(const uint8_t* in, size_t length, uint8_t* out, size_t outSize, size_t& outLength);
+
+// Append the CRC to a decoded frame of `length` bytes (buffer needs 2 spare bytes).
+// Returns the new length.
+size_t controlFrameSeal(uint8_t* frame, size_t length);
+
+// True if the decoded frame is long enough and its CRC matches
+bool controlFrameValid(const uint8_t* frame, size_t length);
+
+// Build the wire form (delimiters included) of a sealed frame. Returns 0 if wire is too small.
+size_t controlFrameToWire(const uint8_t* frame, size_t length, uint8_t* wire, size_t wireSize);
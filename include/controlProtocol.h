@@ -0,0 +1,50 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Binary control protocol on the USB CDC serial, alongside the text console.
+// Wire format and opcodes are in controlFrame.h.
+#pragma once
+#include <Arduino.h>
+#include <controlFrame.h>
+
+struct ControlProtocolStats {
+    uint32_t framesOk;          // Valid requests handled
+    uint32_t crcErrors;
+    uint32_t framingErrors;     // Bad COBS or too short
+    uint32_t overflows;         // Frame longer than CONTROL_FRAME_MAX_LEN (dropped, back to text)
+    uint32_t timeouts;          // Frame with no byte for CONTROL_FRAME_BYTE_TIMEOUT_MS (dropped, back to text)
+    uint32_t unknownOpcodes;
+};
+
+// True while a binary frame is being received (bytes belong to the frame)
+bool controlProtocolReceiving();
+
+// Feed one serial byte; a 0x00 outside a frame starts one
+void controlProtocolRxByte(uint8_t c);
+
+// Call when no serial byte arrived: drops a frame whose next byte is overdue,
+// so a stray 0x00 on the console cannot keep it out of text mode
+void controlProtocolPoll();
+
+// Execute one decoded request payload (also used for batch entries).
+// Writes the response payload after the status byte; returns the status.
+uint8_t controlProtocolExecute(uint8_t opcode, const uint8_t* payload, size_t length,
+                               uint8_t* response, size_t responseSize, size_t& responseLength);
+
+// Where responses are written (default: the console UART); nullptr restores it
+typedef void (*ControlOutput)(const void* data, size_t length);
+void controlProtocolSetOutput(ControlOutput output);
+
+const ControlProtocolStats& getControlProtocolStats();
+void printControlProtocolStats();
@@ -19,7 +19,7 @@
 #define MAX_PEER_NAME_LEN 32
 
 // Message types
-enum MessageType {PAIRING, DATA, COMMAND};
+enum MessageType {PAIRING, DATA, COMMAND, FW_PUSH};   // FW_PUSH: fwPushProtocol.h
 enum CommandType {
   PROGRAM_CHANGE = 0, 
   RESERVED1 = 1,       // (reserved)
@@ -20,6 +20,7 @@
 void printDebugInfo();
 void printPerformanceMetrics();
 void printMemoryAnalysis();
+void printMemoryFragmentation();
 void printWiFiStats();
 void printESPNowStats();
 
@@ -35,6 +36,12 @@ void updateMemoryStats();
 uint32_t getFreeHeap();
 uint32_t getMinFreeHeap();
 
+// malloc/calloc/realloc calls made by the calling task between start and stop.
+// The device build links with --wrap for these (platformio.ini), so calls from
+// the Arduino core and IDF libraries are counted too.
+void allocCountStart();
+uint32_t allocCountStop();
+
 // Performance monitoring structure (matching client)
 struct PerformanceMetrics {
     unsigned long loopCount;
@@ -0,0 +1,125 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Deferred logging for hot paths (switching, ESP-NOW callbacks, MIDI).
+//
+// logq() only stores the format pointer, a timestamp and the raw arguments in
+// a lock-free multi-producer ring; a drain task at the loop's priority formats
+// and prints them every DEFERRED_LOG_DRAIN_INTERVAL_MS.
+// The format string must have static storage (a literal). %s arguments are
+// copied into the record, so temporaries are safe to pass.
+#pragma once
+#include <Arduino.h>
+#include <globals.h>
+#include "config.h"
+
+enum DeferredArgKind : uint8_t {
+    DLOG_ARG_INT,
+    DLOG_ARG_UINT,
+    DLOG_ARG_INT64,
+    DLOG_ARG_UINT64,
+    DLOG_ARG_DOUBLE,
+    DLOG_ARG_PTR,
+    DLOG_ARG_STR        // value.u holds the offset into the record string area
+};
+
+union DeferredArgValue {
+    int32_t i;
+    uint32_t u;
+    int64_t i64;
+    uint64_t u64;
+    double d;
+    const void* p;
+};
+
+// Staging area filled on the caller's stack, then published to the ring in one copy
+struct DeferredLogEntry {
+    const char* format;
+    uint32_t timestamp;
+    uint8_t level;
+    uint8_t argCount;
+    uint8_t stringUsed;
+    uint8_t kinds[DEFERRED_LOG_MAX_ARGS];
+    DeferredArgValue values[DEFERRED_LOG_MAX_ARGS];
+    char strings[DEFERRED_LOG_STRING_BYTES];
+};
+
+// Logger lifecycle and statistics
+void initDeferredLog();
+void flushDeferredLog();                // Format and print everything queued so far
+bool deferredLogPush(const DeferredLogEntry& entry);
+uint32_t getDeferredLogDropped();
+uint32_t getDeferredLogQueued();
+uint32_t getDeferredLogBacklog();      // Records queued but not yet printed
+void printDeferredLogStats();
+
+// Argument capture (overloads chosen at compile time, no format parsing on the hot path)
+inline void deferredLogAdd(DeferredLogEntry& e, uint8_t kind, DeferredArgValue v) {
+    if (e.argCount < DEFERRED_LOG_MAX_ARGS) {
+        e.kinds[e.argCount] = kind;
+        e.values[e.argCount] = v;
+        e.argCount++;
+    }
+}
+
+inline void deferredLogCapture(DeferredLogEntry& e, long long v)          { DeferredArgValue a; a.i64 = v; deferredLogAdd(e, DLOG_ARG_INT64, a); }
+inline void deferredLogCapture(DeferredLogEntry& e, unsigned long long v) { DeferredArgValue a; a.u64 = v; deferredLogAdd(e, DLOG_ARG_UINT64, a); }
+inline void deferredLogCapture(DeferredLogEntry& e, long v) {
+    if (sizeof(long) > 4) { deferredLogCapture(e, (long long)v); return; }
+    DeferredArgValue a; a.i = (int32_t)v; deferredLogAdd(e, DLOG_ARG_INT, a);
+}
+inline void deferredLogCapture(DeferredLogEntry& e, unsigned long v) {
+    if (sizeof(long) > 4) { deferredLogCapture(e, (unsigned long long)v); return; }
+    DeferredArgValue a; a.u = (uint32_t)v; deferredLogAdd(e, DLOG_ARG_UINT, a);
+}
+inline void deferredLogCapture(DeferredLogEntry& e, int v)                { deferredLogCapture(e, (long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, short v)              { deferredLogCapture(e, (long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, signed char v)        { deferredLogCapture(e, (long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, char v)               { deferredLogCapture(e, (long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, bool v)               { deferredLogCapture(e, (long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, unsigned int v)       { deferredLogCapture(e, (unsigned long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, unsigned short v)     { deferredLogCapture(e, (unsigned long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, unsigned char v)      { deferredLogCapture(e, (unsigned long)v); }
+inline void deferredLogCapture(DeferredLogEntry& e, double v)             { DeferredArgValue a; a.d = v;   deferredLogAdd(e, DLOG_ARG_DOUBLE, a); }
+inline void deferredLogCapture(DeferredLogEntry& e, float v)              { deferredLogCapture(e, (double)v); }
+void deferredLogCapture(DeferredLogEntry& e, const char* s);
+inline void deferredLogCapture(DeferredLogEntry& e, char* s)              { deferredLogCapture(e, (const char*)s); }
+template <typename T>
+inline void deferredLogCapture(DeferredLogEntry& e, const T* p)           { DeferredArgValue a; a.p = p; deferredLogAdd(e, DLOG_ARG_PTR, a); }
+
+inline void deferredLogCaptureAll(DeferredLogEntry&) {}
+
+template <typename T, typename... Rest>
+inline void deferredLogCaptureAll(DeferredLogEntry& e, T first, Rest... rest) {
+    deferredLogCapture(e, first);
+    deferredLogCaptureAll(e, rest...);
+}
+
+// Level-checked wrapper, see LOG()/LOGF() in utils.h
+#define LOGQ(level, ...) do { if (LOG_ENABLED(level)) logq((level), __VA_ARGS__); } while (0)
+
+// Queue a log record without formatting. Safe from the WiFi/ESP-NOW callback task.
+template <typename... Args>
+inline void logq(LogLevel level, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many logq() arguments, raise DEFERRED_LOG_MAX_ARGS");
+    if (level > currentLogLevel) return;
+    DeferredLogEntry e;
+    e.format = format;
+    e.timestamp = millis();
+    e.level = (uint8_t)level;
+    e.argCount = 0;
+    e.stringUsed = 0;
+    deferredLogCaptureAll(e, args...);
+    deferredLogPush(e);
+}
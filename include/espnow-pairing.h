@@ -15,11 +15,10 @@
 #pragma once
 
 #include <Arduino.h>
-void setupPairingButtonAndLED();
+void setupPairingButton();
 // void handlePairingButtonPress(); // Replaced with checkPairingButtons() in commandHandler
 void checkPairingTimeout();
 void pairingforceStart();
-void updatePairingLED();  // Now uses advanced LED patterns
 extern bool pairingMode;
 extern volatile bool pairingRequested;
 bool addPeer(const uint8_t *peer_addr, bool save);
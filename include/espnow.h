@@ -15,8 +15,17 @@
 #pragma once
 
 #include <Arduino.h>
-#include <esp_now.h>
+#include <espnowFrame.h>
+
+// Received frames, counted in the WiFi task. rejected[ESPNOW_RX_OK] stays 0.
+struct EspNowRxStats {
+    uint32_t accepted;
+    uint32_t rejected[ESPNOW_RX_REASON_COUNT];
+};
 
 void initESP_NOW();
-void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
-void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
\ No newline at end of file
+// halEspNowSend() plus a capture record; use for every server frame
+int espNowSend(const uint8_t* mac, const void* data, size_t len);
+void OnDataSent(const uint8_t *mac_addr, bool delivered);
+void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
+const EspNowRxStats& getEspNowRxStats();
@@ -0,0 +1,86 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ESP-NOW capture: an optional flight recorder for every frame the server sends
+// or receives, and its pcap export. The format part of this header has no
+// Arduino dependencies; tools/espnow-capture reads the export on a host.
+//
+// Records go into a fixed RAM ring (ESPNOW_CAPTURE_RECORDS in config.h) that
+// overwrites the oldest entry, so after a missed switch the last few seconds of
+// traffic are still there. Each keeps the first ESPNOW_CAPTURE_BYTES of the frame.
+//
+// The export is a classic pcap file (microsecond timestamps, link type USER0).
+// Every packet starts with EspNowCapturePseudo, followed by the frame bytes;
+// orig_len is the full frame length, so truncated records show as such.
+// 'capture dump' on the console sends it between two marker lines:
+//   #PCAP <length> <crc32>\n <length bytes of pcap> \n#END\n
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCAP_MAGIC_US 0xA1B2C3D4u
+#define PCAP_LINKTYPE_USER0 147
+
+enum EspNowCaptureEvent : uint8_t {
+    CAPTURE_TX = 1,             // Frame handed to the driver; status 0 = queued, 1 = refused
+    CAPTURE_RX = 2,             // Frame received; status = EspNowReject (0 = accepted)
+    CAPTURE_TX_STATUS = 3       // Send callback, no payload; status 0 = delivered, 1 = failed
+};
+
+#define CAPTURE_PEER_BROADCAST 0xFE
+#define CAPTURE_PEER_UNKNOWN 0xFF   // Not a paired client
+
+struct PcapFileHeader {
+    uint32_t magic;
+    uint16_t versionMajor;      // 2
+    uint16_t versionMinor;      // 4
+    int32_t thisZone;
+    uint32_t sigFigs;
+    uint32_t snapLen;
+    uint32_t linkType;
+};
+
+struct PcapRecordHeader {
+    uint32_t tsSec;
+    uint32_t tsUsec;
+    uint32_t inclLen;
+    uint32_t origLen;
+};
+
+struct __attribute__((packed)) EspNowCapturePseudo {
+    uint8_t event;              // EspNowCaptureEvent
+    uint8_t peer;               // Paired client slot, CAPTURE_PEER_BROADCAST or CAPTURE_PEER_UNKNOWN
+    uint8_t status;
+    uint8_t reserved;
+    uint8_t mac[6];             // Destination (TX) or source (RX)
+};
+
+static_assert(sizeof(PcapFileHeader) == 24 && sizeof(PcapRecordHeader) == 16, "pcap header layout");
+
+// ---- Firmware side ----
+void espNowCaptureStart();
+void espNowCaptureStop();
+void espNowCaptureClear();
+bool espNowCaptureActive();
+
+// Record one event; a no-op unless capture is on. Safe from the WiFi task.
+void espNowCaptureRecord(uint8_t event, const uint8_t* mac, const uint8_t* data, int length,
+                         uint8_t status, uint32_t timeUs);
+
+// Write the ring as a pcap stream, oldest record first. Stop capture first:
+// records still being written are skipped. Returns the bytes written.
+size_t espNowCaptureExport(void (*write)(const void* data, size_t length));
+
+void dumpEspNowCapture();       // Console export with the marker lines above
+void printEspNowCaptureStatus();
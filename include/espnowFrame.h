@@ -0,0 +1,95 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Validation of received ESP-NOW frames (no Arduino dependencies in this header,
+// so the parser can be fuzzed on a host: tools/frame-fuzz).
+//
+// espNowFrameParse() checks the length of a frame against the layout of its
+// message type before any byte after the type is read. The view it returns
+// points into the radio buffer; fields are read through the accessors below, so
+// nothing is copied and no alignment is assumed.
+//
+// Command/data and pairing frames carry no version field: their layout is
+// identified by the type byte and length. Shorter frames are rejected and
+// trailing bytes (a longer layout from newer clients) are ignored. FW_PUSH
+// frames are checked per op, and an OFFER must carry FW_PUSH_PROTOCOL_VERSION.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <fwPushProtocol.h>
+
+#define ESPNOW_MAX_FRAME_LEN 250       // ESP-NOW v1 payload limit
+
+// MessageType values (dataStructs.h)
+#define ESPNOW_MSG_PAIRING 0
+#define ESPNOW_MSG_DATA    1
+#define ESPNOW_MSG_COMMAND 2
+
+// struct_message layout (checked against the struct in espnow.cpp)
+#define ESPNOW_MESSAGE_LEN            16
+#define ESPNOW_MESSAGE_ID             1
+#define ESPNOW_MESSAGE_COMMAND_TYPE   2
+#define ESPNOW_MESSAGE_COMMAND_VALUE  3
+#define ESPNOW_MESSAGE_TARGET_CHANNEL 4
+#define ESPNOW_MESSAGE_READING_ID     8
+#define ESPNOW_MESSAGE_TIMESTAMP      12
+
+// Status reply tail: a client answering STATUS_REQUEST (DATA, commandType
+// STATUS_REQUEST, commandValue = its program) may append these fields
+#define ESPNOW_STATUS_UPTIME       16   // uint32, ms since the client booted
+#define ESPNOW_STATUS_RSSI         20   // int8, dBm of the server's frames at the client
+#define ESPNOW_STATUS_FIRMWARE     21   // char[ESPNOW_STATUS_FIRMWARE_LEN], not necessarily terminated
+#define ESPNOW_STATUS_FIRMWARE_LEN 16
+#define ESPNOW_STATUS_LEN          37
+
+// struct_pairing layout
+#define ESPNOW_PAIRING_LEN     41
+#define ESPNOW_PAIRING_ID      1
+#define ESPNOW_PAIRING_MAC     2
+#define ESPNOW_PAIRING_CHANNEL 8
+#define ESPNOW_PAIRING_NAME    9
+
+enum EspNowReject : uint8_t {
+    ESPNOW_RX_OK = 0,
+    ESPNOW_RX_BAD_LENGTH,       // Empty, or longer than an ESP-NOW payload
+    ESPNOW_RX_UNKNOWN_TYPE,
+    ESPNOW_RX_SHORT,            // Shorter than the layout of its type (or FW_PUSH op)
+    ESPNOW_RX_BAD_OP,           // Unknown FW_PUSH op
+    ESPNOW_RX_BAD_VERSION,      // FW_PUSH offer with another protocol version
+    ESPNOW_RX_UNKNOWN_PEER,     // Valid frame, sender not paired (counted by espnow.cpp)
+    ESPNOW_RX_NOT_PAIRING,      // Pairing request outside pairing mode (counted by espnow.cpp)
+    ESPNOW_RX_REASON_COUNT
+};
+
+struct EspNowFrame {
+    const uint8_t* data;        // Radio buffer; valid only during the receive callback
+    uint8_t length;
+    uint8_t type;               // MessageType
+};
+
+// Validate a received frame. On ESPNOW_RX_OK frame describes it; otherwise
+// frame is left empty and nothing past data[length - 1] was read.
+EspNowReject espNowFrameParse(const uint8_t* data, int length, EspNowFrame& frame);
+
+const char* espNowRejectName(uint8_t reason);
+
+// Field accessors for a validated frame (offsets above, little endian)
+inline uint8_t espNowFrameU8(const EspNowFrame& frame, size_t offset) {
+    return frame.data[offset];
+}
+
+inline uint32_t espNowFrameU32(const EspNowFrame& frame, size_t offset) {
+    const uint8_t* p = frame.data + offset;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
@@ -0,0 +1,41 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Server-driven firmware update of the ESP-NOW clients (protocol in
+// fwPushProtocol.h). The client image is uploaded to the server's spare OTA
+// partition through the OTA web page ("/client-fw"), then pushed to every
+// target in parallel from loop(), one frame per call, so switching keeps
+// running during the transfer.
+#pragma once
+#include <Arduino.h>
+
+// ---- Staging (called by the web upload handler, web server task) ----
+bool fwStageBegin();
+bool fwStageWrite(const uint8_t* data, size_t length);
+bool fwStageEnd();              // Seals the stage header; false if nothing valid was written
+void fwStageAbort();
+bool fwStagedImage(uint32_t* size, uint32_t* crc);
+
+// ---- Push ----
+// clientIndex -1 pushes to every paired client
+bool startFwPush(int clientIndex = -1);
+void stopFwPush();
+bool fwPushActive();
+void serviceFwPush();           // Call from loop()
+
+// ESP-NOW callback hooks (WiFi task; lock-free)
+void fwPushOnReceive(const uint8_t* mac, const uint8_t* data, int length);
+void fwPushOnSent(const uint8_t* mac, bool delivered);
+
+void printFwPushStatus();
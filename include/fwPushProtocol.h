@@ -0,0 +1,118 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Firmware push over ESP-NOW, shared by the server and the client firmware (no
+// Arduino dependencies in this header).
+//
+// The server offers an image to each client, streams fixed-size chunks (by
+// broadcast when several clients take part, unicast for one) and polls every
+// client after each window of FW_PUSH_WINDOW chunks. A client answers with the
+// first chunk it is missing (base) and a bitmap of the chunks after it that it
+// already holds; the server resends only those gaps, unicast when one client
+// needs a chunk and broadcast when several do.
+//
+// The session id is the CRC-32 (IEEE) of the image. A client keeps its progress keyed
+// by that id, so an interrupted push (either side rebooting, out of range)
+// resumes from the reported base when the same image is offered again.
+//
+// Every frame starts with FwPushHeader; multi-byte fields are little endian.
+//   OFFER   server -> client   image size, chunk size and count
+//   CHUNK   server -> client   index, CRC-16 of index + data, data
+//   POLL    server -> client   reply with STATUS
+//   STATUS  client -> server   state, base, bitmap (sent for OFFER and POLL)
+//   COMMIT  server -> client   image verified by the client: boot it
+//   ABORT   server -> client   push cancelled; progress is kept for a resume
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <controlFrame.h>
+
+#define FW_PUSH_PROTOCOL_VERSION 1
+#define FW_PUSH_MSG_TYPE 3             // MessageType FW_PUSH in dataStructs.h
+#define FW_PUSH_CHUNK_SIZE 224         // Largest chunk frame is 234 of the 250 ESP-NOW bytes
+#define FW_PUSH_WINDOW 64              // Chunks sent ahead of the slowest client (= bitmap width)
+
+enum FwPushOp : uint8_t {
+    FW_OP_OFFER  = 1,
+    FW_OP_CHUNK  = 2,
+    FW_OP_POLL   = 3,
+    FW_OP_STATUS = 4,
+    FW_OP_COMMIT = 5,
+    FW_OP_ABORT  = 6
+};
+
+enum FwClientState : uint8_t {
+    FW_CLIENT_RECEIVING = 0,
+    FW_CLIENT_VERIFIED  = 1,    // All chunks stored and the image CRC matches
+    FW_CLIENT_REJECTED  = 2,    // Offer refused (image too large, ...); detail = reason
+    FW_CLIENT_FAILED    = 3     // Image CRC or flash error; progress was reset to 0
+};
+
+struct __attribute__((packed)) FwPushHeader {
+    uint8_t msgType;            // FW_PUSH_MSG_TYPE
+    uint8_t op;                 // FwPushOp
+    uint32_t session;           // CRC-32 of the image
+};
+
+struct __attribute__((packed)) FwPushOffer {
+    FwPushHeader header;
+    uint8_t version;            // FW_PUSH_PROTOCOL_VERSION
+    uint32_t imageSize;
+    uint16_t chunkSize;
+    uint16_t chunkCount;
+};
+
+struct __attribute__((packed)) FwPushChunk {
+    FwPushHeader header;
+    uint16_t index;
+    uint16_t crc;               // fwPushChunkCrc(index, data, length)
+    uint8_t data[FW_PUSH_CHUNK_SIZE];   // Only the chunk's length is sent
+};
+
+struct __attribute__((packed)) FwPushStatus {
+    FwPushHeader header;
+    uint8_t state;              // FwClientState
+    uint8_t detail;             // Client-specific reason code
+    uint16_t base;              // First missing chunk (chunkCount when complete)
+    uint64_t received;          // Bit i: chunk base + 1 + i already stored
+};
+
+#define FW_PUSH_CHUNK_HEADER_LEN (sizeof(FwPushChunk) - FW_PUSH_CHUNK_SIZE)
+
+static_assert(sizeof(FwPushChunk) <= 250, "chunk frame exceeds the ESP-NOW payload");
+
+inline uint16_t fwPushChunkCount(uint32_t imageSize) {
+    return (uint16_t)((imageSize + FW_PUSH_CHUNK_SIZE - 1) / FW_PUSH_CHUNK_SIZE);
+}
+
+inline size_t fwPushChunkLength(uint32_t imageSize, uint16_t index) {
+    uint32_t offset = (uint32_t)index * FW_PUSH_CHUNK_SIZE;
+    if (offset >= imageSize) return 0;
+    return imageSize - offset < FW_PUSH_CHUNK_SIZE ? imageSize - offset : FW_PUSH_CHUNK_SIZE;
+}
+
+// CRC-16/CCITT-FALSE over the index (little endian) and the chunk data
+inline uint16_t fwPushChunkCrc(uint16_t index, const uint8_t* data, size_t length) {
+    uint8_t indexBytes[2] = {(uint8_t)index, (uint8_t)(index >> 8)};
+    return controlCrc16(data, length, controlCrc16(indexBytes, sizeof(indexBytes)));
+}
+
+// True if a client that reported base/received already holds chunk index.
+// Chunks more than FW_PUSH_WINDOW past base are outside the bitmap and count as missing.
+inline bool fwPushHasChunk(uint16_t base, uint64_t received, uint16_t index) {
+    if (index < base) return true;
+    if (index == base) return false;
+    uint32_t bit = (uint32_t)index - base - 1;
+    return bit < 64 && ((received >> bit) & 1u);
+}
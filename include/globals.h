@@ -30,7 +30,9 @@ extern volatile bool pairingRequested;
 extern bool pairingMode;
 extern bool resetMode;
 extern bool serialOtaTrigger;
+#ifndef MAX_CLIENTS
 #define MAX_CLIENTS 10
+#endif
 #define STORAGE_VERSION 1
 extern uint8_t clientMacAddresses[MAX_CLIENTS][6];
 extern int numClients;
@@ -38,24 +40,6 @@ extern PeerInfo labeledPeers[MAX_CLIENTS];
 extern int numLabeledPeers;
 
 #define PAIRING_LED_PIN 2              // Use actual pin you're using
-#define LEDC_CHANNEL_0  0              // LEDC channel (0–15)
-#define LEDC_TIMER_13_BIT 13           // Resolution (0–8191)
-#define LEDC_BASE_FREQ 1000            // Hz
-
-// LED Pattern System (matching client)
-enum LedPattern {
-    LED_OFF,
-    LED_SINGLE_FLASH,
-    LED_DOUBLE_FLASH,
-    LED_TRIPLE_FLASH,
-    LED_FAST_BLINK,
-    LED_SOLID_ON,
-    LED_FADE
-};
-
-extern LedPattern currentLedPattern;
-extern unsigned long ledPatternStart;
-extern int ledPatternStep;
 
 // Hardware Configuration Variables
 extern char deviceName[MAX_PEER_NAME_LEN];
@@ -84,6 +68,24 @@ enum LogLevel {
 
 extern LogLevel currentLogLevel;
 
+// Compile-time log floor: messages above this level are removed entirely (arguments
+// included). Performance builds (FAST_SWITCHING) drop DEBUG unless overridden.
+#ifndef LOG_COMPILE_LEVEL
+#ifdef FAST_SWITCHING
+#define LOG_COMPILE_LEVEL LOG_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+#endif
+
+template <int Level>
+struct LogCompiledIn {
+  static const bool value = (Level <= LOG_COMPILE_LEVEL);
+};
+
+// Constant-folds to false for compiled-out levels, otherwise a single compare
+#define LOG_ENABLED(level) (LogCompiledIn<(level)>::value && (level) <= currentLogLevel)
+
 extern bool footswitchPressed;
 
 // Server MIDI configuration / state (mirrors client semantics)
@@ -0,0 +1,76 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Hardware abstraction for the parts of the core that touch GPIO, ESP-NOW, NVS
+// and the UARTs. src/halEsp32.cpp maps these onto Arduino/IDF; the native build
+// links the Linux fakes in src/native/halNative.cpp instead, so the switching
+// logic can be run and benchmarked on a host.
+//
+// Timing stays on the Arduino API (millis(), micros(), delay()); the native
+// build provides those from a virtual clock (see src/native/include/Arduino.h).
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define HAL_OK 0                          // Success value of the int-returning calls
+
+// ---- GPIO ----
+enum HalPinMode : uint8_t {
+    HAL_PIN_INPUT,
+    HAL_PIN_INPUT_PULLUP,
+    HAL_PIN_OUTPUT
+};
+
+void halPinMode(uint8_t pin, HalPinMode mode);
+void halPinWrite(uint8_t pin, bool high);
+bool halPinRead(uint8_t pin);
+
+// ---- ESP-NOW ----
+// Callbacks run in the radio task on the device (see espnow.cpp)
+typedef void (*HalEspNowSentCb)(const uint8_t* mac, bool delivered);
+typedef void (*HalEspNowRecvCb)(const uint8_t* mac, const uint8_t* data, int len);
+
+bool halEspNowInit(HalEspNowSentCb onSent, HalEspNowRecvCb onRecv);
+int halEspNowSend(const uint8_t* mac, const void* data, size_t len);   // HAL_OK when queued
+bool halEspNowAddPeer(const uint8_t* mac, uint8_t channel);
+bool halEspNowDelPeer(const uint8_t* mac);
+bool halEspNowPeerExists(const uint8_t* mac);
+bool halStationMac(uint8_t mac[6]);
+const char* halErrName(int err);
+
+// ---- NVS ----
+// One namespace open at a time, with Preferences semantics (getters return the
+// default or 0 when the key is missing, putters return the bytes written)
+bool halNvsInit();                        // Initialise flash, erasing an unusable partition
+bool halNvsBegin(const char* ns, bool readOnly);
+void halNvsEnd();
+bool halNvsIsKey(const char* key);
+bool halNvsRemove(const char* key);
+bool halNvsClear();
+size_t halNvsFreeEntries();
+size_t halNvsGetBytesLength(const char* key);
+size_t halNvsGetBytes(const char* key, void* buf, size_t maxLen);
+size_t halNvsPutBytes(const char* key, const void* buf, size_t len);
+uint8_t halNvsGetUChar(const char* key, uint8_t defaultValue);
+int32_t halNvsGetInt(const char* key, int32_t defaultValue);
+size_t halNvsPutInt(const char* key, int32_t value);
+size_t halNvsGetString(const char* key, char* buf, size_t maxLen);
+
+// ---- UARTs ----
+// Console (USB CDC / UART0): text commands, log output and control frames
+void halConsoleWrite(const void* data, size_t len);
+int halConsoleRead();                     // Next received byte, -1 if none
+// MIDI input (receive only)
+void halMidiBegin(uint32_t baud, int rxPin);
+int halMidiRead();                        // Next received byte, -1 if none
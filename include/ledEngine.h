@@ -0,0 +1,40 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Status LED engine. Patterns are step tables: each step sets a duty (or has
+// the LEDC fade unit ramp to it) and lasts a fixed time. Steps are advanced by
+// an esp_timer callback, so loop() does no LED work at all.
+//
+// Static and repeating patterns (off, on, blink, fade) become the background;
+// flash patterns play once and then return to it. A new pattern takes effect
+// at the next step boundary (at most 200 ms later).
+#pragma once
+#include <Arduino.h>
+
+// LED Pattern System (matching client)
+enum LedPattern {
+    LED_OFF,
+    LED_SINGLE_FLASH,
+    LED_DOUBLE_FLASH,
+    LED_TRIPLE_FLASH,
+    LED_FAST_BLINK,
+    LED_SOLID_ON,
+    LED_FADE
+};
+
+void initLedEngine();           // Before the first setLedPattern()
+void setLedPattern(LedPattern pattern);
+LedPattern getLedPattern();
+const char* ledPatternName(LedPattern pattern);
+uint32_t getLedStepCount();     // Steps executed since boot
@@ -5,3 +5,5 @@
 void initMidiInput();
 // Poll / parse incoming MIDI and forward Program Change messages
 void processMidiInput();
+// Parse one received byte as the UART poll does (switch benchmark input)
+void midiInputFeedByte(uint8_t c);
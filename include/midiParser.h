@@ -0,0 +1,47 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Byte-stream MIDI parser for the server's DIN input (no Arduino dependencies).
+// Channel voice messages are decoded with running status. Real-time bytes
+// (clock, active sensing) may arrive in the middle of a message and are skipped
+// without disturbing it; SysEx and system common messages are discarded.
+#pragma once
+#include <stdint.h>
+
+#define MIDI_NOTE_OFF         0x80
+#define MIDI_NOTE_ON          0x90
+#define MIDI_POLY_PRESSURE    0xA0
+#define MIDI_CONTROL_CHANGE   0xB0
+#define MIDI_PROGRAM_CHANGE   0xC0
+#define MIDI_CHANNEL_PRESSURE 0xD0
+#define MIDI_PITCH_BEND       0xE0
+
+struct MidiParser {
+    uint8_t status;       // Running status, 0 = none (data bytes are ignored)
+    uint8_t needed;       // Data bytes per message for status
+    uint8_t count;        // Data bytes collected so far
+    uint8_t data[2];
+};
+
+struct MidiMessage {
+    uint8_t type;         // MIDI_NOTE_OFF ... MIDI_PITCH_BEND
+    uint8_t channel;      // 1-16
+    uint8_t data1;
+    uint8_t data2;        // 0 for one-byte messages
+};
+
+void midiParserReset(MidiParser& parser);
+
+// Feed one received byte; true when it completes a channel message
+bool midiParserFeed(MidiParser& parser, uint8_t byte, MidiMessage& out);
@@ -15,6 +15,63 @@
 #pragma once
 #include <Arduino.h>
 #include <globals.h>
+#include <configImage.h>
+
+// All settings are persisted as one packed, CRC-protected image (configImage.h).
+// save*ToNVS() copy a section into the RAM image and mark it dirty; the image is
+// written once no change has been made for NVS_COMMIT_QUIET_MS, or immediately by
+// flushNVSCache(), and only if it differs from what is already in flash.
+enum NvsSection : uint16_t {
+    NVS_SECTION_LOG_LEVEL    = 1 << 0,
+    NVS_SECTION_SERVER       = 1 << 1,
+    NVS_SECTION_MIDI_CHANNEL = 1 << 2,
+    NVS_SECTION_MIDI_MAP     = 1 << 3,
+    NVS_SECTION_BUTTON_MAP   = 1 << 4,
+    NVS_SECTION_PEERS        = 1 << 5,
+    NVS_SECTION_RIG_STATE    = 1 << 6,    // Own key, not part of the image
+    NVS_SECTION_SCENES       = 1 << 7,    // Own keys (one per scene bank), not part of the image
+    NVS_SECTION_REMAPS       = 1 << 8     // Own keys (one per remapped client), not part of the image
+};
+
+enum ConfigSource : uint8_t {
+    CONFIG_SOURCE_DEFAULTS,     // Nothing stored
+    CONFIG_SOURCE_PACKED,       // Packed image read directly
+    CONFIG_SOURCE_LEGACY        // Per-key layout read and migrated this boot
+};
+
+struct NvsCacheStats {
+    uint32_t commits;           // Image writes after a change
+    uint32_t flashWrites;       // Blob writes including migration (wear indicator)
+    uint32_t bytesWritten;
+    uint32_t skippedWrites;     // Commits dropped because the image was unchanged
+    uint32_t coalescedSaves;    // save requests folded into an already pending commit
+    uint32_t lastCommitUs;
+    uint32_t maxCommitUs;
+    uint64_t totalCommitUs;
+};
+
+struct NvsBootStats {
+    uint32_t packedLoadUs;      // Time to read and validate the packed image
+    uint32_t legacyLoadUs;      // Time to read the per-key layout (migration boot only)
+    uint8_t source;             // ConfigSource
+};
+
+// Reads the packed image (migrating old per-key settings on first boot).
+// Call once after checkNVS(); the load*FromNVS() functions then apply it.
+bool loadConfigImage();
+const NvsBootStats& getNVSBootStats();
+
+// Session recording (sessionRecord.h): the live settings as an image, and the
+// native replay's way to boot from one (write it as the active image, then
+// loadConfigImage() and the load*FromNVS() functions as at power-on)
+void getConfigSnapshot(ConfigImage& out);
+bool importConfigImage(const ConfigImage& snapshot);
+
+void markNVSDirty(uint16_t sections);
+void serviceNVSCache();         // Call from loop()
+bool flushNVSCache();           // Commit pending changes now
+uint16_t getNVSPendingSections();
+const NvsCacheStats& getNVSCacheStats();
 
 // NVS initialization and version management
 void checkNVS();
@@ -30,7 +87,26 @@ void saveServerConfigToNVS();
 bool loadServerConfigFromNVS();
 void clearServerConfigNVS();
 
-// Peer management (server-specific)
+// Live rig state record (rigState.cpp), restored at power-on. Kept in its own
+// small blob so a channel change does not rewrite the whole config image.
+#define RIG_STATE_MAX_LEN 32
+void saveRigStateToNVS(const void* data, size_t length);
+size_t loadRigStateFromNVS(void* data, size_t maxLength);   // Stored length, 0 if none
+
+// Scene banks (sceneEngine.cpp) and program remap tables (programRemap.cpp), one
+// blob per key so an edit rewrites only its own. The data is written from the
+// caller's buffer at commit time, so it must stay valid (both pass static tables).
+#ifndef NVS_KEYED_BLOB_MAX
+#define NVS_KEYED_BLOB_MAX 16         // At most 32 (dirty mask)
+#endif
+#define SCENE_NVS_MAX_BANKS NVS_KEYED_BLOB_MAX
+void saveSceneBankToNVS(uint8_t bank, const void* data, size_t length);
+size_t loadSceneBankFromNVS(uint8_t bank, void* data, size_t length);   // Stored length if it matches, else 0
+void saveProgramRemapToNVS(uint8_t slot, const void* data, size_t length);   // Length 0 removes the key
+size_t loadProgramRemapFromNVS(uint8_t slot, void* data, size_t maxLength);  // Stored length, 0 if none
+
+// Peer management (server-specific). savePeersToNVS() is safe from the WiFi
+// task (pairing): it only flags the table, which serviceNVSCache() captures.
 void savePeersToNVS();
 void loadPeersFromNVS();
 void clearPeersNVS();
@@ -12,8 +12,34 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
+#pragma once
 #include <Arduino.h>
 
 bool checkOtaTrigger();
 void startOTA();
 void startOTA_AP();
+
+// Live OTA: softAP + web updater in a background task while switching keeps
+// running. Flash chunk writes are paced so the loop stays within
+// LIVE_OTA_LATENCY_BUDGET_US; loop gaps are measured for the whole upload.
+struct LiveOtaStats {
+    uint32_t received;          // Bytes uploaded (smaller than bytes for .swp images)
+    uint32_t bytes;             // Bytes written to the OTA partition
+    uint32_t chunks;
+    uint32_t durationMs;
+    uint32_t maxPauseMs;        // Longest pause inserted after a chunk
+    uint32_t totalPauseMs;
+    uint32_t loopSamples;       // loop() iterations measured during the upload
+    uint32_t maxGapUs;
+    uint64_t totalGapUs;
+    uint32_t overBudget;        // Gaps above LIVE_OTA_LATENCY_BUDGET_US
+    bool completed;
+    bool success;
+};
+
+bool startLiveOTA();
+void stopLiveOTA();
+bool liveOtaActive();
+void serviceLiveOTA();          // Call from loop()
+const LiveOtaStats& getLiveOtaStats();
+void printLiveOtaStatus();
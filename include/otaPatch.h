@@ -0,0 +1,105 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Compressed and delta firmware images ("SWP1" patch files), shared by the
+// firmware and the host packer in tools/ota-packer (no Arduino dependencies).
+//
+// File: [OtaPatchHeader][token stream]. Tokens rebuild the target image in order:
+//   0x00-0x7F  literal run: (b + 1) bytes follow
+//   0x80-0xBF  window match: length (b & 0x3F) + 3, then distance - 1 (u16)
+//              back into the last OTA_PATCH_WINDOW output bytes
+//   0xC0       base copy: varint length, varint zigzag(base offset - output offset)
+//              from the image currently running (delta files only)
+// Varints are LEB128; multi-byte fields are little endian. The decoder needs
+// only the window and two small buffers, so it streams straight into the OTA
+// partition while the upload arrives.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_PATCH_MAGIC 0x31505753u   // "SWP1" little endian
+#define OTA_PATCH_VERSION 1
+#define OTA_PATCH_FLAG_DELTA 0x0001
+
+#define OTA_PATCH_WINDOW 2048         // History window (must be a power of two)
+#define OTA_PATCH_MIN_MATCH 3
+#define OTA_PATCH_MAX_MATCH (0x3F + OTA_PATCH_MIN_MATCH)
+#define OTA_PATCH_MAX_LITERAL 128
+#define OTA_PATCH_OUT_CHUNK 256       // Output is handed to write() in chunks of this size
+
+#define OTA_PATCH_TOKEN_MATCH 0x80
+#define OTA_PATCH_TOKEN_BASE 0xC0
+
+struct OtaPatchHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t targetSize;
+    uint32_t targetCrc;               // CRC-32 (configCrc32) of the rebuilt image
+    uint32_t baseSize;                // Delta only: bytes of the running image used
+    uint32_t baseCrc;                 // Delta only: CRC-32 of those bytes
+    uint32_t payloadSize;             // Token stream length
+};
+
+enum OtaPatchStatus : uint8_t {
+    OTA_PATCH_NEED_MORE,              // Feed more input
+    OTA_PATCH_DONE,                   // Target rebuilt and CRC verified
+    OTA_PATCH_BAD_HEADER,
+    OTA_PATCH_BASE_MISMATCH,          // Running image is not the one the delta was made from
+    OTA_PATCH_BAD_TOKEN,
+    OTA_PATCH_OVERRUN,                // Output would exceed targetSize
+    OTA_PATCH_CRC_MISMATCH,
+    OTA_PATCH_TRUNCATED,              // Input ended early
+    OTA_PATCH_IO_ERROR                // write() or readBase() failed
+};
+
+// Output sink and base image reader (readBase is only used for delta files)
+struct OtaPatchIo {
+    bool (*write)(void* context, const uint8_t* data, size_t length);
+    bool (*readBase)(void* context, uint32_t offset, uint8_t* data, size_t length);
+    void* context;
+};
+
+struct OtaPatchDecoder {
+    OtaPatchIo io;
+    OtaPatchHeader header;
+    uint8_t state;
+    uint8_t status;
+    uint8_t token;
+    uint8_t varintShift;
+    uint32_t varint;
+    uint32_t count;                   // Bytes left in the current literal, or the base copy length
+    uint32_t headerBytes;
+    uint32_t payloadUsed;
+    uint32_t produced;                // Target bytes rebuilt so far
+    uint32_t crc;
+    uint16_t outLength;
+    uint8_t window[OTA_PATCH_WINDOW];
+    uint8_t out[OTA_PATCH_OUT_CHUNK];
+};
+
+void otaPatchBegin(OtaPatchDecoder& decoder, const OtaPatchIo& io);
+
+// Feed the next piece of the file (any size). Returns NEED_MORE until the
+// stream is complete, then DONE; any other value is a permanent error.
+OtaPatchStatus otaPatchFeed(OtaPatchDecoder& decoder, const uint8_t* data, size_t length);
+
+// Call at end of input: DONE if the image was fully rebuilt and verified
+OtaPatchStatus otaPatchFinish(OtaPatchDecoder& decoder);
+
+// Header once parsed (nullptr before), for sizing the OTA partition write
+const OtaPatchHeader* otaPatchHeader(const OtaPatchDecoder& decoder);
+
+const char* otaPatchStatusName(uint8_t status);
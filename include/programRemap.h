@@ -0,0 +1,51 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Per-client program remap: what an incoming Program Change becomes for each
+// client, or PROGRAM_REMAP_NONE to send that client nothing. A client without a
+// table gets the program unchanged, as before. Tables are kept per client MAC
+// (like the scene slots) so a client keeps its table when it re-pairs.
+//
+// Each remapped client has its own NVS key holding only what differs from
+// identity or from "send nothing", or the raw table when that is shorter; a
+// client back on identity has no key at all.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <configImage.h>
+
+#define PROGRAM_REMAP_PROGRAMS 128
+#define PROGRAM_REMAP_SLOTS CONFIG_IMAGE_MAX_PEERS
+#define PROGRAM_REMAP_NONE 0xFF         // Table entry: nothing sent for this program
+
+void loadProgramRemapsFromNVS();        // Call after the peers are loaded
+
+// What client (index into clientMacAddresses) gets for program, PROGRAM_REMAP_NONE
+// if it gets nothing
+uint8_t programRemapFor(int client, uint8_t program);
+bool programRemapActive(int client);    // Client has a table (not identity)
+
+// Edits (persisted after NVS_COMMIT_QUIET_MS). value is a program 0-127 or
+// PROGRAM_REMAP_NONE; a table that ends up as identity is dropped.
+bool programRemapSet(int client, uint8_t first, uint8_t last, uint8_t value);
+bool programRemapShift(int client, uint8_t first, uint8_t last, int offset);   // Each program to program + offset (clamped)
+bool programRemapReset(int client, bool sendNothing);   // Identity, or nothing sent until entries are set
+size_t programRemapStoredBytes(int client);             // Encoded NVS size, 0 for identity
+
+// Stored tables as saveProgramRemapToNVS() takes them (session recorder snapshot)
+void programRemapSnapshot(void (*emit)(uint8_t slot, const void* data, size_t length));
+
+void printProgramRemap(int client);
+void printProgramRemapList();
+void printProgramRemapFor(uint8_t program);             // What every client would get
@@ -19,9 +19,12 @@
 #if HAS_RELAY_OUTPUTS
 
 // Relay control functions
+void restoreRelayOutputs();     // Call first in setup(): pins + last persisted state
 void setRelayChannel(uint8_t channel);
 void turnOffAllRelays();
 uint8_t getCurrentRelayChannel();
+void setRelayMask(uint8_t mask);
+uint8_t getRelayMask();
 
 // Relay testing functions
 void testRelaySpeed();
@@ -35,3 +38,5 @@ void printRelayStatus();
 // Always available footswitch functions
 void updateFootswitchState();
 bool isFootswitchPressed(uint8_t footswitchIndex = 0);
+void serviceFootswitch();        // Call from loop(): poll, act on a footswitch 1 press
+void handleFootswitchPress();    // Channel change (program 1) to every labeled peer
@@ -0,0 +1,40 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Live rig state: the applied relay mask and the last program sent to each
+// client. It is persisted as one small record (write-behind, like the config
+// image) so after a reboot the relays come back immediately and every client is
+// re-sent its program as soon as it acknowledges delivery.
+#pragma once
+#include <Arduino.h>
+
+// Read the stored record; call after checkNVS() and before restoring relays
+bool loadRigState();
+uint8_t getRigStateRelayMask();
+
+// Record changes as they are applied (persisted after NVS_COMMIT_QUIET_MS)
+void rigStateNoteRelayMask(uint8_t mask);
+void rigStateNoteProgram(const uint8_t* clientMac, uint8_t program);
+uint8_t getRigStateProgram(const uint8_t* clientMac);   // Last program sent, 0xFF if none
+
+// Queue stored programs for resend once peers are loaded; serviceRigStateResync()
+// retries every RIG_RESYNC_INTERVAL_MS until each client acknowledges delivery
+void beginRigStateResync();
+void serviceRigStateResync();   // Call from loop()
+
+// ESP-NOW send callback hook (WiFi task; lock-free)
+void rigStateOnSendResult(const uint8_t* clientMac, bool delivered);
+
+void printRigState();
@@ -0,0 +1,125 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Scenes: one recall sets the server relays and every client's program.
+//
+// A scene holds a relay mask (or "keep relays") and one action per client: a
+// program change, all channels off, or nothing. Scene numbers are 0-127, the
+// MIDI program range, so with triggers on (the default) any input that would
+// send program P - a MIDI Program Change, a button, the footswitch - recalls
+// scene P instead when that scene is defined; undefined numbers behave as
+// before. 'scene recall N' does the same from the serial console.
+//
+// Recall drives the relays first, then queues one frame per client back to back
+// (no delay between them; sends the driver refuses are retried on the next loop
+// passes for SCENE_RECALL_RETRY_MS). Programs a client already has are skipped
+// by the client mirror. Each recall is timed from the trigger to the relay
+// write, the last frame queued and the last delivery report.
+//
+// Client actions are stored per scene client slot; the slots map to client
+// MACs in a shared table, so re-pairing or adding a client keeps the scenes.
+// Scenes are kept in RAM and stored as SCENE_BANKS NVS blobs of
+// SCENE_BANK_SIZE scenes, plus one for the slot table; an edit rewrites only
+// its bank (write-behind, like the config image).
+#pragma once
+#include <Arduino.h>
+#include <configImage.h>
+
+#define SCENE_COUNT 128
+#define SCENE_NAME_LEN 12
+#define SCENE_CLIENT_SLOTS CONFIG_IMAGE_MAX_PEERS
+#define SCENE_BANK_SIZE 16
+#define SCENE_BANKS (SCENE_COUNT / SCENE_BANK_SIZE)
+
+#define SCENE_ACTION_NONE 0xFF          // Client action type: nothing sent
+
+enum SceneFlags : uint8_t {
+    SCENE_DEFINED     = 1 << 0,
+    SCENE_KEEP_RELAYS = 1 << 1          // Recall leaves the relays as they are
+};
+
+struct SceneClientAction {
+    uint8_t type;                       // PROGRAM_CHANGE, ALL_CHANNELS_OFF or SCENE_ACTION_NONE
+    uint8_t value;
+};
+
+struct Scene {
+    uint8_t flags;                      // SceneFlags
+    uint8_t relayMask;
+    char name[SCENE_NAME_LEN];          // Not necessarily NUL terminated
+    SceneClientAction clients[SCENE_CLIENT_SLOTS];
+};
+
+enum SceneSource : uint8_t {
+    SCENE_SOURCE_SERIAL,
+    SCENE_SOURCE_MIDI,
+    SCENE_SOURCE_BUTTON,
+    SCENE_SOURCE_FOOTSWITCH,
+    SCENE_SOURCE_COUNT
+};
+
+struct SceneRecallStats {
+    uint32_t recalls;
+    uint32_t bySource[SCENE_SOURCE_COUNT];
+    uint32_t framesQueued;
+    uint32_t framesSkipped;             // Client already on the program (client mirror)
+    uint32_t sendRetries;               // Sends refused by the driver and retried
+    uint32_t sendsAbandoned;            // Still refused after SCENE_RECALL_RETRY_MS
+    uint32_t deliveryFailures;
+    // Last recall, microseconds from the trigger
+    uint8_t lastScene;
+    uint32_t lastRelayUs;
+    uint32_t lastQueuedUs;              // Last client frame accepted by the driver
+    uint32_t lastDeliveredUs;           // Last delivery report, 0 while outstanding
+    // Over all recalls
+    uint32_t maxQueuedUs;
+    uint64_t totalQueuedUs;
+    uint32_t maxDeliveredUs;
+    uint64_t totalDeliveredUs;
+    uint32_t delivered;                 // Recalls whose every frame was reported delivered
+};
+
+void loadScenesFromNVS();               // Call after the peers are loaded
+
+const Scene* getScene(uint8_t index);   // nullptr if out of range
+bool sceneDefined(uint8_t index);
+
+// Edits (persisted after NVS_COMMIT_QUIET_MS). Client actions take a client
+// index into clientMacAddresses.
+bool sceneCapture(uint8_t index, const char* name);   // Current relay mask and last program sent per client
+bool sceneSetRelays(uint8_t index, uint8_t mask, bool keep);
+bool sceneSetClient(uint8_t index, int client, uint8_t type, uint8_t value);
+bool sceneSetName(uint8_t index, const char* name);
+bool sceneDelete(uint8_t index);
+
+bool recallScene(uint8_t index, SceneSource source);  // false if the scene is not defined
+
+// Input hook: recall scene `program` if triggers are on and it is defined.
+// true means the scene replaced the input's normal action.
+bool sceneRecallForProgram(uint8_t program, SceneSource source);
+void setSceneTriggersEnabled(bool enabled);
+bool sceneTriggersEnabled();
+
+void serviceScenes();                   // Call from loop(): retries refused sends
+void sceneOnSendResult(const uint8_t* mac, bool delivered);   // ESP-NOW send callback (WiFi task)
+
+const SceneRecallStats& getSceneRecallStats();
+void resetSceneRecallStats();
+// Stored banks that hold a defined scene, then the client slot table, in the
+// form saveSceneBankToNVS() takes them (session recorder snapshot)
+void sceneSnapshot(void (*emit)(uint8_t bank, const void* data, size_t length));
+
+void printScene(uint8_t index);
+void printSceneList();
+void printSceneStats();
@@ -0,0 +1,115 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Session recorder: every input the server core acts on (footswitch and button
+// edges, MIDI and console bytes, received ESP-NOW frames and send results) and
+// every output it produces (relay masks, frames handed to the driver), each
+// with its time. The format part of this header has no Arduino dependencies;
+// the native build replays a session against the core ('program session') and
+// compares its relay/TX trace with the recorded one.
+//
+// 'session start' allocates SESSION_RECORD_BYTES (config.h) and snapshots what
+// the replay needs to start from the same state (config image, relay mask,
+// station MAC, pairing mode); the level of every footswitch and button pin, the
+// stored scenes and the program remap tables are recorded at time 0. When the
+// buffer is full further records are dropped and counted. 'session dump' sends
+// the session between two marker lines:
+//   #SESSION <length> <crc32>\n <length bytes> \n#END\n
+//
+// Layout: SessionHeader, then records of SessionRecordHeader + length payload
+// bytes, in the order they were written. Times are micros() since the start.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <configImage.h>
+
+#define SESSION_MAGIC 0x31534553u       // "SES1" little endian
+#define SESSION_VERSION 2               // 2: scene bank and program remap records
+#define SESSION_FIRMWARE_LEN 16
+
+#define SESSION_FLAG_PAIRING 0x01       // Pairing mode was on at the start
+
+enum SessionRecordType : uint8_t {
+    // Inputs: re-injected by the replay at their recorded time
+    SESSION_PIN = 1,            // pin, level (as read by the footswitch/button poll)
+    SESSION_MIDI = 2,           // MIDI byte (real-time bytes are left out)
+    SESSION_CONSOLE = 3,        // Console bytes taken in one pass (text and control frames)
+    SESSION_ESPNOW_RX = 4,      // mac[6], frame as received (rejected frames included)
+    SESSION_ESPNOW_SENT = 5,    // mac[6], delivered
+    SESSION_SCENE_BANK = 6,     // bank, stored scene bank (time 0; loaded before the replay boots)
+    SESSION_PROGRAM_REMAP = 7,  // slot, stored remap table (time 0; as SESSION_SCENE_BANK)
+    // Outputs: compared by the replay
+    SESSION_RELAY = 16,         // Relay mask applied
+    SESSION_TX = 17             // mac[6], halEspNowSend() result (int16), frame
+};
+
+#define SESSION_TX_FRAME 8      // Offset of the frame in a SESSION_TX payload
+
+struct __attribute__((packed)) SessionRecordHeader {
+    uint8_t type;               // SessionRecordType; 0 while the record is being written
+    uint8_t reserved;
+    uint16_t length;            // Payload bytes
+    uint32_t timeUs;
+};
+
+struct SessionHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;        // sizeof(SessionHeader)
+    uint32_t recordBytes;       // Bytes of records following the header
+    uint32_t droppedRecords;    // Buffer full
+    uint32_t skippedRealtime;   // MIDI real-time bytes (never affect parsing)
+    uint32_t startUptimeMs;
+    uint32_t durationUs;
+    uint8_t serverMac[6];
+    uint8_t relayMask;
+    uint8_t flags;              // SESSION_FLAG_*
+    char firmware[SESSION_FIRMWARE_LEN];
+    ConfigImage config;         // Live settings at the start (unsaved edits included)
+};
+
+static_assert(sizeof(SessionRecordHeader) == 8, "session record header layout");
+
+// Step through the records: fills header/payload for the record at offset and
+// advances it. False at the end, or at a record that is incomplete or overruns.
+inline bool sessionNextRecord(const uint8_t* records, size_t length, size_t& offset,
+                              SessionRecordHeader& header, const uint8_t*& payload) {
+    if (offset + sizeof(header) > length) return false;
+    memcpy(&header, records + offset, sizeof(header));
+    if (header.type == 0 || offset + sizeof(header) + header.length > length) return false;
+    payload = records + offset + sizeof(header);
+    offset += sizeof(header) + header.length;
+    return true;
+}
+
+// ---- Firmware side ----
+bool sessionRecordStart();      // Clears any previous session; false if the buffer cannot be allocated
+void sessionRecordStop();
+bool sessionRecordActive();
+
+// Hooks, each a no-op unless recording. Safe from the WiFi task.
+void sessionRecordPin(uint8_t pin, bool level);
+void sessionRecordMidi(uint8_t data);   // One byte as the parser takes it
+void sessionRecordConsole(const uint8_t* data, size_t length);
+void sessionRecordReceive(const uint8_t* mac, const uint8_t* data, int length);
+void sessionRecordSent(const uint8_t* mac, bool delivered);
+void sessionRecordRelay(uint8_t mask);
+void sessionRecordTx(const uint8_t* mac, const void* data, size_t length, int result, uint32_t timeUs);
+
+// Write the header and the complete records. Returns the bytes written.
+size_t sessionRecordExport(void (*write)(const void* data, size_t length));
+
+void dumpSessionRecord();       // Console export with the marker lines above
+void printSessionRecordStatus();
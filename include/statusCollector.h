@@ -0,0 +1,71 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Client status collection. startStatusCollection() opens a round: the loop
+// queues a STATUS_REQUEST to each paired client (STATUS_COLLECT_REQUESTS_PER_PASS
+// per pass, no delay, and no more than STATUS_COLLECT_MAX_PENDING awaiting a
+// reply so a large rig does not overrun the driver's TX queue), the receive
+// callback posts each reply to a per-client mailbox, and the round closes once
+// every client replied or STATUS_COLLECT_DEADLINE_MS has passed. Nothing waits
+// for replies, so the table can be read at any time; it holds the last known
+// state of each client.
+//
+// Clients that append the status tail (ESPNOW_STATUS_* in espnowFrame.h)
+// report uptime, RSSI and firmware version; for older ones the uptime comes
+// from the reply's timestamp field and RSSI and firmware are unknown.
+#pragma once
+#include <Arduino.h>
+#include <espnowFrame.h>
+
+enum ClientStatusState : uint8_t {
+    CLIENT_STATUS_NEVER,        // Not asked yet
+    CLIENT_STATUS_PENDING,      // Request queued, waiting for the reply
+    CLIENT_STATUS_OK,           // Replied in the last round
+    CLIENT_STATUS_NO_REPLY,     // Deadline passed without a reply
+    CLIENT_STATUS_SEND_FAILED   // Request not accepted by the driver
+};
+
+#define CLIENT_STATUS_RSSI_UNKNOWN (-128)
+
+struct ClientStatus {
+    uint8_t mac[6];
+    uint8_t state;              // ClientStatusState
+    uint8_t program;            // Reported program, 0xFF = none
+    int8_t rssi;                // dBm at the client, CLIENT_STATUS_RSSI_UNKNOWN if not reported
+    char firmware[ESPNOW_STATUS_FIRMWARE_LEN + 1];   // "" if not reported
+    uint32_t uptimeMs;          // Client uptime when it replied
+    uint32_t replyUs;           // Request queued -> reply received
+    uint32_t updatedMs;         // millis() of the last reply, 0 = never
+};
+
+struct StatusRound {
+    bool active;
+    uint8_t clients;            // Asked in this round
+    uint8_t replies;
+    uint32_t startedMs;
+    uint32_t durationUs;        // First request -> last reply, or the deadline if one is missing
+};
+
+// false if a round is running or no client is paired. printWhenDone prints the
+// table when the round closes ('clients refresh').
+bool startStatusCollection(bool printWhenDone = false);
+bool statusCollectionActive();
+void serviceStatusCollector();  // Call from loop()
+
+// Receive callback (WiFi task): a status reply from a paired client
+void statusCollectorOnReply(const uint8_t* mac, const EspNowFrame& frame);
+
+const ClientStatus* getClientStatus(int index);   // Index into clientMacAddresses, nullptr if out of range
+const StatusRound& getLastStatusRound();          // Running round, or the last one closed
+void printClientStatusTable();
@@ -0,0 +1,69 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// End-to-end switching latency benchmark. Each iteration drives one switch in
+// through an input path (footswitch press, MIDI Program Change bytes, binary
+// control frame) and times, from just before the input, the first relay write
+// and the first and last client transmission it causes. The core marks those
+// points with switchBenchNote(), which costs one flag test when no run is
+// active. Latencies go into fixed log-linear histograms (1 us resolution below
+// 32 us, then 16 buckets per octave), so thousands of iterations need no
+// allocation. Results are emitted as CSV for comparing builds.
+#pragma once
+#include <Arduino.h>
+
+enum SwitchBenchInput : uint8_t {
+    SWITCH_BENCH_IN_FOOTSWITCH,
+    SWITCH_BENCH_IN_MIDI,
+    SWITCH_BENCH_IN_SERIAL,
+    SWITCH_BENCH_IN_COUNT
+};
+
+enum SwitchBenchPoint : uint8_t {
+    SWITCH_BENCH_RELAY,
+    SWITCH_BENCH_CLIENT_TX,
+    SWITCH_BENCH_POINT_COUNT
+};
+
+// Drive one switch in through the input; the iteration number selects the target
+typedef void (*SwitchBenchInject)(SwitchBenchInput input, uint32_t iteration);
+typedef uint32_t (*SwitchBenchClock)();          // Microseconds, monotonic
+typedef void (*SwitchBenchEmit)(const char* line);
+
+struct SwitchBenchHooks {
+    SwitchBenchInject inject;
+    SwitchBenchClock clock;
+    SwitchBenchEmit emit;       // One CSV line per call, without newline
+    const char* source;         // Where the inputs enter, for the CSV header
+};
+
+extern volatile bool switchBenchActive;
+void switchBenchRecord(SwitchBenchPoint point);
+
+// Output points in the core call this right after the relay write / accepted send
+inline void switchBenchNote(SwitchBenchPoint point) {
+    if (switchBenchActive) switchBenchRecord(point);
+}
+
+// Run every input for the given iterations and emit the CSV report. The client
+// mirror is off for the run, so repeated program changes all go out. Returns
+// the number of paths that got some but not all of their samples (each is
+// also reported with a "# short:" line); 0 means every reached path is complete.
+int runSwitchBench(uint32_t iterations, const SwitchBenchHooks& hooks);
+
+// On-device run: inputs enter at the footswitch handler, the MIDI parser and
+// the control protocol receiver; CSV goes to the console. Log output is held
+// at WARN and control replies are discarded for the duration, and the relay
+// mask is restored afterwards. Clients do receive the program changes.
+int runSwitchBenchOnDevice(uint32_t iterations);
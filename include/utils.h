@@ -17,15 +17,26 @@
 #include <globals.h>
 
 // Enhanced logging functions
-void log(LogLevel level, const String& msg);
+void log(LogLevel level, const char* msg);
 void logf(LogLevel level, const char* format, ...);
-void logWithTimestamp(LogLevel level, const String& msg);
+void logWithTimestamp(LogLevel level, const char* msg);
+void writeLogLine(uint32_t timestampMs, LogLevel level, const char* text);
 void printMAC(const uint8_t* mac, LogLevel level);
 
+// Level-checked wrappers: no call or argument evaluation
+// when the level is below the compile-time floor or the runtime level.
+#define LOG(level, msg) do { if (LOG_ENABLED(level)) log((level), (msg)); } while (0)
+#define LOGF(level, ...) do { if (LOG_ENABLED(level)) logf((level), __VA_ARGS__); } while (0)
+
 // System utilities
 void readMacAddress();
 void checkSerialCommands();
-void handleSerialCommand(const String& cmd);
+
+// Binary export on the console, framed for a host to cut out of a serial log:
+//   \n#<tag> <length> <crc32>\n <length bytes> \n#END\n
+// produce() is called twice (measure, then send) and must write the same bytes.
+// Logging is held off until the block is out.
+void writeConsoleBlock(const char* tag, size_t (*produce)(void (*write)(const void* data, size_t length)));
 
 // Peer management functions
 const char* getPeerName(const uint8_t *mac);
@@ -33,12 +44,10 @@ uint8_t* getPeerMacByName(const char* name);
 bool addLabeledPeer(const uint8_t *mac, const char *name);
 void printLabeledPeers();
 
-// Help menu functions
-void printHelpMenu();
-
 // Configuration display functions
 void printPinConfiguration();
 
 // Utility helper functions
 const char* getLogLevelString(LogLevel level);
 void getUptimeString(char* buffer, size_t bufferSize);
+void formatUptimeString(unsigned long uptimeMs, char* buffer, size_t bufferSize);
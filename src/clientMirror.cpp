@@ -0,0 +1,255 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <deferredLog.h>
+#include <dataStructs.h>
+#include <espnowFrame.h>
+#include <commandSender.h>
+#include <clientMirror.h>
+
+#define MIRROR_UNKNOWN 0xFF
+
+// One entry per clientMacAddresses slot. The MAC is kept so a slot that now
+// holds another client (peers cleared or re-paired) starts out unknown. The
+// WiFi task (send callback, status replies, re-pairing) only touches entries
+// already tracked for that MAC and only updates inFlight, failed, stale and the
+// confirmation; creating and resetting entries belongs to the loop task.
+struct MirrorEntry {
+    uint8_t mac[6];
+    volatile uint8_t confirmed;         // Program the client has, MIRROR_UNKNOWN if not known
+    uint8_t queued;                     // Last program change handed to the driver
+    volatile uint8_t inFlight;          // Frames waiting for their send callback
+    volatile bool failed;               // A frame failed since `queued` went out
+    volatile bool stale;                // Client re-paired: reset on the next loop-task use
+    bool collapsed;                     // A repeat of `queued` was dropped while it was in flight
+    uint32_t queuedAtMs;
+    volatile uint32_t confirmedAtMs;
+};
+
+static MirrorEntry entries[MAX_CLIENTS];
+static bool mirrorEnabled = CLIENT_MIRROR_ENABLED;
+static ClientMirrorStats stats;
+
+static void count(uint32_t& counter) {
+    __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+}
+
+static void resetEntry(MirrorEntry& e, const uint8_t* mac) {
+    memcpy(e.mac, mac, 6);
+    e.confirmed = MIRROR_UNKNOWN;
+    e.queued = MIRROR_UNKNOWN;
+    __atomic_store_n(&e.inFlight, 0, __ATOMIC_RELAXED);
+    e.failed = false;
+    e.stale = false;
+    e.collapsed = false;
+    e.queuedAtMs = 0;
+    e.confirmedAtMs = 0;
+}
+
+// Entry of a paired client, nullptr for any other MAC. Loop task only: it may
+// reset the entry.
+static MirrorEntry* entryFor(const uint8_t* mac) {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (memcmp(clientMacAddresses[i], mac, 6) != 0) continue;
+        if (memcmp(entries[i].mac, mac, 6) != 0 || entries[i].stale) resetEntry(entries[i], mac);
+        return &entries[i];
+    }
+    return nullptr;
+}
+
+// Entry already tracked for this MAC, without creating or resetting one; safe
+// from the WiFi task
+static MirrorEntry* trackedEntry(const uint8_t* mac) {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (memcmp(clientMacAddresses[i], mac, 6) == 0 && memcmp(entries[i].mac, mac, 6) == 0) return &entries[i];
+    }
+    return nullptr;
+}
+
+// One frame fewer in flight; false if none was (timed out, reset or rolled back)
+static bool takeInFlight(MirrorEntry* e, uint8_t* left) {
+    uint8_t n = __atomic_load_n(&e->inFlight, __ATOMIC_RELAXED);
+    do {
+        if (n == 0) return false;
+    } while (!__atomic_compare_exchange_n(&e->inFlight, &n, (uint8_t)(n - 1), false, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+    *left = n - 1;
+    return true;
+}
+
+static ClientMirrorDecision skip(ClientMirrorDecision decision, uint32_t& counter) {
+    counter++;
+    stats.airtimeSavedUs += CLIENT_MIRROR_FRAME_AIRTIME_US;
+    return decision;
+}
+
+ClientMirrorDecision clientMirrorCheck(const uint8_t* clientMac, uint8_t program) {
+    if (!mirrorEnabled) return CLIENT_MIRROR_SEND;
+    MirrorEntry* e = entryFor(clientMac);
+    if (!e) return CLIENT_MIRROR_SEND;
+    stats.checked++;
+    if (e->inFlight > 0) {
+        if (e->queued != program || e->failed) return CLIENT_MIRROR_SEND;
+        e->collapsed = true;
+        return skip(CLIENT_MIRROR_COLLAPSE, stats.collapsed);
+    }
+    if (e->confirmed == program) return skip(CLIENT_MIRROR_SUPPRESS, stats.suppressed);
+    return CLIENT_MIRROR_SEND;
+}
+
+void clientMirrorOnQueued(const uint8_t* mac, const uint8_t* data, size_t length) {
+    // Commands are only sent from the loop task, which also created the entry
+    // in clientMirrorCheck(); a pairing reply from the WiFi task only counts
+    MirrorEntry* e = trackedEntry(mac);
+    if (!e) return;
+    if (length >= ESPNOW_MESSAGE_LEN && data[0] == ESPNOW_MSG_COMMAND) {
+        uint8_t type = data[ESPNOW_MESSAGE_COMMAND_TYPE];
+        if (type == PROGRAM_CHANGE) {
+            // The client's program is open until this frame (and any before it) is delivered
+            e->queued = data[ESPNOW_MESSAGE_COMMAND_VALUE];
+            e->confirmed = MIRROR_UNKNOWN;
+            e->failed = false;
+            e->collapsed = false;
+        } else if (type != STATUS_REQUEST) {
+            e->queued = MIRROR_UNKNOWN;     // ALL_CHANNELS_OFF etc.: no program to confirm
+            e->confirmed = MIRROR_UNKNOWN;
+        }
+    }
+    __atomic_store_n(&e->queuedAtMs, millis(), __ATOMIC_RELAXED);
+    if (e->inFlight < 255) __atomic_fetch_add(&e->inFlight, 1, __ATOMIC_RELAXED);
+}
+
+void clientMirrorOnSendRefused(const uint8_t* mac) {
+    MirrorEntry* e = trackedEntry(mac);
+    uint8_t left;
+    if (!e || !takeInFlight(e, &left)) return;
+    e->failed = true;                       // Nothing went out: the program is not confirmed
+    e->confirmed = MIRROR_UNKNOWN;
+}
+
+void clientMirrorOnSendResult(const uint8_t* mac, bool delivered) {
+    MirrorEntry* e = trackedEntry(mac);
+    uint8_t left;
+    if (!e || !takeInFlight(e, &left)) return;     // Not a client, or already timed out
+    if (!delivered) {
+        e->failed = true;
+        e->confirmed = MIRROR_UNKNOWN;
+        count(stats.failures);
+    }
+    if (left > 0) return;
+    if (!e->failed && e->queued != MIRROR_UNKNOWN && e->confirmed != e->queued) {
+        e->confirmed = e->queued;
+        e->confirmedAtMs = millis();
+        count(stats.confirmed);
+    }
+}
+
+void clientMirrorOnStatus(const uint8_t* mac, uint8_t program) {
+    MirrorEntry* e = trackedEntry(mac);
+    if (!e || e->stale || e->inFlight > 0) return;      // A frame in flight settles it instead
+    e->confirmed = program;
+    e->confirmedAtMs = millis();
+    count(stats.statusReplies);
+}
+
+void clientMirrorInvalidate(const uint8_t* mac) {
+    if (mac == nullptr) {
+        memset(entries, 0, sizeof(entries));    // No MAC matches: every entry resets on next use
+        return;
+    }
+    MirrorEntry* e = trackedEntry(mac);     // Called from the WiFi task on re-pairing
+    if (!e) return;
+    e->confirmed = MIRROR_UNKNOWN;
+    e->stale = true;
+    count(stats.reconnects);
+}
+
+void serviceClientMirror() {
+    unsigned long now = millis();
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        MirrorEntry& e = entries[i];
+        if (memcmp(e.mac, clientMacAddresses[i], 6) != 0) continue;
+        if (e.stale) resetEntry(e, e.mac);
+        if (e.inFlight > 0 && now - e.queuedAtMs > CLIENT_MIRROR_ACK_TIMEOUT_MS) {
+            __atomic_store_n(&e.inFlight, 0, __ATOMIC_RELAXED);
+            e.failed = true;
+            e.confirmed = MIRROR_UNKNOWN;
+            stats.timeouts++;
+        }
+        if (e.inFlight > 0) continue;
+        if (e.failed && e.collapsed && e.queued != MIRROR_UNKNOWN) {
+            // A repeat was folded into a frame that did not arrive: send it after all
+            e.collapsed = false;
+            stats.resent++;
+            LOGQ(LOG_DEBUG, "Mirror: resending program %u to %s", e.queued, getPeerName(e.mac));
+            sendCommandToClient(e.mac, PROGRAM_CHANGE, e.queued);
+        } else if (CLIENT_MIRROR_MAX_AGE_MS > 0 && e.confirmed != MIRROR_UNKNOWN &&
+                   now - e.confirmedAtMs > CLIENT_MIRROR_MAX_AGE_MS) {
+            e.confirmed = MIRROR_UNKNOWN;
+            stats.expired++;
+        }
+    }
+}
+
+void setClientMirrorEnabled(bool enabled) {
+    mirrorEnabled = enabled;
+}
+
+bool isClientMirrorEnabled() {
+    return mirrorEnabled;
+}
+
+uint8_t clientMirrorProgram(const uint8_t* mac) {
+    MirrorEntry* e = entryFor(mac);
+    return e ? e->confirmed : MIRROR_UNKNOWN;
+}
+
+const ClientMirrorStats& getClientMirrorStats() {
+    return stats;
+}
+
+void resetClientMirrorStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void printClientMirror() {
+    unsigned long now = millis();
+    log(LOG_INFO, "=== CLIENT MIRROR ===");
+    logf(LOG_INFO, "Mirror: %s", mirrorEnabled ? "ON" : "OFF (every program change is sent)");
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        const MirrorEntry& e = entries[i];
+        bool tracked = memcmp(e.mac, clientMacAddresses[i], 6) == 0;
+        if (!tracked || e.confirmed == MIRROR_UNKNOWN) {
+            logf(LOG_INFO, "  %s: unknown%s", getPeerName(clientMacAddresses[i]),
+                 tracked && e.inFlight > 0 ? " (frames in flight)" : "");
+        } else {
+            logf(LOG_INFO, "  %s: program %u, confirmed %lu ms ago", getPeerName(clientMacAddresses[i]), e.confirmed,
+                 (unsigned long)(now - e.confirmedAtMs));
+        }
+    }
+    logf(LOG_INFO, "Program changes: %lu checked, %lu suppressed, %lu collapsed, %lu resent",
+         (unsigned long)stats.checked, (unsigned long)stats.suppressed, (unsigned long)stats.collapsed,
+         (unsigned long)stats.resent);
+    logf(LOG_INFO, "Confirmed: %lu by delivery, %lu by status reply", (unsigned long)stats.confirmed,
+         (unsigned long)stats.statusReplies);
+    logf(LOG_INFO, "Invalidated: %lu failed, %lu timed out, %lu expired, %lu reconnects",
+         (unsigned long)stats.failures, (unsigned long)stats.timeouts, (unsigned long)stats.expired,
+         (unsigned long)stats.reconnects);
+    logf(LOG_INFO, "Airtime saved: %lu ms", (unsigned long)(stats.airtimeSavedUs / 1000));
+    log(LOG_INFO, "=====================");
+}
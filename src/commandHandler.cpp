@@ -18,8 +18,12 @@
 #include <utils.h>
 #include <espnow-pairing.h>
 #include <commandHandler.h>
-#include <math.h>
 #include <commandSender.h>
+#include <deferredLog.h>
+#include <ledEngine.h>
+#include <hal.h>
+#include <sessionRecord.h>
+#include <sceneEngine.h>
 
 #define BUTTON_DEBOUNCE_MS 100    // Button debounce duration in ms
 #define BUTTON_LONGPRESS_MS 5000  // Base long-press threshold (first milestone)
@@ -53,85 +57,6 @@ static void cycleLearnTarget();
 static void handleChannelSelectAutoSave();
 static bool handleServerMidiLearnTimeout();
 
-// Update LED patterns - call this regularly from main loop
-void updateLedPatterns() {
-    static unsigned long lastUpdate = 0;
-    unsigned long currentTime = millis();
-    
-    if (currentTime - lastUpdate < 50) return; // Update every 50ms
-    lastUpdate = currentTime;
-    
-    unsigned long elapsed = currentTime - ledPatternStart;
-    
-    switch (currentLedPattern) {
-        case LED_SINGLE_FLASH:
-            if (elapsed < 200) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 400) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else {
-                currentLedPattern = LED_OFF;
-            }
-            break;
-            
-        case LED_DOUBLE_FLASH:
-            if (elapsed < 200) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 300) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else if (elapsed < 500) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 600) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else {
-                currentLedPattern = LED_OFF;
-            }
-            break;
-            
-        case LED_TRIPLE_FLASH:
-            if (elapsed < 200) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 300) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else if (elapsed < 500) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 600) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else if (elapsed < 800) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else if (elapsed < 900) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            } else {
-                currentLedPattern = LED_OFF;
-            }
-            break;
-            
-        case LED_FAST_BLINK:
-            if ((elapsed / 200) % 2 == 0) {
-                ledcWrite(LEDC_CHANNEL_0, 255);
-            } else {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            }
-            break;
-            
-        case LED_SOLID_ON:
-            ledcWrite(LEDC_CHANNEL_0, 255);
-            break;
-            
-        case LED_FADE:
-            {
-                int brightness = (sin((elapsed / 1000.0) * 2 * PI) + 1) * 127.5;
-                ledcWrite(LEDC_CHANNEL_0, brightness);
-            }
-            break;
-            
-        case LED_OFF:
-        default:
-            ledcWrite(LEDC_CHANNEL_0, 0);
-            break;
-    }
-}
-
 // Milestone feedback replicating client semantics:
 //  5s  : feedback only
 // 10s  : MIDI Learn ready
@@ -139,27 +64,19 @@ void updateLedPatterns() {
 // 30s  : Pairing ready
 void handleLedFeedback(unsigned long held, const char* buttonName) {
     if (held >= 5000 && !milestone5s) {
-        currentLedPattern = LED_SINGLE_FLASH;
-        ledPatternStart = millis();
-        ledPatternStep = 0;
+        setLedPattern(LED_SINGLE_FLASH);
         milestone5s = true;
         logf(LOG_INFO, "%s - 5s held - LED feedback", buttonName);
     } else if (held >= 10000 && !milestone10s) {
-        currentLedPattern = LED_DOUBLE_FLASH;
-        ledPatternStart = millis();
-        ledPatternStep = 0;
+        setLedPattern(LED_DOUBLE_FLASH);
         milestone10s = true;
         logf(LOG_INFO, "%s - 10s held - MIDI Learn ready", buttonName);
     } else if (held >= 15000 && !milestone15s) {
-        currentLedPattern = LED_TRIPLE_FLASH;
-        ledPatternStart = millis();
-        ledPatternStep = 0;
+        setLedPattern(LED_TRIPLE_FLASH);
         milestone15s = true;
         logf(LOG_INFO, "%s - 15s held - Channel Select ready", buttonName);
     } else if (held >= 30000 && !milestone30s) {
-        currentLedPattern = LED_FAST_BLINK;
-        ledPatternStart = millis();
-        ledPatternStep = 0;
+        setLedPattern(LED_FAST_BLINK);
         milestone30s = true;
         logf(LOG_INFO, "%s - 30s held - Pairing ready", buttonName);
     }
@@ -179,7 +96,7 @@ void checkPairingButtons() {
 
     for (int i = 0; i < serverButtonCount && i < MAX_BUTTONS; i++) {
         if (serverButtonPins[i] == 255) continue;
-        uint8_t reading = digitalRead(serverButtonPins[i]);
+        uint8_t reading = halPinRead(serverButtonPins[i]) ? HIGH : LOW;
         processButtonState(i, reading, lastDebounceTime, lastButtonState,
                           buttonPressed, buttonPressStart, buttonLongPressHandled);
     }
@@ -196,6 +113,7 @@ void processButtonState(int buttonIndex, uint8_t reading,
     const unsigned long debounceDelay = BUTTON_DEBOUNCE_MS;
 
     if (reading != lastButtonState[buttonIndex]) {
+        sessionRecordPin(serverButtonPins[buttonIndex], reading == HIGH);
         lastDebounceTime[buttonIndex] = millis();
     }
 
@@ -226,9 +144,7 @@ void handleButtonPress(int buttonIndex, bool* buttonPressed, unsigned long* butt
     buttonLongPressHandled[buttonIndex] = false;
 
     if (buttonIndex == 0) { // Mode button
-        currentLedPattern = LED_SINGLE_FLASH;
-        ledPatternStart = millis();
-        ledPatternStep = 0;
+        setLedPattern(LED_SINGLE_FLASH);
         resetMilestones();
         midiLearnJustTimedOut = false; // clear flag on new press
 
@@ -259,12 +175,13 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
             if (held < BUTTON_LONGPRESS_MS && !channelSelectMode && !serverMidiLearnArmed) {
                 // Send its mapped Program Change to clients
                 uint8_t pc = serverButtonProgramMap[buttonIndex];
-                forwardMidiProgramToAll(pc);
-                #ifndef FAST_SWITCHING
-                logf(LOG_INFO, "Button %d short press -> send PC %u", buttonIndex, pc);
-                #endif
-                currentLedPattern = LED_SINGLE_FLASH;
-                ledPatternStart = millis();
+                if (sceneRecallForProgram(pc, SCENE_SOURCE_BUTTON)) {
+                    LOGQ(LOG_INFO, "Button %d short press -> scene %u", buttonIndex, pc);
+                } else {
+                    forwardMidiProgramToAll(pc);
+                    LOGQ(LOG_INFO, "Button %d short press -> send PC %u", buttonIndex, pc);
+                }
+                setLedPattern(LED_SINGLE_FLASH);
             } else if (serverMidiLearnArmed && serverMidiLearnTarget >= 0 && held < BUTTON_LONGPRESS_MS) {
                 // While armed pre-PC: use other buttons to pick relay target directly
                 pendingLearnTarget = buttonIndex - 1; // map button1 -> relay0, button2 -> relay1, etc.
@@ -272,8 +189,7 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
                 if (pendingLearnTarget >= MAX_RELAY_CHANNELS) pendingLearnTarget = MAX_RELAY_CHANNELS-1;
                 serverMidiLearnTarget = pendingLearnTarget;
                 logf(LOG_INFO, "MIDI Learn: direct select relay %d via button %d", serverMidiLearnTarget+1, buttonIndex);
-                currentLedPattern = LED_SINGLE_FLASH;
-                ledPatternStart = millis();
+                setLedPattern(LED_SINGLE_FLASH);
             }
         }
         if (buttonIndex == 0) {
@@ -284,8 +200,6 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
             // Pairing mode (30s)
             log(LOG_INFO, "30s+ hold released: Pairing mode activated");
             pairingforceStart();
-            currentLedPattern = LED_FADE;
-            ledPatternStart = millis();
         } else if (held >= 15000) {
             // Enter channel select mode (15s)
             enterChannelSelectMode();
@@ -303,18 +217,14 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
                 logf(LOG_INFO, "MIDI Learn armed. Initial target relay %d. Press button to cycle before sending PC...", pendingLearnTarget + 1);
             }
             serverMidiLearnStartTime = millis();
-            currentLedPattern = LED_FAST_BLINK;
-            ledPatternStart = millis();
+            setLedPattern(LED_FAST_BLINK);
         } else if (held >= firstLongPress) {
             // 5s hold release: just feedback (no OTA here to mirror client). OTA remains via serial command.
             log(LOG_INFO, "5s+ hold released: Feedback only");
-            currentLedPattern = LED_SINGLE_FLASH;
-            ledPatternStart = millis();
+            setLedPattern(LED_SINGLE_FLASH);
         } else {
             // Short press normal action: if not in any special mode just flash
-            currentLedPattern = LED_SINGLE_FLASH;
-            ledPatternStart = millis();
-            ledPatternStep = 0;
+            setLedPattern(LED_SINGLE_FLASH);
     }
     }
     }
@@ -323,7 +233,6 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
     buttonLongPressHandled[buttonIndex] = false;
 
     if (buttonIndex == 0) {
-        currentLedPattern = LED_OFF;
         resetMilestones();
     }
 }
@@ -331,16 +240,12 @@ void handleButtonRelease(int buttonIndex, unsigned long held, bool* buttonPresse
 // Button simulation functions for command interface
 void simulateButton1Press() {
     log(LOG_INFO, "Simulating button 1 short press");
-    currentLedPattern = LED_SINGLE_FLASH;
-    ledPatternStart = millis();
-    ledPatternStep = 0;
+    setLedPattern(LED_SINGLE_FLASH);
 }
 
 void simulateButton2Press() {
     log(LOG_INFO, "Simulating button 2 short press");
-    currentLedPattern = LED_DOUBLE_FLASH;
-    ledPatternStart = millis();
-    ledPatternStep = 0;
+    setLedPattern(LED_DOUBLE_FLASH);
 }
 
 // ---- Helper (local) implementations ----
@@ -353,8 +258,7 @@ static void enterChannelSelectMode() {
     tempMidiChannel = (serverMidiChannel == 0) ? 1 : serverMidiChannel; // start from current (omni -> 1)
     lastChannelButtonPress = millis();
     logf(LOG_INFO, "Channel Select Mode: starting at channel %u", tempMidiChannel);
-    currentLedPattern = LED_FADE;
-    ledPatternStart = millis();
+    setLedPattern(LED_FADE);
 }
 
 static void handleChannelSelectShortPress() {
@@ -364,8 +268,7 @@ static void handleChannelSelectShortPress() {
     if (tempMidiChannel > 16) tempMidiChannel = 1;
     lastChannelButtonPress = millis();
     logf(LOG_INFO, "Channel Select: temp channel -> %u", tempMidiChannel);
-    currentLedPattern = LED_SINGLE_FLASH;
-    ledPatternStart = millis();
+    setLedPattern(LED_SINGLE_FLASH);
 }
 
 static void handleChannelSelectAutoSave() {
@@ -375,8 +278,7 @@ static void handleChannelSelectAutoSave() {
         saveServerMidiChannelToNVS();
         channelSelectMode = false;
         logf(LOG_INFO, "Channel Select: committed channel %u", serverMidiChannel);
-        currentLedPattern = LED_TRIPLE_FLASH; // confirmation
-        ledPatternStart = millis();
+        setLedPattern(LED_TRIPLE_FLASH); // confirmation
     }
 }
 
@@ -388,7 +290,7 @@ static bool handleServerMidiLearnTimeout() {
             serverMidiLearnTarget = -1;
             pendingLearnTarget = -1;
             midiLearnJustTimedOut = true;
-            currentLedPattern = LED_OFF;
+            setLedPattern(LED_OFF);
             return true;
         }
         return true; // still in learn mode (block pairing trigger)
@@ -403,6 +305,5 @@ static void cycleLearnTarget() {
     if (pendingLearnTarget >= MAX_RELAY_CHANNELS) pendingLearnTarget = 0;
     serverMidiLearnTarget = pendingLearnTarget;
     logf(LOG_INFO, "MIDI Learn: target relay -> %d (press again to cycle)", serverMidiLearnTarget + 1);
-    currentLedPattern = LED_SINGLE_FLASH;
-    ledPatternStart = millis();
+    setLedPattern(LED_SINGLE_FLASH);
 }
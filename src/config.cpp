@@ -15,6 +15,7 @@
 #include "config.h"
 #include "globals.h"
 #include "utils.h"
+#include "hal.h"
 #include <cstring>
 
 // Parse comma-separated pin string into array
@@ -101,28 +102,8 @@ void initializeServerConfiguration() {
     // Feed watchdog to prevent timeout during initialization
     yield();
     
-#if HAS_RELAY_OUTPUTS
-    // Parse and set relay output pins from macro
-    log(LOG_DEBUG, "Initializing relay pins...");
-    
-    uint8_t* relayPins = parsePinArray(RELAY_OUTPUT_PINS);
-    
-    if (relayPins != nullptr) {
-        for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
-            relayOutputPins[i] = relayPins[i];
-            if (relayOutputPins[i] != 255) {
-                pinMode(relayOutputPins[i], OUTPUT);
-                digitalWrite(relayOutputPins[i], LOW); // Ensure relays are off at boot
-            }
-            yield(); // Feed watchdog during loop
-        }
-        log(LOG_DEBUG, "Relay output pins initialized");
-    } else {
-        log(LOG_ERROR, "Failed to parse relay pins");
-    }
-#endif
-
-    yield(); // Feed watchdog before next section
+    // Relay pins are configured by restoreRelayOutputs() at the start of setup()
+    // so their restored state is not overwritten here
 
 #if HAS_FOOTSWITCH
     // Parse and set footswitch pins from macro
@@ -133,7 +114,7 @@ void initializeServerConfiguration() {
         for (int i = 0; i < 4; i++) {
             footswitchPins[i] = footPins[i];
             if (footswitchPins[i] != 255) {
-                pinMode(footswitchPins[i], INPUT_PULLUP);
+                halPinMode(footswitchPins[i], HAL_PIN_INPUT_PULLUP);
             }
         }
         log(LOG_DEBUG, "Footswitch pins initialized");
@@ -156,8 +137,7 @@ void initializeServerConfiguration() {
     // Initialize pairing button and LED
     log(LOG_DEBUG, "Initializing pairing button and LED...");
     
-    pinMode(PAIRING_BUTTON_PIN, INPUT_PULLUP);
-    pinMode(PAIRING_LED_PIN, OUTPUT);
+    halPinMode(PAIRING_BUTTON_PIN, HAL_PIN_INPUT_PULLUP);
 
     // Optional additional buttons
 #ifdef SERVER_BUTTON_PINS
@@ -169,7 +149,7 @@ void initializeServerConfiguration() {
         for (int i=0;i<7;i++) {
             if (extra[i] != 255 && extra[i] != PAIRING_BUTTON_PIN) {
                 serverButtonPins[serverButtonCount++] = extra[i];
-                pinMode(extra[i], INPUT_PULLUP);
+                halPinMode(extra[i], HAL_PIN_INPUT_PULLUP);
             }
         }
         logf(LOG_INFO, "Configured %u server buttons", serverButtonCount);
@@ -178,9 +158,6 @@ void initializeServerConfiguration() {
     serverButtonCount = 1; // only pairing button
 #endif
     
-    pinMode(PAIRING_LED_PIN, OUTPUT);
-    digitalWrite(PAIRING_LED_PIN, LOW);
-    
     log(LOG_DEBUG, "Hardware initialization complete");
     
     yield(); // Feed watchdog before final step
@@ -0,0 +1,93 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <configImage.h>
+#include <string.h>
+
+static const size_t CONFIG_IMAGE_BODY_OFFSET = offsetof(ConfigImage, crc) + sizeof(uint32_t);
+
+uint32_t configCrc32(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t imageBodyCrc(const ConfigImage& image) {
+    return configCrc32((const uint8_t*)&image + CONFIG_IMAGE_BODY_OFFSET, sizeof(ConfigImage) - CONFIG_IMAGE_BODY_OFFSET);
+}
+
+void configImageSeal(ConfigImage& image) {
+    image.magic = CONFIG_IMAGE_MAGIC;
+    image.version = CONFIG_IMAGE_VERSION;
+    image.size = (uint16_t)sizeof(ConfigImage);
+    image.crc = imageBodyCrc(image);
+}
+
+bool configImageValid(const ConfigImage& image, size_t storedLength) {
+    if (storedLength != sizeof(ConfigImage)) return false;
+    if (image.magic != CONFIG_IMAGE_MAGIC || image.version != CONFIG_IMAGE_VERSION) return false;
+    if (image.size != sizeof(ConfigImage)) return false;
+    if (image.peerCount > CONFIG_IMAGE_MAX_PEERS || image.relayMapCount > CONFIG_IMAGE_RELAY_SLOTS ||
+        image.buttonCount > CONFIG_IMAGE_BUTTON_SLOTS) return false;
+    return image.crc == imageBodyCrc(image);
+}
+
+bool configGenerationNewer(uint16_t a, uint16_t b) {
+    return (int16_t)(uint16_t)(a - b) > 0;
+}
+
+int configSelectSlot(const ConfigImage images[CONFIG_SLOT_COUNT], const size_t lengths[CONFIG_SLOT_COUNT]) {
+    int best = -1;
+    for (int slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+        if (!configImageValid(images[slot], lengths[slot])) continue;
+        if (best < 0 || configGenerationNewer(images[slot].generation, images[best].generation)) best = slot;
+    }
+    return best;
+}
+
+int configLoadSlots(const ConfigSlotStore& store, ConfigImage& out) {
+    ConfigImage images[CONFIG_SLOT_COUNT];
+    size_t lengths[CONFIG_SLOT_COUNT];
+    for (int slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+        memset(&images[slot], 0, sizeof(ConfigImage));
+        lengths[slot] = store.read((uint8_t)slot, images[slot]);
+    }
+    int active = configSelectSlot(images, lengths);
+    if (active >= 0) out = images[active];
+    return active;
+}
+
+int configCommitSlot(const ConfigSlotStore& store, ConfigImage& image, int activeSlot) {
+    uint16_t previousGeneration = image.generation;
+    int target = (activeSlot < 0) ? 0 : (activeSlot + 1) % CONFIG_SLOT_COUNT;
+    image.generation = previousGeneration + 1;
+    configImageSeal(image);
+
+    ConfigImage readBack;
+    memset(&readBack, 0, sizeof(readBack));
+    if (store.write((uint8_t)target, image) &&
+        configImageValid(readBack, store.read((uint8_t)target, readBack)) &&
+        memcmp(&readBack, &image, sizeof(image)) == 0) {
+        return target;
+    }
+    image.generation = previousGeneration;
+    configImageSeal(image);
+    return -1;
+}
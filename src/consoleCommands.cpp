@@ -0,0 +1,976 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <debug.h>
+#include <nvsManager.h>
+#include <espnow-pairing.h>
+#include <commandHandler.h>
+#include <commandSender.h>
+#include <relayControl.h>
+#include <deferredLog.h>
+#include <consoleCommands.h>
+#include <otaManager.h>
+#include <fwPush.h>
+#include <switchBench.h>
+#include <espnowCapture.h>
+#include <sessionRecord.h>
+#include <clientMirror.h>
+#include <statusCollector.h>
+#include <sceneEngine.h>
+#include <programRemap.h>
+
+static bool clientIndexArg(const ConsoleArgs& args, int index, int& clientIndex) {
+    if (!consoleArgInt(args, index, clientIndex) || clientIndex < 0 || clientIndex >= numClients) {
+        logf(LOG_WARN, "Invalid client index. Use 0-%d", numClients - 1);
+        return false;
+    }
+    return true;
+}
+
+static void printCommandLines(const ConsoleCommand* table, size_t count, int group, const char* prefix, int width) {
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].usage == nullptr) continue;
+        if (group >= 0 && table[i].group != group) continue;
+        Serial.printf("  %s%-*s : %s\n", prefix, width, table[i].usage, table[i].help);
+    }
+}
+
+// ---- System commands ----
+static void cmdMemory(ConsoleArgs& args) {
+    if (args.argc >= 2 && strcmp(args.argv[1], "frag") == 0) {
+        printMemoryFragmentation();
+    } else {
+        printMemoryAnalysis();
+    }
+}
+
+static void cmdHelp(ConsoleArgs&)       { printConsoleHelp(); }
+static void cmdStatus(ConsoleArgs&)     { printDebugInfo(); }
+static void cmdNetwork(ConsoleArgs&)    { printNetworkStatus(); }
+static void cmdServer(ConsoleArgs&)     { printServerStatus(); }
+static void cmdPeers(ConsoleArgs&)      { printLabeledPeers(); }
+static void cmdConfig(ConsoleArgs&)     { printServerConfiguration(); }
+static void cmdPins(ConsoleArgs&)       { printPinConfiguration(); }
+static void cmdVersion(ConsoleArgs&)    { logf(LOG_INFO, "Firmware Version: %s", FIRMWARE_VERSION); }
+
+static void cmdUptime(ConsoleArgs&) {
+    char uptime[32];
+    getUptimeString(uptime, sizeof(uptime));
+    logf(LOG_INFO, "Uptime: %s", uptime);
+}
+
+static void cmdLogLevel(ConsoleArgs&) {
+    logf(LOG_INFO, "Current log level: %s (%u)", getLogLevelString(currentLogLevel), (uint8_t)currentLogLevel);
+    logf(LOG_INFO, "Compiled-in floor: %s (%u)", getLogLevelString((LogLevel)LOG_COMPILE_LEVEL), (uint8_t)LOG_COMPILE_LEVEL);
+}
+
+// ---- Control commands ----
+static void cmdRestart(ConsoleArgs&) {
+    flushNVSCache();
+    log(LOG_WARN, "Restarting ESP32...");
+    delay(1000);
+    ESP.restart();
+}
+
+static void cmdSave(ConsoleArgs&) {
+    if (getNVSPendingSections() == 0) {
+        log(LOG_INFO, "No pending config changes");
+        return;
+    }
+    flushNVSCache();
+}
+
+static void cmdOta(ConsoleArgs& args) {
+    if (args.argc < 2) {
+        startLiveOTA();
+    } else if (strcmp(args.argv[1], "stop") == 0) {
+        stopLiveOTA();
+    } else if (strcmp(args.argv[1], "status") == 0) {
+        printLiveOtaStatus();
+    } else {
+        log(LOG_WARN, "Usage: ota [stop|status]");
+    }
+}
+
+static void cmdFwPush(ConsoleArgs& args) {
+    int clientIndex = -1;
+    if (args.argc >= 2 && strcmp(args.argv[1], "start") == 0) {
+        if (args.argc >= 3 && !clientIndexArg(args, 2, clientIndex)) return;
+        startFwPush(clientIndex);
+    } else if (args.argc >= 2 && strcmp(args.argv[1], "stop") == 0) {
+        stopFwPush();
+    } else if (args.argc < 2 || strcmp(args.argv[1], "status") == 0) {
+        printFwPushStatus();
+    } else {
+        log(LOG_WARN, "Usage: fwpush [start [client]|stop|status]");
+    }
+}
+
+static void cmdCapture(ConsoleArgs& args) {
+    const char* sub = args.argc >= 2 ? args.argv[1] : "status";
+    if (strcmp(sub, "on") == 0) {
+        espNowCaptureStart();
+        log(LOG_INFO, "ESP-NOW capture on");
+    } else if (strcmp(sub, "off") == 0) {
+        espNowCaptureStop();
+        log(LOG_INFO, "ESP-NOW capture off");
+    } else if (strcmp(sub, "clear") == 0) {
+        espNowCaptureClear();
+        log(LOG_INFO, "ESP-NOW capture cleared");
+    } else if (strcmp(sub, "dump") == 0) {
+        dumpEspNowCapture();
+    } else if (strcmp(sub, "status") == 0) {
+        printEspNowCaptureStatus();
+    } else {
+        log(LOG_WARN, "Usage: capture [on|off|clear|dump|status]");
+    }
+}
+
+static void cmdSession(ConsoleArgs& args) {
+    const char* sub = args.argc >= 2 ? args.argv[1] : "status";
+    if (strcmp(sub, "start") == 0) {
+        if (sessionRecordStart()) log(LOG_INFO, "Session recording started");
+    } else if (strcmp(sub, "stop") == 0) {
+        sessionRecordStop();
+        log(LOG_INFO, "Session recording stopped");
+    } else if (strcmp(sub, "dump") == 0) {
+        dumpSessionRecord();
+    } else if (strcmp(sub, "status") == 0) {
+        printSessionRecordStatus();
+    } else {
+        log(LOG_WARN, "Usage: session [start|stop|dump|status]");
+    }
+}
+
+static void cmdClients(ConsoleArgs& args) {
+    const char* sub = args.argc >= 2 ? args.argv[1] : "show";
+    if (strcmp(sub, "refresh") == 0) {
+        if (startStatusCollection(true)) {
+            log(LOG_INFO, "Asking clients for status - the table follows when they have replied");
+        } else {
+            log(LOG_WARN, statusCollectionActive() ? "Status collection already running" : "No clients paired");
+        }
+    } else if (strcmp(sub, "show") == 0) {
+        printClientStatusTable();
+    } else {
+        log(LOG_WARN, "Usage: clients [show|refresh]");
+    }
+}
+
+static void cmdMirror(ConsoleArgs& args) {
+    const char* sub = args.argc >= 2 ? args.argv[1] : "status";
+    if (strcmp(sub, "on") == 0 || strcmp(sub, "off") == 0) {
+        setClientMirrorEnabled(strcmp(sub, "on") == 0);
+        logf(LOG_INFO, "Client mirror %s", isClientMirrorEnabled() ? "on" : "off");
+    } else if (strcmp(sub, "clear") == 0) {
+        clientMirrorInvalidate(nullptr);
+        resetClientMirrorStats();
+        log(LOG_INFO, "Client mirror cleared - next program change goes to every client");
+    } else if (strcmp(sub, "status") == 0) {
+        printClientMirror();
+    } else {
+        log(LOG_WARN, "Usage: mirror [on|off|clear|status]");
+    }
+}
+
+static void cmdSetLog(ConsoleArgs& args) {
+    int level;
+    if (consoleArgInt(args, 1, level) && level >= 0 && level <= 4) {
+        currentLogLevel = (LogLevel)level;
+        saveLogLevelToNVS(currentLogLevel);
+        logf(LOG_INFO, "Log level set to: %s", getLogLevelString(currentLogLevel));
+        if (level > LOG_COMPILE_LEVEL) {
+            logf(LOG_WARN, "Messages above %s are compiled out of this build", getLogLevelString((LogLevel)LOG_COMPILE_LEVEL));
+        }
+    } else {
+        log(LOG_WARN, "Invalid log level. Use 0-4 (0=OFF, 1=ERROR, 2=WARN, 3=INFO, 4=DEBUG)");
+    }
+}
+
+static void cmdClearLog(ConsoleArgs&) {
+    clearLogLevelNVS();
+    currentLogLevel = LOG_INFO;
+    log(LOG_INFO, "Log level reset to default (INFO)");
+}
+
+static void cmdClearAll(ConsoleArgs&) {
+    log(LOG_WARN, "Clearing ALL NVS data and rebooting...");
+    clearAllNVS();
+    ESP.restart();
+}
+
+static void cmdFsPress(ConsoleArgs&) {
+    handleFootswitchPress();
+    log(LOG_INFO, "Footswitch press simulated");
+}
+
+// ---- Pairing commands ----
+static void cmdPair(ConsoleArgs&) {
+    pairingforceStart();
+    log(LOG_INFO, "Pairing mode activated");
+}
+
+static void cmdB1(ConsoleArgs&) {
+    simulateButton1Press();
+    log(LOG_INFO, "Button 1 press simulated");
+}
+
+static void cmdB2(ConsoleArgs&) {
+    simulateButton2Press();
+    log(LOG_INFO, "Button 2 press simulated");
+}
+
+static void cmdClearPeers(ConsoleArgs&) {
+    log(LOG_INFO, "Clearing all peers from NVS...");
+    clearPeersNVS();
+    ESP.restart();
+}
+
+static void cmdPairing(ConsoleArgs&) { printPairingStatus(); }
+
+// ---- Send subcommands ----
+static void sendChannel(ConsoleArgs& args) {
+    int channel;
+    if (!consoleArgInt(args, 1, channel) || channel < 0 || channel > 4) {
+        log(LOG_WARN, "Invalid channel number. Use 0-4 (0=off,1-4=channels)");
+        return;
+    }
+    if (args.argc < 3) {
+        sendChannelChangeToAll(channel);
+        return;
+    }
+    int clientIndex;
+    if (!clientIndexArg(args, 2, clientIndex)) return;
+    sendChannelChange(clientMacAddresses[clientIndex], channel);
+}
+
+static void sendOff(ConsoleArgs& args) {
+    if (args.argc < 2) {
+        sendAllChannelsOffToAll();
+        return;
+    }
+    int clientIndex;
+    if (!clientIndexArg(args, 1, clientIndex)) return;
+    sendAllChannelsOff(clientMacAddresses[clientIndex]);
+}
+
+static void sendStatusReq(ConsoleArgs& args) {
+    if (args.argc < 2) {
+        sendStatusRequestToAll();
+        return;
+    }
+    int clientIndex;
+    if (!clientIndexArg(args, 1, clientIndex)) return;
+    sendStatusRequest(clientMacAddresses[clientIndex]);
+}
+
+static void sendPcRaw(ConsoleArgs& args) {
+    int program;
+    if (args.argc < 2) { log(LOG_WARN, "Missing program number. Use: send pcraw <0-127>"); return; }
+    if (!consoleArgInt(args, 1, program) || program < 0 || program > 127) { log(LOG_WARN, "Invalid program number 0-127"); return; }
+    forwardMidiProgramToAll((uint8_t)program);
+}
+
+static void sendRaw(ConsoleArgs& args) {
+    int commandType, commandValue;
+    if (!consoleArgInt(args, 1, commandType) || !consoleArgInt(args, 2, commandValue)) {
+        log(LOG_WARN, "Format: send raw <type> <value> [client]");
+        return;
+    }
+    if (args.argc < 4) {
+        sendCommandToAllClients(commandType, commandValue);
+        return;
+    }
+    int clientIndex;
+    if (!clientIndexArg(args, 3, clientIndex)) return;
+    sendCommandToClient(clientMacAddresses[clientIndex], commandType, commandValue);
+}
+
+static void sendStatus(ConsoleArgs&) {
+    if (numClients == 0) {
+        log(LOG_INFO, "No clients paired");
+        return;
+    }
+    log(LOG_INFO, "=== PAIRED CLIENTS ===");
+    for (int i = 0; i < numClients; i++) {
+        logf(LOG_INFO, "Client %d: %s", i, getPeerName(clientMacAddresses[i]));
+        Serial.print("  MAC: ");
+        printMAC(clientMacAddresses[i], LOG_INFO);
+    }
+    log(LOG_INFO, "=====================");
+}
+
+static void sendHelp(ConsoleArgs&) { printSendCommandHelp(); }
+
+static constexpr ConsoleCommand sendCommands[] = {
+    {"channel",   sendChannel,   0, "channel|pc <0-4> [client]", "Select amp channel (PROGRAM_CHANGE)"},
+    {"help",      sendHelp,      0, "help",                      "Show this help"},
+    {"off",       sendOff,       0, "off [client]",              "Turn off all channels"},
+    {"pc",        sendChannel,   0, nullptr,                     nullptr},
+    {"pcraw",     sendPcRaw,     0, "pcraw <0-127>",             "Forward raw MIDI Program Change to all clients"},
+    {"progch",    sendChannel,   0, nullptr,                     nullptr},
+    {"raw",       sendRaw,       0, "raw <type> <value> [client]", "Send raw command (types: 0=PROGRAM_CHANGE, 2=ALL_CHANNELS_OFF, 3=STATUS_REQUEST)"},
+    {"status",    sendStatus,    0, "status",                    "Show paired clients with indices"},
+    {"statusreq", sendStatusReq, 0, "statusreq [client]",        "Request status from clients"},
+};
+static_assert(consoleTableSorted(sendCommands), "sendCommands must be sorted by name");
+
+// ---- MIDI subcommands ----
+static void midiChannel(ConsoleArgs& args) {
+    int ch;
+    if (!consoleArgInt(args, 1, ch) || ch < 0 || ch > 16) { log(LOG_WARN, "Invalid MIDI channel (0-16)"); return; }
+    serverMidiChannel = (uint8_t)ch;
+    logf(LOG_INFO, "Server MIDI channel set to %u", serverMidiChannel);
+}
+
+static void midiMap(ConsoleArgs& args) {
+    if (args.argc < 2) {
+        log(LOG_INFO, "Current MIDI Map (relayIndex:program):");
+        for (int i = 0; i < MAX_RELAY_CHANNELS; i++) logf(LOG_INFO, "  %d:%u", i, serverMidiChannelMap[i]);
+        return;
+    }
+    int idx, prog;
+    if (!consoleArgInt(args, 1, idx) || !consoleArgInt(args, 2, prog)) { log(LOG_WARN, "Format: midi map <idx> <program>"); return; }
+    if (idx < 0 || idx >= MAX_RELAY_CHANNELS) { log(LOG_WARN, "Index out of range"); return; }
+    if (prog < 0 || prog > 127) { log(LOG_WARN, "Program 0-127 only"); return; }
+    serverMidiChannelMap[idx] = (uint8_t)prog;
+    logf(LOG_INFO, "Map[%d]=%d", idx, prog);
+}
+
+static void midiReset(ConsoleArgs&) {
+    for (int i = 0; i < MAX_RELAY_CHANNELS; i++) serverMidiChannelMap[i] = 0;
+    saveServerMidiMapToNVS();
+    log(LOG_INFO, "MIDI map reset to defaults (all 0) and saved");
+}
+
+static void midiInfo(ConsoleArgs&) {
+    log(LOG_INFO, "=== MIDI INFO ===");
+    logf(LOG_INFO, " Channel: %u (0=omni)", serverMidiChannel);
+    log(LOG_INFO, " Map (relayIndex -> Program):");
+    for (int i = 0; i < MAX_RELAY_CHANNELS; i++) logf(LOG_INFO, "  %d -> %u", i, serverMidiChannelMap[i]);
+    bool anyDup = false;
+    for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
+        for (int j = i + 1; j < MAX_RELAY_CHANNELS; j++) {
+            if (serverMidiChannelMap[i] == serverMidiChannelMap[j] && serverMidiChannelMap[i] != 0) {
+                logf(LOG_INFO, "  DUPLICATE: Program %u used by relays %d and %d", serverMidiChannelMap[i], i, j);
+                anyDup = true;
+            }
+        }
+    }
+    if (!anyDup) log(LOG_INFO, "  No duplicate non-zero program assignments");
+    logf(LOG_INFO, " Learn Armed: %s", serverMidiLearnArmed ? "yes" : "no");
+    if (serverMidiLearnArmed) logf(LOG_INFO, " Learn Target Relay Index: %d", serverMidiLearnTarget);
+    log(LOG_INFO, "=================");
+}
+
+static void midiSave(ConsoleArgs&) {
+    saveServerMidiChannelToNVS();
+    saveServerMidiMapToNVS();
+    saveServerButtonPcMapToNVS();
+    flushNVSCache();
+}
+
+static void midiHelp(ConsoleArgs&);
+
+static constexpr ConsoleCommand midiCommands[] = {
+    {"ch",    midiChannel, 0, "ch <1-16|0>",     "Set server MIDI channel (0=omni)"},
+    {"help",  midiHelp,    0, "help",            "Show MIDI command help"},
+    {"info",  midiInfo,    0, "info",            "Detailed MIDI status & duplicates"},
+    {"map",   midiMap,     0, "map [idx pc]",    "Show map, or set entry (0-based relay index) to program"},
+    {"reset", midiReset,   0, "reset",           "Reset MIDI map to defaults (all 0) & save"},
+    {"save",  midiSave,    0, "save",            "Save channel & maps to NVS"},
+};
+static_assert(consoleTableSorted(midiCommands), "midiCommands must be sorted by name");
+
+static void midiHelp(ConsoleArgs&) {
+    Serial.println(F("MIDI COMMANDS:"));
+    printCommandLines(midiCommands, sizeof(midiCommands) / sizeof(midiCommands[0]), -1, "midi ", 18);
+}
+
+// ---- Button PC map subcommands ----
+static void btnList(ConsoleArgs&) {
+    logf(LOG_INFO, "Button Count: %u", serverButtonCount);
+    for (int i = 0; i < serverButtonCount; i++) {
+        logf(LOG_INFO, "  Button %d -> PC %u", i, serverButtonProgramMap[i]);
+    }
+}
+
+static void btnSet(ConsoleArgs& args) {
+    int idx, pc;
+    if (!consoleArgInt(args, 1, idx) || !consoleArgInt(args, 2, pc)) { log(LOG_WARN, "Format: btn set <idx> <pc>"); return; }
+    if (idx < 0 || idx >= serverButtonCount) { log(LOG_WARN, "Index out of range"); return; }
+    if (pc < 0 || pc > 127) { log(LOG_WARN, "PC 0-127 only"); return; }
+    serverButtonProgramMap[idx] = (uint8_t)pc;
+    logf(LOG_INFO, "Set button %d -> PC %d", idx, pc);
+    saveServerButtonPcMapToNVS();
+    log(LOG_INFO, "(Button PC map queued for NVS)");
+}
+
+static void btnReset(ConsoleArgs&) {
+    for (int i = 0; i < serverButtonCount; i++) serverButtonProgramMap[i] = (uint8_t)i; // sequential default
+    saveServerButtonPcMapToNVS();
+    log(LOG_INFO, "Button PC map reset to sequential defaults and saved");
+}
+
+static void btnSave(ConsoleArgs&) {
+    saveServerButtonPcMapToNVS();
+    flushNVSCache();
+}
+
+static void btnHelp(ConsoleArgs&);
+
+static constexpr ConsoleCommand btnCommands[] = {
+    {"help",  btnHelp,  0, "help",            "Show button command help"},
+    {"list",  btnList,  0, "list",            "Show button->PC assignments"},
+    {"reset", btnReset, 0, "reset",           "Reset button PC map to sequential defaults & save"},
+    {"save",  btnSave,  0, "save",            "Persist button map now ('set' saves after a quiet period)"},
+    {"set",   btnSet,   0, "set <idx> <pc>",  "Assign Program Change to button index"},
+};
+static_assert(consoleTableSorted(btnCommands), "btnCommands must be sorted by name");
+
+static void btnHelp(ConsoleArgs&) {
+    Serial.println(F("BUTTON PC MAP COMMANDS:"));
+    printCommandLines(btnCommands, sizeof(btnCommands) / sizeof(btnCommands[0]), -1, "btn ", 18);
+}
+
+// Run argv[1] against a subcommand table; bare group name shows its help
+static void dispatchSubcommand(const ConsoleCommand* table, size_t count, ConsoleArgs& args,
+                               const char* group, ConsoleHandler helpHandler) {
+    consoleShift(args);
+    if (args.argc == 0) {
+        helpHandler(args);
+        return;
+    }
+    const ConsoleCommand* sub = consoleFind(table, count, args.argv[0]);
+    if (sub == nullptr) {
+        logf(LOG_WARN, "Unknown %s subcommand: %s", group, args.argv[0]);
+        helpHandler(args);
+        return;
+    }
+    sub->handler(args);
+}
+
+static void cmdSend(ConsoleArgs& args) {
+    if (args.argc < 2) log(LOG_WARN, "Missing send command parameters");
+    dispatchSubcommand(sendCommands, sizeof(sendCommands) / sizeof(sendCommands[0]), args, "send", sendHelp);
+}
+
+static void cmdMidi(ConsoleArgs& args) {
+    dispatchSubcommand(midiCommands, sizeof(midiCommands) / sizeof(midiCommands[0]), args, "midi", midiHelp);
+}
+
+static void cmdBtn(ConsoleArgs& args) {
+    dispatchSubcommand(btnCommands, sizeof(btnCommands) / sizeof(btnCommands[0]), args, "btn", btnHelp);
+}
+
+// ---- Scene commands ----
+static bool sceneArg(const ConsoleArgs& args, int index, uint8_t& scene) {
+    int value;
+    if (!consoleArgInt(args, index, value) || value < 0 || value >= SCENE_COUNT) {
+        logf(LOG_WARN, "Scene number 0-%d expected", SCENE_COUNT - 1);
+        return false;
+    }
+    scene = (uint8_t)value;
+    return true;
+}
+
+static void sceneCaptureCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (!sceneArg(args, 1, scene)) return;
+    sceneCapture(scene, args.argc >= 3 ? args.argv[2] : nullptr);
+    logf(LOG_INFO, "Scene %u captured from the current relays and client programs", scene);
+    printScene(scene);
+}
+
+static void sceneClientCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    int client, pc = 0;
+    if (!sceneArg(args, 1, scene)) return;
+    if (args.argc < 4) {
+        log(LOG_WARN, "Format: scene client <n> <client> <pc|off|none>");
+        return;
+    }
+    if (!clientIndexArg(args, 2, client)) return;
+    uint8_t type = PROGRAM_CHANGE;
+    if (strcmp(args.argv[3], "off") == 0) {
+        type = ALL_CHANNELS_OFF;
+    } else if (strcmp(args.argv[3], "none") == 0) {
+        type = SCENE_ACTION_NONE;
+    } else if (!consoleArgInt(args, 3, pc) || pc < 0 || pc > 127) {
+        log(LOG_WARN, "PC 0-127, 'off' or 'none'");
+        return;
+    }
+    if (sceneSetClient(scene, client, type, (uint8_t)pc)) {
+        logf(LOG_INFO, "Scene %u: client %d set", scene, client);
+    } else {
+        log(LOG_WARN, "No scene client slot free");
+    }
+}
+
+static void sceneDeleteCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (!sceneArg(args, 1, scene)) return;
+    logf(LOG_INFO, sceneDelete(scene) ? "Scene %u deleted" : "Scene %u is not defined", scene);
+}
+
+static void sceneListCmd(ConsoleArgs&) {
+    printSceneList();
+}
+
+static void sceneNameCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (!sceneArg(args, 1, scene)) return;
+    sceneSetName(scene, args.argc >= 3 ? args.argv[2] : nullptr);
+    logf(LOG_INFO, "Scene %u renamed", scene);
+}
+
+static void sceneRecallCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (!sceneArg(args, 1, scene)) return;
+    if (!recallScene(scene, SCENE_SOURCE_SERIAL)) logf(LOG_WARN, "Scene %u is not defined", scene);
+}
+
+static void sceneRelaysCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (!sceneArg(args, 1, scene)) return;
+    if (args.argc < 3) {
+        log(LOG_WARN, "Format: scene relays <n> <mask|keep>");
+        return;
+    }
+    bool keep = strcmp(args.argv[2], "keep") == 0;
+    char* end = nullptr;
+    long mask = keep ? 0 : strtol(args.argv[2], &end, 0);
+    if (!keep && (end == args.argv[2] || *end != '\0' || mask < 0 || mask > 0xFF)) {
+        log(LOG_WARN, "Relay mask 0-0xFF (bit 0 = relay 1) or 'keep'");
+        return;
+    }
+    sceneSetRelays(scene, (uint8_t)mask, keep);
+    logf(LOG_INFO, keep ? "Scene %u leaves the relays unchanged" : "Scene %u sets relay mask 0x%02lX", scene, mask);
+}
+
+static void sceneShowCmd(ConsoleArgs& args) {
+    uint8_t scene;
+    if (sceneArg(args, 1, scene)) printScene(scene);
+}
+
+static void sceneStatsCmd(ConsoleArgs& args) {
+    if (args.argc >= 2 && strcmp(args.argv[1], "reset") == 0) {
+        resetSceneRecallStats();
+        log(LOG_INFO, "Scene recall stats reset");
+        return;
+    }
+    printSceneStats();
+}
+
+static void sceneTriggersCmd(ConsoleArgs& args) {
+    if (args.argc >= 2) setSceneTriggersEnabled(strcmp(args.argv[1], "on") == 0);
+    logf(LOG_INFO, "Scene triggers %s", sceneTriggersEnabled() ? "on" : "off");
+}
+
+static void sceneHelp(ConsoleArgs&);
+
+static constexpr ConsoleCommand sceneCommands[] = {
+    {"capture",  sceneCaptureCmd,  0, "capture <n> [name]",       "Store the current relays and each client's last program"},
+    {"client",   sceneClientCmd,   0, "client <n> <c> <pc|off|none>", "Set what client c gets (none = nothing sent)"},
+    {"delete",   sceneDeleteCmd,   0, "delete <n>",               "Delete a scene"},
+    {"help",     sceneHelp,        0, "help",                     "Show scene command help"},
+    {"list",     sceneListCmd,     0, "list",                     "List defined scenes"},
+    {"name",     sceneNameCmd,     0, "name <n> <name>",          "Name a scene"},
+    {"recall",   sceneRecallCmd,   0, "recall <n>",               "Recall a scene"},
+    {"relays",   sceneRelaysCmd,   0, "relays <n> <mask|keep>",   "Set the relay mask (0x3 = relays 1+2) or keep relays"},
+    {"show",     sceneShowCmd,     0, "show <n>",                 "Show one scene"},
+    {"stats",    sceneStatsCmd,    0, "stats [reset]",            "Recall count and latency"},
+    {"triggers", sceneTriggersCmd, 0, "triggers [on|off]",        "MIDI PC / buttons / footswitch recall scene N for program N"},
+};
+static_assert(consoleTableSorted(sceneCommands), "sceneCommands must be sorted by name");
+
+static void sceneHelp(ConsoleArgs&) {
+    Serial.println(F("SCENE COMMANDS (scenes 0-127):"));
+    printCommandLines(sceneCommands, sizeof(sceneCommands) / sizeof(sceneCommands[0]), -1, "scene ", 30);
+}
+
+static void cmdScene(ConsoleArgs& args) {
+    if (args.argc == 1) {
+        printSceneList();
+        return;
+    }
+    dispatchSubcommand(sceneCommands, sizeof(sceneCommands) / sizeof(sceneCommands[0]), args, "scene", sceneHelp);
+}
+
+// ---- Program remap commands ----
+// "N" or "N-M", programs 0-127
+static bool parseProgramRange(const char* text, uint8_t& first, uint8_t& last) {
+    char* end = nullptr;
+    long a = strtol(text, &end, 10);
+    long b = a;
+    if (end == text) return false;
+    if (*end == '-') {
+        const char* second = end + 1;
+        b = strtol(second, &end, 10);
+        if (end == second) return false;
+    }
+    if (*end != '\0' || a < 0 || b < a || b > 127) return false;
+    first = (uint8_t)a;
+    last = (uint8_t)b;
+    return true;
+}
+
+static void remapListCmd(ConsoleArgs&) {
+    printProgramRemapList();
+}
+
+static void remapResetCmd(ConsoleArgs& args) {
+    int client;
+    if (!clientIndexArg(args, 1, client)) return;
+    bool none = args.argc >= 3 && strcmp(args.argv[2], "none") == 0;
+    programRemapReset(client, none);
+    logf(LOG_INFO, none ? "Client %d: no program sent until entries are set" : "Client %d: identity (no table)",
+         client);
+}
+
+static void remapSetCmd(ConsoleArgs& args) {
+    int client;
+    uint8_t first, last;
+    if (!clientIndexArg(args, 1, client)) return;
+    if (args.argc < 4 || !parseProgramRange(args.argv[2], first, last)) {
+        log(LOG_WARN, "Format: remap set <client> <pc>[-<pc>] <pc|none|same|+n|-n>");
+        return;
+    }
+    const char* value = args.argv[3];
+    bool ok;
+    if (strcmp(value, "none") == 0) {
+        ok = programRemapSet(client, first, last, PROGRAM_REMAP_NONE);
+    } else if (strcmp(value, "same") == 0) {
+        ok = programRemapShift(client, first, last, 0);
+    } else if (value[0] == '+' || value[0] == '-') {
+        ok = programRemapShift(client, first, last, atoi(value));
+    } else {
+        int program;
+        ok = consoleArgInt(args, 3, program) && program >= 0 && program <= 127 &&
+             programRemapSet(client, first, last, (uint8_t)program);
+    }
+    if (!ok) {
+        log(LOG_WARN, "Target: program 0-127, 'none', 'same' or an offset like +10");
+        return;
+    }
+    printProgramRemap(client);
+}
+
+static void remapShowCmd(ConsoleArgs& args) {
+    int client;
+    if (clientIndexArg(args, 1, client)) printProgramRemap(client);
+}
+
+static void remapTestCmd(ConsoleArgs& args) {
+    int program;
+    if (!consoleArgInt(args, 1, program) || program < 0 || program > 127) {
+        log(LOG_WARN, "Format: remap test <pc 0-127>");
+        return;
+    }
+    printProgramRemapFor((uint8_t)program);
+}
+
+static void remapHelp(ConsoleArgs&);
+
+static constexpr ConsoleCommand remapCommands[] = {
+    {"help",  remapHelp,     0, "help",                              "Show remap command help"},
+    {"list",  remapListCmd,  0, "list",                              "Summary per client"},
+    {"reset", remapResetCmd, 0, "reset <c> [none]",                  "Back to identity, or send nothing until set"},
+    {"set",   remapSetCmd,   0, "set <c> <pc>[-<pc>] <pc|none|same|+n|-n>", "Map incoming programs for client c"},
+    {"show",  remapShowCmd,  0, "show <c>",                          "Show a client's table as ranges"},
+    {"test",  remapTestCmd,  0, "test <pc>",                         "What each client gets for an incoming PC"},
+};
+static_assert(consoleTableSorted(remapCommands), "remapCommands must be sorted by name");
+
+static void remapHelp(ConsoleArgs&) {
+    Serial.println(F("PROGRAM REMAP COMMANDS (incoming MIDI/button PCs, per client):"));
+    printCommandLines(remapCommands, sizeof(remapCommands) / sizeof(remapCommands[0]), -1, "remap ", 44);
+}
+
+static void cmdRemap(ConsoleArgs& args) {
+    if (args.argc == 1) {
+        printProgramRemapList();
+        return;
+    }
+    dispatchSubcommand(remapCommands, sizeof(remapCommands) / sizeof(remapCommands[0]), args, "remap", remapHelp);
+}
+
+static void cmdMaps(ConsoleArgs&) {
+    log(LOG_INFO, "=== COMBINED MAP SUMMARY ===");
+    logf(LOG_INFO, "MIDI Channel: %u (0=omni)", serverMidiChannel);
+    log(LOG_INFO, "Relay MIDI Map (index -> Program):");
+    for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
+        logf(LOG_INFO, "  %d -> %u", i, serverMidiChannelMap[i]);
+    }
+    log(LOG_INFO, "Button PC Map (button -> Program):");
+    for (int i = 0; i < serverButtonCount; i++) {
+        logf(LOG_INFO, "  %d -> %u", i, serverButtonProgramMap[i]);
+    }
+    logf(LOG_INFO, "Learn Armed: %s  Target: %d", serverMidiLearnArmed ? "yes" : "no", serverMidiLearnTarget);
+    log(LOG_INFO, "============================");
+}
+
+// ---- Relay commands ----
+#if HAS_RELAY_OUTPUTS
+static void cmdRelay(ConsoleArgs&) { printRelayStatus(); }
+static void cmdSpeed(ConsoleArgs&) { testRelaySpeed(); }
+
+static void cmdOff(ConsoleArgs&) {
+    turnOffAllRelays();
+    log(LOG_INFO, "All relay channels turned off");
+}
+
+static void cmdChannel(ConsoleArgs& args) {
+    int channel = 0;
+    if (consoleArgInt(args, 1, channel) && channel >= 1 && channel <= MAX_RELAY_CHANNELS) {
+        setRelayChannel(channel);
+    } else {
+        logf(LOG_WARN, "Invalid channel: %d (valid: 1-%d)", channel, MAX_RELAY_CHANNELS);
+    }
+}
+
+static void cmdCycle(ConsoleArgs&) {
+    cycleRelays();
+    log(LOG_INFO, "Relay cycle test completed");
+}
+#endif
+
+// ---- Test / debug commands ----
+static void cmdTestMemory(ConsoleArgs&) {
+    log(LOG_INFO, "Running memory test...");
+    printMemoryAnalysis();
+}
+
+static void cmdParseBench(ConsoleArgs& args) {
+    int iterations = 10000;
+    if (args.argc > 1 && (!consoleArgInt(args, 1, iterations) || iterations <= 0)) {
+        log(LOG_WARN, "Format: parsebench [iterations]");
+        return;
+    }
+    runConsoleParseBenchmark((uint32_t)iterations);
+}
+
+static void cmdBench(ConsoleArgs& args) {
+    int iterations = 1000;
+    if (args.argc > 1 && (!consoleArgInt(args, 1, iterations) || iterations <= 0)) {
+        log(LOG_WARN, "Format: bench [iterations]");
+        return;
+    }
+    logf(LOG_INFO, "Switch latency benchmark: %d iterations per input, %d clients (relays switch, clients get PCs)",
+         iterations, numClients);
+    int shortPaths = runSwitchBenchOnDevice((uint32_t)iterations);
+    if (shortPaths > 0) logf(LOG_WARN, "Bench: %d paths incomplete, see the # short lines", shortPaths);
+}
+
+static void cmdDebugPerf(ConsoleArgs&)   { printPerformanceMetrics(); }
+static void cmdDebugLog(ConsoleArgs&)    { printDeferredLogStats(); }
+static void cmdDebugWifi(ConsoleArgs&)   { printWiFiStats(); }
+static void cmdDebugEspNow(ConsoleArgs&) { printESPNowStats(); }
+static void cmdDebugNvs(ConsoleArgs&)    { printNVSStats(); }
+static void cmdDebugReset(ConsoleArgs&)  { resetPerformanceMetrics(); }
+
+// ---- Top-level table (sorted by name) ----
+static constexpr ConsoleCommand consoleCommands[] = {
+    {"b1",          cmdB1,          CMD_GROUP_PAIRING, nullptr,        nullptr},
+    {"b2",          cmdB2,          CMD_GROUP_PAIRING, nullptr,        nullptr},
+    {"bench",       cmdBench,       CMD_GROUP_TEST,    "bench [n]",    "Switching latency per input path, CSV (n iterations)"},
+    {"btn",         cmdBtn,         CMD_GROUP_SEND,    "btn <sub>",    "Manage button PC map (list|set|reset|save)"},
+    {"capture",     cmdCapture,     CMD_GROUP_DEBUG,   "capture <sub>", "Record ESP-NOW frames (on|off|clear|status|dump as pcap)"},
+#if HAS_RELAY_OUTPUTS
+    {"ch",          cmdChannel,     CMD_GROUP_RELAY,   "ch<N>",        "Activate relay channel N"},
+#endif
+    {"clearall",    cmdClearAll,    CMD_GROUP_CONTROL, "clearall",     "Clear ALL NVS data (factory reset)"},
+    {"clearlog",    cmdClearLog,    CMD_GROUP_CONTROL, "clearlog",     "Clear saved log level (reset to default)"},
+    {"clearpeers",  cmdClearPeers,  CMD_GROUP_PAIRING, "clearpeers",   "Clear all peers from NVS"},
+    {"clients",     cmdClients,     CMD_GROUP_SYSTEM,  "clients [refresh]", "Client status table (refresh: ask every client, non-blocking)"},
+    {"config",      cmdConfig,      CMD_GROUP_SYSTEM,  "config",       "Show server configuration"},
+#if HAS_RELAY_OUTPUTS
+    {"cycle",       cmdCycle,       CMD_GROUP_RELAY,   "cycle",        "Cycle through all relays"},
+#endif
+    {"debug",       cmdStatus,      CMD_GROUP_DEBUG,   "debug",        "Show complete debug info"},
+    {"debugespnow", cmdDebugEspNow, CMD_GROUP_DEBUG,   "debugespnow",  "Show ESP-NOW stats"},
+    {"debuglog",    cmdDebugLog,    CMD_GROUP_DEBUG,   "debuglog",     "Show deferred log ring stats"},
+    {"debugmemory", cmdMemory,      CMD_GROUP_DEBUG,   "debugmemory",  "Show memory analysis"},
+    {"debugnvs",    cmdDebugNvs,    CMD_GROUP_DEBUG,   "debugnvs",     "Show NVS statistics"},
+    {"debugperf",   cmdDebugPerf,   CMD_GROUP_DEBUG,   "debugperf",    "Show performance metrics"},
+    {"debugreset",  cmdDebugReset,  CMD_GROUP_DEBUG,   "debugreset",   "Reset performance metrics"},
+    {"debugwifi",   cmdDebugWifi,   CMD_GROUP_DEBUG,   "debugwifi",    "Show WiFi stats"},
+    {"fspress",     cmdFsPress,     CMD_GROUP_CONTROL, "fspress",      "Simulate footswitch press"},
+    {"fwpush",      cmdFwPush,      CMD_GROUP_CONTROL, "fwpush <sub>", "Push client firmware over ESP-NOW (start [n]|stop|status)"},
+    {"help",        cmdHelp,        CMD_GROUP_SYSTEM,  "help",         "Show this help menu"},
+    {"loglevel",    cmdLogLevel,    CMD_GROUP_SYSTEM,  "loglevel",     "Show current log level"},
+    {"maps",        cmdMaps,        CMD_GROUP_SEND,    "maps",         "Show combined MIDI & button maps"},
+    {"memory",      cmdMemory,      CMD_GROUP_SYSTEM,  "memory [frag]", "Show memory usage (frag: fragmentation history)"},
+    {"midi",        cmdMidi,        CMD_GROUP_SEND,    "midi <sub>",   "MIDI channel/map (ch|map|reset|info|save)"},
+    {"mirror",      cmdMirror,      CMD_GROUP_SEND,    "mirror <sub>", "Skip program changes a client already has (on|off|clear|status)"},
+    {"network",     cmdNetwork,     CMD_GROUP_SYSTEM,  "network",      "Show network status"},
+#if HAS_RELAY_OUTPUTS
+    {"off",         cmdOff,         CMD_GROUP_RELAY,   "off",          "Turn off all relays"},
+#endif
+    {"ota",         cmdOta,         CMD_GROUP_CONTROL, "ota [stop|status]", "Live OTA update on a softAP; switching keeps running"},
+    {"pair",        cmdPair,        CMD_GROUP_PAIRING, "pair",         "Start pairing mode"},
+    {"pairing",     cmdPairing,     CMD_GROUP_PAIRING, "pairing",      "Show pairing status"},
+    {"parsebench",  cmdParseBench,  CMD_GROUP_TEST,    "parsebench [n]", "Benchmark console parsing (n iterations)"},
+    {"peers",       cmdPeers,       CMD_GROUP_SYSTEM,  "peers",        "Show registered peers"},
+    {"pins",        cmdPins,        CMD_GROUP_SYSTEM,  "pins",         "Show pin assignments"},
+#if HAS_RELAY_OUTPUTS
+    {"relay",       cmdRelay,       CMD_GROUP_RELAY,   "relay",        "Show relay status"},
+#endif
+    {"remap",       cmdRemap,       CMD_GROUP_SEND,    "remap <sub>",  "Per-client program remap for forwarded PCs ('remap help')"},
+    {"reset",       cmdRestart,     CMD_GROUP_CONTROL, nullptr,        nullptr},
+    {"restart",     cmdRestart,     CMD_GROUP_CONTROL, "restart",      "Reboot the device"},
+    {"save",        cmdSave,        CMD_GROUP_CONTROL, "save",         "Write pending config changes to NVS now"},
+    {"scene",       cmdScene,       CMD_GROUP_SEND,    "scene <sub>",  "Scenes: relays + every client's program in one recall ('scene help')"},
+    {"send",        cmdSend,        CMD_GROUP_SEND,    "send <sub>",   "Send commands to clients ('sendhelp' for details)"},
+    {"sendhelp",    sendHelp,       CMD_GROUP_SEND,    "sendhelp",     "Show send command help"},
+    {"server",      cmdServer,      CMD_GROUP_SYSTEM,  "server",       "Show server status"},
+    {"session",     cmdSession,     CMD_GROUP_DEBUG,   "session <sub>", "Record inputs and outputs for a native replay (start|stop|status|dump)"},
+    {"setlog",      cmdSetLog,      CMD_GROUP_CONTROL, "setlog<N>",    "Set log level (N=0-4)"},
+    {"showmaps",    cmdMaps,        CMD_GROUP_SEND,    nullptr,        nullptr},
+#if HAS_RELAY_OUTPUTS
+    {"speed",       cmdSpeed,       CMD_GROUP_RELAY,   "speed",        "Test relay switching speed"},
+#endif
+    {"status",      cmdStatus,      CMD_GROUP_SYSTEM,  "status",       "Show complete system status"},
+    {"testmemory",  cmdTestMemory,  CMD_GROUP_TEST,    "testmemory",   "Run memory test"},
+    {"uptime",      cmdUptime,      CMD_GROUP_SYSTEM,  "uptime",       "Show system uptime"},
+    {"version",     cmdVersion,     CMD_GROUP_SYSTEM,  "version",      "Show firmware version"},
+};
+static_assert(consoleTableSorted(consoleCommands), "consoleCommands must be sorted by name");
+
+static const size_t consoleCommandCount = sizeof(consoleCommands) / sizeof(consoleCommands[0]);
+
+// Resolve argv[0]. "setlog3"/"ch2" style words fall back to the name before the
+// trailing digits, with the digits inserted as argv[1] (argv[0] keeps the full word).
+static const ConsoleCommand* resolveCommand(ConsoleArgs& args) {
+    return consoleResolve(consoleCommands, consoleCommandCount, args);
+}
+
+void dispatchConsoleLine(char* line) {
+    ConsoleArgs args;
+    if (consoleTokenize(line, args) == 0) return;
+
+    const ConsoleCommand* cmd = resolveCommand(args);
+    if (cmd == nullptr) {
+        logf(LOG_WARN, "Unknown command: '%s'", args.argv[0]);
+        log(LOG_INFO, "Type 'help' for available commands");
+        return;
+    }
+    cmd->handler(args);
+}
+
+// ---- Help ----
+static const char* const consoleGroupTitles[CMD_GROUP_COUNT] = {
+    "SYSTEM COMMANDS:",
+    "CONTROL COMMANDS:",
+    "PAIRING COMMANDS:",
+    "SEND / MAP COMMANDS:",
+    "RELAY COMMANDS:",
+    "TEST COMMANDS:",
+    "DEBUG COMMANDS:",
+};
+
+void printConsoleHelp() {
+    Serial.println(F("\n========== ESP SERVER COMMANDS =========="));
+    for (int g = 0; g < CMD_GROUP_COUNT; g++) {
+        bool any = false;
+        for (size_t i = 0; i < consoleCommandCount; i++) {
+            if (consoleCommands[i].group == g && consoleCommands[i].usage != nullptr) { any = true; break; }
+        }
+        if (!any) continue;
+        Serial.println(consoleGroupTitles[g]);
+        printCommandLines(consoleCommands, consoleCommandCount, g, "", 14);
+        Serial.println(F(""));
+    }
+    Serial.println(F("LOG LEVELS:"));
+    Serial.println(F("  0 = OFF     : No logging"));
+    Serial.println(F("  1 = ERROR   : Error messages only"));
+    Serial.println(F("  2 = WARN    : Warnings and errors"));
+    Serial.println(F("  3 = INFO    : Info, warnings, and errors (default)"));
+    Serial.println(F("  4 = DEBUG   : All messages including debug"));
+    Serial.println(F(""));
+    Serial.println(F("Examples:"));
+    Serial.println(F("  setlog3     : Set log level to INFO"));
+    Serial.println(F("  setlog4     : Set log level to DEBUG"));
+    Serial.println(F("=====================================\n"));
+}
+
+void printSendCommandHelp() {
+    Serial.println(F("=== SEND COMMAND HELP ==="));
+    Serial.println(F("Send commands to paired clients:"));
+    printCommandLines(sendCommands, sizeof(sendCommands) / sizeof(sendCommands[0]), -1, "send ", 28);
+    Serial.println(F(""));
+    Serial.println(F("Examples:"));
+    Serial.println(F("  send channel 1               : All clients -> channel 1"));
+    Serial.println(F("  send channel 2 0             : Client 0 -> channel 2"));
+    Serial.println(F("  send pcraw 5                 : Forward MIDI Program 5 to all clients"));
+    Serial.println(F("  send raw 3 0                 : Send STATUS_REQUEST to all clients"));
+    Serial.println(F(""));
+    Serial.println(F("Notes:"));
+    Serial.println(F("  - Channel 0 = All channels off; 1-4 = specific amp channels"));
+    Serial.println(F("  - Client index starts from 0 (use 'send status' to see indices)"));
+    Serial.println(F("  - 'channel'/'pc' use PROGRAM_CHANGE (type 0) only; type 1 reserved"));
+    Serial.println(F("========================"));
+}
+
+// ---- Parse benchmark ----
+uint32_t consoleParseSamples(uint32_t iterations) {
+    static const char* const samples[] = {
+        "help", "setlog3", "ch2", "send channel 2 0", "send raw 0 5 1",
+        "midi map 1 42", "btn set 2 17", "DEBUGPERF", "status", "nosuchcommand",
+    };
+    const size_t sampleCount = sizeof(samples) / sizeof(samples[0]);
+    char line[SERIAL_LINE_MAX_LEN];
+    uint32_t found = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        strncpy(line, samples[i % sampleCount], sizeof(line) - 1);
+        line[sizeof(line) - 1] = '\0';
+        ConsoleArgs args;
+        if (consoleTokenize(line, args) == 0) continue;
+        const ConsoleCommand* cmd = resolveCommand(args);
+        if (cmd == nullptr) continue;
+        found++;
+        if (cmd->handler == cmdSend || cmd->handler == cmdMidi || cmd->handler == cmdBtn) {
+            const ConsoleCommand* table = (cmd->handler == cmdSend) ? sendCommands
+                                        : (cmd->handler == cmdMidi) ? midiCommands : btnCommands;
+            size_t count = (cmd->handler == cmdSend) ? sizeof(sendCommands) / sizeof(sendCommands[0])
+                         : (cmd->handler == cmdMidi) ? sizeof(midiCommands) / sizeof(midiCommands[0])
+                         : sizeof(btnCommands) / sizeof(btnCommands[0]);
+            if (args.argc > 1 && consoleFind(table, count, args.argv[1]) != nullptr) found++;
+        }
+    }
+    return found;
+}
+
+void runConsoleParseBenchmark(uint32_t iterations) {
+    allocCountStart();
+    unsigned long start = micros();
+    uint32_t found = consoleParseSamples(iterations);
+    unsigned long elapsed = micros() - start;
+    uint32_t allocations = allocCountStop();
+
+    log(LOG_INFO, "=== CONSOLE PARSE BENCHMARK ===");
+    logf(LOG_INFO, "Commands parsed: %lu (%lu lookups hit)", (unsigned long)iterations, (unsigned long)found);
+    logf(LOG_INFO, "Elapsed: %lu us", elapsed);
+    if (elapsed > 0) {
+        logf(LOG_INFO, "Throughput: %lu commands/s", (unsigned long)((uint64_t)iterations * 1000000ULL / elapsed));
+    }
+    logf(LOG_INFO, "Heap allocations: %lu calls (%lu.%03lu per command)", (unsigned long)allocations,
+         (unsigned long)(allocations / iterations), (unsigned long)((uint64_t)(allocations % iterations) * 1000 / iterations));
+    log(LOG_INFO, "===============================");
+}
@@ -0,0 +1,92 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <consoleParser.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+int consoleTokenize(char* line, ConsoleArgs& args) {
+    args.argc = 0;
+    char* p = line;
+    while (*p && args.argc < CONSOLE_MAX_ARGS) {
+        while (isBlank(*p)) *p++ = '\0';
+        if (!*p) break;
+        args.argv[args.argc++] = p;
+        while (*p && !isBlank(*p)) p++;
+    }
+    if (args.argc == 0) return 0;
+
+    for (char* c = args.argv[0]; *c; c++) {
+        if (*c >= 'A' && *c <= 'Z') *c = *c - 'A' + 'a';
+    }
+    return args.argc;
+}
+
+// Compare the first len chars of name against a table entry, strcmp-style
+static int compareCommandName(const char* name, size_t len, const char* entry) {
+    int cmp = strncasecmp(name, entry, len);
+    if (cmp != 0) return cmp;
+    return entry[len] == '\0' ? 0 : -1;
+}
+
+static const ConsoleCommand* findCommandN(const ConsoleCommand* table, size_t count, const char* name, size_t len) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = compareCommandName(name, len, table[mid].name);
+        if (cmp == 0) return &table[mid];
+        if (cmp < 0) hi = mid; else lo = mid + 1;
+    }
+    return nullptr;
+}
+
+const ConsoleCommand* consoleFind(const ConsoleCommand* table, size_t count, const char* name) {
+    return findCommandN(table, count, name, strlen(name));
+}
+
+const ConsoleCommand* consoleResolve(const ConsoleCommand* table, size_t count, ConsoleArgs& args) {
+    const char* word = args.argv[0];
+    size_t len = strlen(word);
+    const ConsoleCommand* cmd = findCommandN(table, count, word, len);
+    if (cmd != nullptr) return cmd;
+
+    size_t digits = len;
+    while (digits > 0 && word[digits - 1] >= '0' && word[digits - 1] <= '9') digits--;
+    if (digits == 0 || digits == len || args.argc >= CONSOLE_MAX_ARGS) return nullptr;
+
+    cmd = findCommandN(table, count, word, digits);
+    if (cmd != nullptr) {
+        for (int i = args.argc; i > 1; i--) args.argv[i] = args.argv[i - 1];
+        args.argv[1] = args.argv[0] + digits;
+        args.argc++;
+    }
+    return cmd;
+}
+
+void consoleShift(ConsoleArgs& args) {
+    for (int i = 1; i < args.argc; i++) args.argv[i - 1] = args.argv[i];
+    if (args.argc > 0) args.argc--;
+}
+
+bool consoleArgInt(const ConsoleArgs& args, int index, int& out) {
+    if (index >= args.argc) return false;
+    char* end = nullptr;
+    long v = strtol(args.argv[index], &end, 10);
+    if (end == args.argv[index] || *end != '\0') return false;
+    out = (int)v;
+    return true;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Portable framing helpers (also compiled into the host client).
+#include <controlFrame.h>
+
+uint16_t controlCrc16(const uint8_t* data, size_t length, uint16_t crc) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t codeIndex = 0;
+    size_t outIndex = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[outIndex++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[codeIndex] = code;
+            code = 1;
+            codeIndex = outIndex++;
+        }
+    }
+    out[codeIndex] = code;
+    return outIndex;
+}
+
+bool cobsDecode(const uint8_t* in, size_t length, uint8_t* out, size_t outSize, size_t& outLength) {
+    size_t inIndex = 0;
+    outLength = 0;
+    while (inIndex < length) {
+        uint8_t code = in[inIndex++];
+        if (code == 0) return false;
+        for (uint8_t i = 1; i < code; i++) {
+            if (inIndex >= length || in[inIndex] == 0 || outLength >= outSize) return false;
+            out[outLength++] = in[inIndex++];
+        }
+        // A block shorter than 0xFF stands for a zero, except at the very end
+        if (code != 0xFF && inIndex < length) {
+            if (outLength >= outSize) return false;
+            out[outLength++] = 0;
+        }
+    }
+    return true;
+}
+
+size_t controlFrameSeal(uint8_t* frame, size_t length) {
+    uint16_t crc = controlCrc16(frame, length);
+    frame[length++] = (uint8_t)(crc & 0xFF);
+    frame[length++] = (uint8_t)(crc >> 8);
+    return length;
+}
+
+bool controlFrameValid(const uint8_t* frame, size_t length) {
+    if (length < CONTROL_FRAME_MIN_LEN) return false;
+    uint16_t expected = (uint16_t)frame[length - 2] | ((uint16_t)frame[length - 1] << 8);
+    return controlCrc16(frame, length - CONTROL_FRAME_CRC_LEN) == expected;
+}
+
+size_t controlFrameToWire(const uint8_t* frame, size_t length, uint8_t* wire, size_t wireSize) {
+    if (wireSize < COBS_MAX_ENCODED_LEN(length) + 2) return 0;
+    wire[0] = 0x00;
+    size_t encoded = cobsEncode(frame, length, wire + 1);
+    wire[1 + encoded] = 0x00;
+    return encoded + 2;
+}
@@ -0,0 +1,319 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <debug.h>
+#include <relayControl.h>
+#include <commandSender.h>
+#include <deferredLog.h>
+#include <nvsManager.h>
+#include <controlProtocol.h>
+#include <hal.h>
+
+// Receive state: encoded bytes of the frame in progress (without delimiters)
+static uint8_t rxEncoded[COBS_MAX_ENCODED_LEN(CONTROL_FRAME_MAX_LEN)];
+static size_t rxLength = 0;
+static bool rxActive = false;
+static uint32_t rxLastMs = 0;
+static ControlProtocolStats protoStats = {0, 0, 0, 0, 0, 0};
+static ControlOutput output = halConsoleWrite;
+
+static inline void putU32(uint8_t* out, uint32_t v) {
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)(v >> 16);
+    out[3] = (uint8_t)(v >> 24);
+}
+
+typedef uint8_t (*ControlOpHandler)(const uint8_t* req, size_t len, uint8_t* resp, size_t respSize, size_t& respLen);
+
+struct ControlOp {
+    uint8_t opcode;
+    uint8_t minLength;
+    uint8_t maxLength;      // 0xFF = up to CONTROL_FRAME_MAX_PAYLOAD
+    ControlOpHandler handler;
+};
+
+// ---- Handlers ----
+static uint8_t handlePing(const uint8_t*, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+    if (respSize < 5) return CTRL_STATUS_FAILED;
+    resp[0] = CONTROL_PROTOCOL_VERSION;
+    putU32(resp + 1, millis());
+    respLen = 5;
+    return CTRL_STATUS_OK;
+}
+
+// [uptime u32][free heap u32][min free heap u32][clients][relay ch][relay mask][log level]
+// [frames ok u32][crc errors u32][framing errors u32][deferred log dropped u32]
+// (framing errors include frames dropped on overflow or byte timeout)
+static uint8_t handleStats(const uint8_t*, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+    if (respSize < 32) return CTRL_STATUS_FAILED;
+    putU32(resp + 0, millis());
+    putU32(resp + 4, getFreeHeap());
+    putU32(resp + 8, getMinFreeHeap());
+    resp[12] = (uint8_t)numClients;
+#if HAS_RELAY_OUTPUTS
+    resp[13] = getCurrentRelayChannel();
+    resp[14] = getRelayMask();
+#else
+    resp[13] = 0;
+    resp[14] = 0;
+#endif
+    resp[15] = (uint8_t)currentLogLevel;
+    putU32(resp + 16, protoStats.framesOk);
+    putU32(resp + 20, protoStats.crcErrors);
+    putU32(resp + 24, protoStats.framingErrors + protoStats.overflows + protoStats.timeouts);
+    putU32(resp + 28, getDeferredLogDropped());
+    respLen = 32;
+    return CTRL_STATUS_OK;
+}
+
+static uint8_t relayState(uint8_t* resp, size_t respSize, size_t& respLen) {
+#if HAS_RELAY_OUTPUTS
+    if (respSize < 2) return CTRL_STATUS_FAILED;
+    resp[0] = getCurrentRelayChannel();
+    resp[1] = getRelayMask();
+    respLen = 2;
+    return CTRL_STATUS_OK;
+#else
+    return CTRL_STATUS_UNSUPPORTED;
+#endif
+}
+
+static uint8_t handleRelaySet(const uint8_t* req, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+#if HAS_RELAY_OUTPUTS
+    if (req[0] > MAX_RELAY_CHANNELS) return CTRL_STATUS_BAD_ARGUMENT;
+    if (req[0] > 0 && relayOutputPins[req[0] - 1] == 255) return CTRL_STATUS_BAD_ARGUMENT;
+    setRelayChannel(req[0]);
+#endif
+    return relayState(resp, respSize, respLen);
+}
+
+static uint8_t handleRelayMask(const uint8_t* req, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+#if HAS_RELAY_OUTPUTS
+    setRelayMask(req[0]);
+#endif
+    return relayState(resp, respSize, respLen);
+}
+
+static uint8_t handleRelayGet(const uint8_t*, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+    return relayState(resp, respSize, respLen);
+}
+
+static bool validCommandType(uint8_t type) {
+    return type == PROGRAM_CHANGE || type == ALL_CHANNELS_OFF || type == STATUS_REQUEST;
+}
+
+static uint8_t handleSendClient(const uint8_t* req, size_t, uint8_t*, size_t, size_t&) {
+    if (req[0] >= numClients || !validCommandType(req[1])) return CTRL_STATUS_BAD_ARGUMENT;
+    return sendCommandToClient(clientMacAddresses[req[0]], req[1], req[2]) ? CTRL_STATUS_OK : CTRL_STATUS_FAILED;
+}
+
+static uint8_t handleSendAll(const uint8_t* req, size_t, uint8_t*, size_t, size_t&) {
+    if (!validCommandType(req[0])) return CTRL_STATUS_BAD_ARGUMENT;
+    return sendCommandToAllClients(req[0], req[1]) ? CTRL_STATUS_OK : CTRL_STATUS_FAILED;
+}
+
+static uint8_t handleMapGet(const uint8_t*, size_t, uint8_t* resp, size_t respSize, size_t& respLen) {
+    size_t needed = 3 + MAX_RELAY_CHANNELS + serverButtonCount;
+    if (respSize < needed) return CTRL_STATUS_FAILED;
+    size_t n = 0;
+    resp[n++] = serverMidiChannel;
+    resp[n++] = MAX_RELAY_CHANNELS;
+    memcpy(resp + n, serverMidiChannelMap, MAX_RELAY_CHANNELS);
+    n += MAX_RELAY_CHANNELS;
+    resp[n++] = serverButtonCount;
+    memcpy(resp + n, serverButtonProgramMap, serverButtonCount);
+    n += serverButtonCount;
+    respLen = n;
+    return CTRL_STATUS_OK;
+}
+
+// Map edits only change RAM; CTRL_OP_MAP_SAVE persists them so a batch of edits costs one NVS write
+static uint8_t handleMapSetRelay(const uint8_t* req, size_t, uint8_t*, size_t, size_t&) {
+    if (req[0] >= MAX_RELAY_CHANNELS || req[1] > 127) return CTRL_STATUS_BAD_ARGUMENT;
+    serverMidiChannelMap[req[0]] = req[1];
+    return CTRL_STATUS_OK;
+}
+
+static uint8_t handleMapSetButton(const uint8_t* req, size_t, uint8_t*, size_t, size_t&) {
+    if (req[0] >= serverButtonCount || req[1] > 127) return CTRL_STATUS_BAD_ARGUMENT;
+    serverButtonProgramMap[req[0]] = req[1];
+    return CTRL_STATUS_OK;
+}
+
+static uint8_t handleMidiChannel(const uint8_t* req, size_t, uint8_t*, size_t, size_t&) {
+    if (req[0] > 16) return CTRL_STATUS_BAD_ARGUMENT;
+    serverMidiChannel = req[0];
+    return CTRL_STATUS_OK;
+}
+
+static uint8_t handleMapSave(const uint8_t*, size_t, uint8_t*, size_t, size_t&) {
+    saveServerMidiChannelToNVS();
+    saveServerMidiMapToNVS();
+    saveServerButtonPcMapToNVS();
+    return flushNVSCache() ? CTRL_STATUS_OK : CTRL_STATUS_FAILED;
+}
+
+static uint8_t handleBatch(const uint8_t* req, size_t len, uint8_t* resp, size_t respSize, size_t& respLen);
+
+static const ControlOp controlOps[] = {
+    {CTRL_OP_PING,           0, 0,    handlePing},
+    {CTRL_OP_STATS,          0, 0,    handleStats},
+    {CTRL_OP_RELAY_SET,      1, 1,    handleRelaySet},
+    {CTRL_OP_RELAY_MASK,     1, 1,    handleRelayMask},
+    {CTRL_OP_RELAY_GET,      0, 0,    handleRelayGet},
+    {CTRL_OP_SEND_CLIENT,    3, 3,    handleSendClient},
+    {CTRL_OP_SEND_ALL,       2, 2,    handleSendAll},
+    {CTRL_OP_MAP_GET,        0, 0,    handleMapGet},
+    {CTRL_OP_MAP_SET_RELAY,  2, 2,    handleMapSetRelay},
+    {CTRL_OP_MAP_SET_BUTTON, 2, 2,    handleMapSetButton},
+    {CTRL_OP_MIDI_CHANNEL,   1, 1,    handleMidiChannel},
+    {CTRL_OP_MAP_SAVE,       0, 0,    handleMapSave},
+    {CTRL_OP_BATCH,          0, 0xFF, handleBatch},
+};
+
+uint8_t controlProtocolExecute(uint8_t opcode, const uint8_t* payload, size_t length,
+                               uint8_t* response, size_t responseSize, size_t& responseLength) {
+    responseLength = 0;
+    for (size_t i = 0; i < sizeof(controlOps) / sizeof(controlOps[0]); i++) {
+        const ControlOp& op = controlOps[i];
+        if (op.opcode != opcode) continue;
+        if (length < op.minLength || (op.maxLength != 0xFF && length > op.maxLength)) return CTRL_STATUS_BAD_LENGTH;
+        return op.handler(payload, length, response, responseSize, responseLength);
+    }
+    protoStats.unknownOpcodes++;
+    return CTRL_STATUS_UNKNOWN_OPCODE;
+}
+
+// Entries run in order; each reports its own status (response data of entries is not returned)
+static uint8_t handleBatch(const uint8_t* req, size_t len, uint8_t* resp, size_t respSize, size_t& respLen) {
+    uint8_t scratch[48];
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        if (pos + 2 > len || pos + 2 + req[pos + 1] > len) return CTRL_STATUS_BAD_LENGTH;
+        if (1 + count >= respSize) return CTRL_STATUS_FAILED;
+        uint8_t opcode = req[pos];
+        uint8_t entryLength = req[pos + 1];
+        size_t scratchLength;
+        uint8_t status = (opcode == CTRL_OP_BATCH)
+            ? (uint8_t)CTRL_STATUS_BAD_ARGUMENT // no nesting
+            : controlProtocolExecute(opcode, req + pos + 2, entryLength, scratch, sizeof(scratch), scratchLength);
+        resp[1 + count++] = status;
+        pos += 2 + entryLength;
+    }
+    resp[0] = (uint8_t)count;
+    respLen = 1 + count;
+    return CTRL_STATUS_OK;
+}
+
+// ---- Framing ----
+static void sendResponse(uint16_t seq, uint8_t opcode, uint8_t status, const uint8_t* payload, size_t length) {
+    uint8_t frame[CONTROL_FRAME_MAX_LEN];
+    uint8_t wire[CONTROL_WIRE_MAX_LEN];
+    if (length > CONTROL_FRAME_MAX_PAYLOAD - 1) length = CONTROL_FRAME_MAX_PAYLOAD - 1;
+    frame[0] = (uint8_t)seq;
+    frame[1] = (uint8_t)(seq >> 8);
+    frame[2] = opcode | CONTROL_RESPONSE_FLAG;
+    frame[3] = status;
+    memcpy(frame + 4, payload, length);
+    size_t frameLength = controlFrameSeal(frame, 4 + length);
+    size_t wireLength = controlFrameToWire(frame, frameLength, wire, sizeof(wire));
+    // One write per frame so log output from other tasks cannot split it
+    output(wire, wireLength);
+}
+
+static void handleFrame() {
+    uint8_t frame[CONTROL_FRAME_MAX_LEN];
+    size_t frameLength;
+    if (!cobsDecode(rxEncoded, rxLength, frame, sizeof(frame), frameLength) || frameLength < CONTROL_FRAME_MIN_LEN) {
+        protoStats.framingErrors++;
+        return;
+    }
+    if (!controlFrameValid(frame, frameLength)) {
+        protoStats.crcErrors++;
+        return; // No reply: the seq itself cannot be trusted, the host times out and retries
+    }
+    uint16_t seq = (uint16_t)frame[0] | ((uint16_t)frame[1] << 8);
+    uint8_t opcode = frame[2];
+    protoStats.framesOk++;
+
+    uint8_t response[CONTROL_FRAME_MAX_PAYLOAD - 1];
+    size_t responseLength = 0;
+    uint8_t status = controlProtocolExecute(opcode, frame + CONTROL_FRAME_HEADER_LEN,
+                                            frameLength - CONTROL_FRAME_MIN_LEN,
+                                            response, sizeof(response), responseLength);
+    sendResponse(seq, opcode, status, response, responseLength);
+}
+
+bool controlProtocolReceiving() {
+    return rxActive;
+}
+
+void controlProtocolRxByte(uint8_t c) {
+    if (!rxActive) {
+        if (c == 0x00) {
+            rxActive = true;
+            rxLength = 0;
+            rxLastMs = millis();
+        }
+        return;
+    }
+    rxLastMs = millis();
+    if (c != 0x00) {
+        if (rxLength < sizeof(rxEncoded)) {
+            rxEncoded[rxLength++] = c;
+            return;
+        }
+        // Longer than any frame: noise or text after a stray 0x00
+        protoStats.overflows++;
+        rxActive = false;
+        logf(LOG_WARN, "Control frame longer than %d bytes dropped", (int)sizeof(rxEncoded));
+        return;
+    }
+    if (rxLength == 0) return; // Back-to-back delimiters: still waiting for a frame
+    handleFrame();
+    rxActive = false;
+}
+
+void controlProtocolPoll() {
+    if (!rxActive || millis() - rxLastMs < CONTROL_FRAME_BYTE_TIMEOUT_MS) return;
+    protoStats.timeouts++;
+    rxActive = false;
+    logf(LOG_WARN, "Control frame dropped after %u bytes: nothing for %d ms", (unsigned)rxLength,
+         CONTROL_FRAME_BYTE_TIMEOUT_MS);
+}
+
+void controlProtocolSetOutput(ControlOutput sink) {
+    output = sink ? sink : halConsoleWrite;
+}
+
+const ControlProtocolStats& getControlProtocolStats() {
+    return protoStats;
+}
+
+void printControlProtocolStats() {
+    log(LOG_INFO, "=== CONTROL PROTOCOL ===");
+    logf(LOG_INFO, "Frames OK: %lu", (unsigned long)protoStats.framesOk);
+    logf(LOG_INFO, "CRC Errors: %lu", (unsigned long)protoStats.crcErrors);
+    logf(LOG_INFO, "Framing Errors: %lu", (unsigned long)protoStats.framingErrors);
+    logf(LOG_INFO, "Overflows: %lu", (unsigned long)protoStats.overflows);
+    logf(LOG_INFO, "Byte Timeouts: %lu", (unsigned long)protoStats.timeouts);
+    logf(LOG_INFO, "Unknown Opcodes: %lu", (unsigned long)protoStats.unknownOpcodes);
+    log(LOG_INFO, "========================");
+}
@@ -21,13 +21,91 @@
 #include <utils.h>
 #include <debug.h>
 #include <nvsManager.h>
+#include <deferredLog.h>
+#include <controlProtocol.h>
+#include <espnow.h>
+#include <rigState.h>
+#include <ledEngine.h>
 
 // Global variables for memory tracking
 extern uint32_t minFreeHeap;
 
+// ---- Allocation counter (linker-wrapped malloc) ----
+static TaskHandle_t allocCountTask = nullptr;
+static volatile uint32_t allocCalls = 0;
+
+static inline void countAlloc() {
+    if (allocCountTask != nullptr && xTaskGetCurrentTaskHandle() == allocCountTask) allocCalls++;
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    countAlloc();
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    countAlloc();
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    countAlloc();
+    return __real_realloc(ptr, size);
+}
+}
+
+void allocCountStart() {
+    allocCalls = 0;
+    allocCountTask = xTaskGetCurrentTaskHandle();
+}
+
+uint32_t allocCountStop() {
+    allocCountTask = nullptr;
+    return allocCalls;
+}
+
 // Performance metrics (matching client structure)
 PerformanceMetrics perfMetrics = {0, 0, 0, ULONG_MAX, 0, 0};
 
+// Fragmentation history: a fixed ring of periodic heap samples. A growing gap
+// between free heap and the largest free block means the heap is fragmenting.
+struct MemoryFragSample {
+    uint32_t uptimeSec;
+    uint32_t freeBytes;
+    uint32_t largestBlock;
+};
+
+static MemoryFragSample fragSamples[MEMORY_FRAG_SAMPLES];
+static uint16_t fragSampleCount = 0;
+static uint16_t fragSampleNext = 0;
+static unsigned long lastFragSample = 0;
+
+// Percentage of free heap that is not usable as one allocation
+static uint8_t fragPercent(const MemoryFragSample& sample) {
+    if (sample.freeBytes == 0) return 0;
+    return (uint8_t)(100 - (uint64_t)sample.largestBlock * 100 / sample.freeBytes);
+}
+
+static void recordFragSample() {
+    MemoryFragSample& sample = fragSamples[fragSampleNext];
+    sample.uptimeSec = millis() / 1000;
+    sample.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    sample.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    fragSampleNext = (fragSampleNext + 1) % MEMORY_FRAG_SAMPLES;
+    if (fragSampleCount < MEMORY_FRAG_SAMPLES) fragSampleCount++;
+    lastFragSample = millis();
+}
+
+static const MemoryFragSample& fragSampleAt(uint16_t index) {
+    uint16_t oldest = (fragSampleNext + MEMORY_FRAG_SAMPLES - fragSampleCount) % MEMORY_FRAG_SAMPLES;
+    return fragSamples[(oldest + index) % MEMORY_FRAG_SAMPLES];
+}
+
 // Debug and monitoring functions (matching client naming conventions)
 void printDebugInfo() {
     log(LOG_INFO, "=== DEBUG INFORMATION ===");
@@ -37,6 +115,8 @@ void printDebugInfo() {
     printWiFiStats();
     printESPNowStats();
     printNVSStats();
+    printRigState();
+    printControlProtocolStats();
     log(LOG_INFO, "========================");
 }
 
@@ -58,6 +138,7 @@ void printPerformanceMetrics() {
     logf(LOG_INFO, "CPU Frequency: %u MHz", getCpuFrequencyMhz());
     logf(LOG_INFO, "Flash Size: %u bytes", ESP.getFlashChipSize());
     logf(LOG_INFO, "Free Heap: %u bytes", getFreeHeap());
+    logf(LOG_INFO, "Deferred Log Dropped: %lu", (unsigned long)getDeferredLogDropped());
     
     log(LOG_INFO, "==========================");
 }
@@ -77,6 +158,16 @@ void printMemoryAnalysis() {
     
     // Additional heap analysis
     logf(LOG_INFO, "Largest Free Block: %u bytes", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    if (fragSampleCount > 0) {
+        uint8_t lowest = 100, highest = 0;
+        for (uint16_t i = 0; i < fragSampleCount; i++) {
+            uint8_t percent = fragPercent(fragSampleAt(i));
+            if (percent < lowest) lowest = percent;
+            if (percent > highest) highest = percent;
+        }
+        logf(LOG_INFO, "Fragmentation: %u%% now, %u-%u%% over %u samples ('memory frag' for history)",
+             fragPercent(fragSampleAt(fragSampleCount - 1)), lowest, highest, fragSampleCount);
+    }
     
     // Memory leak detection
     if (minFreeHeap < (totalHeap * 0.2)) { // Less than 20% free at minimum
@@ -86,6 +177,24 @@ void printMemoryAnalysis() {
     log(LOG_INFO, "======================");
 }
 
+void printMemoryFragmentation() {
+    recordFragSample();
+    log(LOG_INFO, "=== HEAP FRAGMENTATION ===");
+    logf(LOG_INFO, "Sampled every %lu s, last %u samples:", (unsigned long)(MEMORY_FRAG_SAMPLE_INTERVAL_MS / 1000), fragSampleCount);
+    log(LOG_INFO, "  Uptime      Free   Largest  Frag");
+    for (uint16_t i = 0; i < fragSampleCount; i++) {
+        const MemoryFragSample& sample = fragSampleAt(i);
+        char uptime[16];
+        formatUptimeString((unsigned long)sample.uptimeSec * 1000, uptime, sizeof(uptime));
+        logf(LOG_INFO, "  %s %7u %9u %4u%%", uptime, sample.freeBytes, sample.largestBlock, fragPercent(sample));
+    }
+    const MemoryFragSample& first = fragSampleAt(0);
+    const MemoryFragSample& last = fragSampleAt(fragSampleCount - 1);
+    logf(LOG_INFO, "Change since first sample: free %+ld bytes, largest block %+ld bytes",
+         (long)last.freeBytes - (long)first.freeBytes, (long)last.largestBlock - (long)first.largestBlock);
+    log(LOG_INFO, "==========================");
+}
+
 void printWiFiStats() {
     log(LOG_INFO, "=== WIFI STATISTICS ===");
     
@@ -124,8 +233,20 @@ void printESPNowStats() {
         logf(LOG_INFO, "Pairing Timeout: %lu seconds remaining", remaining);
     }
     
+    const EspNowRxStats& rx = getEspNowRxStats();
+    uint32_t rejected = 0;
+    for (int reason = ESPNOW_RX_OK + 1; reason < ESPNOW_RX_REASON_COUNT; reason++) rejected += rx.rejected[reason];
+    logf(LOG_INFO, "Frames Received: %lu accepted, %lu rejected", (unsigned long)rx.accepted, (unsigned long)rejected);
+    for (int reason = ESPNOW_RX_OK + 1; reason < ESPNOW_RX_REASON_COUNT; reason++) {
+        if (rx.rejected[reason] > 0) {
+            logf(LOG_INFO, "  %s: %lu", espNowRejectName(reason), (unsigned long)rx.rejected[reason]);
+        }
+    }
+    
     logf(LOG_INFO, "Footswitch Status: %s", footswitchPressed ? "PRESSED" : "RELEASED");
     logf(LOG_INFO, "OTA Trigger: %s", serialOtaTrigger ? "ACTIVE" : "INACTIVE");
+    logf(LOG_INFO, "LED Pattern: %s (%lu steps since boot)", ledPatternName(getLedPattern()),
+         (unsigned long)getLedStepCount());
     
     log(LOG_INFO, "==========================");
 }
@@ -193,6 +314,9 @@ void updateMemoryStats() {
     if (currentFree < minFreeHeap) {
         minFreeHeap = currentFree;
     }
+    if (fragSampleCount == 0 || millis() - lastFragSample >= MEMORY_FRAG_SAMPLE_INTERVAL_MS) {
+        recordFragSample();
+    }
 }
 
 uint32_t getFreeHeap() {
@@ -251,6 +375,8 @@ void handleDebugCommand(const char* cmd) {
         printDebugInfo();
     } else if (strcmp(cmd, "debugperf") == 0) {
         printPerformanceMetrics();
+    } else if (strcmp(cmd, "debuglog") == 0) {
+        printDeferredLogStats();
     } else if (strcmp(cmd, "debugmemory") == 0) {
         printMemoryAnalysis();
     } else if (strcmp(cmd, "debugwifi") == 0) {
@@ -271,6 +397,7 @@ void printDebugHelp() {
     log(LOG_INFO, "=== DEBUG COMMANDS ===");
     log(LOG_INFO, "debug       - Complete debug info");
     log(LOG_INFO, "debugperf   - Performance metrics");
+    log(LOG_INFO, "debuglog    - Deferred log ring stats");
     log(LOG_INFO, "debugmemory - Memory analysis");
     log(LOG_INFO, "debugwifi   - WiFi statistics");
     log(LOG_INFO, "debugespnow - ESP-NOW statistics");
@@ -0,0 +1,218 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <atomic>
+#include <globals.h>
+#include <utils.h>
+#include <deferredLog.h>
+
+#if (DEFERRED_LOG_SLOTS & (DEFERRED_LOG_SLOTS - 1)) != 0
+#error "DEFERRED_LOG_SLOTS must be a power of two"
+#endif
+
+// Bounded multi-producer / single-consumer ring (Vyukov sequence-per-cell scheme).
+// Producers claim a cell with one CAS on the enqueue index; nothing ever blocks.
+// Sequences are stored relative to the cell index so the zero-initialised ring is
+// already valid and records logged before initDeferredLog() are kept.
+struct DeferredLogCell {
+    std::atomic<uint32_t> sequence;
+    DeferredLogEntry entry;
+};
+
+static DeferredLogCell logRing[DEFERRED_LOG_SLOTS];
+static std::atomic<uint32_t> enqueuePos(0);
+static uint32_t dequeuePos = 0;                // Only touched by the drain task
+static std::atomic<uint32_t> droppedRecords(0);
+static std::atomic<uint32_t> queuedRecords(0);
+static uint32_t reportedDropped = 0;
+static uint32_t maxBacklog = 0;
+#ifndef NATIVE_BUILD
+static TaskHandle_t drainTaskHandle = nullptr;
+#endif
+
+void deferredLogCapture(DeferredLogEntry& e, const char* s) {
+    DeferredArgValue a;
+    a.u = e.stringUsed;
+    if (s == nullptr) s = "(null)";
+    size_t room = DEFERRED_LOG_STRING_BYTES - e.stringUsed;
+    if (room == 0) {
+        a.u = DEFERRED_LOG_STRING_BYTES - 1; // points at a terminator written below
+    } else {
+        size_t n = strnlen(s, room - 1);
+        memcpy(&e.strings[e.stringUsed], s, n);
+        e.strings[e.stringUsed + n] = '\0';
+        e.stringUsed += n + 1;
+    }
+    e.strings[DEFERRED_LOG_STRING_BYTES - 1] = '\0';
+    deferredLogAdd(e, DLOG_ARG_STR, a);
+}
+
+bool deferredLogPush(const DeferredLogEntry& entry) {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t index = pos & (DEFERRED_LOG_SLOTS - 1);
+        DeferredLogCell& cell = logRing[index];
+        uint32_t seq = cell.sequence.load(std::memory_order_acquire) + index;
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.entry = entry;
+                cell.sequence.store(pos + 1 - index, std::memory_order_release);
+                queuedRecords.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        } else if (diff < 0) {
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            return false; // Ring full - never wait on the hot path
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+static bool popEntry(DeferredLogEntry& out) {
+    uint32_t index = dequeuePos & (DEFERRED_LOG_SLOTS - 1);
+    DeferredLogCell& cell = logRing[index];
+    uint32_t seq = cell.sequence.load(std::memory_order_acquire) + index;
+    if ((int32_t)(seq - (dequeuePos + 1)) < 0) return false;
+    out = cell.entry;
+    cell.sequence.store(dequeuePos + DEFERRED_LOG_SLOTS - index, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+// Format one conversion spec with the captured argument, casting to what the spec expects
+static int formatArg(char* out, size_t size, const char* spec, char conv, const char* lengthMod,
+                     const DeferredLogEntry& e, uint8_t index) {
+    if (index >= e.argCount) return snprintf(out, size, "<?>");
+    uint8_t kind = e.kinds[index];
+    const DeferredArgValue& v = e.values[index];
+
+    if (conv == 's') {
+        const char* s = (kind == DLOG_ARG_STR) ? &e.strings[v.u] : "<?>";
+        return snprintf(out, size, spec, s);
+    }
+    if (conv == 'p') {
+        return snprintf(out, size, spec, (kind == DLOG_ARG_PTR) ? v.p : nullptr);
+    }
+
+    bool isFloatConv = strchr("fFeEgGaA", conv) != nullptr;
+    long long asInt;
+    double asDouble;
+    switch (kind) {
+        case DLOG_ARG_INT:    asInt = v.i;              asDouble = v.i; break;
+        case DLOG_ARG_UINT:   asInt = v.u;              asDouble = v.u; break;
+        case DLOG_ARG_INT64:  asInt = v.i64;            asDouble = (double)v.i64; break;
+        case DLOG_ARG_UINT64: asInt = (long long)v.u64; asDouble = (double)v.u64; break;
+        case DLOG_ARG_DOUBLE: asInt = (long long)v.d;   asDouble = v.d; break;
+        default:              asInt = 0;                asDouble = 0; break;
+    }
+    if (isFloatConv) return snprintf(out, size, spec, asDouble);
+    if (strcmp(lengthMod, "ll") == 0 || strcmp(lengthMod, "j") == 0) return snprintf(out, size, spec, asInt);
+    if (strcmp(lengthMod, "l") == 0) return snprintf(out, size, spec, (long)asInt);
+    if (strcmp(lengthMod, "z") == 0) return snprintf(out, size, spec, (size_t)asInt);
+    return snprintf(out, size, spec, (int)asInt);
+}
+
+static void formatEntry(const DeferredLogEntry& e, char* out, size_t size) {
+    size_t used = 0;
+    uint8_t argIndex = 0;
+    const char* f = e.format;
+    while (*f && used + 1 < size) {
+        if (*f != '%') { out[used++] = *f++; continue; }
+        if (f[1] == '%') { out[used++] = '%'; f += 2; continue; }
+
+        // Collect "%[flags][width][.precision][length]conv"
+        char spec[16];
+        char lengthMod[3] = {0};
+        size_t specLen = 0;
+        spec[specLen++] = *f++;
+        while (*f && strchr("-+ #0123456789.*", *f) && specLen < sizeof(spec) - 4) spec[specLen++] = *f++;
+        size_t lenStart = 0;
+        while (*f && strchr("hljzt", *f) && lenStart < 2) {
+            lengthMod[lenStart++] = *f;
+            spec[specLen++] = *f++;
+        }
+        if (!*f) break;
+        char conv = *f++;
+        spec[specLen++] = conv;
+        spec[specLen] = '\0';
+        if (strcmp(lengthMod, "hh") == 0 || strcmp(lengthMod, "h") == 0) lengthMod[0] = '\0';
+
+        int n = formatArg(out + used, size - used, spec, conv, lengthMod, e, argIndex++);
+        if (n > 0) used += ((size_t)n < size - used) ? (size_t)n : size - used - 1;
+    }
+    out[used] = '\0';
+}
+
+void flushDeferredLog() {
+    DeferredLogEntry entry;
+    char message[256];
+    uint32_t backlog = enqueuePos.load(std::memory_order_relaxed) - dequeuePos;
+    if (backlog > maxBacklog) maxBacklog = backlog;
+
+    while (popEntry(entry)) {
+        formatEntry(entry, message, sizeof(message));
+        writeLogLine(entry.timestamp, (LogLevel)entry.level, message);
+    }
+
+    uint32_t dropped = droppedRecords.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped) {
+        logf(LOG_WARN, "Deferred log: %lu records dropped (ring full)", (unsigned long)(dropped - reportedDropped));
+        reportedDropped = dropped;
+    }
+}
+
+#ifndef NATIVE_BUILD
+static void deferredLogTask(void* param) {
+    (void)param;
+    for (;;) {
+        flushDeferredLog();
+        vTaskDelay(pdMS_TO_TICKS(DEFERRED_LOG_DRAIN_INTERVAL_MS));
+    }
+}
+#endif
+
+// The native build has no drain task; its runner calls flushDeferredLog() itself
+void initDeferredLog() {
+#ifndef NATIVE_BUILD
+    if (drainTaskHandle != nullptr) return;
+    // The loop task never blocks, so a lower priority would never run: share its
+    // priority and take round-robin slices between the drain delays
+    xTaskCreate(deferredLogTask, "logDrain", 4096, nullptr, uxTaskPriorityGet(nullptr), &drainTaskHandle);
+#endif
+    logf(LOG_DEBUG, "Deferred log ready (%d slots, %u bytes)", DEFERRED_LOG_SLOTS, (unsigned)sizeof(logRing));
+}
+
+uint32_t getDeferredLogDropped() {
+    return droppedRecords.load(std::memory_order_relaxed);
+}
+
+uint32_t getDeferredLogQueued() {
+    return queuedRecords.load(std::memory_order_relaxed);
+}
+
+uint32_t getDeferredLogBacklog() {
+    return enqueuePos.load(std::memory_order_relaxed) - __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED);
+}
+
+void printDeferredLogStats() {
+    log(LOG_INFO, "=== DEFERRED LOG ===");
+    logf(LOG_INFO, "Ring Slots: %d (%u bytes)", DEFERRED_LOG_SLOTS, (unsigned)sizeof(logRing));
+    logf(LOG_INFO, "Records Queued: %lu", (unsigned long)getDeferredLogQueued());
+    logf(LOG_INFO, "Records Dropped: %lu", (unsigned long)getDeferredLogDropped());
+    logf(LOG_INFO, "Peak Backlog: %lu", (unsigned long)maxBacklog);
+    log(LOG_INFO, "====================");
+}
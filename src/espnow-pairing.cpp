@@ -12,15 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-#include <esp_now.h>
-#include <esp_wifi.h>
-#include <esp_wifi_types.h>
 #include <globals.h>
-#include <datastructs.h>
+#include <dataStructs.h>
 #include <utils.h>
+#include <deferredLog.h>
+#include <ledEngine.h>
+#include <hal.h>
 
 
-esp_now_peer_info_t slave;
 // Old button variables - now handled in commandHandler.cpp
 // volatile unsigned long buttonPressTime = 0;
 // unsigned long lastButtonEvent = 0;
@@ -45,15 +44,10 @@ void IRAM_ATTR pairingButtonISR() {
 }
 */
 
-void setupPairingButtonAndLED() {
-  pinMode(PAIRING_BUTTON_PIN, INPUT_PULLUP);
+void setupPairingButton() {
+  halPinMode(PAIRING_BUTTON_PIN, HAL_PIN_INPUT_PULLUP);
   // No longer using interrupt-based handling - using polling in checkPairingButtons()
-  pinMode(PAIRING_LED_PIN, OUTPUT);
-  digitalWrite(PAIRING_LED_PIN, LOW);
-  
-  // Initialize LED system
-  ledcSetup(LEDC_CHANNEL_0, LEDC_BASE_FREQ, LEDC_TIMER_13_BIT);
-  ledcAttachPin(PAIRING_LED_PIN, LEDC_CHANNEL_0);
+  // The LED pin is owned by the LED engine (initLedEngine() in setup)
 }
 
 // Old button handling function - replaced with sophisticated system in commandHandler.cpp
@@ -68,12 +62,12 @@ void handlePairingButtonPress() {
     } else {
       if (resetMode) {
         //clearPeers(true);
-        log(LOG_DEBUG, "Peers cleared (long press).");
+        LOG(LOG_DEBUG, "Peers cleared (long press).");
       } else {
         pairingRequested = true;
         pairingMode = true;
         pairingStartTime = millis();
-        log(LOG_DEBUG, "Pairing mode enabled (short press).");
+        LOG(LOG_DEBUG, "Pairing mode enabled (short press).");
       }
       buttonPressTime = 0;
       resetMode = false;
@@ -86,7 +80,8 @@ void pairingforceStart(){
   pairingRequested = true;
   pairingMode = true;
   pairingStartTime = millis();
-  log(LOG_DEBUG, "Pairing mode enabled (forced).");
+  setLedPattern(LED_FADE);
+  LOG(LOG_DEBUG, "Pairing mode enabled (forced).");
 }
 
 
@@ -99,106 +94,11 @@ void pairingforceStart(){
 void checkPairingTimeout() {
   if (pairingMode && (millis() - pairingStartTime > PAIRING_TIMEOUT_MS)) {
     pairingMode = false;
+    setLedPattern(serialOtaTrigger ? LED_FAST_BLINK : LED_OFF);
     log(LOG_INFO, "Pairing mode DISABLED (timeout)");
   }
 }
 
-void updatePairingLED() {
-    static uint16_t fadeValue = 0;
-    static int8_t fadeDirection = 1;
-    static unsigned long lastUpdate = 0;
-    static bool ledState = LOW;
-    static unsigned long lastFadeUpdate = 0;
-    unsigned long now = millis();
-
-    // Only override patterns during active pairing phases, not when paired
-    if (pairingMode) {
-        if (currentLedPattern != LED_FADE) {
-            currentLedPattern = LED_FADE;
-            ledPatternStart = now;
-            ledPatternStep = 0;
-        }
-    } else if (serialOtaTrigger) {
-        if (currentLedPattern != LED_FAST_BLINK) {
-            currentLedPattern = LED_FAST_BLINK;
-            ledPatternStart = now;
-            ledPatternStep = 0;
-        }
-    }
-
-    switch (currentLedPattern) {
-        case LED_SINGLE_FLASH:
-            if (ledPatternStep == 0) {
-                ledcWrite(LEDC_CHANNEL_0, 8191);
-                if (now - ledPatternStart > 80) { ledPatternStep = 1; ledPatternStart = now; }
-            } else if (ledPatternStep == 1) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-                if (now - ledPatternStart > 120) { currentLedPattern = LED_OFF; }
-            }
-            break;
-        case LED_DOUBLE_FLASH:
-            if (ledPatternStep == 0 || ledPatternStep == 2) {
-                ledcWrite(LEDC_CHANNEL_0, 8191);
-                if (now - ledPatternStart > 60) { ledPatternStep++; ledPatternStart = now; }
-            } else if (ledPatternStep == 1 || ledPatternStep == 3) {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-                if (now - ledPatternStart > 60) { ledPatternStep++; ledPatternStart = now; }
-            } else {
-                currentLedPattern = LED_OFF;
-            }
-            break;
-        case LED_TRIPLE_FLASH:
-            if (ledPatternStep % 2 == 0) {
-                ledcWrite(LEDC_CHANNEL_0, 8191);
-            } else {
-                ledcWrite(LEDC_CHANNEL_0, 0);
-            }
-            if (now - ledPatternStart > 50) {
-                ledPatternStep++;
-                ledPatternStart = now;
-            }
-            if (ledPatternStep > 5) {
-                currentLedPattern = LED_OFF;
-            }
-            break;
-        case LED_FAST_BLINK:
-            ledcWrite(LEDC_CHANNEL_0, (now / 100) % 2 ? 8191 : 0);
-            break;
-        case LED_SOLID_ON:
-            ledcWrite(LEDC_CHANNEL_0, 8191);
-            break;
-        case LED_FADE:
-            // Smooth 2-second fade cycle - continuous fade from bottom to top and back
-            if (now - lastFadeUpdate > 20) { // Update every 20ms for smooth fade
-                static bool started = false;
-                
-                if (!started) {
-                    fadeValue = 0; // Start from bottom (off)
-                    fadeDirection = 1; // Start fading up
-                    started = true;
-                }
-                
-                fadeValue += fadeDirection * 20; // Smaller increment for smooth fade
-                
-                if (fadeValue >= 8191) {
-                    fadeValue = 8191;
-                    fadeDirection = -1; // Start fading down
-                } else if (fadeValue <= 0) {
-                    fadeValue = 0;
-                    fadeDirection = 1; // Start fading up
-                }
-                
-                ledcWrite(LEDC_CHANNEL_0, fadeValue);
-                lastFadeUpdate = now;
-            }
-            break;
-        case LED_OFF:
-        default:
-            ledcWrite(LEDC_CHANNEL_0, 0);
-            break;
-    }
-}
-
 bool isPeerAlreadyAdded(const uint8_t *mac_addr) {
   for (int i = 0; i < numClients; i++) {
     if (memcmp(clientMacAddresses[i], mac_addr, 6) == 0) return true;
@@ -207,23 +107,17 @@ bool isPeerAlreadyAdded(const uint8_t *mac_addr) {
 }
 
 bool addPeer(const uint8_t *peer_addr, bool save) {      // add pairing
-  memset(&slave, 0, sizeof(slave));
-  const esp_now_peer_info_t *peer = &slave;
-  memcpy(slave.peer_addr, peer_addr, 6);
-  slave.channel = chan; // pick a channel
-  slave.encrypt = 0; // no encryption
   // check if the peer exists
-  bool exists = esp_now_is_peer_exist(slave.peer_addr);
+  bool exists = halEspNowPeerExists(peer_addr);
   if (exists || numClients >= MAX_CLIENTS) {
-    log(LOG_DEBUG, "Already Paired");
+    LOGQ(LOG_DEBUG, "Already Paired");
     return true;
   }
   if (memcmp(peer_addr, "\0\0\0\0\0\0", 6) == 0) {
-    log(LOG_DEBUG, "Invalid MAC address — not adding.");
+    LOGQ(LOG_DEBUG, "Invalid MAC address — not adding.");
     return false;
   }
-  esp_err_t addStatus = esp_now_add_peer(peer);
-  if (addStatus == ESP_OK) {
+  if (halEspNowAddPeer(peer_addr, chan)) {   // unencrypted, on the shared channel
     // Pair success
     memcpy(clientMacAddresses[numClients], peer_addr, 6);
     numClients++;
@@ -244,11 +138,11 @@ bool addPeer(const uint8_t *peer_addr, bool save) {      // add pairing
     }
     // Keep numClients and numLabeledPeers in sync
     if (numLabeledPeers < numClients) numLabeledPeers = numClients;
-    log(LOG_DEBUG, "Pair success");
+    LOGQ(LOG_DEBUG, "Pair success");
     if (save) savePeersToNVS();
     return true;
   } else {
-    log(LOG_DEBUG, "Pair failed");
+    LOGQ(LOG_DEBUG, "Pair failed");
     return false;
   }
 } 
@@ -12,69 +12,106 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-#include <esp_now.h>
-#include <esp_wifi.h>
-#include <esp_wifi_types.h>
 #include <globals.h>
-#include <datastructs.h>
+#include <dataStructs.h>
 #include <utils.h>
 #include <espnow-pairing.h>
+#include <deferredLog.h>
+#include <rigState.h>
+#include <fwPush.h>
+#include <espnow.h>
+#include <espnowFrame.h>
+#include <espnowCapture.h>
+#include <sessionRecord.h>
+#include <clientMirror.h>
+#include <statusCollector.h>
+#include <sceneEngine.h>
+#include <hal.h>
 
 
 uint8_t clientMacAddress[6];
 
-struct_message incomingReadings;
-
 struct_pairing pairingData;
 
+static_assert(sizeof(struct_message) == ESPNOW_MESSAGE_LEN, "struct_message layout changed");
+static_assert(offsetof(struct_message, readingId) == ESPNOW_MESSAGE_READING_ID, "struct_message layout changed");
+static_assert(offsetof(struct_message, timestamp) == ESPNOW_MESSAGE_TIMESTAMP, "struct_message layout changed");
+static_assert(sizeof(struct_pairing) == ESPNOW_PAIRING_LEN, "struct_pairing layout changed");
+static_assert(offsetof(struct_pairing, macAddr) == ESPNOW_PAIRING_MAC, "struct_pairing layout changed");
+static_assert(offsetof(struct_pairing, name) == ESPNOW_PAIRING_NAME, "struct_pairing layout changed");
+static_assert(PAIRING == ESPNOW_MSG_PAIRING && DATA == ESPNOW_MSG_DATA && COMMAND == ESPNOW_MSG_COMMAND &&
+              FW_PUSH == FW_PUSH_MSG_TYPE, "MessageType values changed");
+
+static EspNowRxStats rxStats;
+
+// ESP-NOW callbacks run in the WiFi task: only the deferred logger (logq) is used here,
+// never Serial directly, so the radio path is not held up by UART output.
+
+static void countRx(EspNowReject reason) {
+  if (reason == ESPNOW_RX_OK) __atomic_fetch_add(&rxStats.accepted, 1, __ATOMIC_RELAXED);
+  else __atomic_fetch_add(&rxStats.rejected[reason], 1, __ATOMIC_RELAXED);
+}
+
+static bool fromKnownPeer(const uint8_t* mac_addr) {
+  if (strcmp(getPeerName(mac_addr), "Unknown") != 0) return true;
+  LOGQ(LOG_INFO, "Rejected DATA from unknown MAC: %02X:%02X:%02X:%02X:%02X:%02X",
+       mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+  return false;
+}
+
+const EspNowRxStats& getEspNowRxStats() {
+  return rxStats;
+}
+
 // callback when data is sent
-void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
-  logf(LOG_DEBUG, "Last Packet Send Status: %s to ", 
-       status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
-  printMAC(mac_addr, LOG_DEBUG);
+void OnDataSent(const uint8_t *mac_addr, bool delivered) {
+  LOGQ(LOG_DEBUG, "Last Packet Send Status: %s to %02X:%02X:%02X:%02X:%02X:%02X",
+       delivered ? "Delivery Success" : "Delivery Fail",
+       mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+  espNowCaptureRecord(CAPTURE_TX_STATUS, mac_addr, nullptr, 0, delivered ? 0 : 1, micros());
+  sessionRecordSent(mac_addr, delivered);
+  rigStateOnSendResult(mac_addr, delivered);
+  clientMirrorOnSendResult(mac_addr, delivered);
+  sceneOnSendResult(mac_addr, delivered);
+  fwPushOnSent(mac_addr, delivered);
 }
 
-void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len) { 
-  logf(LOG_DEBUG, "%d bytes of new data received.", len);
-  String payload;
-  uint8_t type = incomingData[0];       // first message byte is the type of message 
-  switch (type) {
+// Act on a validated frame; returns why it was ignored, or ESPNOW_RX_OK
+static EspNowReject handleFrame(const uint8_t* mac_addr, const EspNowFrame& frame) {
+  switch (frame.type) {
   case COMMAND :
-    if (strcmp(getPeerName(mac_addr), "Unknown") == 0) {
-        log(LOG_INFO, "Rejected DATA from unknown MAC: ");
-        printMAC(mac_addr, LOG_INFO);
-        return;
-    }
-     memcpy(&incomingReadings, incomingData, sizeof(incomingReadings));
-     logf(LOG_DEBUG, "ID: %d", incomingReadings.id);
-     logf(LOG_DEBUG, "Command Type: %d", incomingReadings.commandType);
-     logf(LOG_DEBUG, "Command Value: %d", incomingReadings.commandValue);
-     break;
+    if (!fromKnownPeer(mac_addr)) return ESPNOW_RX_UNKNOWN_PEER;
+    LOGQ(LOG_DEBUG, "ID: %d, Command Type: %d, Command Value: %d",
+         espNowFrameU8(frame, ESPNOW_MESSAGE_ID), espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_TYPE),
+         espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_VALUE));
+    break;
   case DATA :                           // the message is data type
-      if (strcmp(getPeerName(mac_addr), "Unknown") == 0) {
-        log(LOG_INFO, "Rejected DATA from unknown MAC: ");
-        printMAC(mac_addr, LOG_INFO);
-        return;
+    if (!fromKnownPeer(mac_addr)) return ESPNOW_RX_UNKNOWN_PEER;
+    LOGQ(LOG_DEBUG, "ID: %d, Reading ID: %u (event)", espNowFrameU8(frame, ESPNOW_MESSAGE_ID),
+         (unsigned)espNowFrameU32(frame, ESPNOW_MESSAGE_READING_ID));
+    if (espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_TYPE) == STATUS_REQUEST) {   // status reply: current program
+      clientMirrorOnStatus(mac_addr, espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_VALUE));
+      statusCollectorOnReply(mac_addr, frame);
     }
-    memcpy(&incomingReadings, incomingData, sizeof(incomingReadings));
-     logf(LOG_DEBUG, "ID: %d", incomingReadings.id);
-     logf(LOG_DEBUG, "Reading ID: %d", incomingReadings.readingId);
-     log(LOG_DEBUG, "Event send:");
-
     break;
   
+  case FW_PUSH:                         // firmware push status from a client being updated
+    fwPushOnReceive(mac_addr, frame.data, frame.length);
+    break;
+
   case PAIRING:                            // the message is a pairing request 
-   if (!pairingMode) {
-      log(LOG_INFO, "Pairing not enabled - ignored.");
-      return;
+    if (!pairingMode) {
+      LOGQ(LOG_INFO, "Pairing not enabled - ignored.");
+      return ESPNOW_RX_NOT_PAIRING;
     }  
-    memcpy(&pairingData, incomingData, sizeof(pairingData));
-    logf(LOG_DEBUG, "Pairing message type: %d", pairingData.msgType);
-    logf(LOG_DEBUG, "Pairing ID: %d", pairingData.id);
-    log(LOG_INFO, "Pairing request from MAC Address: ");
-    printMAC(pairingData.macAddr, LOG_INFO);
-    logf(LOG_INFO, "Named: %s", pairingData.name);
-  logf(LOG_INFO, "Client was on channel: %d", pairingData.channel);
+    // Copied: pairingData becomes the reply and supplies the peer name to addLabeledPeer()
+    memcpy(&pairingData, frame.data, sizeof(pairingData));
+    pairingData.name[MAX_PEER_NAME_LEN - 1] = '\0';   // the name on the air need not be terminated
+    LOGQ(LOG_DEBUG, "Pairing message type: %d, ID: %d", pairingData.msgType, pairingData.id);
+    LOGQ(LOG_INFO, "Pairing request from %02X:%02X:%02X:%02X:%02X:%02X named %s",
+         pairingData.macAddr[0], pairingData.macAddr[1], pairingData.macAddr[2],
+         pairingData.macAddr[3], pairingData.macAddr[4], pairingData.macAddr[5], pairingData.name);
+    LOGQ(LOG_INFO, "Client was on channel: %d", pairingData.channel);
 
     clientMacAddress[0] = pairingData.macAddr[0];
     clientMacAddress[1] = pairingData.macAddr[1];
@@ -86,28 +123,51 @@ void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len)
     if (pairingData.id > 0) {     // do not replay to server itself
       if (pairingData.msgType == PAIRING) { 
         pairingData.id = 0;       // 0 is server
-        log(LOG_INFO, "Pairing MAC Address: ");
-        printMAC(clientMacAddress, LOG_INFO);
-        esp_wifi_get_mac(WIFI_IF_STA, pairingData.macAddr);
+        halStationMac(pairingData.macAddr);
         pairingData.channel = chan;
-        logf(LOG_INFO, "Server instructs client to switch to channel: %d", chan);
+        LOGQ(LOG_INFO, "Server instructs client to switch to channel: %d", chan);
+        clientMirrorInvalidate(clientMacAddress);   // a re-pairing client has restarted
         addLabeledPeer(clientMacAddress,pairingData.name);
         addPeer(clientMacAddress, true);  // Add to ESP-NOW peer list first
-        esp_err_t result = esp_now_send(clientMacAddress, (uint8_t *) &pairingData, sizeof(pairingData));
-        logf(LOG_INFO, "esp_now_send result: %s (0x%04X)", esp_err_to_name(result), result);
+        int result = espNowSend(clientMacAddress, &pairingData, sizeof(pairingData));
+        LOGQ(LOG_INFO, "esp_now_send result: %s (0x%04X)", halErrName(result), result);
       }  
     }  
     break; 
   }
+  return ESPNOW_RX_OK;
+}
+
+void OnDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len) { 
+  uint32_t rxUs = micros();
+  sessionRecordReceive(mac_addr, incomingData, len);
+  EspNowFrame frame;
+  EspNowReject reason = espNowFrameParse(incomingData, len, frame);
+  if (reason == ESPNOW_RX_OK) {
+    LOGQ(LOG_DEBUG, "%d bytes of new data received.", len);
+    reason = handleFrame(mac_addr, frame);
+  } else {                              // nothing past the valid length has been read
+    LOGQ(LOG_DEBUG, "Dropped %d byte frame: %s", len, espNowRejectName(reason));
+  }
+  countRx(reason);
+  espNowCaptureRecord(CAPTURE_RX, mac_addr, incomingData, len, reason, rxUs);
+}
+
+int espNowSend(const uint8_t* mac, const void* data, size_t len) {
+  uint32_t txUs = micros();
+  clientMirrorOnQueued(mac, (const uint8_t*)data, len);   // in flight before the callback can run
+  int result = halEspNowSend(mac, data, len);
+  if (result != HAL_OK) clientMirrorOnSendRefused(mac);
+  espNowCaptureRecord(CAPTURE_TX, mac, (const uint8_t*)data, (int)len, result == HAL_OK ? 0 : 1, txUs);
+  sessionRecordTx(mac, data, len, result, txUs);
+  return result;
 }
 
 void initESP_NOW(){
     // Init ESP-NOW
-    if (esp_now_init() != ESP_OK) {
+    if (!halEspNowInit(OnDataSent, OnDataRecv)) {
       log(LOG_ERROR, "Error initializing ESP-NOW");
       return;
     }
-    esp_now_register_send_cb(OnDataSent);
-    esp_now_register_recv_cb(esp_now_recv_cb_t(OnDataRecv));
 } 
 
@@ -0,0 +1,145 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <espnowCapture.h>
+
+#if (ESPNOW_CAPTURE_RECORDS & (ESPNOW_CAPTURE_RECORDS - 1)) != 0
+#error "ESPNOW_CAPTURE_RECORDS must be a power of two"
+#endif
+
+// Writers (loop task for TX, WiFi task for RX and send status) claim a cell with
+// one atomic add and overwrite whatever was there. sequence is set to claim + 1
+// after the record is complete; the exporter skips cells whose sequence does not
+// match the position it expects (overwritten or still being written).
+struct CaptureCell {
+    uint32_t sequence;
+    uint32_t timeUs;
+    uint8_t event;
+    uint8_t peer;
+    uint8_t status;
+    uint8_t length;             // Full frame length (capped at 255)
+    uint8_t mac[6];
+    uint8_t data[ESPNOW_CAPTURE_BYTES];
+};
+
+static CaptureCell captureRing[ESPNOW_CAPTURE_RECORDS];
+static uint32_t capturePos = 0;
+static bool capturing = false;
+
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint8_t peerSlot(const uint8_t* mac) {
+    if (memcmp(mac, broadcastMac, 6) == 0) return CAPTURE_PEER_BROADCAST;
+    for (int i = 0; i < numLabeledPeers; i++) {
+        if (memcmp(mac, labeledPeers[i].mac, 6) == 0) return (uint8_t)i;
+    }
+    return CAPTURE_PEER_UNKNOWN;
+}
+
+void espNowCaptureStart() {
+    __atomic_store_n(&capturing, true, __ATOMIC_RELEASE);
+}
+
+void espNowCaptureStop() {
+    __atomic_store_n(&capturing, false, __ATOMIC_RELEASE);
+}
+
+bool espNowCaptureActive() {
+    return __atomic_load_n(&capturing, __ATOMIC_ACQUIRE);
+}
+
+void espNowCaptureClear() {
+    bool wasCapturing = espNowCaptureActive();
+    espNowCaptureStop();
+    delay(2);                   // Let a record being written in the WiFi task finish
+    memset(captureRing, 0, sizeof(captureRing));
+    __atomic_store_n(&capturePos, 0, __ATOMIC_RELAXED);
+    if (wasCapturing) espNowCaptureStart();
+}
+
+void espNowCaptureRecord(uint8_t event, const uint8_t* mac, const uint8_t* data, int length,
+                         uint8_t status, uint32_t timeUs) {
+    if (!__atomic_load_n(&capturing, __ATOMIC_RELAXED)) return;
+    uint32_t pos = __atomic_fetch_add(&capturePos, 1, __ATOMIC_RELAXED);
+    CaptureCell& cell = captureRing[pos & (ESPNOW_CAPTURE_RECORDS - 1)];
+    __atomic_store_n(&cell.sequence, 0, __ATOMIC_RELAXED);
+    cell.timeUs = timeUs;
+    cell.event = event;
+    cell.peer = peerSlot(mac);
+    cell.status = status;
+    if (length < 0 || data == nullptr) length = 0;
+    cell.length = length > 255 ? 255 : (uint8_t)length;
+    memcpy(cell.mac, mac, 6);
+    memcpy(cell.data, data, length < ESPNOW_CAPTURE_BYTES ? length : ESPNOW_CAPTURE_BYTES);
+    __atomic_store_n(&cell.sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+size_t espNowCaptureExport(void (*write)(const void* data, size_t length)) {
+    PcapFileHeader header = {PCAP_MAGIC_US, 2, 4, 0, 0,
+                             (uint32_t)(sizeof(EspNowCapturePseudo) + ESPNOW_CAPTURE_BYTES), PCAP_LINKTYPE_USER0};
+    write(&header, sizeof(header));
+    size_t total = sizeof(header);
+
+    uint32_t end = __atomic_load_n(&capturePos, __ATOMIC_ACQUIRE);
+    uint32_t pos = end > ESPNOW_CAPTURE_RECORDS ? end - ESPNOW_CAPTURE_RECORDS : 0;
+    uint64_t wraps = 0;
+    uint32_t lastUs = 0;
+    for (; pos != end; pos++) {
+        const CaptureCell& cell = captureRing[pos & (ESPNOW_CAPTURE_RECORDS - 1)];
+        if (__atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE) != pos + 1) continue;
+        uint8_t packet[sizeof(PcapRecordHeader) + sizeof(EspNowCapturePseudo) + ESPNOW_CAPTURE_BYTES];
+        size_t kept = cell.length < ESPNOW_CAPTURE_BYTES ? cell.length : ESPNOW_CAPTURE_BYTES;
+
+        // micros() wraps every 71 minutes; records are near enough in order to unwrap
+        if (cell.timeUs < lastUs && lastUs - cell.timeUs > 0x80000000u) wraps++;
+        lastUs = cell.timeUs;
+        uint64_t timeUs = (wraps << 32) | cell.timeUs;
+
+        PcapRecordHeader record = {(uint32_t)(timeUs / 1000000), (uint32_t)(timeUs % 1000000),
+                                   (uint32_t)(sizeof(EspNowCapturePseudo) + kept),
+                                   (uint32_t)(sizeof(EspNowCapturePseudo) + cell.length)};
+        EspNowCapturePseudo pseudo = {cell.event, cell.peer, cell.status, 0, {0}};
+        memcpy(pseudo.mac, cell.mac, 6);
+        memcpy(packet, &record, sizeof(record));
+        memcpy(packet + sizeof(record), &pseudo, sizeof(pseudo));
+        memcpy(packet + sizeof(record) + sizeof(pseudo), cell.data, kept);
+        size_t length = sizeof(record) + sizeof(pseudo) + kept;
+        write(packet, length);  // One write per record
+        total += length;
+    }
+    return total;
+}
+
+void dumpEspNowCapture() {
+    bool wasCapturing = espNowCaptureActive();
+    espNowCaptureStop();
+    writeConsoleBlock("PCAP", espNowCaptureExport);
+    if (wasCapturing) espNowCaptureStart();
+}
+
+void printEspNowCaptureStatus() {
+    uint32_t total = __atomic_load_n(&capturePos, __ATOMIC_RELAXED);
+    log(LOG_INFO, "=== ESP-NOW CAPTURE ===");
+    logf(LOG_INFO, "Capture: %s", espNowCaptureActive() ? "ON" : "OFF");
+    logf(LOG_INFO, "Records: %lu held, %d capacity (%u frame bytes each, %u bytes RAM)",
+         (unsigned long)(total < ESPNOW_CAPTURE_RECORDS ? total : ESPNOW_CAPTURE_RECORDS), ESPNOW_CAPTURE_RECORDS,
+         (unsigned)ESPNOW_CAPTURE_BYTES, (unsigned)sizeof(captureRing));
+    logf(LOG_INFO, "Recorded since clear: %lu (%lu overwritten)", (unsigned long)total,
+         (unsigned long)(total > ESPNOW_CAPTURE_RECORDS ? total - ESPNOW_CAPTURE_RECORDS : 0));
+    log(LOG_INFO, "=======================");
+}
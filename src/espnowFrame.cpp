@@ -0,0 +1,75 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <espnowFrame.h>
+
+static EspNowReject checkFwPush(const uint8_t* data, int length) {
+    if (length < (int)sizeof(FwPushHeader)) return ESPNOW_RX_SHORT;
+    int needed;
+    switch (data[offsetof(FwPushHeader, op)]) {
+        case FW_OP_OFFER:  needed = sizeof(FwPushOffer); break;
+        case FW_OP_CHUNK:  needed = FW_PUSH_CHUNK_HEADER_LEN; break;
+        case FW_OP_STATUS: needed = sizeof(FwPushStatus); break;
+        case FW_OP_POLL:
+        case FW_OP_COMMIT:
+        case FW_OP_ABORT:  needed = sizeof(FwPushHeader); break;
+        default:           return ESPNOW_RX_BAD_OP;
+    }
+    if (length < needed) return ESPNOW_RX_SHORT;
+    if (data[offsetof(FwPushHeader, op)] == FW_OP_OFFER &&
+        data[offsetof(FwPushOffer, version)] != FW_PUSH_PROTOCOL_VERSION) return ESPNOW_RX_BAD_VERSION;
+    return ESPNOW_RX_OK;
+}
+
+EspNowReject espNowFrameParse(const uint8_t* data, int length, EspNowFrame& frame) {
+    frame.data = nullptr;
+    frame.length = 0;
+    frame.type = 0;
+    if (data == nullptr || length <= 0 || length > ESPNOW_MAX_FRAME_LEN) return ESPNOW_RX_BAD_LENGTH;
+
+    EspNowReject result;
+    switch (data[0]) {
+        case ESPNOW_MSG_DATA:
+        case ESPNOW_MSG_COMMAND:
+            result = length < ESPNOW_MESSAGE_LEN ? ESPNOW_RX_SHORT : ESPNOW_RX_OK;
+            break;
+        case ESPNOW_MSG_PAIRING:
+            result = length < ESPNOW_PAIRING_LEN ? ESPNOW_RX_SHORT : ESPNOW_RX_OK;
+            break;
+        case FW_PUSH_MSG_TYPE:
+            result = checkFwPush(data, length);
+            break;
+        default:
+            return ESPNOW_RX_UNKNOWN_TYPE;
+    }
+    if (result != ESPNOW_RX_OK) return result;
+    frame.data = data;
+    frame.length = (uint8_t)length;
+    frame.type = data[0];
+    return ESPNOW_RX_OK;
+}
+
+const char* espNowRejectName(uint8_t reason) {
+    switch (reason) {
+        case ESPNOW_RX_OK:           return "ok";
+        case ESPNOW_RX_BAD_LENGTH:   return "bad length";
+        case ESPNOW_RX_UNKNOWN_TYPE: return "unknown type";
+        case ESPNOW_RX_SHORT:        return "truncated";
+        case ESPNOW_RX_BAD_OP:       return "bad fw op";
+        case ESPNOW_RX_BAD_VERSION:  return "bad fw version";
+        case ESPNOW_RX_UNKNOWN_PEER: return "unknown peer";
+        case ESPNOW_RX_NOT_PAIRING:  return "not pairing";
+        default:                     return "?";
+    }
+}
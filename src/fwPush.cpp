@@ -0,0 +1,606 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <fwPush.h>
+#include <fwPushProtocol.h>
+#include <globals.h>
+#include <utils.h>
+#include <configImage.h>
+#include <deferredLog.h>
+#include <hal.h>
+#include <espnow.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <Update.h>
+
+static_assert(FW_PUSH_MSG_TYPE == FW_PUSH, "FW_PUSH_MSG_TYPE must match MessageType FW_PUSH");
+
+// ---- Staged client image ----
+// Kept in the OTA partition the server is not running from. The first sector
+// holds a descriptor that is written after the image, so an interrupted upload
+// never looks valid. A server OTA update overwrites the staged image.
+#define FW_STAGE_MAGIC 0x54535746u   // "FWST" little endian
+#define FW_STAGE_SECTOR 4096
+#define FW_STAGE_DATA_OFFSET FW_STAGE_SECTOR
+
+struct FwStageHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;                   // CRC-32 of the image (the push session id)
+    uint32_t headerCrc;
+};
+
+static const esp_partition_t* stagePartition = nullptr;
+static volatile bool staging = false;
+static uint32_t stageSize = 0;
+static uint32_t stageCrc = 0;
+static uint32_t stageErased = 0;     // Sectors below this offset are erased
+
+// ---- Push session ----
+enum FwPushPhase : uint8_t {
+    FW_PHASE_IDLE,
+    FW_PHASE_OFFER,                 // Waiting for clients to accept (or resume)
+    FW_PHASE_STREAM,                // Sending the current window
+    FW_PHASE_POLL,                  // Waiting for STATUS after a window
+    FW_PHASE_REPAIR                 // Resending the gaps the clients reported
+};
+
+enum FwTargetState : uint8_t {
+    FW_TARGET_OFFERED,
+    FW_TARGET_RECEIVING,
+    FW_TARGET_STALLED,              // Stopped answering; no longer holds back the window
+    FW_TARGET_DONE,
+    FW_TARGET_REJECTED,
+    FW_TARGET_FAILED
+};
+
+struct FwTarget {
+    uint8_t mac[6];
+    uint8_t state;                  // FwTargetState
+    uint8_t missedPolls;
+    uint8_t failures;
+    bool answered;                  // STATUS received since the last poll
+    uint16_t base;
+    uint64_t received;
+    uint16_t resumedAt;             // Chunks the client already held when it accepted
+    uint32_t startMs;
+    uint32_t doneMs;
+    uint32_t repairs;               // Chunks resent to this client alone
+};
+
+// Latest STATUS per target, handed from the WiFi task to loop(). A reply that
+// arrives before loop() took the previous one is dropped; the next poll repeats it.
+struct FwMailbox {
+    uint8_t full;
+    FwPushStatus status;
+};
+
+struct FwPushCounters {
+    uint32_t streamed;              // First transmissions
+    uint32_t broadcastRepairs;
+    uint32_t unicastRepairs;
+    uint32_t polls;
+    uint32_t sendErrors;
+    uint32_t statusDropped;
+};
+
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static FwTarget targets[MAX_CLIENTS];
+static FwMailbox mailbox[MAX_CLIENTS];
+static int targetCount = 0;
+static volatile uint8_t phase = FW_PHASE_IDLE;
+static uint32_t session = 0;
+static uint32_t imageSize = 0;
+static uint16_t chunkCount = 0;
+static uint16_t windowBase = 0;     // Lowest base of the receiving clients
+static uint16_t sendNext = 0;       // Next chunk never sent in this session
+static uint16_t repairCursor = 0;
+static uint32_t sessionStartMs = 0;
+static uint32_t sessionEndMs = 0;
+static uint32_t phaseStartMs = 0;
+static volatile bool sendBusy = false;
+static uint32_t sendStartMs = 0;
+static bool addedBroadcastPeer = false;
+static FwPushCounters counters;
+
+static const esp_partition_t* stageTarget() {
+    return esp_ota_get_next_update_partition(nullptr);
+}
+
+static bool readStageHeader(const esp_partition_t* partition, FwStageHeader& header) {
+    return partition != nullptr && esp_partition_read(partition, 0, &header, sizeof(header)) == ESP_OK &&
+           header.magic == FW_STAGE_MAGIC &&
+           header.headerCrc == configCrc32(&header, offsetof(FwStageHeader, headerCrc)) &&
+           header.size > 0 && header.size <= partition->size - FW_STAGE_DATA_OFFSET;
+}
+
+bool fwStageBegin() {
+    if (phase != FW_PHASE_IDLE) {
+        LOGQ(LOG_WARN, "Client image upload refused: firmware push running");
+        return false;
+    }
+    if (Update.isRunning()) {
+        LOGQ(LOG_WARN, "Client image upload refused: server update in progress");
+        return false;
+    }
+    const esp_partition_t* partition = stageTarget();
+    if (partition == nullptr || esp_partition_erase_range(partition, 0, FW_STAGE_SECTOR) != ESP_OK) {
+        LOGQ(LOG_ERROR, "Client image upload: no staging partition");
+        return false;
+    }
+    stagePartition = partition;
+    stageSize = 0;
+    stageCrc = 0;
+    stageErased = FW_STAGE_DATA_OFFSET;
+    staging = true;
+    return true;
+}
+
+// Sectors are erased as the upload reaches them so no single call blocks for long
+bool fwStageWrite(const uint8_t* data, size_t length) {
+    if (!staging) return false;
+    uint32_t offset = FW_STAGE_DATA_OFFSET + stageSize;
+    bool ok = offset + length <= stagePartition->size;
+    while (ok && stageErased < offset + length) {
+        ok = esp_partition_erase_range(stagePartition, stageErased, FW_STAGE_SECTOR) == ESP_OK;
+        stageErased += FW_STAGE_SECTOR;
+    }
+    if (ok) ok = esp_partition_write(stagePartition, offset, data, length) == ESP_OK;
+    if (!ok) {
+        LOGQ(LOG_ERROR, "Client image upload: flash write failed at %lu", (unsigned long)stageSize);
+        staging = false;
+        return false;
+    }
+    stageCrc = configCrc32(data, length, stageCrc);
+    stageSize += length;
+    return true;
+}
+
+bool fwStageEnd() {
+    if (!staging) return false;
+    staging = false;
+    if (stageSize == 0) return false;
+    FwStageHeader header = {FW_STAGE_MAGIC, stageSize, stageCrc, 0};
+    header.headerCrc = configCrc32(&header, offsetof(FwStageHeader, headerCrc));
+    if (esp_partition_write(stagePartition, 0, &header, sizeof(header)) != ESP_OK) return false;
+    LOGQ(LOG_INFO, "Client image staged: %lu bytes, CRC 0x%08lX", (unsigned long)stageSize, (unsigned long)stageCrc);
+    return true;
+}
+
+// The descriptor sector was erased by fwStageBegin(), so nothing stays staged
+void fwStageAbort() {
+    staging = false;
+}
+
+bool fwStagedImage(uint32_t* size, uint32_t* crc) {
+    FwStageHeader header;
+    if (staging || !readStageHeader(stageTarget(), header)) return false;
+    if (size) *size = header.size;
+    if (crc) *crc = header.crc;
+    return true;
+}
+
+// ---- Frames ----
+static void fillHeader(FwPushHeader& header, uint8_t op) {
+    header.msgType = FW_PUSH_MSG_TYPE;
+    header.op = op;
+    header.session = session;
+}
+
+// One frame in flight: fwPushOnSent() (or FW_PUSH_SEND_TIMEOUT_MS) releases the next
+static bool sendFrame(const uint8_t* mac, const void* frame, size_t length) {
+    sendBusy = true;
+    sendStartMs = millis();
+    if (espNowSend(mac, frame, length) == HAL_OK) return true;
+    sendBusy = false;
+    counters.sendErrors++;
+    return false;
+}
+
+static void sendControl(const uint8_t* mac, uint8_t op) {
+    FwPushHeader header;
+    fillHeader(header, op);
+    sendFrame(mac, &header, sizeof(header));
+}
+
+static void sendOffer(const uint8_t* mac) {
+    FwPushOffer offer;
+    fillHeader(offer.header, FW_OP_OFFER);
+    offer.version = FW_PUSH_PROTOCOL_VERSION;
+    offer.imageSize = imageSize;
+    offer.chunkSize = FW_PUSH_CHUNK_SIZE;
+    offer.chunkCount = chunkCount;
+    sendFrame(mac, &offer, sizeof(offer));
+}
+
+static bool sendChunk(const uint8_t* mac, uint16_t index) {
+    FwPushChunk frame;
+    size_t length = fwPushChunkLength(imageSize, index);
+    uint32_t offset = FW_STAGE_DATA_OFFSET + (uint32_t)index * FW_PUSH_CHUNK_SIZE;
+    if (esp_partition_read(stagePartition, offset, frame.data, length) != ESP_OK) {
+        counters.sendErrors++;
+        return false;
+    }
+    fillHeader(frame.header, FW_OP_CHUNK);
+    frame.index = index;
+    frame.crc = fwPushChunkCrc(index, frame.data, length);
+    return sendFrame(mac, &frame, FW_PUSH_CHUNK_HEADER_LEN + length);
+}
+
+// ---- Session bookkeeping ----
+static int countState(uint8_t state) {
+    int count = 0;
+    for (int i = 0; i < targetCount; i++) {
+        if (targets[i].state == state) count++;
+    }
+    return count;
+}
+
+// Only clients that answered the last poll are repaired; a silent one still
+// holds back the window until FW_PUSH_MAX_MISSED_POLLS, but costs no airtime
+static bool needsChunk(const FwTarget& target, uint16_t index) {
+    return target.state == FW_TARGET_RECEIVING && target.answered && index <= target.base + FW_PUSH_WINDOW &&
+           !fwPushHasChunk(target.base, target.received, index);
+}
+
+static uint16_t lowestBase() {
+    uint16_t lowest = chunkCount;
+    for (int i = 0; i < targetCount; i++) {
+        if (targets[i].state == FW_TARGET_RECEIVING && targets[i].base < lowest) lowest = targets[i].base;
+    }
+    return lowest;
+}
+
+// Broadcast while several clients share the stream; a single client gets
+// unicast frames, which the radio acknowledges and retries.
+static const uint8_t* streamMac() {
+    if (countState(FW_TARGET_RECEIVING) != 1) return broadcastMac;
+    for (int i = 0; i < targetCount; i++) {
+        if (targets[i].state == FW_TARGET_RECEIVING) return targets[i].mac;
+    }
+    return broadcastMac;
+}
+
+static uint32_t transferredBytes(const FwTarget& target, uint16_t base) {
+    uint32_t from = (uint32_t)target.resumedAt * FW_PUSH_CHUNK_SIZE;
+    uint32_t to = (uint32_t)base * FW_PUSH_CHUNK_SIZE;
+    if (to > imageSize) to = imageSize;
+    return to > from ? to - from : 0;
+}
+
+static void reportDone(const FwTarget& target) {
+    uint32_t elapsed = target.doneMs - target.startMs;
+    LOGQ(LOG_INFO, "Firmware push: %s updated in %lu ms (%lu KB/s, %lu chunks resent, resumed at chunk %u)",
+         getPeerName(target.mac), (unsigned long)elapsed,
+         (unsigned long)(elapsed > 0 ? transferredBytes(target, chunkCount) / elapsed : 0),
+         (unsigned long)target.repairs, target.resumedAt);
+}
+
+static void applyStatus(FwTarget& target, const FwPushStatus& status) {
+    if (status.header.session != session) return;
+    target.answered = true;
+    target.missedPolls = 0;
+    if (target.startMs == 0) {
+        target.startMs = millis();
+        target.resumedAt = status.base;
+        if (status.base > 0) {
+            LOGQ(LOG_INFO, "Firmware push: %s resuming at chunk %u of %u", getPeerName(target.mac), status.base, chunkCount);
+        }
+    }
+    switch (status.state) {
+        case FW_CLIENT_RECEIVING:
+            if (target.state == FW_TARGET_STALLED) LOGQ(LOG_INFO, "Firmware push: %s is back", getPeerName(target.mac));
+            if (target.state == FW_TARGET_OFFERED || target.state == FW_TARGET_STALLED) target.state = FW_TARGET_RECEIVING;
+            target.base = status.base;
+            target.received = status.received;
+            break;
+        case FW_CLIENT_VERIFIED:
+            // COMMIT is repeated for every VERIFIED report in case one was lost
+            sendControl(target.mac, FW_OP_COMMIT);
+            if (target.state == FW_TARGET_DONE) break;
+            target.state = FW_TARGET_DONE;
+            target.base = chunkCount;
+            target.doneMs = millis();
+            if (target.resumedAt >= chunkCount) {
+                LOGQ(LOG_INFO, "Firmware push: %s already has this image", getPeerName(target.mac));
+            } else {
+                reportDone(target);
+            }
+            break;
+        case FW_CLIENT_REJECTED:
+            target.state = FW_TARGET_REJECTED;
+            LOGQ(LOG_WARN, "Firmware push: %s rejected the image (reason %u)", getPeerName(target.mac), status.detail);
+            break;
+        case FW_CLIENT_FAILED:
+            if (++target.failures >= FW_PUSH_MAX_FAILURES) {
+                target.state = FW_TARGET_FAILED;
+                LOGQ(LOG_ERROR, "Firmware push: %s failed verification %u times - giving up", getPeerName(target.mac),
+                     target.failures);
+                break;
+            }
+            LOGQ(LOG_WARN, "Firmware push: %s failed verification (reason %u) - resending", getPeerName(target.mac),
+                 status.detail);
+            target.state = FW_TARGET_RECEIVING;
+            target.base = status.base;
+            target.received = status.received;
+            break;
+    }
+}
+
+static void drainMailboxes() {
+    for (int i = 0; i < targetCount; i++) {
+        if (!__atomic_load_n(&mailbox[i].full, __ATOMIC_ACQUIRE)) continue;
+        FwPushStatus status = mailbox[i].status;
+        __atomic_store_n(&mailbox[i].full, 0, __ATOMIC_RELEASE);
+        applyStatus(targets[i], status);
+    }
+}
+
+// Offers go to clients that have not accepted yet, polls to everyone still receiving
+static void pollTargets() {
+    for (int i = 0; i < targetCount; i++) {
+        FwTarget& target = targets[i];
+        target.answered = false;
+        if (target.state == FW_TARGET_OFFERED) {
+            sendOffer(target.mac);
+        } else if (target.state == FW_TARGET_RECEIVING || target.state == FW_TARGET_STALLED) {
+            sendControl(target.mac, FW_OP_POLL);
+        }
+    }
+    counters.polls++;
+    phaseStartMs = millis();
+}
+
+static void finishFwPush(const char* outcome) {
+    phase = FW_PHASE_IDLE;
+    sessionEndMs = millis();
+    if (addedBroadcastPeer) {
+        halEspNowDelPeer(broadcastMac);
+        addedBroadcastPeer = false;
+    }
+    logf(LOG_INFO, "Firmware push %s after %lu ms: %d/%d clients updated", outcome,
+         (unsigned long)(sessionEndMs - sessionStartMs), countState(FW_TARGET_DONE), targetCount);
+}
+
+bool startFwPush(int clientIndex) {
+    if (phase != FW_PHASE_IDLE) {
+        log(LOG_INFO, "Firmware push already running");
+        return false;
+    }
+    uint32_t size, crc;
+    if (!fwStagedImage(&size, &crc)) {
+        log(LOG_WARN, "No client image staged - upload one at /client-fw (ota command) first");
+        return false;
+    }
+    if (size > (uint32_t)0xFFFF * FW_PUSH_CHUNK_SIZE) {
+        log(LOG_ERROR, "Firmware push: staged image too large");
+        return false;
+    }
+    if (numClients == 0 || clientIndex >= numClients) {
+        log(LOG_WARN, "Firmware push: no such client");
+        return false;
+    }
+    if (!halEspNowPeerExists(broadcastMac)) {
+        if (!halEspNowAddPeer(broadcastMac, chan)) {
+            log(LOG_ERROR, "Firmware push: cannot add broadcast peer");
+            return false;
+        }
+        addedBroadcastPeer = true;
+    }
+
+    stagePartition = stageTarget();
+    session = crc;
+    imageSize = size;
+    chunkCount = fwPushChunkCount(size);
+    windowBase = 0;
+    sendNext = 0;
+    repairCursor = 0;
+    memset(&counters, 0, sizeof(counters));
+    targetCount = 0;
+    for (int i = 0; i < numClients; i++) {
+        if (clientIndex >= 0 && i != clientIndex) continue;
+        FwTarget& target = targets[targetCount];
+        memset(&target, 0, sizeof(target));
+        memcpy(target.mac, clientMacAddresses[i], 6);
+        target.state = FW_TARGET_OFFERED;
+        __atomic_store_n(&mailbox[targetCount].full, 0, __ATOMIC_RELAXED);
+        targetCount++;
+    }
+    sessionStartMs = millis();
+    __atomic_store_n(&phase, (uint8_t)FW_PHASE_OFFER, __ATOMIC_RELEASE);   // Targets are visible to the WiFi task
+    logf(LOG_INFO, "Firmware push: %lu bytes (%u chunks, CRC 0x%08lX) to %d clients", (unsigned long)size, chunkCount,
+         (unsigned long)crc, targetCount);
+    pollTargets();
+    return true;
+}
+
+void stopFwPush() {
+    if (phase == FW_PHASE_IDLE) {
+        log(LOG_INFO, "Firmware push not running");
+        return;
+    }
+    for (int i = 0; i < targetCount; i++) {
+        uint8_t state = targets[i].state;
+        if (state == FW_TARGET_OFFERED || state == FW_TARGET_RECEIVING || state == FW_TARGET_STALLED) {
+            sendControl(targets[i].mac, FW_OP_ABORT);
+        }
+    }
+    finishFwPush("stopped");
+}
+
+bool fwPushActive() {
+    return phase != FW_PHASE_IDLE;
+}
+
+// One frame per call, so loop() never waits on the radio
+void serviceFwPush() {
+    if (phase == FW_PHASE_IDLE) return;
+    drainMailboxes();
+    uint32_t now = millis();
+    if (sendBusy && now - sendStartMs < FW_PUSH_SEND_TIMEOUT_MS) return;
+    sendBusy = false;
+
+    switch (phase) {
+        case FW_PHASE_OFFER:
+            if (countState(FW_TARGET_OFFERED) > 0 && now - sessionStartMs < FW_PUSH_OFFER_TIMEOUT_MS) {
+                if (now - phaseStartMs >= FW_PUSH_POLL_TIMEOUT_MS) pollTargets();
+                return;
+            }
+            // Clients that have not answered keep being offered on every poll
+            windowBase = lowestBase();
+            sendNext = windowBase;
+            phase = FW_PHASE_STREAM;
+            return;
+
+        case FW_PHASE_STREAM: {
+            if (countState(FW_TARGET_RECEIVING) == 0) {
+                finishFwPush(countState(FW_TARGET_DONE) == targetCount ? "complete" : "ended");
+                return;
+            }
+            if (sendNext < windowBase) sendNext = windowBase;
+            uint32_t windowEnd = (uint32_t)windowBase + FW_PUSH_WINDOW;
+            if (windowEnd > chunkCount) windowEnd = chunkCount;
+            if (sendNext < windowEnd) {
+                if (sendChunk(streamMac(), sendNext)) {
+                    sendNext++;
+                    counters.streamed++;
+                }
+                return;
+            }
+            pollTargets();
+            phase = FW_PHASE_POLL;
+            return;
+        }
+
+        case FW_PHASE_POLL:
+            for (int i = 0; i < targetCount; i++) {
+                if (targets[i].state == FW_TARGET_RECEIVING && !targets[i].answered &&
+                    now - phaseStartMs < FW_PUSH_POLL_TIMEOUT_MS) return;
+            }
+            for (int i = 0; i < targetCount; i++) {
+                FwTarget& target = targets[i];
+                if (target.state != FW_TARGET_RECEIVING || target.answered) continue;
+                if (++target.missedPolls >= FW_PUSH_MAX_MISSED_POLLS) {
+                    target.state = FW_TARGET_STALLED;
+                    LOGQ(LOG_WARN, "Firmware push: %s not answering at chunk %u - continuing without it",
+                         getPeerName(target.mac), target.base);
+                }
+            }
+            windowBase = lowestBase();
+            repairCursor = windowBase;
+            phase = FW_PHASE_REPAIR;
+            return;
+
+        case FW_PHASE_REPAIR: {
+            // Bounded scan per call; chunks nobody is missing cost no airtime
+            uint32_t scanEnd = (uint32_t)repairCursor + 2 * FW_PUSH_WINDOW;
+            if (scanEnd > sendNext) scanEnd = sendNext;
+            while (repairCursor < scanEnd) {
+                uint16_t index = repairCursor++;
+                int missing = 0;
+                int only = -1;
+                for (int i = 0; i < targetCount; i++) {
+                    if (needsChunk(targets[i], index)) {
+                        missing++;
+                        only = i;
+                    }
+                }
+                if (missing == 0) continue;
+                if (missing == 1) {
+                    if (sendChunk(targets[only].mac, index)) {
+                        targets[only].repairs++;
+                        counters.unicastRepairs++;
+                    }
+                } else if (sendChunk(broadcastMac, index)) {
+                    counters.broadcastRepairs++;
+                }
+                return;
+            }
+            if (repairCursor >= sendNext) phase = FW_PHASE_STREAM;   // Window slides to the new lowest base
+            return;
+        }
+    }
+}
+
+void fwPushOnReceive(const uint8_t* mac, const uint8_t* data, int length) {
+    if (__atomic_load_n(&phase, __ATOMIC_ACQUIRE) == FW_PHASE_IDLE) return;
+    if (length < (int)sizeof(FwPushStatus) || data[1] != FW_OP_STATUS) return;
+    for (int i = 0; i < targetCount; i++) {
+        if (memcmp(targets[i].mac, mac, 6) != 0) continue;
+        if (__atomic_load_n(&mailbox[i].full, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_add(&counters.statusDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        memcpy(&mailbox[i].status, data, sizeof(FwPushStatus));
+        __atomic_store_n(&mailbox[i].full, 1, __ATOMIC_RELEASE);
+        return;
+    }
+}
+
+void fwPushOnSent(const uint8_t*, bool) {
+    if (phase != FW_PHASE_IDLE) sendBusy = false;
+}
+
+static const char* targetStateName(uint8_t state) {
+    switch (state) {
+        case FW_TARGET_OFFERED:   return "offered";
+        case FW_TARGET_RECEIVING: return "receiving";
+        case FW_TARGET_STALLED:   return "stalled";
+        case FW_TARGET_DONE:      return "updated";
+        case FW_TARGET_REJECTED:  return "rejected";
+        case FW_TARGET_FAILED:    return "failed";
+        default:                  return "unknown";
+    }
+}
+
+static const char* phaseName(uint8_t value) {
+    switch (value) {
+        case FW_PHASE_OFFER:  return "offering";
+        case FW_PHASE_STREAM: return "streaming";
+        case FW_PHASE_POLL:   return "polling";
+        case FW_PHASE_REPAIR: return "repairing";
+        default:              return "idle";
+    }
+}
+
+void printFwPushStatus() {
+    log(LOG_INFO, "=== FIRMWARE PUSH ===");
+    uint32_t size, crc;
+    if (fwStagedImage(&size, &crc)) {
+        logf(LOG_INFO, "Staged Image: %lu bytes, CRC 0x%08lX", (unsigned long)size, (unsigned long)crc);
+    } else {
+        log(LOG_INFO, staging ? "Staged Image: upload in progress" : "Staged Image: none");
+    }
+    logf(LOG_INFO, "State: %s", phaseName(phase));
+    if (targetCount == 0) return;
+
+    uint32_t now = phase == FW_PHASE_IDLE ? sessionEndMs : millis();
+    logf(LOG_INFO, "Session: %lu ms, window %u-%u of %u chunks", (unsigned long)(now - sessionStartMs), windowBase,
+         sendNext, chunkCount);
+    logf(LOG_INFO, "Frames: %lu streamed, %lu broadcast + %lu unicast repairs, %lu polls, %lu send errors, %lu replies dropped",
+         (unsigned long)counters.streamed, (unsigned long)counters.broadcastRepairs,
+         (unsigned long)counters.unicastRepairs, (unsigned long)counters.polls, (unsigned long)counters.sendErrors,
+         (unsigned long)counters.statusDropped);
+    for (int i = 0; i < targetCount; i++) {
+        const FwTarget& target = targets[i];
+        uint16_t base = target.base > chunkCount ? chunkCount : target.base;
+        uint32_t end = target.state == FW_TARGET_DONE ? target.doneMs : now;
+        uint32_t elapsed = target.startMs ? end - target.startMs : 0;
+        logf(LOG_INFO, "  %s: %s, %u%% (chunk %u), %lu ms, %lu KB/s, %lu resent, %u missed polls",
+             getPeerName(target.mac), targetStateName(target.state), chunkCount ? base * 100u / chunkCount : 0, base,
+             (unsigned long)elapsed, (unsigned long)(elapsed > 0 ? transferredBytes(target, base) / elapsed : 0),
+             (unsigned long)target.repairs, target.missedPolls);
+    }
+}
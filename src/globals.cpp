@@ -36,11 +36,6 @@ const unsigned long SERVER_MIDI_LEARN_TIMEOUT = 30000; // 30s
 unsigned long serverMidiLearnCompleteTime = 0;
 const unsigned long SERVER_MIDI_LEARN_COOLDOWN = 750UL; // 0.75s ignore PCs right after learn
 
-// LED Pattern System (matching client)
-LedPattern currentLedPattern = LED_OFF;
-unsigned long ledPatternStart = 0;
-int ledPatternStep = 0;
-
 // Hardware Configuration Variables
 char deviceName[MAX_PEER_NAME_LEN] = {0};
 
@@ -0,0 +1,171 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ESP32 implementation of hal.h (Arduino core + IDF). Not part of the native build.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <nvs_flash.h>
+#include <hal.h>
+#include <globals.h>
+#include <utils.h>
+
+// ---- GPIO ----
+void halPinMode(uint8_t pin, HalPinMode mode) {
+    switch (mode) {
+        case HAL_PIN_INPUT:        pinMode(pin, INPUT); break;
+        case HAL_PIN_INPUT_PULLUP: pinMode(pin, INPUT_PULLUP); break;
+        case HAL_PIN_OUTPUT:       pinMode(pin, OUTPUT); break;
+    }
+}
+
+void halPinWrite(uint8_t pin, bool high) {
+    digitalWrite(pin, high ? HIGH : LOW);
+}
+
+bool halPinRead(uint8_t pin) {
+    return digitalRead(pin) == HIGH;
+}
+
+// ---- ESP-NOW ----
+static HalEspNowSentCb sentCallback = nullptr;
+
+static void espNowSent(const uint8_t* mac, esp_now_send_status_t status) {
+    sentCallback(mac, status == ESP_NOW_SEND_SUCCESS);
+}
+
+bool halEspNowInit(HalEspNowSentCb onSent, HalEspNowRecvCb onRecv) {
+    if (esp_now_init() != ESP_OK) return false;
+    sentCallback = onSent;
+    esp_now_register_send_cb(espNowSent);
+    esp_now_register_recv_cb(onRecv);     // Same signature as esp_now_recv_cb_t, no adapter needed
+    return true;
+}
+
+int halEspNowSend(const uint8_t* mac, const void* data, size_t len) {
+    return esp_now_send(mac, (const uint8_t*)data, len);
+}
+
+bool halEspNowAddPeer(const uint8_t* mac, uint8_t channel) {
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(peer));
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = channel;
+    peer.encrypt = false;
+    return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+bool halEspNowDelPeer(const uint8_t* mac) {
+    return esp_now_del_peer(mac) == ESP_OK;
+}
+
+bool halEspNowPeerExists(const uint8_t* mac) {
+    return esp_now_is_peer_exist(mac);
+}
+
+bool halStationMac(uint8_t mac[6]) {
+    return esp_wifi_get_mac(WIFI_IF_STA, mac) == ESP_OK;
+}
+
+const char* halErrName(int err) {
+    return esp_err_to_name((esp_err_t)err);
+}
+
+// ---- NVS ----
+static Preferences preferences;
+
+bool halNvsInit() {
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // NVS partition was truncated and needs to be erased
+        log(LOG_WARN, "NVS partition truncated, erasing and reinitializing...");
+        err = nvs_flash_erase();
+        if (err == ESP_OK) err = nvs_flash_init();
+    }
+    if (err != ESP_OK) {
+        logf(LOG_ERROR, "NVS flash init failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool halNvsBegin(const char* ns, bool readOnly) {
+    return preferences.begin(ns, readOnly);
+}
+
+void halNvsEnd() {
+    preferences.end();
+}
+
+bool halNvsIsKey(const char* key) {
+    return preferences.isKey(key);
+}
+
+bool halNvsRemove(const char* key) {
+    return preferences.remove(key);
+}
+
+bool halNvsClear() {
+    return preferences.clear();
+}
+
+size_t halNvsFreeEntries() {
+    return preferences.freeEntries();
+}
+
+size_t halNvsGetBytesLength(const char* key) {
+    return preferences.getBytesLength(key);
+}
+
+size_t halNvsGetBytes(const char* key, void* buf, size_t maxLen) {
+    return preferences.getBytes(key, buf, maxLen);
+}
+
+size_t halNvsPutBytes(const char* key, const void* buf, size_t len) {
+    return preferences.putBytes(key, buf, len);
+}
+
+uint8_t halNvsGetUChar(const char* key, uint8_t defaultValue) {
+    return preferences.getUChar(key, defaultValue);
+}
+
+int32_t halNvsGetInt(const char* key, int32_t defaultValue) {
+    return preferences.getInt(key, defaultValue);
+}
+
+size_t halNvsPutInt(const char* key, int32_t value) {
+    return preferences.putInt(key, value);
+}
+
+size_t halNvsGetString(const char* key, char* buf, size_t maxLen) {
+    return preferences.getString(key, buf, maxLen);
+}
+
+// ---- UARTs ----
+void halConsoleWrite(const void* data, size_t len) {
+    Serial.write((const uint8_t*)data, len);
+}
+
+int halConsoleRead() {
+    return Serial.read();
+}
+
+void halMidiBegin(uint32_t baud, int rxPin) {
+    Serial1.begin(baud, SERIAL_8N1, rxPin, -1);   // RX only
+}
+
+int halMidiRead() {
+    return Serial1.read();
+}
@@ -0,0 +1,165 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <ledEngine.h>
+#include <globals.h>
+#include <utils.h>
+#include <esp_timer.h>
+#include <driver/ledc.h>
+
+#define LED_DUTY_MAX ((1u << PAIRING_LED_RESOLUTION_BITS) - 1)
+#define LED_FADE_SETTLE_MS 2     // Let the fade unit finish before the next step writes the duty
+#define LED_PATTERN_NONE 0xFF
+
+#if SOC_LEDC_SUPPORT_HS_MODE
+static const ledc_mode_t ledMode = PAIRING_LED_CHANNEL < 8 ? LEDC_HIGH_SPEED_MODE : LEDC_LOW_SPEED_MODE;
+#else
+static const ledc_mode_t ledMode = LEDC_LOW_SPEED_MODE;
+#endif
+static const ledc_channel_t ledChannel = (ledc_channel_t)(PAIRING_LED_CHANNEL % 8);
+
+struct LedStep {
+    uint16_t duty;
+    uint16_t ms;                // 0 = hold this duty until the next pattern
+    bool fade;                  // Ramp to duty over ms using the LEDC fade unit
+};
+
+struct LedPatternTable {
+    const LedStep* steps;
+    uint8_t count;
+    bool oneShot;               // Return to the background pattern when done
+};
+
+#define LED_ON_FOR(ms)  {LED_DUTY_MAX, ms, false}
+#define LED_OFF_FOR(ms) {0, ms, false}
+// Squared ramp so the brightness steps look even; short segments keep pattern
+// changes prompt because a running hardware fade cannot be cut short
+#define LED_FADE_TO(k)  {(uint16_t)(LED_DUTY_MAX * (k) * (k) / 64), 125, true}
+
+static const LedStep offSteps[] = {LED_OFF_FOR(0)};
+static const LedStep onSteps[] = {LED_ON_FOR(0)};
+static const LedStep singleSteps[] = {LED_ON_FOR(200), LED_OFF_FOR(200)};
+static const LedStep doubleSteps[] = {LED_ON_FOR(200), LED_OFF_FOR(100), LED_ON_FOR(200), LED_OFF_FOR(100)};
+static const LedStep tripleSteps[] = {LED_ON_FOR(200), LED_OFF_FOR(100), LED_ON_FOR(200), LED_OFF_FOR(100),
+                                      LED_ON_FOR(200), LED_OFF_FOR(100)};
+static const LedStep blinkSteps[] = {LED_ON_FOR(100), LED_OFF_FOR(100)};
+static const LedStep fadeSteps[] = {LED_FADE_TO(1), LED_FADE_TO(2), LED_FADE_TO(3), LED_FADE_TO(4),
+                                    LED_FADE_TO(5), LED_FADE_TO(6), LED_FADE_TO(7), LED_FADE_TO(8),
+                                    LED_FADE_TO(7), LED_FADE_TO(6), LED_FADE_TO(5), LED_FADE_TO(4),
+                                    LED_FADE_TO(3), LED_FADE_TO(2), LED_FADE_TO(1), LED_FADE_TO(0)};
+
+#define LED_TABLE(steps, oneShot) {steps, sizeof(steps) / sizeof(steps[0]), oneShot}
+
+// Indexed by LedPattern
+static const LedPatternTable patterns[] = {
+    LED_TABLE(offSteps, false),
+    LED_TABLE(singleSteps, true),
+    LED_TABLE(doubleSteps, true),
+    LED_TABLE(tripleSteps, true),
+    LED_TABLE(blinkSteps, false),
+    LED_TABLE(onSteps, false),
+    LED_TABLE(fadeSteps, false),
+};
+static_assert(sizeof(patterns) / sizeof(patterns[0]) == LED_FADE + 1, "one step table per LedPattern");
+
+static esp_timer_handle_t stepTimer = nullptr;
+static uint8_t pendingPattern = LED_PATTERN_NONE;   // Set by setLedPattern(), taken by the step
+static uint8_t stepArmed = 0;                       // A step is running or scheduled
+static uint8_t activePattern = LED_OFF;
+static uint8_t backgroundPattern = LED_OFF;
+static uint8_t stepIndex = 0;
+static uint32_t stepCount = 0;
+
+static void applyStep(const LedStep& step) {
+    if (step.fade) {
+        ledc_set_fade_time_and_start(ledMode, ledChannel, step.duty, step.ms, LEDC_FADE_NO_WAIT);
+    } else {
+        ledc_set_duty(ledMode, ledChannel, step.duty);
+        ledc_update_duty(ledMode, ledChannel);
+    }
+}
+
+// Runs from the step timer (esp_timer task), or directly from setLedPattern()
+// when the engine is holding a static duty
+static void runStep(void*) {
+    for (;;) {
+        uint8_t requested = __atomic_exchange_n(&pendingPattern, (uint8_t)LED_PATTERN_NONE, __ATOMIC_ACQ_REL);
+        if (requested != LED_PATTERN_NONE) {
+            activePattern = requested;
+            stepIndex = 0;
+            if (!patterns[requested].oneShot) backgroundPattern = requested;
+        } else if (++stepIndex >= patterns[activePattern].count) {
+            stepIndex = 0;
+            if (patterns[activePattern].oneShot) activePattern = backgroundPattern;
+        }
+
+        const LedStep& step = patterns[activePattern].steps[stepIndex];
+        applyStep(step);
+        stepCount++;
+        if (step.ms > 0) {
+            uint32_t ms = step.fade ? step.ms + LED_FADE_SETTLE_MS : step.ms;
+            esp_timer_start_once(stepTimer, (uint64_t)ms * 1000);
+            return;
+        }
+
+        // Holding: stop, unless a request slipped in after it was taken above
+        __atomic_store_n(&stepArmed, 0, __ATOMIC_RELEASE);
+        if (__atomic_load_n(&pendingPattern, __ATOMIC_ACQUIRE) == LED_PATTERN_NONE) return;
+        if (__atomic_exchange_n(&stepArmed, 1, __ATOMIC_ACQ_REL)) return;
+    }
+}
+
+void initLedEngine() {
+    ledcSetup(PAIRING_LED_CHANNEL, PAIRING_LED_FREQ, PAIRING_LED_RESOLUTION_BITS);
+    ledcAttachPin(PAIRING_LED_PIN, PAIRING_LED_CHANNEL);
+    ledc_fade_func_install(0);
+
+    esp_timer_create_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.callback = runStep;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "led";
+    if (esp_timer_create(&args, &stepTimer) != ESP_OK) {
+        stepTimer = nullptr;
+        log(LOG_ERROR, "LED engine: step timer unavailable");
+    }
+}
+
+void setLedPattern(LedPattern pattern) {
+    if (stepTimer == nullptr || pattern > LED_FADE) return;
+    __atomic_store_n(&pendingPattern, (uint8_t)pattern, __ATOMIC_RELEASE);
+    // A running pattern picks the request up at its next step
+    if (!__atomic_exchange_n(&stepArmed, 1, __ATOMIC_ACQ_REL)) runStep(nullptr);
+}
+
+LedPattern getLedPattern() {
+    return (LedPattern)activePattern;
+}
+
+const char* ledPatternName(LedPattern pattern) {
+    switch (pattern) {
+        case LED_OFF:          return "off";
+        case LED_SINGLE_FLASH: return "single flash";
+        case LED_DOUBLE_FLASH: return "double flash";
+        case LED_TRIPLE_FLASH: return "triple flash";
+        case LED_FAST_BLINK:   return "fast blink";
+        case LED_SOLID_ON:     return "on";
+        case LED_FADE:         return "fade";
+        default:               return "unknown";
+    }
+}
+
+uint32_t getLedStepCount() {
+    return stepCount;
+}
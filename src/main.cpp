@@ -30,13 +30,20 @@
 #include <relayControl.h>
 #include <midiInput.h>
 #include <nvsManager.h>
+#include <deferredLog.h>
+#include <rigState.h>
+#include <clientMirror.h>
+#include <statusCollector.h>
+#include <sceneEngine.h>
+#include <programRemap.h>
+#include <fwPush.h>
+#include <ledEngine.h>
+#include <hal.h>
 
 struct_message outgoingSetpoints;
-struct_message outgoingCommand;
 MessageType messageType;
 
 int counter = 0;
-bool lastFootswitchState = false;
 
 void setupWiFiChannel() {
   WiFi.mode(WIFI_STA);
@@ -65,31 +72,30 @@ void readDataToSend() {
 }
 
 void setup() {
-
-  delay(5000);
   // Initialize Serial Monitor
   Serial.begin(115200);
+  initDeferredLog();
 
-  //Setup LED
-  ledcSetup(LEDC_CHANNEL_0, LEDC_BASE_FREQ, LEDC_TIMER_13_BIT);
-  ledcAttachPin(PAIRING_LED_PIN, LEDC_CHANNEL_0);
-
-  unsigned long serialWaitStart = millis();
-  log(LOG_INFO, "Enter 'ota' within 10 seconds to enter OTA mode...");
+  // Relays first: after a power blip the rig must be back on its last channel
+  // before anything slow (Wi-Fi, ESP-NOW, peers) runs
+  checkNVS();
+#if HAS_RELAY_OUTPUTS
+  restoreRelayOutputs();
+#else
+  loadRigState();
+#endif
 
-  while (millis() - serialWaitStart < 10000) {
-    checkSerialCommands();
-    delay(10);
-  if (serialOtaTrigger) break;
-  }
+  initLedEngine();
 
-  if (checkOtaTrigger() || serialOtaTrigger) {
-    updatePairingLED();
+  // Holding the OTA button at power-on enters the full OTA mode; the serial 'ota'
+  // command starts live OTA from loop() so boot never waits for it
+  if (checkOtaTrigger()) {
+    setLedPattern(LED_FAST_BLINK);
     startOTA();
     return;
   }
 
-  checkNVS();
+  loadConfigImage();
   
   // Initialize server configuration
   initializeServerConfiguration();
@@ -106,50 +112,36 @@ void setup() {
   // Save the actual channel being used to NVS for consistency
   saveServerConfigToNVS();
   
-  setupPairingButtonAndLED();  // This will now use the new system
+  setupPairingButton();
   initESP_NOW();
   loadPeersFromNVS();
+  loadScenesFromNVS();
+  loadProgramRemapsFromNVS();
+  beginRigStateResync();
   initMidiInput();
   loadServerMidiConfigFromNVS();
   loadServerButtonPcMapFromNVS();
 }
-void prepareChannelChangeCommand() {
-  outgoingCommand.msgType = COMMAND;
-  outgoingCommand.id = 0;
-  outgoingCommand.commandType = PROGRAM_CHANGE;
-  outgoingCommand.commandValue = 1;
-}
 void loop() {
   unsigned long loopStart = millis();
   
-  // Check buttons for pairing/LED functions
-  checkPairingButtons();
-  
-  // Handle LED patterns
-  updateLedPatterns();
-  
-  // Update footswitch state
-  updateFootswitchState();
+  // Footswitch state; a footswitch 1 press sends the channel change to the peers
+  serviceFootswitch();
   // Poll MIDI input (non-blocking)
   processMidiInput();
 
-
-  if (footswitchPressed && !lastFootswitchState) {
-    prepareChannelChangeCommand();
-    for (int i = 0; i < numLabeledPeers; i++) {
-      esp_now_send(labeledPeers[i].mac, (uint8_t *)&outgoingCommand, sizeof(outgoingCommand));
-      logf(LOG_INFO, "Footswitch pressed: sent channel change command to peer %s", labeledPeers[i].name);
-    }
-  }
-
-  lastFootswitchState = footswitchPressed;
-
   // Removed continuous data sending - only send commands when needed
   
-  checkPairingButtons();     // New sophisticated button handling
+  checkPairingButtons();     // Pairing / mode button and extra buttons (LED runs on its own timer)
   checkPairingTimeout();
-  updatePairingLED();        // Now using advanced LED patterns
   checkSerialCommands();
+  serviceNVSCache();
+  serviceRigStateResync();
+  serviceClientMirror();
+  serviceStatusCollector();
+  serviceScenes();
+  serviceLiveOTA();
+  serviceFwPush();
   // (Optional) future: MIDI learn timeout handling could go here
   
   // Update performance metrics
@@ -1,9 +1,15 @@
 #include <config.h>
 #include <utils.h>
 #include <commandSender.h>
-#include <MIDI.h>
+#include <midiParser.h>
 #include <globals.h>
 #include <relayControl.h>
+#include <deferredLog.h>
+#include <ledEngine.h>
+#include <hal.h>
+#include <midiInput.h>
+#include <sessionRecord.h>
+#include <sceneEngine.h>
 
 // Ensure this translation unit only compiled once; if included via another source accidentally, guard with unique macro.
 #ifdef SERVER_MIDI_INPUT_SOURCE
@@ -11,7 +17,7 @@
 #endif
 #define SERVER_MIDI_INPUT_SOURCE
 
-MIDI_CREATE_INSTANCE(HardwareSerial, Serial1, SERVER_MIDI);
+static MidiParser midiParser;
 static uint8_t lastProgram = 0xFF;
 static bool lastProgramOn = false;
 
@@ -35,13 +41,19 @@ void serverHandleProgramChange(byte channel, byte program) {
         }
         serverMidiLearnArmed = false;
         serverMidiLearnTarget = -1;
-        currentLedPattern = LED_SINGLE_FLASH;
-        ledPatternStart = millis();
+        setLedPattern(LED_SINGLE_FLASH);
         lastProgram = program;
         serverMidiLearnCompleteTime = millis();
         return;
     }
 
+    // A defined scene for this program replaces forwarding and the relay map
+    if (sceneRecallForProgram(program, SCENE_SOURCE_MIDI)) {
+        setLedPattern(LED_TRIPLE_FLASH);
+        lastProgram = program;
+        return;
+    }
+
     // Forward to clients always
     forwardMidiProgramToAll(program);
 
@@ -52,32 +64,30 @@ void serverHandleProgramChange(byte channel, byte program) {
         if (lastProgramOn) {
             setRelayChannel(0); // off
             lastProgramOn = false;
-            logf(LOG_INFO, "Server MIDI: PC %u -> Relay OFF (toggle)", program);
+            LOGQ(LOG_INFO, "Server MIDI: PC %u -> Relay OFF (toggle)", program);
         } else {
             setRelayChannel(1);
             lastProgramOn = true;
-            logf(LOG_INFO, "Server MIDI: PC %u -> Relay ON (toggle)", program);
+            LOGQ(LOG_INFO, "Server MIDI: PC %u -> Relay ON (toggle)", program);
         }
-        currentLedPattern = LED_TRIPLE_FLASH;
-        ledPatternStart = millis();
+        setLedPattern(LED_TRIPLE_FLASH);
     } else {
         // Not mapped -> ignore (debug only)
-        logf(LOG_DEBUG, "Server MIDI: PC %u no mapping", program);
+        LOGQ(LOG_DEBUG, "Server MIDI: PC %u no mapping", program);
     }
 #else
     bool matched = false;
     for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
         if (serverMidiChannelMap[i] == program) {
             setRelayChannel(i + 1);
-            logf(LOG_INFO, "Server MIDI: PC %u -> Relay %d", program, i + 1);
-            currentLedPattern = LED_TRIPLE_FLASH;
-            ledPatternStart = millis();
+            LOGQ(LOG_INFO, "Server MIDI: PC %u -> Relay %d", program, i + 1);
+            setLedPattern(LED_TRIPLE_FLASH);
             matched = true;
             break;
         }
     }
     if (!matched) {
-        logf(LOG_DEBUG, "Server MIDI: PC %u no mapping", program);
+        LOGQ(LOG_DEBUG, "Server MIDI: PC %u no mapping", program);
     }
 #endif
     lastProgram = program;
@@ -85,15 +95,26 @@ void serverHandleProgramChange(byte channel, byte program) {
 
 // Initialize server MIDI input (single definition)
 void initMidiInput() {
-    Serial1.begin(MIDI_BAUD_RATE, SERIAL_8N1, MIDI_UART_RX_PIN, -1); // RX only
-    SERVER_MIDI.setHandleProgramChange(serverHandleProgramChange);
-    SERVER_MIDI.begin(MIDI_CHANNEL_OMNI);
+    halMidiBegin(MIDI_BAUD_RATE, MIDI_UART_RX_PIN);
+    midiParserReset(midiParser);
     logf(LOG_INFO, "Server MIDI initialized RX pin %d", MIDI_UART_RX_PIN);
 }
 
-// Poll MIDI input - call in main loop
+// Poll MIDI input - call in main loop. Drains what the UART has buffered; at
+// 31250 baud that is at most a few bytes per loop.
 void processMidiInput() {
-    SERVER_MIDI.read();
+    int c;
+    while ((c = halMidiRead()) >= 0) {
+        sessionRecordMidi((uint8_t)c);
+        midiInputFeedByte((uint8_t)c);
+    }
+}
+
+void midiInputFeedByte(uint8_t c) {
+    MidiMessage message;
+    if (midiParserFeed(midiParser, c, message) && message.type == MIDI_PROGRAM_CHANGE) {
+        serverHandleProgramChange(message.channel, message.data1);
+    }
 }
  
 
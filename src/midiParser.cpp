@@ -0,0 +1,46 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <midiParser.h>
+
+void midiParserReset(MidiParser& parser) {
+    parser.status = 0;
+    parser.needed = 0;
+    parser.count = 0;
+}
+
+bool midiParserFeed(MidiParser& parser, uint8_t byte, MidiMessage& out) {
+    if (byte >= 0xF8) return false;               // Real-time: never affects parsing
+    if (byte >= 0xF0) {                           // SysEx / system common cancel running status
+        midiParserReset(parser);
+        return false;
+    }
+    if (byte & 0x80) {
+        uint8_t type = byte & 0xF0;
+        parser.status = byte;
+        parser.needed = (type == MIDI_PROGRAM_CHANGE || type == MIDI_CHANNEL_PRESSURE) ? 1 : 2;
+        parser.count = 0;
+        return false;
+    }
+    if (parser.status == 0) return false;         // Data with no status (or inside SysEx)
+
+    parser.data[parser.count++] = byte;
+    if (parser.count < parser.needed) return false;
+    parser.count = 0;                             // Keep the status for running-status data
+    out.type = parser.status & 0xF0;
+    out.channel = (uint8_t)((parser.status & 0x0F) + 1);
+    out.data1 = parser.data[0];
+    out.data2 = parser.needed == 2 ? parser.data[1] : 0;
+    return true;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Host allocation counter behind allocCountStart/Stop (debug.h). The native env
+// links with --wrap for malloc/calloc/realloc like the device build, and
+// operator new is replaced here so C++ allocations go through the wrapped
+// malloc as well (libstdc++'s own operator new would call the unwrapped one).
+#include <stdlib.h>
+#include <new>
+#include <debug.h>
+
+static bool allocCounting = false;
+static uint32_t allocCalls = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    if (allocCounting) allocCalls++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    if (allocCounting) allocCalls++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (allocCounting) allocCalls++;
+    return __real_realloc(ptr, size);
+}
+}
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void allocCountStart() {
+    allocCalls = 0;
+    allocCounting = true;
+}
+
+uint32_t allocCountStop() {
+    allocCounting = false;
+    return allocCalls;
+}
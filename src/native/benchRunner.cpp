@@ -0,0 +1,139 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Native switching latency run: the same suite as the `bench` console command,
+// but inputs enter at the HAL (footswitch pin level, MIDI UART bytes, console
+// UART frame) and go through a loop() pass as on the device. Latency is the
+// virtual clock (the core's delay() calls and modelled MIDI wire time) plus
+// the host CPU time spent, so the CSV tracks both scheduled waits and code cost.
+//
+//   program bench [-v] [--iterations N] [--clients N] [--csv FILE]
+#include <Arduino.h>
+#include <time.h>
+#include <hal.h>
+#include <halNative.h>
+#include <nativeRunner.h>
+#include <globals.h>
+#include <switchBench.h>
+#include <controlFrame.h>
+#include <deferredLog.h>
+
+#define BENCH_MIDI_BYTE_US 320          // One byte at 31250 baud
+
+static FILE* csvOut = stdout;
+static uint64_t hostStartNs = 0;
+
+static uint64_t hostNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t virtualPlusHostUs() {
+    return (uint32_t)(halNativeNowUs() + (hostNs() - hostStartNs) / 1000);
+}
+
+static void emitCsv(const char* line) {
+    fprintf(csvOut, "%s\n", line);
+}
+
+static void injectAtHal(SwitchBenchInput input, uint32_t iteration) {
+    uint8_t relay = (uint8_t)(iteration % (MAX_RELAY_CHANNELS > 1 ? 2 : 1));
+    switch (input) {
+        case SWITCH_BENCH_IN_FOOTSWITCH:
+            halNativeSetInput(footswitchPins[0], false);     // Active low
+            runCoreLoopOnce();
+            halNativeSetInput(footswitchPins[0], true);
+            runCoreLoopOnce();
+            break;
+        case SWITCH_BENCH_IN_MIDI: {
+            // Status byte first; the program byte lands one byte time later
+            uint8_t status = (uint8_t)(0xC0 | ((serverMidiChannel ? serverMidiChannel - 1 : 0) & 0x0F));
+            uint8_t program = serverMidiChannelMap[relay] & 0x7F;
+            halNativeMidiInput(&status, 1);
+            runCoreLoopOnce();
+            halNativeAdvanceUs(BENCH_MIDI_BYTE_US);
+            halNativeMidiInput(&program, 1);
+            runCoreLoopOnce();
+            break;
+        }
+        case SWITCH_BENCH_IN_SERIAL: {
+            uint8_t frame[CONTROL_FRAME_MAX_LEN];
+            uint8_t wire[CONTROL_WIRE_MAX_LEN];
+            frame[0] = (uint8_t)iteration;
+            frame[1] = (uint8_t)(iteration >> 8);
+            frame[2] = CTRL_OP_RELAY_SET;
+            frame[3] = (uint8_t)(relay + 1);
+            size_t length = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN + 1);
+            halNativeConsoleInputBytes(wire, controlFrameToWire(frame, length, wire, sizeof(wire)));
+            runCoreLoopOnce();
+            break;
+        }
+        default:
+            break;
+    }
+    flushDeferredLog();
+}
+
+static int argInt(int argc, char** argv, const char* name, int fallback) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return atoi(argv[i + 1]);
+    }
+    return fallback;
+}
+
+static const char* argString(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return nullptr;
+}
+
+int runSwitchBenchmarks(int argc, char** argv) {
+    int iterations = argInt(argc, argv, "--iterations", 2000);
+    int clients = argInt(argc, argv, "--clients", 8);
+    const char* csvPath = argString(argc, argv, "--csv");
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+    }
+    if (clients < 0 || clients > MAX_CLIENTS) clients = MAX_CLIENTS;
+    if (iterations < 1) iterations = 1;
+    halNativeSetConsoleEcho(verbose);
+
+    bootCore();
+    if (clients > 0) pairClients(clients);
+    // Map relays 1/2 to programs the bench sends, as a rig would be set up
+    serverMidiChannel = 0;
+    serverMidiChannelMap[0] = 10;
+    if (MAX_RELAY_CHANNELS > 1) serverMidiChannelMap[1] = 11;
+    currentLogLevel = LOG_WARN;
+
+    if (csvPath) {
+        csvOut = fopen(csvPath, "w");
+        if (csvOut == nullptr) {
+            perror(csvPath);
+            return 1;
+        }
+    }
+    SwitchBenchHooks hooks = {injectAtHal, virtualPlusHostUs, emitCsv, "native-hal"};
+    hostStartNs = hostNs();
+    int shortPaths = runSwitchBench((uint32_t)iterations, hooks);
+    if (csvOut != stdout) {
+        fclose(csvOut);
+        printf("CSV written to %s\n", csvPath);
+    }
+    if (shortPaths > 0) fprintf(stderr, "%d paths got fewer samples than iterations\n", shortPaths);
+    return shortPaths > 0 ? 1 : 0;
+}
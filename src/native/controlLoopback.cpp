@@ -0,0 +1,290 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Control protocol loopback: the host ControlClient talks to the firmware's
+// console input (checkSerialCommands) over a socketpair, with the firmware side
+// in a forked process as on a real serial link. Covers every opcode through the
+// client API, pipelined requests, CRC rejection, console text between frames, a
+// stray 0x00 before a text command and COBS round trips (in process and on the
+// wire).
+#include <Arduino.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <halNative.h>
+#include <dataStructs.h>
+#include <controlFrame.h>
+#include <controlProtocol.h>
+#include <nativeRunner.h>
+#include "../../tools/control-client/controlClient.h"
+
+#define LOOPBACK_PIPELINE 32
+
+static int failures = 0;
+static int deviceFd = -1;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    printf("FAIL: %s\n", what);
+    failures++;
+}
+
+static void writeAll(int fd, const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        p += n;
+        length -= (size_t)n;
+    }
+}
+
+static void writeToHost(const void* data, size_t length) {
+    writeAll(deviceFd, data, length);
+}
+
+static uint64_t hostUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Firmware side: every byte goes through the console input as on the device,
+// with the virtual clock advancing with the host clock so the frame byte
+// timeout applies; an idle port polls as the main loop would. Each read is
+// followed by a console line, as log output shares the port. Exits when the
+// host hangs up; a console line written after that must not end it with SIGPIPE.
+static void runDevice(int fd) {
+    static const char consoleText[] = "[INFO] loopback console line\r\n";
+    signal(SIGPIPE, SIG_IGN);
+    deviceFd = fd;
+    controlProtocolSetOutput(writeToHost);
+    uint64_t lastUs = hostUs();
+    uint8_t buf[256];
+    for (;;) {
+        struct pollfd readable = {fd, POLLIN, 0};
+        int ready = poll(&readable, 1, 2);
+        if (ready < 0 && errno == EINTR) continue;
+        uint64_t nowUs = hostUs();
+        halNativeAdvanceUs(nowUs - lastUs);     // Handlers may have advanced it too (delay)
+        lastUs = nowUs;
+        if (ready == 0) {
+            checkSerialCommands();
+            continue;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        halNativeConsoleInputBytes(buf, (size_t)n);
+        for (ssize_t done = 0; done < n; done += SERIAL_RX_BYTES_PER_LOOP) checkSerialCommands();
+        writeAll(fd, consoleText, sizeof(consoleText) - 1);
+    }
+    _exit(0);
+}
+
+static uint32_t getU32(const std::vector<uint8_t>& p, size_t offset) {
+    return (uint32_t)p[offset] | ((uint32_t)p[offset + 1] << 8) | ((uint32_t)p[offset + 2] << 16) |
+           ((uint32_t)p[offset + 3] << 24);
+}
+
+static uint8_t statusOf(ControlClient& client, uint8_t opcode, const uint8_t* payload, size_t length) {
+    ControlResponse response;
+    if (!client.request(opcode, payload, length, response)) return 0xFF;
+    return response.status;
+}
+
+static void checkCobsRoundTrips() {
+    static uint8_t in[600];
+    static uint8_t encoded[COBS_MAX_ENCODED_LEN(sizeof(in))];
+    static uint8_t decoded[sizeof(in)];
+    bool ok = true;
+    for (int pattern = 0; pattern < 3; pattern++) {
+        for (size_t length = 0; length <= sizeof(in); length++) {
+            for (size_t i = 0; i < length; i++) {
+                if (pattern == 0) in[i] = 0;                                  // Every byte a zero
+                else if (pattern == 1) in[i] = (uint8_t)(1 + i % 255);        // No zeros: 254-byte blocks
+                else in[i] = (uint8_t)((i * 37 + length) % 7 == 0 ? 0 : i * 13 + 1);
+            }
+            size_t encodedLength = cobsEncode(in, length, encoded);
+            size_t decodedLength = 0;
+            ok = ok && encodedLength <= COBS_MAX_ENCODED_LEN(length) &&
+                 memchr(encoded, 0, encodedLength) == nullptr &&
+                 cobsDecode(encoded, encodedLength, decoded, sizeof(decoded), decodedLength) &&
+                 decodedLength == length && memcmp(in, decoded, length) == 0;
+        }
+    }
+    check(ok, "COBS encode/decode round trip, lengths 0-600");
+    static const uint8_t truncated[] = {0x05, 0x11, 0x22};
+    size_t decodedLength;
+    check(!cobsDecode(truncated, sizeof(truncated), decoded, sizeof(decoded), decodedLength),
+          "COBS block longer than its input rejected");
+}
+
+static void checkEveryOpcode(ControlClient& client, int clients) {
+    uint32_t uptime = 0;
+    check(client.ping(&uptime), "PING answered");
+
+    ControlResponse response;
+    check(client.request(CTRL_OP_STATS, nullptr, 0, response) && response.status == CTRL_STATUS_OK &&
+          response.payload.size() == 32 && response.payload[12] == clients, "STATS reports the paired clients");
+
+    check(client.setRelay(1), "RELAY_SET 1");
+    check(client.request(CTRL_OP_RELAY_GET, nullptr, 0, response) && response.status == CTRL_STATUS_OK &&
+          response.payload.size() == 2 && response.payload[0] == 1, "RELAY_GET after RELAY_SET");
+    check(client.setRelayMask(0x03), "RELAY_MASK 0x03");
+    check(client.request(CTRL_OP_RELAY_GET, nullptr, 0, response) && response.payload.size() == 2 &&
+          response.payload[1] == 0x03, "RELAY_GET after RELAY_MASK");
+    uint8_t pastLast = MAX_RELAY_CHANNELS + 1;
+    check(statusOf(client, CTRL_OP_RELAY_SET, &pastLast, 1) == CTRL_STATUS_BAD_ARGUMENT,
+          "RELAY_SET past the last relay refused");
+
+    check(client.sendToClient(0, PROGRAM_CHANGE, 3), "SEND_CLIENT to client 0");
+    check(!client.sendToClient((uint8_t)clients, PROGRAM_CHANGE, 3), "SEND_CLIENT to an unpaired index refused");
+    check(client.sendToAll(PROGRAM_CHANGE, 4), "SEND_ALL");
+
+    uint8_t channel = 5;
+    check(statusOf(client, CTRL_OP_MIDI_CHANNEL, &channel, 1) == CTRL_STATUS_OK, "MIDI_CHANNEL 5");
+    check(client.setRelayMap(0, 0), "MAP_SET_RELAY with a zero program");
+    check(client.setButtonMap(0, 7), "MAP_SET_BUTTON");
+    check(client.request(CTRL_OP_MAP_GET, nullptr, 0, response) && response.status == CTRL_STATUS_OK &&
+          response.payload.size() >= (size_t)(3 + MAX_RELAY_CHANNELS) && response.payload[0] == 5 &&
+          response.payload[1] == MAX_RELAY_CHANNELS && response.payload[2] == 0,
+          "MAP_GET returns the edited channel and relay map");
+    check(client.saveMaps(), "MAP_SAVE");
+
+    ControlBatch batch;
+    uint8_t two = 2, badChannel = 17;
+    batch.add(CTRL_OP_RELAY_SET, &two, 1);
+    batch.add(CTRL_OP_RELAY_GET);
+    batch.add(CTRL_OP_MIDI_CHANNEL, &badChannel, 1);
+    std::vector<uint8_t> statuses;
+    check(!client.batch(batch, &statuses) && statuses.size() == 3 && statuses[0] == CTRL_STATUS_OK &&
+          statuses[1] == CTRL_STATUS_OK && statuses[2] == CTRL_STATUS_BAD_ARGUMENT,
+          "BATCH returns one status per entry");
+
+    check(statusOf(client, 0x7E, nullptr, 0) == CTRL_STATUS_UNKNOWN_OPCODE, "unknown opcode answered");
+    uint8_t tooLong[2] = {1, 1};
+    check(statusOf(client, CTRL_OP_RELAY_SET, tooLong, sizeof(tooLong)) == CTRL_STATUS_BAD_LENGTH,
+          "payload length checked");
+}
+
+static void checkPipelining(ControlClient& client) {
+    int seqs[LOOPBACK_PIPELINE];
+    for (int i = 0; i < LOOPBACK_PIPELINE; i++) {
+        seqs[i] = client.send(i % 2 ? CTRL_OP_RELAY_GET : CTRL_OP_PING);
+    }
+    bool ok = true;
+    for (int i = 0; i < LOOPBACK_PIPELINE; i++) {
+        ControlResponse response;
+        ok = ok && seqs[i] >= 0 && client.receive(response, 500) && response.seq == (uint16_t)seqs[i] &&
+             response.opcode == (i % 2 ? CTRL_OP_RELAY_GET : CTRL_OP_PING) && response.status == CTRL_STATUS_OK;
+    }
+    check(ok, "pipelined requests answered in order");
+}
+
+// A frame with a broken CRC gets no reply and is counted; the next one is answered
+static void checkCrcRejection(ControlClient& client, int fd) {
+    ControlResponse response;
+    check(client.request(CTRL_OP_STATS, nullptr, 0, response) && response.payload.size() == 32,
+          "STATS before the bad frame");
+    uint32_t crcErrors = getU32(response.payload, 20);
+
+    uint8_t frame[CONTROL_FRAME_MAX_LEN];
+    uint8_t wire[CONTROL_WIRE_MAX_LEN];
+    frame[0] = 0xEF;
+    frame[1] = 0xBE;
+    frame[2] = CTRL_OP_PING;
+    size_t length = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN);
+    frame[length - 1] ^= 0x01;
+    writeAll(fd, wire, controlFrameToWire(frame, length, wire, sizeof(wire)));
+
+    int seq = client.send(CTRL_OP_PING);
+    check(client.receive(response, 500) && response.seq == (uint16_t)seq, "bad-CRC frame gets no reply");
+    check(client.request(CTRL_OP_STATS, nullptr, 0, response) && response.payload.size() == 32 &&
+          getU32(response.payload, 20) == crcErrors + 1, "bad-CRC frame counted");
+}
+
+// A stray 0x00 opens a frame that never ends: after CONTROL_FRAME_BYTE_TIMEOUT_MS
+// the console is back in text mode and runs the next command
+static void checkStrayZero(ControlClient& client, int fd) {
+    ControlResponse response;
+    check(client.setRelay(1), "RELAY_SET 1 before the stray 0x00");
+    check(client.request(CTRL_OP_STATS, nullptr, 0, response) && response.payload.size() == 32,
+          "STATS before the stray 0x00");
+    uint32_t framingErrors = getU32(response.payload, 24);
+
+    writeAll(fd, "\0", 1);
+    usleep(CONTROL_FRAME_BYTE_TIMEOUT_MS * 3000);
+    writeAll(fd, "ch2\r\n", 5);
+    check(client.request(CTRL_OP_STATS, nullptr, 0, response) && response.payload.size() == 32 &&
+          response.payload[13] == 2, "text command after a stray 0x00 ran");
+    check(response.payload.size() == 32 && getU32(response.payload, 24) == framingErrors + 1,
+          "frame dropped on the byte timeout counted");
+}
+
+// The largest request, mostly zero bytes: [MIDI_CHANNEL][1][0] entries
+static void checkLargestFrame(ControlClient& client) {
+    ControlBatch batch;
+    size_t entries = CONTROL_FRAME_MAX_PAYLOAD / 3;
+    uint8_t omni = 0;
+    for (size_t i = 0; i < entries; i++) batch.add(CTRL_OP_MIDI_CHANNEL, &omni, 1);
+    std::vector<uint8_t> statuses;
+    check(client.batch(batch, &statuses) && statuses.size() == entries, "largest zero-filled frame round trip");
+}
+
+int checkControlLoopback(int clients) {
+    failures = 0;
+    checkCobsRoundTrips();
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    fflush(stdout);
+    pid_t device = fork();
+    if (device < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (device == 0) {
+        close(fds[0]);
+        runDevice(fds[1]);
+    }
+    close(fds[1]);
+
+    ControlClient client;
+    client.attach(fds[0]);
+    checkEveryOpcode(client, clients);
+    checkPipelining(client);
+    checkCrcRejection(client, fds[0]);
+    checkStrayZero(client, fds[0]);
+    checkLargestFrame(client);
+    check(client.discardedFrames() > 0, "console text between frames skipped by the client");
+
+    client.close();
+    close(fds[0]);
+    int status = 0;
+    waitpid(device, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "firmware side exited cleanly");
+    return failures;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Stand-ins for the device-only modules the core and the console commands call
+// into (LED engine, firmware push, live OTA, heap monitor and debug reports,
+// restart). The native build excludes those modules because they need LEDC,
+// flash partitions, the heap allocator, Wi-Fi or the OTA web server. Actions
+// that would change what the server sends are counted as skipped, so a session
+// replay knows where its trace stops being comparable.
+#include <Arduino.h>
+#include <globals.h>
+#include <utils.h>
+#include <ledEngine.h>
+#include <fwPush.h>
+#include <debug.h>
+#include <otaManager.h>
+#include <halNative.h>
+#include <nativeRunner.h>
+
+static LedPattern nativeLedPattern = LED_OFF;
+
+void setLedPattern(LedPattern pattern) {
+    nativeLedPattern = pattern;
+}
+
+LedPattern getLedPattern() {
+    return nativeLedPattern;
+}
+
+void fwPushOnReceive(const uint8_t* mac, const uint8_t* data, int length) {
+    (void)mac;
+    (void)data;
+    (void)length;
+}
+
+void fwPushOnSent(const uint8_t* mac, bool delivered) {
+    (void)mac;
+    (void)delivered;
+}
+
+uint32_t getFreeHeap() {
+    return 0;
+}
+
+uint32_t getMinFreeHeap() {
+    return 0;
+}
+
+static uint32_t skippedActions = 0;
+static uint64_t firstSkippedUs = 0;
+
+static void skipAction(const char* what) {
+    if (skippedActions++ == 0) firstSkippedUs = halNativeNowUs();
+    logf(LOG_WARN, "%s is device-only: skipped in the native build", what);
+}
+
+static void notAvailable(const char* what) {
+    logf(LOG_INFO, "%s: not available in the native build", what);
+}
+
+uint32_t nativeSkippedActions(uint64_t* firstUs) {
+    if (firstUs) *firstUs = firstSkippedUs;
+    return skippedActions;
+}
+
+void nativeResetSkippedActions() {
+    skippedActions = 0;
+    firstSkippedUs = 0;
+}
+
+void NativeEsp::restart() {
+    skipAction("Restart");
+}
+
+NativeEsp ESP;
+
+bool startFwPush(int clientIndex) {
+    (void)clientIndex;
+    skipAction("Firmware push");
+    return false;
+}
+
+void stopFwPush() {
+    skipAction("Firmware push stop");
+}
+
+void printFwPushStatus() {
+    notAvailable("Firmware push status");
+}
+
+bool startLiveOTA() {
+    skipAction("Live OTA");
+    return false;
+}
+
+void stopLiveOTA() {
+    skipAction("Live OTA stop");
+}
+
+void printLiveOtaStatus() {
+    notAvailable("Live OTA status");
+}
+
+void printDebugInfo()           { notAvailable("Debug info"); }
+void printPerformanceMetrics()  { notAvailable("Performance metrics"); }
+void resetPerformanceMetrics()  {}
+void printMemoryAnalysis()      { notAvailable("Memory analysis"); }
+void printMemoryFragmentation() { notAvailable("Heap fragmentation history"); }
+void printWiFiStats()           { notAvailable("WiFi stats"); }
+void printESPNowStats()         { notAvailable("ESP-NOW stats"); }
+void printNetworkStatus()       { notAvailable("Network status"); }
+void printServerStatus()        { notAvailable("Server status"); }
+void printPairingStatus()       { notAvailable("Pairing status"); }
@@ -0,0 +1,417 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <hal.h>
+#include <espnowSim.h>
+#include <espnowFrame.h>
+#include <deque>
+#include <queue>
+#include <vector>
+
+// 802.11b timing at the ESP-NOW default rate; OFDM rates use the short PLCP
+#define SIM_DSSS_PREAMBLE_US 192
+#define SIM_OFDM_PREAMBLE_US 20
+#define SIM_MAC_OVERHEAD 43         // MAC header, action/vendor element headers, FCS
+#define SIM_ACK_BYTES 14
+#define SIM_SIFS_US 10
+#define SIM_DIFS_US 50
+#define SIM_SLOT_US 20
+#define SIM_CW_MIN 15
+#define SIM_CW_MAX 1023
+#define SIM_FOREIGN_MIN_US 200      // Other networks' frames, uniform in this range
+#define SIM_FOREIGN_MAX_US 2000
+#define SIM_CLIENT_REPLY_US 200     // Client firmware turnaround for a status reply
+
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+struct SimFrame {
+    int from;                 // -1 = server
+    int to;                   // -1 = server, ESPNOW_SIM_MAX_CLIENTS = broadcast
+    uint8_t len;
+    uint8_t data[250];
+    uint8_t attempts;
+    uint32_t tag;
+    uint64_t queuedUs;
+};
+
+enum SimEventType { SIM_ATTEMPT_DONE, SIM_DELIVER, SIM_CLIENT_SEND, SIM_PAIR_RETRY };
+
+struct SimEvent {
+    uint64_t atUs;
+    uint32_t order;           // FIFO among events due at the same time
+    SimEventType type;
+    bool success;
+    int client;
+    SimFrame frame;
+};
+
+struct LaterEvent {
+    bool operator()(const SimEvent& a, const SimEvent& b) const {
+        return a.atUs != b.atUs ? a.atUs > b.atUs : a.order > b.order;
+    }
+};
+
+struct SimClient {
+    uint8_t mac[6];
+    float loss;
+    bool pairing;
+    bool paired;
+    uint8_t program;
+};
+
+static EspNowSimConfig config;
+static SimClient clients[ESPNOW_SIM_MAX_CLIENTS];
+static EspNowSimStats stats;
+static std::priority_queue<SimEvent, std::vector<SimEvent>, LaterEvent> events;
+static std::deque<SimFrame> medium;        // Waiting for airtime, head may be in flight
+static bool onAir = false;
+static uint64_t channelFreeUs = 0;
+static int serverQueued = 0;               // Server frames in the driver queue
+static uint32_t eventOrder = 0;
+static uint32_t rng = 1;
+static bool running = false;
+static EspNowSimCommandHook commandHook = nullptr;
+static EspNowSimTagSource tagSource = nullptr;
+
+// xorshift32: deterministic per seed and independent of the host libc
+static uint32_t nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static float randomUnit() {
+    return (nextRandom() >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t randomBelow(uint32_t bound) {
+    return bound ? nextRandom() % bound : 0;
+}
+
+static uint32_t airtimeUs(size_t bytes) {
+    uint32_t preamble = config.bitRate <= 11000000 ? SIM_DSSS_PREAMBLE_US : SIM_OFDM_PREAMBLE_US;
+    return preamble + (uint32_t)(((uint64_t)bytes * 8 * 1000000 + config.bitRate - 1) / config.bitRate);
+}
+
+static void schedule(uint64_t atUs, SimEventType type, bool success, int client, const SimFrame* frame) {
+    SimEvent event;
+    event.atUs = atUs;
+    event.order = eventOrder++;
+    event.type = type;
+    event.success = success;
+    event.client = client;
+    if (frame) event.frame = *frame;
+    else memset(&event.frame, 0, sizeof(event.frame));
+    events.push(event);
+}
+
+static int findClient(const uint8_t* mac) {
+    for (int i = 0; i < config.clients; i++) {
+        if (memcmp(clients[i].mac, mac, 6) == 0) return i;
+    }
+    return -1;
+}
+
+static float linkLoss(const SimFrame& frame) {
+    int client = frame.from >= 0 ? frame.from : frame.to;
+    return client >= 0 && client < config.clients ? clients[client].loss : config.loss;
+}
+
+// Put the head of the medium queue on air: wait for the channel, DIFS and a
+// backoff that doubles per retry, defer to foreign traffic, then the frame and
+// (unicast) its ACK or ACK timeout
+static void startAttempt() {
+    if (onAir || medium.empty()) return;
+    SimFrame& frame = medium.front();
+    uint64_t now = halNativeNowUs();
+    uint64_t start = (channelFreeUs > now ? channelFreeUs : now);
+    uint32_t window = SIM_CW_MIN;
+    for (int i = 0; i < frame.attempts && window < SIM_CW_MAX; i++) window = window * 2 + 1;
+    start += SIM_DIFS_US + randomBelow(window + 1) * SIM_SLOT_US;
+    while (config.foreignDuty > 0 && randomUnit() < config.foreignDuty) {
+        uint32_t foreign = SIM_FOREIGN_MIN_US + randomBelow(SIM_FOREIGN_MAX_US - SIM_FOREIGN_MIN_US);
+        start += foreign + SIM_DIFS_US;
+        stats.foreignUs += foreign;
+    }
+
+    bool broadcast = frame.to == ESPNOW_SIM_MAX_CLIENTS;
+    bool success = randomUnit() >= linkLoss(frame);
+    uint32_t busy = airtimeUs(SIM_MAC_OVERHEAD + frame.len);
+    if (!broadcast) busy += SIM_SIFS_US + airtimeUs(SIM_ACK_BYTES);   // ACK, or the time spent waiting for it
+    frame.attempts++;
+    if (frame.from < 0) stats.attempts++;
+    stats.airtimeUs += busy;
+    channelFreeUs = start + busy;
+    onAir = true;
+    schedule(channelFreeUs, SIM_ATTEMPT_DONE, success, -1, nullptr);
+}
+
+static void deliverLater(const SimFrame& frame, int client) {
+    uint64_t at = halNativeNowUs() + config.latencyUs + randomBelow(config.jitterUs + 1);
+    schedule(at, SIM_DELIVER, true, client, &frame);
+}
+
+static void attemptDone(bool success) {
+    SimFrame frame = medium.front();
+    bool broadcast = frame.to == ESPNOW_SIM_MAX_CLIENTS;
+    bool retry = !success && !broadcast && frame.attempts <= config.retries;
+    onAir = false;
+    if (retry) {
+        startAttempt();
+        return;
+    }
+    medium.pop_front();
+
+    if (frame.from < 0) {
+        serverQueued--;
+        if (broadcast) {
+            for (int i = 0; i < config.clients; i++) {
+                if (randomUnit() >= clients[i].loss) deliverLater(frame, i);
+            }
+        } else if (success) {
+            stats.delivered++;
+            stats.clientDelivered[frame.to]++;
+            deliverLater(frame, frame.to);
+        } else {
+            stats.failed++;
+            stats.clientFailed[frame.to]++;
+        }
+        // Broadcasts always report success, as on the device
+        halNativeEspNowSent(broadcast ? broadcastMac : clients[frame.to].mac, success || broadcast);
+    } else if (success) {
+        stats.uplinkDelivered++;
+        deliverLater(frame, -1);
+    }
+    startAttempt();
+}
+
+static void enqueue(const SimFrame& frame) {
+    medium.push_back(frame);
+    startAttempt();
+}
+
+static void clientSend(int client, const void* data, size_t len, bool broadcast) {
+    SimFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.from = client;
+    frame.to = broadcast ? ESPNOW_SIM_MAX_CLIENTS : -1;
+    frame.len = (uint8_t)len;
+    memcpy(frame.data, data, len);
+    frame.queuedUs = halNativeNowUs();
+    stats.uplinkSent++;
+    enqueue(frame);
+}
+
+static void sendPairingRequest(int client) {
+    struct_pairing request;
+    memset(&request, 0, sizeof(request));
+    request.msgType = PAIRING;
+    request.id = (uint8_t)(client + 1);
+    memcpy(request.macAddr, clients[client].mac, 6);
+    request.channel = 1;
+    snprintf(request.name, sizeof(request.name), "sim-%02d", client);
+    clientSend(client, &request, sizeof(request), true);
+}
+
+// What a client's firmware does with a frame addressed to it
+static void clientReceive(int client, const SimFrame& frame) {
+    SimClient& c = clients[client];
+    if (frame.len == sizeof(struct_pairing) && frame.data[0] == PAIRING) {
+        if (c.pairing) {
+            c.pairing = false;
+            c.paired = true;
+        }
+        return;
+    }
+    if (frame.len < sizeof(struct_message) || frame.data[0] != COMMAND) return;
+    struct_message message;
+    memcpy(&message, frame.data, sizeof(message));
+    if (message.commandType == PROGRAM_CHANGE) c.program = message.commandValue;
+    if (commandHook) commandHook(client, message, frame.tag, frame.queuedUs, halNativeNowUs());
+    if (message.commandType == STATUS_REQUEST) {
+        struct_message reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.msgType = DATA;
+        reply.id = (uint8_t)(client + 1);
+        reply.commandType = STATUS_REQUEST;
+        reply.commandValue = c.program;
+        reply.readingId = message.readingId;
+        reply.timestamp = millis();
+        SimFrame replyFrame;
+        memset(&replyFrame, 0, sizeof(replyFrame));
+        replyFrame.len = ESPNOW_STATUS_LEN;     // With the status tail: uptime, RSSI, firmware
+        memcpy(replyFrame.data, &reply, sizeof(reply));
+        uint32_t uptimeMs = millis();
+        memcpy(replyFrame.data + ESPNOW_STATUS_UPTIME, &uptimeMs, sizeof(uptimeMs));
+        replyFrame.data[ESPNOW_STATUS_RSSI] = (uint8_t)(int8_t)(-45 - (int)(c.loss * 50));
+        strncpy((char*)replyFrame.data + ESPNOW_STATUS_FIRMWARE, "sim-client", ESPNOW_STATUS_FIRMWARE_LEN);
+        schedule(halNativeNowUs() + SIM_CLIENT_REPLY_US, SIM_CLIENT_SEND, true, client, &replyFrame);
+    }
+}
+
+static void handle(const SimEvent& event) {
+    switch (event.type) {
+        case SIM_ATTEMPT_DONE:
+            attemptDone(event.success);
+            break;
+        case SIM_DELIVER:
+            if (event.client < 0) {
+                halNativeEspNowReceive(clients[event.frame.from].mac, event.frame.data, event.frame.len);
+            } else {
+                clientReceive(event.client, event.frame);
+            }
+            break;
+        case SIM_CLIENT_SEND:
+            clientSend(event.client, event.frame.data, event.frame.len, false);
+            break;
+        case SIM_PAIR_RETRY:
+            if (!clients[event.client].pairing) break;
+            sendPairingRequest(event.client);
+            schedule(halNativeNowUs() + ESPNOW_SIM_PAIR_RETRY_US, SIM_PAIR_RETRY, true, event.client, nullptr);
+            break;
+    }
+}
+
+void espNowSimRun(uint64_t untilUs) {
+    if (running) return;              // A callback waiting in delay(): the outer run continues
+    running = true;
+    while (!events.empty() && events.top().atUs <= untilUs) {
+        SimEvent event = events.top();
+        events.pop();
+        halNativeSetTimeUs(event.atUs);
+        handle(event);
+    }
+    running = false;
+}
+
+// Server side: every frame the core hands to halEspNowSend() for a peer
+static int serverTransmit(const uint8_t* mac, const uint8_t* data, size_t len) {
+    bool broadcast = memcmp(mac, broadcastMac, 6) == 0;
+    int client = broadcast ? ESPNOW_SIM_MAX_CLIENTS : findClient(mac);
+    if (client < 0) return HAL_OK;    // Peer with no simulated station: frame goes nowhere
+    if (serverQueued >= config.txQueueDepth) {
+        stats.queueFull++;
+        return HAL_NATIVE_ERR_NO_MEM;
+    }
+    SimFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.from = -1;
+    frame.to = client;
+    frame.len = (uint8_t)len;
+    memcpy(frame.data, data, len);
+    frame.tag = tagSource ? tagSource() : 0;
+    frame.queuedUs = halNativeNowUs();
+    serverQueued++;
+    stats.queued++;
+    if ((uint32_t)serverQueued > stats.maxQueue) stats.maxQueue = serverQueued;
+    enqueue(frame);
+    return HAL_OK;
+}
+
+void espNowSimDefaults(EspNowSimConfig& c) {
+    c.clients = 10;
+    c.bitRate = 1000000;
+    c.loss = 0.02f;
+    c.weakClients = 0;
+    c.weakLoss = 0.3f;
+    c.latencyUs = 300;
+    c.jitterUs = 200;
+    c.retries = 7;
+    c.txQueueDepth = 10;
+    c.foreignDuty = 0.1f;
+    c.seed = 1;
+}
+
+void espNowSimBegin(const EspNowSimConfig& c) {
+    config = c;
+    if (config.clients > ESPNOW_SIM_MAX_CLIENTS) config.clients = ESPNOW_SIM_MAX_CLIENTS;
+    if (config.bitRate == 0) config.bitRate = 1000000;
+    memset(clients, 0, sizeof(clients));
+    for (int i = 0; i < config.clients; i++) {
+        espNowSimClientMac(i, clients[i].mac);
+        clients[i].loss = i >= config.clients - config.weakClients ? config.weakLoss : config.loss;
+        clients[i].program = 0xFF;
+    }
+    memset(&stats, 0, sizeof(stats));
+    events = std::priority_queue<SimEvent, std::vector<SimEvent>, LaterEvent>();
+    medium.clear();
+    onAir = false;
+    channelFreeUs = 0;
+    serverQueued = 0;
+    rng = config.seed ? config.seed : 1;
+    halNativeSetTxHook(serverTransmit);
+    halNativeOnAdvance(espNowSimRun);
+}
+
+void espNowSimEnd() {
+    halNativeSetTxHook(nullptr);
+    halNativeOnAdvance(nullptr);
+}
+
+bool espNowSimIdle() {
+    return medium.empty() && !onAir;
+}
+
+void espNowSimClientMac(int client, uint8_t mac[6]) {
+    const uint8_t base[6] = {0x02, 0x5E, 0x00, 0x00, 0x00, 0x00};
+    memcpy(mac, base, 6);
+    mac[5] = (uint8_t)(client + 1);
+}
+
+void espNowSimStartPairing(int client) {
+    if (client < 0 || client >= config.clients || clients[client].paired) return;
+    clients[client].pairing = true;
+    schedule(halNativeNowUs(), SIM_PAIR_RETRY, true, client, nullptr);
+}
+
+bool espNowSimClientPaired(int client) {
+    return client >= 0 && client < config.clients && clients[client].paired;
+}
+
+uint8_t espNowSimClientProgram(int client) {
+    return client >= 0 && client < config.clients ? clients[client].program : 0xFF;
+}
+
+void espNowSimClientSend(int client, const uint8_t* data, size_t len) {
+    if (client < 0 || client >= config.clients) return;
+    clientSend(client, data, len > sizeof(SimFrame().data) ? sizeof(SimFrame().data) : len, false);
+}
+
+void espNowSimOnCommand(EspNowSimCommandHook hook) {
+    commandHook = hook;
+}
+
+void espNowSimTagSource(EspNowSimTagSource source) {
+    tagSource = source;
+}
+
+const EspNowSimStats& espNowSimStats() {
+    return stats;
+}
+
+void espNowSimResetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+float espNowSimClientLoss(int client) {
+    return client >= 0 && client < config.clients ? clients[client].loss : 0.0f;
+}
+
+void espNowSimSetLoss(float loss) {
+    config.loss = loss;
+    config.weakClients = 0;
+    for (int i = 0; i < config.clients; i++) clients[i].loss = loss;
+}
@@ -0,0 +1,416 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Linux fakes behind hal.h for the native build: a virtual clock, a pin array,
+// an ESP-NOW peer table with a TX hook, RAM-backed NVS and byte-queue UARTs.
+#include <Arduino.h>
+#include <hal.h>
+#include <halNative.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// ---- Virtual clock ----
+static uint64_t nowUs = 0;
+static HalNativeAdvanceHook advanceHook = nullptr;
+
+static void advanceTo(uint64_t targetUs) {
+    if (advanceHook) advanceHook(targetUs);
+    if (targetUs > nowUs) nowUs = targetUs;
+}
+
+uint64_t halNativeNowUs() {
+    return nowUs;
+}
+
+void halNativeAdvanceUs(uint64_t us) {
+    advanceTo(nowUs + us);
+}
+
+void halNativeSetTimeUs(uint64_t us) {
+    if (us > nowUs) nowUs = us;
+}
+
+void halNativeOnAdvance(HalNativeAdvanceHook hook) {
+    advanceHook = hook;
+}
+
+unsigned long millis() {
+    return (unsigned long)(uint32_t)(nowUs / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(uint32_t)nowUs;
+}
+
+void delay(unsigned long ms) {
+    advanceTo(nowUs + (uint64_t)ms * 1000);
+}
+
+void yield() {}
+
+// ---- GPIO ----
+struct FakePin {
+    uint8_t mode;
+    bool level;
+    bool driven;         // Input level set by halNativeSetInput()
+    uint32_t writes;
+};
+
+static FakePin pins[HAL_NATIVE_PINS];
+static HalNativePinHook pinHook = nullptr;
+
+void halPinMode(uint8_t pin, HalPinMode mode) {
+    if (pin >= HAL_NATIVE_PINS) return;
+    pins[pin].mode = mode;
+}
+
+void halPinWrite(uint8_t pin, bool high) {
+    if (pin >= HAL_NATIVE_PINS) return;
+    pins[pin].level = high;
+    pins[pin].writes++;
+    if (pinHook) pinHook(pin, high);
+}
+
+bool halPinRead(uint8_t pin) {
+    if (pin >= HAL_NATIVE_PINS) return true;
+    const FakePin& p = pins[pin];
+    if (p.mode == HAL_PIN_OUTPUT) return p.level;
+    return p.driven ? p.level : true;
+}
+
+void halNativeSetInput(uint8_t pin, bool high) {
+    if (pin >= HAL_NATIVE_PINS) return;
+    pins[pin].driven = true;
+    pins[pin].level = high;
+}
+
+bool halNativePinLevel(uint8_t pin) {
+    return halPinRead(pin);
+}
+
+bool halNativePinIsOutput(uint8_t pin) {
+    return pin < HAL_NATIVE_PINS && pins[pin].mode == HAL_PIN_OUTPUT;
+}
+
+uint32_t halNativePinWrites(uint8_t pin) {
+    return pin < HAL_NATIVE_PINS ? pins[pin].writes : 0;
+}
+
+void halNativeOnPinWrite(HalNativePinHook hook) {
+    pinHook = hook;
+}
+
+// ---- ESP-NOW ----
+static HalEspNowSentCb sentCallback = nullptr;
+static HalEspNowRecvCb recvCallback = nullptr;
+static HalNativeTxHook txHook = nullptr;
+static uint8_t peers[HAL_NATIVE_MAX_PEERS][6];
+static int peerCount = 0;
+static uint32_t txCount = 0;
+static uint8_t stationMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+static int findPeer(const uint8_t* mac) {
+    for (int i = 0; i < peerCount; i++) {
+        if (memcmp(peers[i], mac, 6) == 0) return i;
+    }
+    return -1;
+}
+
+bool halEspNowInit(HalEspNowSentCb onSent, HalEspNowRecvCb onRecv) {
+    sentCallback = onSent;
+    recvCallback = onRecv;
+    return true;
+}
+
+int halEspNowSend(const uint8_t* mac, const void* data, size_t len) {
+    if (mac == nullptr || data == nullptr || len == 0 || len > 250) return HAL_NATIVE_ERR_ARG;
+    if (findPeer(mac) < 0) return HAL_NATIVE_ERR_NOT_FOUND;
+    int result = txHook ? txHook(mac, (const uint8_t*)data, len) : HAL_OK;
+    if (result == HAL_OK) txCount++;
+    return result;
+}
+
+bool halEspNowAddPeer(const uint8_t* mac, uint8_t channel) {
+    (void)channel;
+    if (findPeer(mac) >= 0 || peerCount >= HAL_NATIVE_MAX_PEERS) return false;
+    memcpy(peers[peerCount++], mac, 6);
+    return true;
+}
+
+bool halEspNowDelPeer(const uint8_t* mac) {
+    int index = findPeer(mac);
+    if (index < 0) return false;
+    memmove(peers[index], peers[index + 1], (size_t)(peerCount - index - 1) * 6);
+    peerCount--;
+    return true;
+}
+
+bool halEspNowPeerExists(const uint8_t* mac) {
+    return findPeer(mac) >= 0;
+}
+
+bool halStationMac(uint8_t mac[6]) {
+    memcpy(mac, stationMac, 6);
+    return true;
+}
+
+const char* halErrName(int err) {
+    switch (err) {
+        case HAL_OK:                   return "ESP_OK";
+        case HAL_NATIVE_ERR_NOT_FOUND: return "ESP_ERR_ESPNOW_NOT_FOUND";
+        case HAL_NATIVE_ERR_ARG:       return "ESP_ERR_ESPNOW_ARG";
+        case HAL_NATIVE_ERR_FULL:      return "ESP_ERR_ESPNOW_FULL";
+        case HAL_NATIVE_ERR_NO_MEM:    return "ESP_ERR_ESPNOW_NO_MEM";
+        default:                       return "ESP_FAIL";
+    }
+}
+
+void halNativeSetTxHook(HalNativeTxHook hook) {
+    txHook = hook;
+}
+
+void halNativeEspNowReceive(const uint8_t* mac, const uint8_t* data, int len) {
+    if (recvCallback) recvCallback(mac, data, len);
+}
+
+void halNativeEspNowSent(const uint8_t* mac, bool delivered) {
+    if (sentCallback) sentCallback(mac, delivered);
+}
+
+bool halNativeEspNowReady() {
+    return recvCallback != nullptr;
+}
+
+uint32_t halNativeEspNowTxCount() {
+    return txCount;
+}
+
+int halNativeEspNowPeerCount() {
+    return peerCount;
+}
+
+void halNativeSetStationMac(const uint8_t mac[6]) {
+    memcpy(stationMac, mac, 6);
+}
+
+// ---- NVS ----
+// Namespaces only exist once opened read-write, as with Preferences
+typedef std::map<std::string, std::vector<uint8_t> > NvsNamespace;
+static const size_t NVS_FAKE_ENTRIES = 630;   // Roughly a 20 KB partition
+
+static std::map<std::string, NvsNamespace> nvsStore;
+static NvsNamespace* openNamespace = nullptr;
+static bool openReadOnly = true;
+static uint32_t nvsWrites = 0;
+
+bool halNvsInit() {
+    return true;
+}
+
+bool halNvsBegin(const char* ns, bool readOnly) {
+    if (openNamespace != nullptr) return false;
+    std::map<std::string, NvsNamespace>::iterator it = nvsStore.find(ns);
+    if (it == nvsStore.end()) {
+        if (readOnly) return false;
+        it = nvsStore.insert(std::make_pair(std::string(ns), NvsNamespace())).first;
+    }
+    openNamespace = &it->second;
+    openReadOnly = readOnly;
+    return true;
+}
+
+void halNvsEnd() {
+    openNamespace = nullptr;
+}
+
+static const std::vector<uint8_t>* findKey(const char* key) {
+    if (openNamespace == nullptr) return nullptr;
+    NvsNamespace::const_iterator it = openNamespace->find(key);
+    return it == openNamespace->end() ? nullptr : &it->second;
+}
+
+static size_t putKey(const char* key, const void* data, size_t len) {
+    if (openNamespace == nullptr || openReadOnly) return 0;
+    const uint8_t* bytes = (const uint8_t*)data;
+    (*openNamespace)[key].assign(bytes, bytes + len);
+    nvsWrites++;
+    return len;
+}
+
+bool halNvsIsKey(const char* key) {
+    return findKey(key) != nullptr;
+}
+
+bool halNvsRemove(const char* key) {
+    if (openNamespace == nullptr || openReadOnly) return false;
+    if (openNamespace->erase(key) == 0) return false;
+    nvsWrites++;
+    return true;
+}
+
+bool halNvsClear() {
+    if (openNamespace == nullptr || openReadOnly) return false;
+    openNamespace->clear();
+    nvsWrites++;
+    return true;
+}
+
+size_t halNvsFreeEntries() {
+    size_t used = 0;
+    for (std::map<std::string, NvsNamespace>::const_iterator ns = nvsStore.begin(); ns != nvsStore.end(); ++ns) {
+        for (NvsNamespace::const_iterator it = ns->second.begin(); it != ns->second.end(); ++it) {
+            used += 1 + (it->second.size() + 31) / 32;    // Header entry plus 32-byte data entries
+        }
+    }
+    return used < NVS_FAKE_ENTRIES ? NVS_FAKE_ENTRIES - used : 0;
+}
+
+size_t halNvsGetBytesLength(const char* key) {
+    const std::vector<uint8_t>* value = findKey(key);
+    return value ? value->size() : 0;
+}
+
+size_t halNvsGetBytes(const char* key, void* buf, size_t maxLen) {
+    const std::vector<uint8_t>* value = findKey(key);
+    if (value == nullptr || value->size() > maxLen) return 0;
+    memcpy(buf, value->data(), value->size());
+    return value->size();
+}
+
+size_t halNvsPutBytes(const char* key, const void* buf, size_t len) {
+    return putKey(key, buf, len);
+}
+
+uint8_t halNvsGetUChar(const char* key, uint8_t defaultValue) {
+    const std::vector<uint8_t>* value = findKey(key);
+    return (value && value->size() == 1) ? (*value)[0] : defaultValue;
+}
+
+int32_t halNvsGetInt(const char* key, int32_t defaultValue) {
+    const std::vector<uint8_t>* value = findKey(key);
+    if (value == nullptr || value->size() != sizeof(int32_t)) return defaultValue;
+    int32_t result;
+    memcpy(&result, value->data(), sizeof(result));
+    return result;
+}
+
+size_t halNvsPutInt(const char* key, int32_t value) {
+    return putKey(key, &value, sizeof(value));
+}
+
+size_t halNvsGetString(const char* key, char* buf, size_t maxLen) {
+    const std::vector<uint8_t>* value = findKey(key);
+    if (value == nullptr || value->size() + 1 > maxLen) return 0;
+    memcpy(buf, value->data(), value->size());
+    buf[value->size()] = '\0';
+    return value->size() + 1;
+}
+
+void halNativeNvsErase() {
+    nvsStore.clear();
+    openNamespace = nullptr;
+}
+
+uint32_t halNativeNvsWrites() {
+    return nvsWrites;
+}
+
+// ---- UARTs ----
+static std::deque<uint8_t> consoleRx;
+static std::deque<uint8_t> midiRx;
+static bool consoleEcho = true;
+static uint32_t consoleBytesOut = 0;
+static uint32_t midiDropped = 0;
+static uint32_t midiBytesRead = 0;
+
+void halConsoleWrite(const void* data, size_t len) {
+    consoleBytesOut += len;
+    if (consoleEcho) fwrite(data, 1, len, stdout);
+}
+
+NativeSerial Serial;
+
+size_t NativeSerial::print(const char* text) {
+    size_t len = strlen(text);
+    halConsoleWrite(text, len);
+    return len;
+}
+
+size_t NativeSerial::println(const char* text) {
+    return print(text) + print("\r\n");
+}
+
+size_t NativeSerial::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return print(buffer);
+}
+
+int halConsoleRead() {
+    if (consoleRx.empty()) return -1;
+    uint8_t c = consoleRx.front();
+    consoleRx.pop_front();
+    return c;
+}
+
+void halMidiBegin(uint32_t baud, int rxPin) {
+    (void)baud;
+    (void)rxPin;
+    midiRx.clear();
+}
+
+int halMidiRead() {
+    if (midiRx.empty()) return -1;
+    uint8_t c = midiRx.front();
+    midiRx.pop_front();
+    midiBytesRead++;
+    return c;
+}
+
+void halNativeConsoleInput(const char* text) {
+    halNativeConsoleInputBytes((const uint8_t*)text, strlen(text));
+}
+
+void halNativeConsoleInputBytes(const uint8_t* data, size_t len) {
+    consoleRx.insert(consoleRx.end(), data, data + len);
+}
+
+void halNativeSetConsoleEcho(bool enabled) {
+    consoleEcho = enabled;
+}
+
+uint32_t halNativeConsoleBytesOut() {
+    return consoleBytesOut;
+}
+
+void halNativeMidiInput(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (midiRx.size() < HAL_NATIVE_UART_RX_BUFFER) midiRx.push_back(data[i]);
+        else midiDropped++;
+    }
+}
+
+uint32_t halNativeMidiDropped() {
+    return midiDropped;
+}
+
+uint32_t halNativeMidiBytesRead() {
+    return midiBytesRead;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Arduino API subset for the native (Linux) build: basic types, timing and the
+// Serial/ESP calls the console commands make. Hardware goes through hal.h;
+// millis()/micros() read the virtual clock kept by src/native/halNative.cpp,
+// and delay() advances it instead of sleeping.
+#pragma once
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+#define F(text) (text)
+
+// Serial text goes to the console HAL, like log output
+class NativeSerial {
+public:
+    size_t print(const char* text);
+    size_t println(const char* text = "");
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+extern NativeSerial Serial;
+
+// restart() is a device-only action (deviceStubs.cpp); the process keeps running
+class NativeEsp {
+public:
+    void restart();
+};
+extern NativeEsp ESP;
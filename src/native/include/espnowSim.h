@@ -0,0 +1,95 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Simulated ESP-NOW medium for the native build. Virtual clients live in
+// process; the server's frames reach them through the halEspNowSend() TX hook
+// and theirs reach the real OnDataRecv(), with OnDataSent() reporting each
+// unicast outcome as the WiFi task would. One shared channel is modelled:
+// frames queue for airtime (DIFS + backoff, PHY preamble, payload at the PHY
+// rate, SIFS + ACK), each attempt can be lost per link, unicast frames are
+// retried, and the driver TX queue has a fixed depth.
+//
+// Events run on the virtual clock, from the advance hook while the core waits
+// in delay() or the runner steps time.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <dataStructs.h>
+#include <halNative.h>
+
+#define ESPNOW_SIM_MAX_CLIENTS HAL_NATIVE_MAX_PEERS
+#define ESPNOW_SIM_PAIR_RETRY_US 500000    // Client re-sends its pairing request until answered
+
+struct EspNowSimConfig {
+    int clients;
+    uint32_t bitRate;          // PHY rate in bit/s (ESP-NOW default 1 Mbit/s)
+    float loss;                // Per-attempt loss probability on every link
+    int weakClients;           // The last weakClients use weakLoss instead
+    float weakLoss;
+    uint32_t latencyUs;        // Stack delay between end of airtime and the receiver's callback
+    uint32_t jitterUs;         // Uniform 0..jitterUs added to latencyUs
+    uint8_t retries;           // Unicast retries after the first attempt
+    uint8_t txQueueDepth;      // Frames the driver holds before ESP_ERR_ESPNOW_NO_MEM
+    float foreignDuty;         // Chance another network holds the channel each time we contend (repeats)
+    uint32_t seed;
+};
+
+struct EspNowSimStats {
+    uint32_t queued;           // Server frames accepted by halEspNowSend()
+    uint32_t queueFull;        // Rejected with ESP_ERR_ESPNOW_NO_MEM
+    uint32_t attempts;         // Server transmissions including retries
+    uint32_t delivered;        // Server unicast frames acknowledged
+    uint32_t failed;           // Server unicast frames that ran out of retries
+    uint32_t uplinkSent;       // Client frames put on air
+    uint32_t uplinkDelivered;
+    uint32_t maxQueue;         // Deepest driver TX queue seen
+    uint64_t airtimeUs;        // Channel time used by the simulated stations
+    uint64_t foreignUs;        // Channel time taken by other networks
+    uint32_t clientDelivered[ESPNOW_SIM_MAX_CLIENTS];
+    uint32_t clientFailed[ESPNOW_SIM_MAX_CLIENTS];
+};
+
+// A COMMAND frame reaching a client: tag is what the tag source returned when
+// the server queued it, queuedUs when halEspNowSend() accepted it
+typedef void (*EspNowSimCommandHook)(int client, const struct_message& message, uint32_t tag,
+                                     uint64_t queuedUs, uint64_t rxUs);
+typedef uint32_t (*EspNowSimTagSource)();
+
+void espNowSimDefaults(EspNowSimConfig& config);
+
+// Install the TX and advance hooks and reset clients and statistics. A runner
+// with its own timed inputs can replace the advance hook and call
+// espNowSimRun() from its own.
+void espNowSimBegin(const EspNowSimConfig& config);
+void espNowSimEnd();
+
+// Fire every event due at or before untilUs, stepping the clock to each
+void espNowSimRun(uint64_t untilUs);
+bool espNowSimIdle();                    // No frame queued or in flight
+
+void espNowSimClientMac(int client, uint8_t mac[6]);
+void espNowSimStartPairing(int client);  // Client broadcasts pairing requests until answered
+bool espNowSimClientPaired(int client);
+uint8_t espNowSimClientProgram(int client);   // 0xFF until a PROGRAM_CHANGE arrives
+
+// Client puts a raw frame on air to the server (captured traffic, malformed frames)
+void espNowSimClientSend(int client, const uint8_t* data, size_t len);
+
+void espNowSimOnCommand(EspNowSimCommandHook hook);
+void espNowSimTagSource(EspNowSimTagSource source);
+
+const EspNowSimStats& espNowSimStats();
+void espNowSimResetStats();              // Start measuring from here (e.g. after pairing)
+float espNowSimClientLoss(int client);
+void espNowSimSetLoss(float loss);       // Every link, from now on
@@ -0,0 +1,74 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Control side of the Linux fakes behind hal.h, for native runners and
+// simulators. Nothing here exists in the device build.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define HAL_NATIVE_PINS 64
+#define HAL_NATIVE_MAX_PEERS 20
+#define HAL_NATIVE_UART_RX_BUFFER 256    // HardwareSerial default RX buffer
+
+// Error codes returned by the fake halEspNowSend() (names match the IDF ones)
+#define HAL_NATIVE_ERR_NOT_FOUND 0x3069   // ESP_ERR_ESPNOW_NOT_FOUND
+#define HAL_NATIVE_ERR_ARG       0x3067   // ESP_ERR_ESPNOW_ARG
+#define HAL_NATIVE_ERR_FULL      0x3068   // ESP_ERR_ESPNOW_FULL (peer list)
+#define HAL_NATIVE_ERR_NO_MEM    0x3065   // ESP_ERR_ESPNOW_NO_MEM (TX queue)
+
+// ---- Virtual clock (millis()/micros()) ----
+// The advance hook runs before delay() or halNativeAdvanceUs() moves the clock
+// to targetUs, so a simulator can fire the events due in between (as the WiFi
+// task would while the loop waits) after stepping the clock to each of them.
+typedef void (*HalNativeAdvanceHook)(uint64_t targetUs);
+uint64_t halNativeNowUs();
+void halNativeAdvanceUs(uint64_t us);
+void halNativeSetTimeUs(uint64_t us);    // Never moves backwards
+void halNativeOnAdvance(HalNativeAdvanceHook hook);
+
+// ---- GPIO ----
+// Pins read high until driven (pull-ups); outputs read back their last level
+typedef void (*HalNativePinHook)(uint8_t pin, bool high);
+void halNativeSetInput(uint8_t pin, bool high);
+bool halNativePinLevel(uint8_t pin);
+bool halNativePinIsOutput(uint8_t pin);
+uint32_t halNativePinWrites(uint8_t pin);
+void halNativeOnPinWrite(HalNativePinHook hook);
+
+// ---- ESP-NOW ----
+// The TX hook sees every frame halEspNowSend() accepts and returns the send
+// result; it (or a simulator behind it) reports completions with
+// halNativeEspNowSent(). Without a hook frames are accepted and counted only.
+typedef int (*HalNativeTxHook)(const uint8_t* mac, const uint8_t* data, size_t len);
+void halNativeSetTxHook(HalNativeTxHook hook);
+void halNativeEspNowReceive(const uint8_t* mac, const uint8_t* data, int len);   // -> recv callback
+void halNativeEspNowSent(const uint8_t* mac, bool delivered);                    // -> send callback
+bool halNativeEspNowReady();             // halEspNowInit() has run
+uint32_t halNativeEspNowTxCount();
+int halNativeEspNowPeerCount();
+void halNativeSetStationMac(const uint8_t mac[6]);
+
+// ---- NVS ----
+void halNativeNvsErase();                // Blank flash, as on a new board
+uint32_t halNativeNvsWrites();           // Put/remove/clear calls that changed flash
+
+// ---- UARTs ----
+void halNativeConsoleInput(const char* text);
+void halNativeConsoleInputBytes(const uint8_t* data, size_t len);
+void halNativeSetConsoleEcho(bool enabled);   // Console output to stdout (default on)
+uint32_t halNativeConsoleBytesOut();
+void halNativeMidiInput(const uint8_t* data, size_t len);   // Bytes past the RX buffer are dropped
+uint32_t halNativeMidiDropped();
+uint32_t halNativeMidiBytesRead();       // Bytes the core has taken with halMidiRead()
@@ -0,0 +1,43 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Pieces shared by the native runners. nativeMain.cpp dispatches on the first
+// argument: none for the checks and benchmarks, "sim" for the ESP-NOW load
+// simulation, "bench" for the switching latency CSV.
+#pragma once
+
+// setup() without Wi-Fi, the LED engine and OTA
+void bootCore();
+
+// The core's share of loop(): inputs, pairing timeout, console, NVS and resync
+void runCoreLoopOnce();
+
+// Pair count virtual clients over the fake ESP-NOW (every frame accepted)
+void pairClients(int count);
+
+int runSimulation(int argc, char** argv);          // simRunner.cpp
+int runSwitchBenchmarks(int argc, char** argv);    // benchRunner.cpp
+int runReplay(int argc, char** argv);              // replayRunner.cpp
+int runSessionReplay(int argc, char** argv);       // sessionRunner.cpp
+
+// Device-only actions (restart, firmware push, live OTA) the console asked for,
+// with the virtual time of the first (deviceStubs.cpp)
+uint32_t nativeSkippedActions(uint64_t* firstUs = nullptr);
+void nativeResetSkippedActions();
+
+// Host control client against the firmware over a socketpair; failed checks
+int checkControlLoopback(int clients);             // controlLoopback.cpp
+
+// OTA patch images packed on the host and rebuilt by the decoder; failed checks
+int checkOtaPatch();                               // otaPatchCheck.cpp
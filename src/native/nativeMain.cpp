@@ -0,0 +1,685 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Native runner: boots the server core against the Linux fakes, pairs a set of
+// virtual clients and times the switching paths with the host clock. It also
+// checks that the core reacted as the device would (relay levels, frames sent,
+// NVS round trip) and exits non-zero if it did not.
+//
+//   pio run -e native -t exec            (or .pio/build/native/program [-v] [clients])
+//   .pio/build/native/program sim [options]      ESP-NOW load simulation (simRunner.cpp)
+//   .pio/build/native/program bench [options]    switching latency CSV (benchRunner.cpp)
+//   .pio/build/native/program replay FILE        ESP-NOW capture replay (replayRunner.cpp)
+//   .pio/build/native/program session FILE       recorded session replay (sessionRunner.cpp)
+#include <Arduino.h>
+#include <time.h>
+#include <vector>
+#include <hal.h>
+#include <halNative.h>
+#include <globals.h>
+#include <utils.h>
+#include <dataStructs.h>
+#include <deferredLog.h>
+#include <espnow.h>
+#include <espnow-pairing.h>
+#include <nvsManager.h>
+#include <configImage.h>
+#include <relayControl.h>
+#include <rigState.h>
+#include <clientMirror.h>
+#include <statusCollector.h>
+#include <sceneEngine.h>
+#include <programRemap.h>
+#include <commandSender.h>
+#include <midiInput.h>
+#include <midiParser.h>
+#include <controlFrame.h>
+#include <sessionRecord.h>
+#include <consoleCommands.h>
+#include <debug.h>
+#include <nativeRunner.h>
+
+static int failures = 0;
+
+static uint64_t hostNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    printf("FAIL: %s\n", what);
+    failures++;
+}
+
+static void report(const char* name, uint32_t iterations, uint64_t totalNs, const char* unit = "op") {
+    printf("  %-34s %8u x %10.1f ns/%s\n", name, iterations, iterations ? (double)totalNs / iterations : 0.0, unit);
+}
+
+void bootCore() {
+    initDeferredLog();
+    checkNVS();
+    restoreRelayOutputs();
+    loadConfigImage();
+    initializeServerConfiguration();
+    loadServerConfigFromNVS();
+    currentLogLevel = loadLogLevelFromNVS();
+    initESP_NOW();
+    loadPeersFromNVS();
+    loadScenesFromNVS();
+    loadProgramRemapsFromNVS();
+    beginRigStateResync();
+    initMidiInput();
+    loadServerMidiConfigFromNVS();
+    loadServerButtonPcMapFromNVS();
+    flushDeferredLog();
+}
+
+// Mirrors loop() minus the footswitch broadcast, buttons, OTA and firmware push
+void runCoreLoopOnce() {
+    serviceFootswitch();
+    processMidiInput();
+    checkPairingTimeout();
+    checkSerialCommands();
+    serviceNVSCache();
+    serviceRigStateResync();
+    serviceClientMirror();
+    serviceStatusCollector();
+    serviceScenes();
+    flushDeferredLog();
+}
+
+static void clientMac(int index, uint8_t mac[6]) {
+    const uint8_t base[6] = {0x02, 0xC1, 0x1E, 0x00, 0x00, 0x00};
+    memcpy(mac, base, 6);
+    mac[5] = (uint8_t)(index + 1);
+}
+
+// Pairing requests as a client sends them while the server is in pairing mode
+void pairClients(int count) {
+    pairingforceStart();
+    for (int i = 0; i < count; i++) {
+        struct_pairing request;
+        memset(&request, 0, sizeof(request));
+        request.msgType = PAIRING;
+        request.id = (uint8_t)(i + 1);
+        clientMac(i, request.macAddr);
+        request.channel = chan;
+        snprintf(request.name, sizeof(request.name), "client-%d", i);
+        halNativeEspNowReceive(request.macAddr, (const uint8_t*)&request, sizeof(request));
+    }
+    flushNVSCache();
+    flushDeferredLog();
+}
+
+// Feed a byte sequence to a fresh parser; true if exactly the expected messages
+// (type | channel - 1, data1, data2) come out, in order
+static bool midiParses(const uint8_t* bytes, size_t length, const uint8_t (*expected)[3], size_t count) {
+    MidiParser parser;
+    midiParserReset(parser);
+    size_t seen = 0;
+    for (size_t i = 0; i < length; i++) {
+        MidiMessage message;
+        if (!midiParserFeed(parser, bytes[i], message)) continue;
+        if (seen >= count) return false;
+        const uint8_t* want = expected[seen++];
+        if ((message.type | (message.channel - 1)) != want[0] || message.data1 != want[1] ||
+            message.data2 != want[2]) return false;
+    }
+    return seen == count;
+}
+
+#define MIDI_CASE(bytes, expected, what) \
+    check(midiParses(bytes, sizeof(bytes), expected, sizeof(expected) / sizeof(expected[0])), what)
+
+// The cases the MIDI Library used to handle for us
+static void checkMidiParser() {
+    const uint8_t noteRunning[] = {0x90, 0x3C, 0x64, 0x3E, 0x50, 0x40, 0x00};
+    const uint8_t noteRunningOut[][3] = {{0x90, 0x3C, 0x64}, {0x90, 0x3E, 0x50}, {0x90, 0x40, 0x00}};
+    MIDI_CASE(noteRunning, noteRunningOut, "running status, two data bytes");
+
+    const uint8_t pcRunning[] = {0xC5, 0x01, 0x02, 0x7F, 0xD3, 0x40, 0x41};
+    const uint8_t pcRunningOut[][3] = {{0xC5, 0x01, 0}, {0xC5, 0x02, 0}, {0xC5, 0x7F, 0}, {0xD3, 0x40, 0}, {0xD3, 0x41, 0}};
+    MIDI_CASE(pcRunning, pcRunningOut, "running status, one data byte");
+
+    const uint8_t realTime[] = {0xB0, 0xF8, 0x07, 0xFE, 0x7F, 0xF8, 0x0A, 0xFF, 0x20, 0xC1, 0xFA, 0x05};
+    const uint8_t realTimeOut[][3] = {{0xB0, 0x07, 0x7F}, {0xB0, 0x0A, 0x20}, {0xC1, 0x05, 0}};
+    MIDI_CASE(realTime, realTimeOut, "real-time bytes inside messages skipped");
+
+    const uint8_t sysEx[] = {0xC0, 0x05, 0xF0, 0x43, 0x10, 0x06, 0xF7, 0x07, 0xC0, 0x08};
+    const uint8_t sysExOut[][3] = {{0xC0, 0x05, 0}, {0xC0, 0x08, 0}};
+    MIDI_CASE(sysEx, sysExOut, "SysEx cancels running status");
+
+    const uint8_t common[] = {0x90, 0x40, 0x40, 0xF3, 0x01, 0x41, 0x41, 0xE2, 0x00, 0x40, 0xF6, 0x10, 0x20};
+    const uint8_t commonOut[][3] = {{0x90, 0x40, 0x40}, {0xE2, 0x00, 0x40}};
+    MIDI_CASE(common, commonOut, "system common bytes cancel running status");
+
+    const uint8_t noStatus[] = {0x10, 0x20, 0x30, 0xC0, 0x03};
+    const uint8_t noStatusOut[][3] = {{0xC0, 0x03, 0}};
+    MIDI_CASE(noStatus, noStatusOut, "data bytes with no status ignored");
+
+    const uint8_t interrupted[] = {0x90, 0x40, 0xC2, 0x09, 0xB0, 0x01, 0x90, 0x3C, 0x7F};
+    const uint8_t interruptedOut[][3] = {{0xC2, 0x09, 0}, {0x90, 0x3C, 0x7F}};
+    MIDI_CASE(interrupted, interruptedOut, "status byte mid-message starts a new message");
+}
+
+static void benchMidiParser() {
+    static uint8_t stream[3000];
+    for (size_t i = 0; i < sizeof(stream); i += 3) {
+        stream[i] = 0xC0;
+        stream[i + 1] = (uint8_t)(i & 0x7F);
+        stream[i + 2] = 0xF8;                  // Clock byte between messages
+    }
+    MidiParser parser;
+    midiParserReset(parser);
+    uint32_t messages = 0;
+    const int rounds = 1000;
+    uint64_t start = hostNs();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < sizeof(stream); i++) {
+            MidiMessage message;
+            if (midiParserFeed(parser, stream[i], message)) messages++;
+        }
+    }
+    uint64_t elapsed = hostNs() - start;
+    check(messages == rounds * sizeof(stream) / 3, "MIDI parser decoded every Program Change");
+    report("MIDI parser", rounds * sizeof(stream), elapsed, "byte");
+}
+
+// One Program Change byte pair in the UART -> relay switched and every client sent
+static void benchMidiToRelay(int clients) {
+    serverMidiChannel = 0;
+    serverMidiChannelMap[0] = 10;
+    serverMidiChannelMap[1] = 11;
+    for (int i = 2; i < MAX_RELAY_CHANNELS; i++) serverMidiChannelMap[i] = 127;
+
+    const uint32_t iterations = 5000;
+    uint64_t total = 0;
+    bool relaysOk = true;
+    uint32_t txBefore = halNativeEspNowTxCount();
+    for (uint32_t k = 0; k < iterations; k++) {
+        uint8_t relay = k & 1;
+        uint8_t message[2] = {0xC0, (uint8_t)(10 + relay)};
+        halNativeMidiInput(message, sizeof(message));
+        uint64_t start = hostNs();
+        processMidiInput();
+        total += hostNs() - start;
+        relaysOk = relaysOk && halNativePinLevel(relayOutputPins[relay]) && !halNativePinLevel(relayOutputPins[relay ^ 1]);
+        flushDeferredLog();
+    }
+    check(relaysOk, "MIDI Program Change switched the mapped relay");
+    check(halNativeEspNowTxCount() - txBefore == iterations * (uint32_t)clients, "MIDI Program Change sent to every client");
+    report("MIDI PC -> relay + client sends", iterations, total);
+}
+
+static void benchRelaySwitch() {
+    const uint32_t iterations = 100000;
+    uint64_t start = hostNs();
+    for (uint32_t k = 0; k < iterations; k++) {
+        setRelayChannel((uint8_t)(1 + (k & 1)));
+    }
+    uint64_t elapsed = hostNs() - start;
+    flushDeferredLog();
+    check(halNativePinLevel(relayOutputPins[1]) && !halNativePinLevel(relayOutputPins[0]), "setRelayChannel drove the pins");
+    report("setRelayChannel", iterations, elapsed);
+
+    setRelayChannel(3);                     // No pin configured
+    setRelayChannel(MAX_RELAY_CHANNELS + 1);
+    check(halNativePinLevel(relayOutputPins[1]) && getRelayMask() == 0x02 && getRigStateRelayMask() == 0x02,
+          "rejected relay channel left outputs and recorded mask alone");
+}
+
+// Binary control frame on the console UART -> relay
+static void benchControlFrame() {
+    const uint32_t iterations = 20000;
+    uint64_t total = 0;
+    bool relaysOk = true;
+    for (uint32_t k = 0; k < iterations; k++) {
+        uint8_t channel = (uint8_t)(1 + (k & 1));
+        uint8_t frame[CONTROL_FRAME_MAX_LEN];
+        uint8_t wire[CONTROL_WIRE_MAX_LEN];
+        frame[0] = (uint8_t)k;
+        frame[1] = (uint8_t)(k >> 8);
+        frame[2] = CTRL_OP_RELAY_SET;
+        frame[3] = channel;
+        size_t length = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN + 1);
+        size_t wireLength = controlFrameToWire(frame, length, wire, sizeof(wire));
+        halNativeConsoleInputBytes(wire, wireLength);
+        uint64_t start = hostNs();
+        checkSerialCommands();
+        total += hostNs() - start;
+        relaysOk = relaysOk && halNativePinLevel(relayOutputPins[channel - 1]);
+        flushDeferredLog();
+    }
+    check(relaysOk, "control frame switched the relay");
+    report("control frame -> relay + reply", iterations, total);
+}
+
+// Console tokenizer + table lookup on the device's sample lines, no handlers run
+static void benchConsoleParser() {
+    const uint32_t iterations = 200000;
+    allocCountStart();
+    uint64_t start = hostNs();
+    uint32_t found = consoleParseSamples(iterations);
+    uint64_t elapsed = hostNs() - start;
+    uint32_t allocations = allocCountStop();
+    // 9 of the 10 samples resolve, 4 of them with a subcommand
+    check(found == iterations / 10 * 13, "console samples resolved (commands and subcommands)");
+    check(allocations == 0, "console parse made no heap allocations");
+    report("console tokenize + lookup", iterations, elapsed, "command");
+    printf("  %-34s %8.0f commands/s, %u allocations\n", "", elapsed ? iterations * 1e9 / elapsed : 0.0, allocations);
+}
+
+// Truncated pairing and command frames through the receive callback: all rejected
+// by length, none reaches the pairing code
+static void benchRxRejects() {
+    const uint32_t iterations = 100000;
+    struct_pairing request;
+    memset(&request, 0xA5, sizeof(request));
+    request.msgType = PAIRING;
+    request.id = 99;
+    uint8_t mac[6] = {0x02, 0xBA, 0xD0, 0x00, 0x00, 0x01};
+    int clientsBefore = numClients;
+    const EspNowRxStats& rx = getEspNowRxStats();
+    uint32_t rejectedBefore = rx.rejected[ESPNOW_RX_SHORT] + rx.rejected[ESPNOW_RX_BAD_LENGTH];
+    uint64_t start = hostNs();
+    for (uint32_t k = 0; k < iterations; k++) {
+        request.msgType = (k & 1) ? PAIRING : COMMAND;
+        int length = (int)(k % (k & 1 ? ESPNOW_PAIRING_LEN : ESPNOW_MESSAGE_LEN));
+        halNativeEspNowReceive(mac, (const uint8_t*)&request, length);
+    }
+    uint64_t elapsed = hostNs() - start;
+    flushDeferredLog();
+    check(rx.rejected[ESPNOW_RX_SHORT] + rx.rejected[ESPNOW_RX_BAD_LENGTH] - rejectedBefore == iterations,
+          "truncated ESP-NOW frames rejected");
+    check(numClients == clientsBefore, "truncated pairing request ignored");
+    report("truncated ESP-NOW frame -> reject", iterations, elapsed, "frame");
+}
+
+// Footswitch press and control frames with the session recorder on: the inputs
+// and the relay/TX outputs they cause are all in the export
+static std::vector<uint8_t> sessionExport;
+
+static void collectSession(const void* data, size_t length) {
+    sessionExport.insert(sessionExport.end(), (const uint8_t*)data, (const uint8_t*)data + length);
+}
+
+static void benchSessionRecorder(int clients) {
+    const uint32_t iterations = 1000;
+    uint32_t txBefore = halNativeEspNowTxCount();
+    check(sessionRecordStart(), "session recorder started");
+    halNativeSetInput(footswitchPins[0], false);
+    runCoreLoopOnce();
+    halNativeSetInput(footswitchPins[0], true);
+    runCoreLoopOnce();
+
+    uint64_t total = 0;
+    for (uint32_t k = 0; k < iterations; k++) {
+        uint8_t frame[CONTROL_FRAME_MAX_LEN];
+        uint8_t wire[CONTROL_WIRE_MAX_LEN];
+        frame[0] = (uint8_t)k;
+        frame[1] = (uint8_t)(k >> 8);
+        frame[2] = CTRL_OP_RELAY_SET;
+        frame[3] = (uint8_t)(1 + (k & 1));
+        size_t length = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN + 1);
+        size_t wireLength = controlFrameToWire(frame, length, wire, sizeof(wire));
+        halNativeConsoleInputBytes(wire, wireLength);
+        uint64_t start = hostNs();
+        checkSerialCommands();
+        total += hostNs() - start;
+        flushDeferredLog();
+    }
+    sessionRecordStop();
+    sessionExport.clear();
+    sessionRecordExport(collectSession);
+
+    uint32_t counts[SESSION_TX + 1] = {0};
+    SessionHeader header;
+    memcpy(&header, sessionExport.data(), sizeof(header));
+    size_t offset = 0;
+    SessionRecordHeader record;
+    const uint8_t* payload;
+    const uint8_t* records = sessionExport.data() + sizeof(header);
+    while (sessionNextRecord(records, header.recordBytes, offset, record, payload)) {
+        if (record.type <= SESSION_TX) counts[record.type]++;
+    }
+    check(header.magic == SESSION_MAGIC && header.droppedRecords == 0, "session exported without drops");
+    check(counts[SESSION_PIN] >= 2, "footswitch edges recorded");
+    check(counts[SESSION_CONSOLE] == iterations, "console bytes recorded once per pass");
+    check(counts[SESSION_RELAY] == iterations, "relay outputs recorded");
+    check(counts[SESSION_TX] == (uint32_t)clients && halNativeEspNowTxCount() - txBefore == (uint32_t)clients,
+          "footswitch TX recorded per client");
+    report("control frame -> relay, recording", iterations, total);
+}
+
+// Program changes to one client: a repeat is dropped while the first is in flight
+// or once it is delivered, and sent again after a failure, a re-pair or a status
+// reply that reports another program
+// TX hooks for the mirror's send ordering: a callback that arrives before
+// halEspNowSend() returns (the WiFi task preempting the loop), and a full queue
+static int deliverBeforeReturn(const uint8_t* mac, const uint8_t* data, size_t len) {
+    (void)data;
+    (void)len;
+    halNativeEspNowSent(mac, true);
+    return HAL_OK;
+}
+
+static int refuseSend(const uint8_t* mac, const uint8_t* data, size_t len) {
+    (void)mac;
+    (void)data;
+    (void)len;
+    return HAL_NATIVE_ERR_NO_MEM;
+}
+
+static void checkClientMirror() {
+    const uint8_t* mac = clientMacAddresses[0];
+    clientMirrorInvalidate(nullptr);
+    resetClientMirrorStats();
+    uint32_t txBefore = halNativeEspNowTxCount();
+    sendCommandToClient(mac, PROGRAM_CHANGE, 5);
+    check(sendCommandToClient(mac, PROGRAM_CHANGE, 5) && halNativeEspNowTxCount() - txBefore == 1,
+          "repeat collapsed while in flight");
+    halNativeEspNowSent(mac, true);
+    check(clientMirrorProgram(mac) == 5, "program confirmed by delivery");
+    sendCommandToClient(mac, PROGRAM_CHANGE, 5);
+    check(halNativeEspNowTxCount() - txBefore == 1, "repeat of a delivered program suppressed");
+
+    sendCommandToClient(mac, PROGRAM_CHANGE, 6);
+    sendCommandToClient(mac, PROGRAM_CHANGE, 6);
+    halNativeEspNowSent(mac, false);
+    check(clientMirrorProgram(mac) == 0xFF, "failed delivery makes the client unknown");
+    serviceClientMirror();
+    check(halNativeEspNowTxCount() - txBefore == 3 && getClientMirrorStats().resent == 1,
+          "collapsed repeat resent after the failure");
+    halNativeEspNowSent(mac, true);
+    check(clientMirrorProgram(mac) == 6, "resent program confirmed");
+
+    pairClients(1);     // Client 0 re-pairs after a restart
+    check(clientMirrorProgram(mac) == 0xFF && getClientMirrorStats().reconnects == 1, "re-pair invalidates the client");
+    halNativeEspNowSent(mac, true);     // Pairing reply
+
+    struct_message status;
+    memset(&status, 0, sizeof(status));
+    status.msgType = DATA;
+    status.id = 1;
+    status.commandType = STATUS_REQUEST;
+    status.commandValue = 9;
+    halNativeEspNowReceive(mac, (const uint8_t*)&status, sizeof(status));
+    check(clientMirrorProgram(mac) == 9, "status reply sets the program");
+    uint32_t txStatus = halNativeEspNowTxCount();
+    sendCommandToClient(mac, PROGRAM_CHANGE, 9);
+    sendCommandToClient(mac, PROGRAM_CHANGE, 6);
+    check(halNativeEspNowTxCount() - txStatus == 1, "only the program the client lacks is sent");
+    halNativeEspNowSent(mac, true);
+
+    halNativeSetTxHook(deliverBeforeReturn);
+    sendCommandToClient(mac, PROGRAM_CHANGE, 7);
+    check(clientMirrorProgram(mac) == 7, "callback ahead of the send's return confirms the program");
+    halNativeSetTxHook(refuseSend);
+    sendCommandToClient(mac, PROGRAM_CHANGE, 8);
+    halNativeSetTxHook(nullptr);
+    uint32_t txRefused = halNativeEspNowTxCount();
+    sendCommandToClient(mac, PROGRAM_CHANGE, 8);
+    check(halNativeEspNowTxCount() - txRefused == 1 && clientMirrorProgram(mac) == 0xFF,
+          "refused send rolled back, not collapsed");
+    halNativeEspNowSent(mac, true);
+    flushDeferredLog();
+}
+
+// A status round over every client: one old-style reply, one with the status
+// tail, the rest missing at the deadline. Requests stop at the pending limit
+// until replies come in; the loop is never held.
+static void checkStatusCollector(int clients) {
+    uint32_t txBefore = halNativeEspNowTxCount();
+    check(startStatusCollection() && !startStatusCollection(), "one status round at a time");
+    for (int pass = 0; pass < clients; pass++) serviceStatusCollector();
+    int asked = clients < STATUS_COLLECT_MAX_PENDING ? clients : STATUS_COLLECT_MAX_PENDING;
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)asked, "status requests queued up to the pending limit");
+
+    uint8_t reply[ESPNOW_STATUS_LEN];
+    memset(reply, 0, sizeof(reply));
+    reply[0] = DATA;
+    reply[ESPNOW_MESSAGE_ID] = 1;
+    reply[ESPNOW_MESSAGE_COMMAND_TYPE] = STATUS_REQUEST;
+    reply[ESPNOW_MESSAGE_COMMAND_VALUE] = 4;
+    uint32_t clientMillis = 65000;
+    memcpy(reply + ESPNOW_MESSAGE_TIMESTAMP, &clientMillis, sizeof(clientMillis));
+    halNativeEspNowReceive(clientMacAddresses[0], reply, ESPNOW_MESSAGE_LEN);
+    uint32_t uptimeMs = 3600000;
+    memcpy(reply + ESPNOW_STATUS_UPTIME, &uptimeMs, sizeof(uptimeMs));
+    reply[ESPNOW_STATUS_RSSI] = (uint8_t)(int8_t)-61;
+    memcpy(reply + ESPNOW_STATUS_FIRMWARE, "2.1.0", 5);
+    halNativeEspNowReceive(clientMacAddresses[1], reply, sizeof(reply));
+    serviceStatusCollector();
+    asked = clients < asked + 2 ? clients : asked + 2;
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)asked, "replies make room for further requests");
+
+    const ClientStatus* legacy = getClientStatus(0);
+    const ClientStatus* tail = getClientStatus(1);
+    check(legacy->state == CLIENT_STATUS_OK && legacy->program == 4 && legacy->uptimeMs == clientMillis &&
+          legacy->rssi == CLIENT_STATUS_RSSI_UNKNOWN && legacy->firmware[0] == '\0', "old-style status reply read");
+    check(tail->state == CLIENT_STATUS_OK && tail->uptimeMs == uptimeMs && tail->rssi == -61 &&
+          strcmp(tail->firmware, "2.1.0") == 0, "status tail read");
+    check(statusCollectionActive(), "round open while clients are missing");
+    delay(STATUS_COLLECT_DEADLINE_MS);
+    serviceStatusCollector();
+    const StatusRound& round = getLastStatusRound();
+    check(!round.active && round.replies == 2 && getClientStatus(clients - 1)->state == CLIENT_STATUS_NO_REPLY,
+          "round closed at the deadline");
+    flushDeferredLog();
+}
+
+// A scene sets the relays and queues one frame per client in the same pass, is
+// recalled by the MIDI program with its number and survives a reload from NVS
+static void checkSceneEngine(int clients) {
+    resetSceneRecallStats();
+    sceneSetRelays(20, 0x03, false);
+    for (int i = 0; i < clients; i++) sceneSetClient(20, i, PROGRAM_CHANGE, (uint8_t)(30 + i));
+    sceneSetClient(20, clients - 1, ALL_CHANNELS_OFF, 0);
+
+    uint32_t txBefore = halNativeEspNowTxCount();
+    uint64_t start = hostNs();
+    check(recallScene(20, SCENE_SOURCE_SERIAL), "defined scene recalled");
+    uint64_t elapsed = hostNs() - start;
+    check(getRelayMask() == 0x03, "scene set the relay mask");
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)clients, "one frame queued per client");
+    report("Scene recall (relays + client frames queued)", 1, elapsed);
+
+    serviceScenes();
+    check(getSceneRecallStats().delivered == 0, "recall open until every frame is reported");
+    for (int i = 0; i < clients; i++) halNativeEspNowSent(clientMacAddresses[i], true);
+    serviceScenes();
+    check(getSceneRecallStats().delivered == 1, "recall closed once every frame is delivered");
+
+    setRelayMask(0);
+    uint8_t message[2] = {0xC0, 20};
+    halNativeMidiInput(message, sizeof(message));
+    processMidiInput();
+    check(getSceneRecallStats().bySource[SCENE_SOURCE_MIDI] == 1 && getRelayMask() == 0x03,
+          "MIDI PC recalled the scene with its number");
+    // The mirror only tracks programs, so just the "all off" action goes out again
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)clients + 1, "programs clients already have not resent");
+    halNativeEspNowSent(clientMacAddresses[clients - 1], true);
+    serviceScenes();
+    setSceneTriggersEnabled(false);
+    check(!sceneRecallForProgram(20, SCENE_SOURCE_MIDI), "triggers off leaves program changes alone");
+    setSceneTriggersEnabled(true);
+    check(!sceneRecallForProgram(21, SCENE_SOURCE_MIDI), "undefined scene not recalled");
+
+    delay(NVS_COMMIT_QUIET_MS + 1);
+    serviceNVSCache();
+    loadScenesFromNVS();
+    const Scene* scene = getScene(20);
+    check(sceneDefined(20) && scene->relayMask == 0x03 && scene->clients[0].type == PROGRAM_CHANGE &&
+          scene->clients[0].value == 30 && sceneTriggersEnabled(), "scenes restored from NVS");
+    sceneDelete(20);
+    flushDeferredLog();
+}
+
+// Forwarded PCs follow each client's table: shifted, sent to nobody but one
+// program, or unchanged. Tables are stored as exceptions and survive a reload.
+static void checkProgramRemap(int clients) {
+    for (int i = 0; i < clients; i++) programRemapReset(i, false);
+    programRemapShift(0, 0, 9, 20);
+    programRemapReset(1, true);
+    programRemapSet(1, 5, 5, 7);
+    check(programRemapStoredBytes(0) < 40 && programRemapStoredBytes(1) < 20 && programRemapStoredBytes(2) == 0,
+          "remap tables stored as exceptions");
+
+    uint32_t txBefore = halNativeEspNowTxCount();
+    forwardMidiProgramToAll(5);
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)clients, "remapped PC sent to every listening client");
+    check(getRigStateProgram(clientMacAddresses[0]) == 25 && getRigStateProgram(clientMacAddresses[1]) == 7 &&
+          getRigStateProgram(clientMacAddresses[2]) == 5, "each client got its own program");
+    txBefore = halNativeEspNowTxCount();
+    forwardMidiProgramToAll(50);
+    check(halNativeEspNowTxCount() - txBefore == (uint32_t)clients - 1, "no frame for a client that does not care");
+
+    delay(NVS_COMMIT_QUIET_MS + 1);
+    serviceNVSCache();
+    loadProgramRemapsFromNVS();
+    check(programRemapFor(0, 9) == 29 && programRemapFor(0, 10) == 10 && programRemapFor(1, 5) == 7 &&
+          programRemapFor(1, 50) == PROGRAM_REMAP_NONE, "remap tables restored from NVS");
+    programRemapReset(0, false);
+    programRemapReset(1, false);
+    delay(NVS_COMMIT_QUIET_MS + 1);
+    serviceNVSCache();
+    loadProgramRemapsFromNVS();
+    check(!programRemapActive(0) && !programRemapActive(1), "identity tables leave no NVS key");
+    flushDeferredLog();
+}
+
+// Write-behind commit, then a simulated reboot reads the settings back
+static void checkNvsRoundTrip() {
+    uint32_t writesBefore = halNativeNvsWrites();
+    serverMidiChannelMap[0] = 42;
+    saveServerMidiMapToNVS();
+    setRelayChannel(2);
+    serviceNVSCache();
+    check(halNativeNvsWrites() == writesBefore, "NVS write deferred during the quiet period");
+    delay(NVS_COMMIT_QUIET_MS + 1);
+    uint64_t start = hostNs();
+    serviceNVSCache();
+    uint64_t elapsed = hostNs() - start;
+    check(halNativeNvsWrites() > writesBefore, "NVS commit after the quiet period");
+    report("NVS write-behind commit", 1, elapsed);
+
+    serverMidiChannelMap[0] = 0;
+    halPinWrite(relayOutputPins[1], false);
+    restoreRelayOutputs();
+    loadConfigImage();
+    loadServerMidiConfigFromNVS();
+    check(serverMidiChannelMap[0] == 42, "MIDI map restored from NVS");
+    check(halNativePinLevel(relayOutputPins[1]), "relay state restored from NVS");
+    flushDeferredLog();
+}
+
+// RAM slot store for configLoadSlots()/configCommitSlot(). A torn write stores
+// only the first tornBytes of the new image over the old one.
+static ConfigImage ramSlots[CONFIG_SLOT_COUNT];
+static size_t ramLengths[CONFIG_SLOT_COUNT];
+static size_t tornBytes = 0;
+
+static size_t ramSlotRead(uint8_t slot, ConfigImage& out) {
+    if (ramLengths[slot] > 0) out = ramSlots[slot];
+    return ramLengths[slot];
+}
+
+static bool ramSlotWrite(uint8_t slot, const ConfigImage& image) {
+    memcpy(&ramSlots[slot], &image, tornBytes ? tornBytes : sizeof(image));
+    ramLengths[slot] = sizeof(image);
+    return true;
+}
+
+static void checkConfigSlots() {
+    const ConfigSlotStore store = {ramSlotRead, ramSlotWrite};
+    memset(ramSlots, 0, sizeof(ramSlots));
+    memset(ramLengths, 0, sizeof(ramLengths));
+    ConfigImage image, loaded;
+    memset(&image, 0, sizeof(image));
+    check(configLoadSlots(store, loaded) == -1, "empty store: no slot, defaults");
+
+    int active = -1;
+    int order[4];
+    for (int i = 0; i < 4; i++) {
+        image.midiChannel = (uint8_t)(i + 1);
+        order[i] = active = configCommitSlot(store, image, active);
+    }
+    check(order[0] == 0 && order[1] == 1 && order[2] == 0 && order[3] == 1, "writes alternate between the slots");
+    check(configLoadSlots(store, loaded) == 1 && loaded.generation == 4 && loaded.midiChannel == 4,
+          "newest slot loaded");
+
+    ramSlots[1].midiChannel ^= 0x40;    // Bit flip in the newer slot
+    check(configLoadSlots(store, loaded) == 0 && loaded.generation == 3 && loaded.midiChannel == 3,
+          "CRC-bad newer slot falls back to the older one");
+    ramSlots[1].midiChannel ^= 0x40;
+
+    tornBytes = offsetof(ConfigImage, midiChannel);     // Header and CRC land, the body does not
+    image.midiChannel = 9;
+    check(configCommitSlot(store, image, active) == -1 && image.generation == 4, "torn write detected on read-back");
+    tornBytes = 0;
+    check(configLoadSlots(store, loaded) == 1 && loaded.generation == 4, "torn older slot leaves the newer one active");
+
+    image.generation = 0xFFFE;
+    active = configCommitSlot(store, image, 1);     // Slot 0, generation 0xFFFF
+    active = configCommitSlot(store, image, active);    // Slot 1, generation 0
+    check(active == 1 && image.generation == 0 && configLoadSlots(store, loaded) == 1 && loaded.generation == 0,
+          "generation 0 after 0xFFFF is the newer one");
+
+    ramSlots[0].crc ^= 1;
+    ramLengths[1] = sizeof(ConfigImage) - 1;
+    check(configLoadSlots(store, loaded) == -1, "both slots invalid: defaults");
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "sim") == 0) return runSimulation(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) return runSwitchBenchmarks(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "replay") == 0) return runReplay(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "session") == 0) return runSessionReplay(argc - 1, argv + 1);
+    bool verbose = false;
+    int clients = 8;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+        else clients = atoi(argv[i]);
+    }
+    if (clients < 1 || clients > MAX_CLIENTS) clients = MAX_CLIENTS;
+    halNativeSetConsoleEcho(verbose);
+
+    bootCore();
+    pairClients(clients);
+    check(numClients == clients, "all virtual clients paired");
+    check(halNativeEspNowPeerCount() == clients, "ESP-NOW peer added per client");
+
+    printf("Server core on host, %d clients, log level %s\n", numClients, getLogLevelString(currentLogLevel));
+    checkMidiParser();
+    benchMidiParser();
+    benchMidiToRelay(clients);
+    benchRelaySwitch();
+    benchControlFrame();
+    benchConsoleParser();
+    benchRxRejects();
+    benchSessionRecorder(clients);
+    checkClientMirror();
+    checkStatusCollector(clients);
+    checkSceneEngine(clients);
+    if (clients >= 3) checkProgramRemap(clients);
+    checkNvsRoundTrip();
+    checkConfigSlots();
+    failures += checkControlLoopback(clients);
+    failures += checkOtaPatch();
+
+    printf("%s (%d failed checks)\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
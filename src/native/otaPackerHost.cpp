@@ -0,0 +1,18 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// The OTA packer's encoder (tools/ota-packer) built into the native runner, so
+// the patch check in otaPatchCheck.cpp packs images with the code otapack uses.
+// The tool keeps its own sources and build line.
+#include "../../tools/ota-packer/otaPacker.cpp"
@@ -0,0 +1,133 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// OTA patch round trip: a generated base and a modified target are packed with
+// the host encoder and rebuilt through otaPatchFeed() in upload-sized pieces, as
+// /patch does. A wrong base, a cut stream and an oversized varint must be
+// refused with the matching status.
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <otaPatch.h>
+#include <configImage.h>
+#include <nativeRunner.h>
+#include "../../tools/ota-packer/otaPacker.h"
+
+#define OTA_CHECK_IMAGE_BYTES 65536
+#define OTA_CHECK_UPLOAD_CHUNK 1436     // Upload piece size seen from the web server
+
+typedef std::vector<uint8_t> Bytes;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    printf("FAIL: %s\n", what);
+    failures++;
+}
+
+struct PatchTarget {
+    const Bytes* base;
+    Bytes rebuilt;
+};
+
+static bool writeRebuilt(void* context, const uint8_t* data, size_t length) {
+    PatchTarget* target = (PatchTarget*)context;
+    target->rebuilt.insert(target->rebuilt.end(), data, data + length);
+    return true;
+}
+
+static bool readBase(void* context, uint32_t offset, uint8_t* data, size_t length) {
+    PatchTarget* target = (PatchTarget*)context;
+    if ((size_t)offset + length > target->base->size()) return false;
+    memcpy(data, target->base->data() + offset, length);
+    return true;
+}
+
+// Feed the first `length` bytes of file, then finish; returns the final status
+static OtaPatchStatus decode(const Bytes& file, size_t length, const Bytes& base, Bytes& rebuilt) {
+    static OtaPatchDecoder decoder;
+    PatchTarget target = {&base, Bytes()};
+    OtaPatchIo io = {writeRebuilt, readBase, &target};
+    otaPatchBegin(decoder, io);
+    OtaPatchStatus status = OTA_PATCH_NEED_MORE;
+    for (size_t pos = 0; pos < length && status == OTA_PATCH_NEED_MORE; pos += OTA_CHECK_UPLOAD_CHUNK) {
+        size_t n = length - pos < OTA_CHECK_UPLOAD_CHUNK ? length - pos : OTA_CHECK_UPLOAD_CHUNK;
+        status = otaPatchFeed(decoder, file.data() + pos, n);
+    }
+    if (status == OTA_PATCH_NEED_MORE) status = otaPatchFinish(decoder);
+    rebuilt = target.rebuilt;
+    return status;
+}
+
+// Firmware-like base: code-ish random words with repeated tables
+static Bytes generateBase() {
+    Bytes base(OTA_CHECK_IMAGE_BYTES);
+    uint32_t seed = 0x5EED0A7Au;
+    for (size_t i = 0; i < base.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        base[i] = (i / 4096) % 3 == 2 ? (uint8_t)(i % 61) : (uint8_t)(seed >> 24);
+    }
+    return base;
+}
+
+// A release built from the base: one function rewritten, code inserted (the
+// rest shifts) and a string table changed
+static Bytes modifyTarget(const Bytes& base) {
+    Bytes target(base);
+    for (size_t i = 1000; i < 1200; i++) target[i] ^= 0x5A;
+    Bytes inserted(700);
+    for (size_t i = 0; i < inserted.size(); i++) inserted[i] = (uint8_t)(i * 7);
+    target.insert(target.begin() + 30000, inserted.begin(), inserted.end());
+    memcpy(target.data() + 50000, "release 2.1.0 built for the rig", 31);
+    return target;
+}
+
+int checkOtaPatch() {
+    failures = 0;
+    Bytes base = generateBase();
+    Bytes target = modifyTarget(base);
+    Bytes rebuilt;
+    OtaPackStats stats;
+
+    Bytes delta = otaPackImage(target, &base, stats);
+    check(stats.baseCopies > 0 && delta.size() < target.size() / 10, "delta mostly copies from the base");
+    check(decode(delta, delta.size(), base, rebuilt) == OTA_PATCH_DONE && rebuilt == target,
+          "delta rebuilt the target through otaPatchFeed");
+
+    Bytes compressed = otaPackImage(target, nullptr, stats);
+    Bytes none;
+    check(decode(compressed, compressed.size(), none, rebuilt) == OTA_PATCH_DONE && rebuilt == target,
+          "compressed image rebuilt the target");
+
+    Bytes otherBase(base);
+    otherBase[base.size() / 2] ^= 1;
+    check(decode(delta, delta.size(), otherBase, rebuilt) == OTA_PATCH_BASE_MISMATCH && rebuilt.empty(),
+          "delta against another base refused before any write");
+    check(decode(delta, delta.size() - 5, base, rebuilt) == OTA_PATCH_TRUNCATED, "cut delta stream reported truncated");
+    check(decode(compressed, sizeof(OtaPatchHeader) + 10, none, rebuilt) == OTA_PATCH_TRUNCATED,
+          "cut compressed stream reported truncated");
+
+    // Base copy whose length varint runs to a sixth byte
+    Bytes corrupt(delta.begin(), delta.begin() + sizeof(OtaPatchHeader));
+    const uint8_t token[] = {OTA_PATCH_TOKEN_BASE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+    corrupt.insert(corrupt.end(), token, token + sizeof(token));
+    ((OtaPatchHeader*)corrupt.data())->payloadSize = sizeof(token);
+    check(decode(corrupt, corrupt.size(), base, rebuilt) == OTA_PATCH_BAD_TOKEN, "oversized varint refused");
+
+    printf("OTA patch: %zu byte target, delta %zu bytes (%.1f%%), compressed %zu bytes (%.1f%%)\n", target.size(),
+           delta.size(), 100.0 * delta.size() / target.size(), compressed.size(),
+           100.0 * compressed.size() / target.size());
+    return failures;
+}
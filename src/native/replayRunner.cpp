@@ -0,0 +1,248 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Replays an ESP-NOW capture (converted by tools/espnow-capture) through the
+// simulated medium: the server core re-sends the captured TX frames and the
+// captured RX frames come from virtual clients, at their recorded times. The
+// report compares what was captured (delivered/failed per peer, frames
+// accepted/rejected) with the replay under the chosen channel conditions.
+//
+//   program replay FILE [-v] [--loss P] [--latency US] [--jitter US]
+//                       [--retries N] [--queue N] [--busy DUTY] [--phy BIT/S] [--seed N]
+//
+// Pairing frames are not replayed: the virtual clients pair on a clean channel
+// before the replay starts and take the captured peer slots in order. Truncated records are
+// skipped and counted.
+#include <Arduino.h>
+#include <vector>
+#include <hal.h>
+#include <halNative.h>
+#include <espnowSim.h>
+#include <nativeRunner.h>
+#include <globals.h>
+#include <espnow.h>
+#include <espnowCapture.h>
+#include <espnow-pairing.h>
+#include <nvsManager.h>
+
+#define REPLAY_LOOP_US 100
+#define REPLAY_PAIRING_WINDOW_US 3000000
+#define REPLAY_DRAIN_US 2000000
+#define REPLAY_SETTLE_US 20000          // Frames off air still reach their receiver after the stack latency
+
+struct ReplayEvent {
+    uint64_t timeUs;
+    uint8_t event;              // EspNowCaptureEvent
+    uint8_t peer;
+    uint8_t status;
+    uint16_t length;            // On air
+    uint8_t mac[6];
+    std::vector<uint8_t> data;
+};
+
+struct PeerTally {
+    uint32_t tx;
+    uint32_t delivered;
+    uint32_t failed;
+    uint32_t rx;
+};
+
+static double argNumber(int argc, char** argv, const char* name, double fallback) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return atof(argv[i + 1]);
+    }
+    return fallback;
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool loadReplay(const char* path, std::vector<ReplayEvent>& events) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[1024];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineNo++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        unsigned long long timeUs;
+        char kind[8], hex[600];
+        unsigned peer, status, length, mac[6];
+        if (sscanf(line, "%llu %7s %u %u %u %x:%x:%x:%x:%x:%x %599s", &timeUs, kind, &peer, &status, &length,
+                   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], hex) != 12) {
+            fprintf(stderr, "%s:%d: malformed line\n", path, lineNo);
+            fclose(f);
+            return false;
+        }
+        ReplayEvent event;
+        event.timeUs = timeUs;
+        event.event = strcmp(kind, "tx") == 0 ? CAPTURE_TX : strcmp(kind, "rx") == 0 ? CAPTURE_RX : CAPTURE_TX_STATUS;
+        event.peer = (uint8_t)peer;
+        event.status = (uint8_t)status;
+        event.length = (uint16_t)length;
+        for (int i = 0; i < 6; i++) event.mac[i] = (uint8_t)mac[i];
+        for (size_t i = 0; hex[0] != '-' && hex[i] && hex[i + 1]; i += 2) {
+            int hi = hexNibble(hex[i]), lo = hexNibble(hex[i + 1]);
+            if (hi < 0 || lo < 0) break;
+            event.data.push_back((uint8_t)(hi << 4 | lo));
+        }
+        events.push_back(event);
+    }
+    fclose(f);
+    return true;
+}
+
+static void loopOnce() {
+    runCoreLoopOnce();
+    halNativeAdvanceUs(REPLAY_LOOP_US);
+}
+
+static bool isClientSlot(uint8_t peer, int clients) {
+    return peer != CAPTURE_PEER_BROADCAST && peer != CAPTURE_PEER_UNKNOWN && peer < clients;
+}
+
+int runReplay(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "usage: program replay FILE [-v] [--loss P] [--latency US] [--seed N] ...\n");
+        return 2;
+    }
+    std::vector<ReplayEvent> events;
+    if (!loadReplay(argv[1], events)) return 1;
+
+    int clients = 1;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].peer < CAPTURE_PEER_BROADCAST && events[i].peer + 1 > clients) clients = events[i].peer + 1;
+    }
+    if (clients > MAX_CLIENTS) clients = MAX_CLIENTS;
+
+    EspNowSimConfig config;
+    espNowSimDefaults(config);
+    config.clients = clients;
+    config.loss = (float)argNumber(argc, argv, "--loss", config.loss);
+    config.latencyUs = (uint32_t)argNumber(argc, argv, "--latency", config.latencyUs);
+    config.jitterUs = (uint32_t)argNumber(argc, argv, "--jitter", config.jitterUs);
+    config.retries = (uint8_t)argNumber(argc, argv, "--retries", config.retries);
+    config.txQueueDepth = (uint8_t)argNumber(argc, argv, "--queue", config.txQueueDepth);
+    config.foreignDuty = (float)argNumber(argc, argv, "--busy", config.foreignDuty);
+    config.bitRate = (uint32_t)argNumber(argc, argv, "--phy", config.bitRate);
+    config.seed = (uint32_t)argNumber(argc, argv, "--seed", config.seed);
+    bool verbose = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+    }
+    halNativeSetConsoleEcho(verbose);
+
+    bootCore();
+    float loss = config.loss;
+    config.loss = 0;
+    espNowSimBegin(config);
+    pairingforceStart();
+    for (int i = 0; i < clients; i++) espNowSimStartPairing(i);
+    uint64_t pairingEnd = halNativeNowUs() + REPLAY_PAIRING_WINDOW_US;
+    int paired = 0;
+    while (halNativeNowUs() < pairingEnd && paired < clients) {
+        loopOnce();
+        paired = 0;
+        for (int i = 0; i < clients; i++) paired += espNowSimClientPaired(i) ? 1 : 0;
+    }
+    flushNVSCache();
+    if (paired < clients) {
+        printf("FAILED: %d of %d virtual clients paired\n", paired, clients);
+        espNowSimEnd();
+        return 1;
+    }
+
+    espNowSimSetLoss(loss);
+    config.loss = loss;
+
+    std::vector<PeerTally> captured(clients), replayed(clients);
+    uint32_t skippedPairing = 0, skippedTruncated = 0, skippedUnknown = 0, foreignRx = 0, capturedRejects = 0;
+    EspNowRxStats rxBefore = getEspNowRxStats();
+    espNowSimResetStats();
+    uint64_t base = halNativeNowUs() + 100000;
+
+    for (size_t i = 0; i < events.size(); i++) {
+        const ReplayEvent& e = events[i];
+        while (halNativeNowUs() < base + e.timeUs) loopOnce();
+        bool client = isClientSlot(e.peer, clients);
+        if (e.event == CAPTURE_TX_STATUS) {
+            if (client) (e.status == 0 ? captured[e.peer].delivered : captured[e.peer].failed)++;
+            continue;
+        }
+        if (e.event == CAPTURE_RX && e.status != 0) capturedRejects++;
+        if (!e.data.empty() && e.data[0] == ESPNOW_MSG_PAIRING) {
+            skippedPairing++;
+            continue;
+        }
+        if (e.data.size() < e.length) {
+            skippedTruncated++;
+            continue;
+        }
+        if (e.event == CAPTURE_TX) {
+            if (client) captured[e.peer].tx++;
+            if (client || e.peer == CAPTURE_PEER_BROADCAST) {
+                uint8_t mac[6];
+                if (client) espNowSimClientMac(e.peer, mac);
+                else memset(mac, 0xFF, sizeof(mac));
+                espNowSend(mac, e.data.data(), e.data.size());
+            } else {
+                skippedUnknown++;
+            }
+        } else if (client) {
+            captured[e.peer].rx++;
+            espNowSimClientSend(e.peer, e.data.data(), e.data.size());
+        } else {
+            foreignRx++;                // Unpaired sender: straight into the receive callback
+            halNativeEspNowReceive(e.mac, e.data.data(), (int)e.data.size());
+        }
+    }
+    uint64_t drainEnd = halNativeNowUs() + REPLAY_DRAIN_US;
+    while (halNativeNowUs() < drainEnd && !espNowSimIdle()) loopOnce();
+    uint64_t settleEnd = halNativeNowUs() + REPLAY_SETTLE_US;
+    while (halNativeNowUs() < settleEnd) loopOnce();
+
+    const EspNowSimStats& radio = espNowSimStats();
+    const EspNowRxStats& rxAfter = getEspNowRxStats();
+    uint32_t rejected = 0;
+    for (int r = ESPNOW_RX_OK + 1; r < ESPNOW_RX_REASON_COUNT; r++) rejected += rxAfter.rejected[r] - rxBefore.rejected[r];
+
+    printf("Replay of %s: %u events over %.1f ms, %d clients\n", argv[1], (unsigned)events.size(),
+           events.empty() ? 0.0 : events.back().timeUs / 1000.0, clients);
+    printf("  medium: loss %.1f%%, latency %u+0..%u us, %u retries, queue %u, foreign airtime %.0f%%, seed %u\n",
+           config.loss * 100, config.latencyUs, config.jitterUs, config.retries, config.txQueueDepth,
+           config.foreignDuty * 100, config.seed);
+    printf("  skipped: %u pairing, %u truncated, %u TX to unknown peers; %u RX from unpaired senders\n",
+           skippedPairing, skippedTruncated, skippedUnknown, foreignRx);
+    printf("  server RX: captured %u rejected; replay %u accepted, %u rejected\n",
+           capturedRejects, rxAfter.accepted - rxBefore.accepted, rejected);
+
+    printf("\n  peer   captured tx/delivered/failed     replay tx/delivered/failed   rx\n");
+    for (int i = 0; i < clients; i++) {
+        replayed[i].delivered = radio.clientDelivered[i];
+        replayed[i].failed = radio.clientFailed[i];
+        printf("  %4d   %6u %9u %6u            %6u %9u %6u   %4u\n", i,
+               captured[i].tx, captured[i].delivered, captured[i].failed,
+               captured[i].tx, replayed[i].delivered, replayed[i].failed, captured[i].rx);
+    }
+
+    espNowSimEnd();
+    return 0;
+}
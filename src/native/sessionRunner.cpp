@@ -0,0 +1,415 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Replays a recorded session (sessionRecord.h) against the server core: the
+// recorded inputs are injected at their recorded times and the core records a
+// new session while it runs. The relay/TX outputs of the two are then compared
+// in order; frames are compared byte for byte except the readingId and
+// timestamp fields, which are stamped at send time.
+//
+//   program session FILE [-v] [--trace FILE] [--expected FILE]
+//
+// FILE is a session as written by 'program sim --session' or a serial log with
+// a 'session dump' in it (the last intact #SESSION block is used). --trace and
+// --expected write the replayed and the recorded output trace as text.
+//
+// The replay boots from the recorded config image, relay mask and station MAC,
+// and applies the recorded start levels of the inputs before the session
+// starts. Results of halEspNowSend() are inputs too: the TX hook returns the
+// recorded result for each frame in turn. Console commands and control frames
+// run through the same dispatcher as on the device. Device-only actions
+// (restart, firmware push, live OTA) are skipped: outputs from the first of
+// them on are reported as not comparable instead of compared. Exits non-zero if
+// the comparable part of the traces differs.
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include <hal.h>
+#include <halNative.h>
+#include <nativeRunner.h>
+#include <globals.h>
+#include <configImage.h>
+#include <espnowFrame.h>
+#include <sessionRecord.h>
+#include <nvsManager.h>
+#include <relayControl.h>
+#include <commandHandler.h>
+#include <espnow-pairing.h>
+
+#define SESSION_REPLAY_LOOP_US 50
+#define SESSION_REPLAY_SETTLE_US 200000     // Boot work and start levels, before recording
+#define SESSION_REPLAY_TAIL_US 20000        // Past the recorded end, for outputs still in progress
+#define SESSION_REPLAY_SHOWN 10             // Mismatches listed
+
+struct SessionEvent {
+    uint32_t timeUs;
+    uint8_t type;
+    std::vector<uint8_t> payload;
+};
+
+struct Session {
+    SessionHeader header;
+    std::vector<SessionEvent> inputs;
+    std::vector<SessionEvent> outputs;
+    std::vector<uint32_t> latencyUs;        // Per output: time since the last input before it
+};
+
+static std::vector<uint8_t> exported;
+static std::vector<int> txResults;          // Recorded results of frames that reached the driver
+static size_t txNext = 0;
+static const std::vector<SessionEvent>* pendingInputs = nullptr;
+static size_t nextInput = 0;
+static uint64_t replayBaseUs = 0;
+
+static const char* argString(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return nullptr;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+// Last intact "#SESSION <length> <crc>" block in a serial log
+static bool extractSession(const std::vector<uint8_t>& log, std::vector<uint8_t>& session) {
+    static const char marker[] = "#SESSION ";
+    bool found = false;
+    for (size_t i = 0; i + sizeof(marker) - 1 < log.size(); i++) {
+        if ((i > 0 && log[i - 1] != '\n') || memcmp(&log[i], marker, sizeof(marker) - 1) != 0) continue;
+        size_t eol = i;
+        while (eol < log.size() && log[eol] != '\n') eol++;
+        if (eol >= log.size()) break;
+        std::string line((const char*)&log[i], eol - i);
+        unsigned long length = 0, crc = 0;
+        if (sscanf(line.c_str(), "#SESSION %lu %lx", &length, &crc) != 2 || eol + 1 + length > log.size()) continue;
+        const uint8_t* body = &log[eol + 1];
+        if (configCrc32(body, length) != (uint32_t)crc) {
+            fprintf(stderr, "dump at offset %lu: CRC mismatch (console output mixed in?), skipped\n", (unsigned long)i);
+            continue;
+        }
+        session.assign(body, body + length);
+        found = true;
+        i = eol + length;
+    }
+    return found;
+}
+
+static bool parseSession(const uint8_t* data, size_t length, Session& out, const char* what) {
+    if (length < sizeof(SessionHeader)) {
+        fprintf(stderr, "%s: too short for a session header\n", what);
+        return false;
+    }
+    memcpy(&out.header, data, sizeof(out.header));
+    const SessionHeader& h = out.header;
+    if (h.magic != SESSION_MAGIC || h.version != SESSION_VERSION || h.headerSize != sizeof(SessionHeader)) {
+        fprintf(stderr, "%s: not a version %d session (magic %08X, version %u)\n", what, SESSION_VERSION,
+                (unsigned)h.magic, h.version);
+        return false;
+    }
+    if (sizeof(SessionHeader) + h.recordBytes > length || !configImageValid(h.config, sizeof(h.config))) {
+        fprintf(stderr, "%s: truncated session or invalid config image\n", what);
+        return false;
+    }
+    const uint8_t* records = data + sizeof(SessionHeader);
+    size_t offset = 0;
+    SessionRecordHeader record;
+    const uint8_t* payload;
+    uint32_t lastInputUs = 0;
+    while (sessionNextRecord(records, h.recordBytes, offset, record, payload)) {
+        SessionEvent event;
+        event.timeUs = record.timeUs;
+        event.type = record.type;
+        event.payload.assign(payload, payload + record.length);
+        if (record.type >= SESSION_RELAY) {
+            out.outputs.push_back(event);
+            out.latencyUs.push_back(record.timeUs - lastInputUs);
+        } else {
+            out.inputs.push_back(event);
+            lastInputUs = record.timeUs;
+        }
+    }
+    if (offset != h.recordBytes) fprintf(stderr, "%s: %u bytes after the last complete record ignored\n", what,
+                                         (unsigned)(h.recordBytes - offset));
+    return true;
+}
+
+static bool loadSession(const char* path, Session& out) {
+    std::vector<uint8_t> raw, session;
+    if (!readFile(path, raw)) return false;
+    uint32_t magic = 0;
+    if (raw.size() >= 4) memcpy(&magic, raw.data(), 4);
+    if (magic == SESSION_MAGIC) {
+        session.swap(raw);
+    } else if (!extractSession(raw, session)) {
+        fprintf(stderr, "%s: no session header and no intact '#SESSION' dump found\n", path);
+        return false;
+    }
+    return parseSession(session.data(), session.size(), out, path);
+}
+
+static int16_t txResult(const SessionEvent& e) {
+    return (int16_t)(e.payload[6] | (e.payload[7] << 8));
+}
+
+// Same output, ignoring the fields stamped at send time
+static bool sameOutput(const SessionEvent& a, const SessionEvent& b) {
+    if (a.type != b.type || a.payload.size() != b.payload.size()) return false;
+    if (a.type != SESSION_TX || a.payload.size() < SESSION_TX_FRAME + 1) return a.payload == b.payload;
+    std::vector<uint8_t> x(a.payload), y(b.payload);
+    const uint8_t* frame = &x[SESSION_TX_FRAME];
+    size_t frameLength = x.size() - SESSION_TX_FRAME;
+    if ((frame[0] == ESPNOW_MSG_DATA || frame[0] == ESPNOW_MSG_COMMAND) && frameLength >= ESPNOW_MESSAGE_LEN) {
+        memset(&x[SESSION_TX_FRAME + ESPNOW_MESSAGE_READING_ID], 0, 8);
+        memset(&y[SESSION_TX_FRAME + ESPNOW_MESSAGE_READING_ID], 0, 8);
+    }
+    return x == y;
+}
+
+static void describe(const SessionEvent& e, char* out, size_t size) {
+    if (e.type == SESSION_RELAY && !e.payload.empty()) {
+        snprintf(out, size, "%10u relay 0x%02X", e.timeUs, e.payload[0]);
+        return;
+    }
+    if (e.type != SESSION_TX || e.payload.size() < SESSION_TX_FRAME + 1) {
+        snprintf(out, size, "%10u type %u (%u bytes)", e.timeUs, e.type, (unsigned)e.payload.size());
+        return;
+    }
+    const uint8_t* p = e.payload.data();
+    const uint8_t* frame = p + SESSION_TX_FRAME;
+    size_t frameLength = e.payload.size() - SESSION_TX_FRAME;
+    int n = snprintf(out, size, "%10u tx %02x:%02x:%02x:%02x:%02x:%02x len %u msg %u", e.timeUs,
+                     p[0], p[1], p[2], p[3], p[4], p[5], (unsigned)frameLength, frame[0]);
+    if ((frame[0] == ESPNOW_MSG_DATA || frame[0] == ESPNOW_MSG_COMMAND) && frameLength >= ESPNOW_MESSAGE_LEN) {
+        n += snprintf(out + n, size - n, " cmd %u value %u", frame[ESPNOW_MESSAGE_COMMAND_TYPE],
+                      frame[ESPNOW_MESSAGE_COMMAND_VALUE]);
+    }
+    if (txResult(e) != HAL_OK) snprintf(out + n, size - n, " result 0x%X", (unsigned)(uint16_t)txResult(e));
+}
+
+static bool writeTrace(const char* path, const std::vector<SessionEvent>& outputs) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[160];
+    for (size_t i = 0; i < outputs.size(); i++) {
+        describe(outputs[i], line, sizeof(line));
+        fprintf(f, "%s\n", line);
+    }
+    fclose(f);
+    return true;
+}
+
+static void collect(const void* data, size_t length) {
+    exported.insert(exported.end(), (const uint8_t*)data, (const uint8_t*)data + length);
+}
+
+static int replayTxHook(const uint8_t* mac, const uint8_t* data, size_t len) {
+    (void)mac;
+    (void)data;
+    (void)len;
+    return txNext < txResults.size() ? txResults[txNext++] : HAL_OK;
+}
+
+static void loopOnce() {
+    runCoreLoopOnce();
+    checkPairingButtons();
+    halNativeAdvanceUs(SESSION_REPLAY_LOOP_US);
+}
+
+static void inject(const SessionEvent& e) {
+    const uint8_t* p = e.payload.data();
+    size_t length = e.payload.size();
+    switch (e.type) {
+    case SESSION_PIN:
+        if (length >= 2) halNativeSetInput(p[0], p[1] != 0);
+        break;
+    case SESSION_MIDI:
+        halNativeMidiInput(p, length);
+        break;
+    case SESSION_CONSOLE:
+        halNativeConsoleInputBytes(p, length);
+        break;
+    case SESSION_ESPNOW_RX:
+        if (length >= 6) halNativeEspNowReceive(p, p + 6, (int)(length - 6));
+        break;
+    case SESSION_ESPNOW_SENT:
+        if (length >= 7) halNativeEspNowSent(p, p[6] != 0);
+        break;
+    }
+}
+
+// Inputs arrive while the core waits in delay() too (UART buffers, WiFi task
+// callbacks): inject every input due before the clock reaches targetUs
+static void advanceWithInputs(uint64_t targetUs) {
+    while (pendingInputs && nextInput < pendingInputs->size() &&
+           replayBaseUs + (*pendingInputs)[nextInput].timeUs <= targetUs) {
+        const SessionEvent& e = (*pendingInputs)[nextInput++];
+        halNativeSetTimeUs(replayBaseUs + e.timeUs);
+        inject(e);
+    }
+}
+
+static void latencySummary(const std::vector<uint32_t>& us, double& mean, uint32_t& max) {
+    uint64_t total = 0;
+    max = 0;
+    for (size_t i = 0; i < us.size(); i++) {
+        total += us[i];
+        if (us[i] > max) max = us[i];
+    }
+    mean = us.empty() ? 0.0 : (double)total / us.size();
+}
+
+int runSessionReplay(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "usage: program session FILE [-v] [--trace FILE] [--expected FILE]\n");
+        return 2;
+    }
+    Session recorded;
+    if (!loadSession(argv[1], recorded)) return 1;
+    const SessionHeader& h = recorded.header;
+    bool verbose = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+    }
+    halNativeSetConsoleEcho(verbose);
+
+    for (size_t i = 0; i < recorded.outputs.size(); i++) {
+        const SessionEvent& e = recorded.outputs[i];
+        if (e.type != SESSION_TX || e.payload.size() < SESSION_TX_FRAME) continue;
+        int result = txResult(e);
+        if (result != HAL_NATIVE_ERR_ARG && result != HAL_NATIVE_ERR_NOT_FOUND) txResults.push_back(result);
+    }
+
+    // Boot as the recorded server: same settings, MAC and relays
+    halNativeSetStationMac(h.serverMac);
+    checkNVS();
+    if (!importConfigImage(h.config)) {
+        printf("FAILED: could not write the recorded config image\n");
+        return 1;
+    }
+    for (size_t i = 0; i < recorded.inputs.size(); i++) {
+        const SessionEvent& e = recorded.inputs[i];
+        if (e.type == SESSION_SCENE_BANK && e.payload.size() > 1) {
+            saveSceneBankToNVS(e.payload[0], e.payload.data() + 1, e.payload.size() - 1);
+        } else if (e.type == SESSION_PROGRAM_REMAP && e.payload.size() > 1) {
+            saveProgramRemapToNVS(e.payload[0], e.payload.data() + 1, e.payload.size() - 1);
+        }
+    }
+    flushNVSCache();
+    bootCore();
+#if HAS_RELAY_OUTPUTS
+    setRelayMask(h.relayMask);
+#endif
+    if (h.flags & SESSION_FLAG_PAIRING) pairingforceStart();
+    size_t next = 0;
+    while (next < recorded.inputs.size() && recorded.inputs[next].type == SESSION_PIN &&
+           recorded.inputs[next].timeUs == 0) {
+        inject(recorded.inputs[next++]);
+    }
+    uint64_t settleEnd = halNativeNowUs() + SESSION_REPLAY_SETTLE_US;
+    while (halNativeNowUs() < settleEnd) loopOnce();
+    halNativeSetTxHook(replayTxHook);
+
+    nativeResetSkippedActions();
+    sessionRecordStart();
+    replayBaseUs = halNativeNowUs();
+    pendingInputs = &recorded.inputs;
+    nextInput = next;
+    halNativeOnAdvance(advanceWithInputs);
+    uint64_t end = replayBaseUs + h.durationUs + SESSION_REPLAY_TAIL_US;
+    while (halNativeNowUs() < end) loopOnce();
+    sessionRecordStop();
+    halNativeOnAdvance(nullptr);
+    halNativeSetTxHook(nullptr);
+    sessionRecordExport(collect);
+
+    Session replayed;
+    if (!parseSession(exported.data(), exported.size(), replayed, "replay")) return 1;
+
+    // ---- Compare ----
+    // Outputs from the first skipped device-only action on depend on what the
+    // device did there; they are counted but not compared
+    uint64_t skippedUs = 0;
+    uint32_t skipped = nativeSkippedActions(&skippedUs);
+    size_t recordedCompared = recorded.outputs.size(), replayedCompared = replayed.outputs.size();
+    if (skipped > 0) {
+        uint32_t cutUs = (uint32_t)(skippedUs - replayBaseUs);
+        while (recordedCompared > 0 && recorded.outputs[recordedCompared - 1].timeUs >= cutUs) recordedCompared--;
+        while (replayedCompared > 0 && replayed.outputs[replayedCompared - 1].timeUs >= cutUs) replayedCompared--;
+    }
+    size_t common = recordedCompared < replayedCompared ? recordedCompared : replayedCompared;
+    size_t matched = 0, shown = 0;
+    std::vector<uint32_t> shift;
+    char a[160], b[160];
+    for (size_t i = 0; i < common; i++) {
+        const SessionEvent& r = recorded.outputs[i];
+        const SessionEvent& p = replayed.outputs[i];
+        if (sameOutput(r, p)) {
+            matched++;
+            shift.push_back(p.timeUs > r.timeUs ? p.timeUs - r.timeUs : r.timeUs - p.timeUs);
+        } else if (shown++ < SESSION_REPLAY_SHOWN) {
+            describe(r, a, sizeof(a));
+            describe(p, b, sizeof(b));
+            printf("  output %u differs\n    recorded %s\n    replayed %s\n", (unsigned)i, a, b);
+        }
+    }
+    bool same = matched == recordedCompared && matched == replayedCompared;
+
+    double recordedMean, replayedMean, shiftMean;
+    uint32_t recordedMax, replayedMax, shiftMax;
+    latencySummary(recorded.latencyUs, recordedMean, recordedMax);
+    latencySummary(replayed.latencyUs, replayedMean, replayedMax);
+    latencySummary(shift, shiftMean, shiftMax);
+
+    printf("Session %s: firmware %.*s, %.1f ms, %u inputs, %u outputs (%u records dropped, %u MIDI real-time bytes skipped)\n",
+           argv[1], SESSION_FIRMWARE_LEN, h.firmware, h.durationUs / 1000.0, (unsigned)recorded.inputs.size(),
+           (unsigned)recorded.outputs.size(), h.droppedRecords, h.skippedRealtime);
+    printf("  replay: %u outputs, %u match in order, %u differ, %d extra/missing\n",
+           (unsigned)replayed.outputs.size(), (unsigned)matched, (unsigned)(common - matched),
+           (int)replayedCompared - (int)recordedCompared);
+    printf("  input->output latency: recorded mean %.0f max %u us, replayed mean %.0f max %u us\n",
+           recordedMean, recordedMax, replayedMean, replayedMax);
+    printf("  output time shift (matched): mean %.0f max %u us\n", shiftMean, shiftMax);
+    if (h.droppedRecords > 0) printf("  note: the recorder buffer filled up; the replay stops where the recording did\n");
+    if (skipped > 0) {
+        printf("  note: %u device-only console actions skipped, the first at %.1f ms; %u recorded and %u replayed "
+               "outputs after it are not comparable\n", skipped, (skippedUs - replayBaseUs) / 1000.0,
+               (unsigned)(recorded.outputs.size() - recordedCompared), (unsigned)(replayed.outputs.size() - replayedCompared));
+    }
+
+    const char* tracePath = argString(argc, argv, "--trace");
+    const char* expectedPath = argString(argc, argv, "--expected");
+    if (tracePath && writeTrace(tracePath, replayed.outputs)) printf("Replayed trace written to %s\n", tracePath);
+    if (expectedPath && writeTrace(expectedPath, recorded.outputs)) printf("Recorded trace written to %s\n", expectedPath);
+
+    if (same && skipped > 0) {
+        printf("OK: replayed relay/TX trace matches the recording up to the first skipped action\n");
+    } else {
+        printf("%s\n", same ? "OK: replayed relay/TX trace matches the recording" : "FAILED: traces differ");
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,432 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ESP-NOW load simulation: pairs virtual clients over the simulated medium,
+// plays bursts of MIDI Program Changes into the UART at a fixed rate and
+// follows every PC to each client. Reports what the UART accepted, how the
+// radio coped (queueing, retries, delivery) and the input-to-client latency
+// and first-to-last client skew per PC.
+//
+//   program sim [-v] [--clients N] [--loss P] [--weak N] [--weak-loss P]
+//               [--latency US] [--jitter US] [--rate PC/s] [--burst MS]
+//               [--idle MS] [--bursts N] [--retries N] [--queue N]
+//               [--busy DUTY] [--phy BIT/S] [--seed N] [--capture FILE]
+//               [--session FILE] [--repeat N] [--no-mirror] [--status N]
+//               [--scenes] [--mute N] [--type TEXT]
+//
+// --capture records the run in the ESP-NOW capture ring and writes it as pcap
+// (the last ESPNOW_CAPTURE_RECORDS frames), the same as 'capture dump' on a device.
+// --session records the load phase with the session recorder, for 'program session'.
+// --repeat sends every program N times in a row, as a controller resending its
+// current patch would; --no-mirror turns the client mirror off to compare.
+// --status runs N status collection rounds after pairing and reports how long
+// each took to gather every client's reply.
+// --scenes defines scene N as "every client to program N" for all 128 programs,
+// so each PC is a scene recall (frames queued back to back) instead of a forward.
+// --mute gives the last N paired clients a remap table that sends them nothing,
+// as for clients that do not care about program changes.
+// --type types TEXT on the console halfway through every idle gap; ';' separates
+// commands ("send channel 2 0;relay").
+#include <Arduino.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <hal.h>
+#include <halNative.h>
+#include <espnowSim.h>
+#include <nativeRunner.h>
+#include <globals.h>
+#include <espnow-pairing.h>
+#include <nvsManager.h>
+#include <utils.h>
+#include <espnowCapture.h>
+#include <sessionRecord.h>
+#include <clientMirror.h>
+#include <statusCollector.h>
+#include <sceneEngine.h>
+#include <programRemap.h>
+
+#define SIM_LOOP_US 100                 // Virtual time per loop() pass
+#define SIM_PAIRING_WINDOW_US 3000000
+#define SIM_DRAIN_LIMIT_US 120000000    // Give up waiting for a backlog after this
+
+struct PcEvent {
+    uint64_t dueUs;                     // MIDI bytes enter the UART
+    uint8_t program;
+    bool accepted;                      // Both bytes fitted in the RX buffer
+    uint32_t receivedMask;              // Clients that got this PC
+    uint8_t received;
+    uint64_t firstRxUs;
+    uint64_t lastRxUs;
+};
+
+static std::vector<PcEvent> pcEvents;
+static std::vector<uint32_t> acceptedEvents;   // Index into pcEvents, in UART order
+static size_t nextEvent = 0;
+static bool inMidiInput = false;
+static uint64_t midiPassUs = 0;          // Virtual time spent in loop passes that handled PCs
+
+static double argNumber(int argc, char** argv, const char* name, double fallback) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return atof(argv[i + 1]);
+    }
+    return fallback;
+}
+
+static const char* argString(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return nullptr;
+}
+
+// Console lines as typed at the terminal
+static void typeConsole(const char* text) {
+    std::string lines(text);
+    std::replace(lines.begin(), lines.end(), ';', '\n');
+    lines += "\r\n";
+    halNativeConsoleInput(lines.c_str());
+}
+
+static FILE* outputFile = nullptr;
+
+static void writeOutput(const void* data, size_t length) {
+    fwrite(data, 1, length, outputFile);
+}
+
+// Export with writeOutput(); returns the bytes written, or 0 if the file could not be created
+static size_t exportTo(const char* path, size_t (*produce)(void (*write)(const void* data, size_t length))) {
+    outputFile = fopen(path, "wb");
+    if (!outputFile) {
+        perror(path);
+        return 0;
+    }
+    size_t bytes = produce(writeOutput);
+    fclose(outputFile);
+    outputFile = nullptr;
+    return bytes;
+}
+
+// Frames queued while processMidiInput() handles a PC carry the UART read
+// count, which identifies the PC because every one is two bytes
+static uint32_t midiTag() {
+    return inMidiInput ? halNativeMidiBytesRead() : 0;
+}
+
+static void onClientCommand(int client, const struct_message& message, uint32_t tag, uint64_t queuedUs, uint64_t rxUs) {
+    (void)queuedUs;
+    if (message.commandType != PROGRAM_CHANGE || tag < 2 || tag / 2 > acceptedEvents.size()) return;
+    PcEvent& event = pcEvents[acceptedEvents[tag / 2 - 1]];
+    uint32_t bit = 1u << client;
+    if (event.receivedMask & bit) return;
+    event.receivedMask |= bit;
+    if (event.received++ == 0) event.firstRxUs = rxUs;
+    event.lastRxUs = rxUs;
+}
+
+static void injectPc(PcEvent& event) {
+    uint8_t message[2] = {0xC0, event.program};
+    uint32_t droppedBefore = halNativeMidiDropped();
+    halNativeMidiInput(message, sizeof(message));
+    event.accepted = halNativeMidiDropped() == droppedBefore;
+    if (event.accepted) acceptedEvents.push_back((uint32_t)(&event - &pcEvents[0]));
+}
+
+// The UART keeps receiving while the core waits in delay(): inject every PC due
+// before the clock reaches targetUs, interleaved with the radio events
+static void advanceWithInputs(uint64_t targetUs) {
+    while (nextEvent < pcEvents.size() && pcEvents[nextEvent].dueUs <= targetUs) {
+        PcEvent& event = pcEvents[nextEvent++];
+        espNowSimRun(event.dueUs);
+        halNativeSetTimeUs(event.dueUs);
+        injectPc(event);
+    }
+    espNowSimRun(targetUs);
+}
+
+static void loopOnce() {
+    uint32_t bytesBefore = halNativeMidiBytesRead();
+    uint64_t passStart = halNativeNowUs();
+    inMidiInput = true;
+    runCoreLoopOnce();
+    inMidiInput = false;
+    if (halNativeMidiBytesRead() != bytesBefore) midiPassUs += halNativeNowUs() - passStart;
+    halNativeAdvanceUs(SIM_LOOP_US);
+}
+
+static uint64_t percentile(std::vector<uint64_t>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[rank];
+}
+
+static void reportSpread(const char* name, std::vector<uint64_t>& us, const char* unit = "PCs") {
+    if (us.empty()) {
+        printf("  %-28s no samples\n", name);
+        return;
+    }
+    printf("  %-28s p50 %8.2f  p95 %8.2f  p99 %8.2f  max %8.2f ms  (%u %s)\n", name,
+           percentile(us, 50) / 1000.0, percentile(us, 95) / 1000.0, percentile(us, 99) / 1000.0,
+           percentile(us, 100) / 1000.0, (unsigned)us.size(), unit);
+}
+
+static double ratio(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+int runSimulation(int argc, char** argv) {
+    EspNowSimConfig config;
+    espNowSimDefaults(config);
+    config.clients = (int)argNumber(argc, argv, "--clients", 20);
+    config.loss = (float)argNumber(argc, argv, "--loss", config.loss);
+    config.weakClients = (int)argNumber(argc, argv, "--weak", config.weakClients);
+    config.weakLoss = (float)argNumber(argc, argv, "--weak-loss", config.weakLoss);
+    config.latencyUs = (uint32_t)argNumber(argc, argv, "--latency", config.latencyUs);
+    config.jitterUs = (uint32_t)argNumber(argc, argv, "--jitter", config.jitterUs);
+    config.retries = (uint8_t)argNumber(argc, argv, "--retries", config.retries);
+    config.txQueueDepth = (uint8_t)argNumber(argc, argv, "--queue", config.txQueueDepth);
+    config.foreignDuty = (float)argNumber(argc, argv, "--busy", config.foreignDuty);
+    config.bitRate = (uint32_t)argNumber(argc, argv, "--phy", config.bitRate);
+    config.seed = (uint32_t)argNumber(argc, argv, "--seed", config.seed);
+    double rate = argNumber(argc, argv, "--rate", 100);
+    uint32_t burstMs = (uint32_t)argNumber(argc, argv, "--burst", 1000);
+    uint32_t idleMs = (uint32_t)argNumber(argc, argv, "--idle", 2000);
+    int bursts = (int)argNumber(argc, argv, "--bursts", 3);
+    int repeat = (int)argNumber(argc, argv, "--repeat", 1);
+    int statusRounds = (int)argNumber(argc, argv, "--status", 0);
+    int muted = (int)argNumber(argc, argv, "--mute", 0);
+    bool verbose = false;
+    bool scenes = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) verbose = true;
+        if (strcmp(argv[i], "--no-mirror") == 0) setClientMirrorEnabled(false);
+        if (strcmp(argv[i], "--scenes") == 0) scenes = true;
+    }
+    if (config.clients < 1 || config.clients > ESPNOW_SIM_MAX_CLIENTS) config.clients = ESPNOW_SIM_MAX_CLIENTS;
+    if (config.weakClients > config.clients) config.weakClients = config.clients;
+    if (rate <= 0) rate = 1;
+    if (repeat < 1) repeat = 1;
+    halNativeSetConsoleEcho(verbose);
+
+    bootCore();
+    espNowSimBegin(config);
+    espNowSimOnCommand(onClientCommand);
+    espNowSimTagSource(midiTag);
+    halNativeOnAdvance(advanceWithInputs);
+
+    // Clients pair over the air the way they do at a gig: pairing mode on, every client asking at once
+    pairingforceStart();
+    for (int i = 0; i < config.clients; i++) espNowSimStartPairing(i);
+    uint64_t pairingEnd = halNativeNowUs() + SIM_PAIRING_WINDOW_US;
+    int paired = 0;
+    while (halNativeNowUs() < pairingEnd) {
+        loopOnce();
+        paired = 0;
+        for (int i = 0; i < config.clients; i++) paired += espNowSimClientPaired(i) ? 1 : 0;
+        if (paired == config.clients) break;
+    }
+    flushNVSCache();
+    uint64_t pairingUs = halNativeNowUs() - (pairingEnd - SIM_PAIRING_WINDOW_US);
+
+    // Status rounds: the loop keeps running while replies come in
+    std::vector<uint64_t> statusUs;
+    uint32_t statusReplies = 0;
+    uint32_t statusAsked = 0;
+    for (int r = 0; r < statusRounds && paired > 0; r++) {
+        if (!startStatusCollection()) break;
+        while (statusCollectionActive()) loopOnce();
+        const StatusRound& round = getLastStatusRound();
+        statusUs.push_back(round.durationUs);
+        statusReplies += round.replies;
+        statusAsked += round.clients;
+        for (int k = 0; k < 100; k++) loopOnce();     // Let late callbacks settle between rounds
+    }
+
+    if (muted < 0) muted = 0;
+    if (muted > numClients) muted = numClients;
+    for (int i = numClients - muted; i < numClients; i++) programRemapReset(i, true);
+    int listening = paired - muted;
+    if (scenes) {
+        for (int program = 0; program < SCENE_COUNT; program++) {
+            for (int i = 0; i < numClients; i++) sceneSetClient((uint8_t)program, i, PROGRAM_CHANGE, (uint8_t)program);
+        }
+        flushNVSCache();
+    }
+
+    // Load: bursts of evenly spaced PCs, programs cycling through 0-127 (each sent `repeat` times)
+    uint64_t start = halNativeNowUs() + 100000;
+    uint32_t perBurst = (uint32_t)(rate * burstMs / 1000.0);
+    for (int b = 0; b < bursts; b++) {
+        uint64_t burstStart = start + (uint64_t)b * (burstMs + idleMs) * 1000;
+        for (uint32_t k = 0; k < perBurst; k++) {
+            PcEvent event;
+            memset(&event, 0, sizeof(event));
+            event.dueUs = burstStart + (uint64_t)(k * 1000000.0 / rate);
+            event.program = (uint8_t)((pcEvents.size() / repeat) & 0x7F);
+            pcEvents.push_back(event);
+        }
+    }
+    espNowSimResetStats();
+    resetClientMirrorStats();
+    resetSceneRecallStats();
+    midiPassUs = 0;
+    const char* capturePath = argString(argc, argv, "--capture");
+    if (capturePath) espNowCaptureStart();
+    const char* sessionPath = argString(argc, argv, "--session");
+    if (sessionPath) sessionRecordStart();
+    uint64_t loadEnd = start + (uint64_t)bursts * (burstMs + idleMs) * 1000;
+    const char* typed = argString(argc, argv, "--type");
+    int typedGaps = 0;
+    while (halNativeNowUs() < loadEnd ||
+           halNativeMidiBytesRead() < acceptedEvents.size() * 2 || !espNowSimIdle()) {
+        if (halNativeNowUs() > loadEnd + SIM_DRAIN_LIMIT_US) break;
+        if (typed && typedGaps < bursts &&
+            halNativeNowUs() >= start + ((uint64_t)typedGaps * (burstMs + idleMs) + burstMs + idleMs / 2) * 1000) {
+            typeConsole(typed);
+            typedGaps++;
+        }
+        loopOnce();
+    }
+    uint64_t endUs = halNativeNowUs();
+    if (capturePath) {
+        espNowCaptureStop();
+        size_t bytes = exportTo(capturePath, espNowCaptureExport);
+        if (bytes > 0) printf("Capture: %u bytes written to %s\n", (unsigned)bytes, capturePath);
+    }
+    if (sessionPath) {
+        sessionRecordStop();
+        size_t bytes = exportTo(sessionPath, sessionRecordExport);
+        if (bytes > 0) printf("Session: %u bytes written to %s\n", (unsigned)bytes, sessionPath);
+    }
+    const EspNowSimStats& radio = espNowSimStats();
+
+    // ---- Report ----
+    printf("ESP-NOW simulation: %d virtual clients, %d paired (server limit MAX_CLIENTS %d) in %.0f ms\n",
+           config.clients, paired, MAX_CLIENTS, pairingUs / 1000.0);
+    printf("  medium: %.1f Mbit/s, loss %.1f%% (%d weak at %.1f%%), latency %u+0..%u us, %u retries, "
+           "queue %u, foreign airtime %.0f%%, seed %u\n",
+           config.bitRate / 1e6, config.loss * 100, config.weakClients, config.weakLoss * 100,
+           config.latencyUs, config.jitterUs, config.retries, config.txQueueDepth, config.foreignDuty * 100, config.seed);
+    printf("  load: %d bursts of %u ms at %.0f PC/s, %u ms apart (%u PCs, each program %d times)\n",
+           bursts, burstMs, rate, idleMs, (unsigned)pcEvents.size(), repeat);
+    if (paired == 0) {
+        printf("FAILED: no client paired\n");
+        espNowSimEnd();
+        return 1;
+    }
+
+    if (!statusUs.empty()) {
+        printf("\nStatus collection (%u rounds, deadline %u ms, %u requests per loop pass)\n",
+               (unsigned)statusUs.size(), STATUS_COLLECT_DEADLINE_MS, STATUS_COLLECT_REQUESTS_PER_PASS);
+        printf("  replies %u of %u\n", statusReplies, statusAsked);
+        reportSpread("collection time", statusUs, "rounds");
+        if (verbose) printClientStatusTable();
+    }
+
+    uint32_t processed = 0;
+    uint32_t complete = 0;
+    uint64_t clientPcs = 0;
+    std::vector<uint64_t> firstUs, lastUs, skewUs;
+    for (size_t i = 0; i < pcEvents.size(); i++) {
+        const PcEvent& event = pcEvents[i];
+        if (!event.accepted || event.received == 0) continue;
+        processed++;
+        clientPcs += event.received;
+        firstUs.push_back(event.firstRxUs - event.dueUs);
+        if (event.received == listening) {
+            complete++;
+            lastUs.push_back(event.lastRxUs - event.dueUs);
+            skewUs.push_back(event.lastRxUs - event.firstRxUs);
+        }
+    }
+
+    printf("\nInput (MIDI UART, %u byte RX buffer)\n", HAL_NATIVE_UART_RX_BUFFER);
+    printf("  accepted %u, dropped on overflow %u, reached a client %u\n",
+           (unsigned)acceptedEvents.size(), (unsigned)(pcEvents.size() - acceptedEvents.size()), processed);
+    double perPcMs = acceptedEvents.empty() ? 0.0 : midiPassUs / 1000.0 / acceptedEvents.size();
+    printf("  loop held %.2f ms per PC -> at most %.1f PC/s (offered %.0f PC/s in bursts)\n",
+           perPcMs, perPcMs > 0 ? 1000.0 / perPcMs : 0.0, rate);
+
+    double runS = (endUs - start) / 1e6;
+    printf("\nRadio\n");
+    printf("  frames queued %u, delivered %u, failed %u, queue full %u, max queue %u\n",
+           radio.queued, radio.delivered, radio.failed, radio.queueFull, radio.maxQueue);
+    printf("  attempts %u (%.2f per frame), MAC delivery ratio %.2f%%\n",
+           radio.attempts, radio.queued ? (double)radio.attempts / radio.queued : 0.0,
+           ratio(radio.delivered, radio.delivered + radio.failed));
+    printf("  throughput %.0f frames/s, channel busy %.1f%% (ours) + %.1f%% (foreign)\n",
+           runS > 0 ? radio.delivered / runS : 0.0,
+           ratio(radio.airtimeUs, endUs - start), ratio(radio.foreignUs, endUs - start));
+
+    printf("\nPC delivery (MIDI byte in -> client callback)\n");
+    printf("  client PCs %llu of %llu (%.2f%%), PCs reaching all %d listening clients %u of %u%s\n",
+           (unsigned long long)clientPcs, (unsigned long long)processed * listening,
+           ratio(clientPcs, (uint64_t)processed * listening), listening, complete, processed,
+           muted ? " (muted clients are sent nothing)" : "");
+    reportSpread("first client", firstUs);
+    reportSpread("last client", lastUs);
+    reportSpread("skew first -> last", skewUs);
+
+    const ClientMirrorStats& mirror = getClientMirrorStats();
+    printf("\nClient mirror (%s)\n", isClientMirrorEnabled() ? "on" : "off");
+    printf("  client PCs checked %u: suppressed %u, collapsed in flight %u, resent %u\n",
+           mirror.checked, mirror.suppressed, mirror.collapsed, mirror.resent);
+    printf("  confirmed %u, invalidated %u failed + %u timed out, airtime saved %.1f ms\n",
+           mirror.confirmed, mirror.failures, mirror.timeouts, mirror.airtimeSavedUs / 1000.0);
+
+    if (scenes) {
+        const SceneRecallStats& recall = getSceneRecallStats();
+        printf("\nScene recall (trigger -> last frame queued / every frame delivered)\n");
+        printf("  recalls %u, frames queued %u, skipped %u, refused and retried %u, abandoned %u, failed %u\n",
+               recall.recalls, recall.framesQueued, recall.framesSkipped, recall.sendRetries,
+               recall.sendsAbandoned, recall.deliveryFailures);
+        printf("  queued mean %.2f ms, max %.2f ms; delivered %u recalls, mean %.2f ms, max %.2f ms\n",
+               recall.recalls ? recall.totalQueuedUs / 1000.0 / recall.recalls : 0.0, recall.maxQueuedUs / 1000.0,
+               recall.delivered, recall.delivered ? recall.totalDeliveredUs / 1000.0 / recall.delivered : 0.0,
+               recall.maxDeliveredUs / 1000.0);
+    }
+
+    uint8_t finalProgram = 0xFF;
+    for (size_t i = acceptedEvents.size(); i > 0; i--) {
+        const PcEvent& event = pcEvents[acceptedEvents[i - 1]];
+        if (event.received) {
+            finalProgram = event.program;
+            break;
+        }
+    }
+    printf("\nClients (final program should be %u)\n", finalProgram);
+    int mismatched = 0;
+    for (int i = 0; i < config.clients; i++) {
+        uint8_t mac[6];
+        espNowSimClientMac(i, mac);
+        uint32_t ok = radio.clientDelivered[i];
+        uint32_t bad = radio.clientFailed[i];
+        bool isMuted = false;
+        for (int k = 0; k < numClients; k++) {
+            if (memcmp(clientMacAddresses[k], mac, 6) == 0) isMuted = programRemapFor(k, finalProgram) == PROGRAM_REMAP_NONE;
+        }
+        bool inSync = isMuted || espNowSimClientProgram(i) == finalProgram;
+        if (espNowSimClientPaired(i) && !inSync) mismatched++;
+        if (!verbose && espNowSimClientPaired(i) && inSync && bad == 0) continue;
+        printf("  %2d %02X:%02X:%02X:%02X:%02X:%02X loss %4.1f%%  %s  delivered %5u failed %4u  program %3u%s\n",
+               i, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], espNowSimClientLoss(i) * 100,
+               espNowSimClientPaired(i) ? "paired  " : "unpaired", ok, bad, espNowSimClientProgram(i),
+               isMuted ? "  muted" : espNowSimClientPaired(i) && !inSync ? "  OUT OF SYNC" : "");
+    }
+    printf("  %d of %d paired clients in sync%s\n", paired - mismatched, paired, verbose ? "" : " (others omitted, -v lists all)");
+
+    espNowSimEnd();
+    return 0;
+}
@@ -13,51 +13,457 @@
 // limitations under the License.
 //
 #include <Arduino.h>
-#include <Preferences.h>
 #include <globals.h>
 #include <utils.h>
 #include <dataStructs.h>
 #include <nvsManager.h>
-#include <nvs_flash.h>
-#include <esp_err.h>
-#include <nvs.h>
-#include <esp_now.h>
+#include <configImage.h>
 #include <espnow-pairing.h>
+#include <hal.h>
 
-Preferences preferences;
+static_assert(NVS_KEYED_BLOB_MAX <= 32, "keyed blob dirty mask holds 32 keys");
+static_assert(MAX_CLIENTS <= CONFIG_IMAGE_MAX_PEERS, "config image cannot hold MAX_CLIENTS peers");
+static_assert(MAX_RELAY_CHANNELS <= CONFIG_IMAGE_RELAY_SLOTS, "config image cannot hold the relay map");
+static_assert(sizeof(serverButtonProgramMap) <= CONFIG_IMAGE_BUTTON_SLOTS, "config image cannot hold the button map");
+static_assert(MAX_PEER_NAME_LEN <= CONFIG_IMAGE_NAME_LEN, "config image peer name too short");
 
-// NVS initialization and version management
-void checkNVS() {
-    // First, try to initialize NVS flash
-    esp_err_t err = nvs_flash_init();
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-            // NVS partition was truncated and needs to be erased
-            log(LOG_WARN, "NVS partition truncated, erasing and reinitializing...");
-            ESP_ERROR_CHECK(nvs_flash_erase());
-            err = nvs_flash_init();
-            if (err != ESP_OK) {
-                logf(LOG_ERROR, "Failed to reinitialize NVS flash: %s", esp_err_to_name(err));
-                return;
+#define CONFIG_IMAGE_KEY "config"     // Single-slot image written by earlier firmware
+static const char* const configSlotKeys[CONFIG_SLOT_COUNT] = {"cfg_a", "cfg_b"};
+#define RIG_STATE_KEY "rig_state"
+
+// ---- Packed configuration image with write-behind ----
+// All settings are stored as one CRC-protected blob, so boot costs a single NVS
+// lookup. save*ToNVS() copy the section into `image` and mark it dirty; the blob is
+// written once edits go quiet, and only if it differs from what is in flash.
+// Commits alternate between two slots (see configImage.h): the slot in use is
+// never overwritten, so a power cut mid-save falls back to the previous image.
+static ConfigImage image;
+static ConfigImage committed;          // Last image read from or written to flash
+static bool imageLoaded = false;
+static bool committedValid = false;
+static int activeSlot = -1;            // Slot holding `committed`, -1 if none
+static uint8_t rigState[RIG_STATE_MAX_LEN];
+static uint8_t committedRigState[RIG_STATE_MAX_LEN];
+static size_t rigStateLength = 0;
+static bool rigStateValid = false;     // committedRigState matches flash
+// Blobs kept under their own numbered keys ("<prefix><index>"), written from the
+// owner's buffer at commit time. Length 0 removes the key.
+struct KeyedBlobs {
+    const char* prefix;
+    const void* data[NVS_KEYED_BLOB_MAX];
+    size_t length[NVS_KEYED_BLOB_MAX];
+    uint32_t dirty;
+};
+static KeyedBlobs sceneBanks = {"scene", {}, {}, 0};
+static KeyedBlobs programRemaps = {"remap", {}, {}, 0};
+static uint16_t pendingSections = 0;
+static volatile bool peersChanged = false;   // Set by savePeersToNVS() from any task
+static unsigned long lastDirtyTime = 0;
+static NvsCacheStats cacheStats = {0, 0, 0, 0, 0, 0, 0, 0};
+static NvsBootStats bootStats = {0, 0, CONFIG_SOURCE_DEFAULTS};
+
+static void captureSections(ConfigImage& target, uint16_t sections) {
+    if (sections & NVS_SECTION_LOG_LEVEL) {
+        target.logLevel = (uint8_t)currentLogLevel;
+    }
+    if (sections & NVS_SECTION_SERVER) {
+        target.wifiChannel = chan;
+    }
+    if (sections & NVS_SECTION_MIDI_CHANNEL) {
+        target.midiChannel = serverMidiChannel;
+    }
+    if (sections & NVS_SECTION_MIDI_MAP) {
+        target.relayMapCount = MAX_RELAY_CHANNELS;
+        memcpy(target.relayMap, serverMidiChannelMap, MAX_RELAY_CHANNELS);
+    }
+    if (sections & NVS_SECTION_BUTTON_MAP) {
+        target.buttonCount = serverButtonCount;
+        memcpy(target.buttonMap, serverButtonProgramMap, sizeof(serverButtonProgramMap));
+    }
+    if (sections & NVS_SECTION_PEERS) {
+        // Peers are stored compacted, skipping empty MACs
+        int count = 0;
+        memset(target.peers, 0, sizeof(target.peers));
+        for (int i = 0; i < numLabeledPeers && count < MAX_CLIENTS; i++) {
+            if (memcmp(labeledPeers[i].mac, "\0\0\0\0\0\0", 6) == 0) {
+                logf(LOG_ERROR, "Skipped Peer %d - empty or invalid MAC", i);
+                continue;
+            }
+            memcpy(target.peers[count].mac, labeledPeers[i].mac, 6);
+            strncpy(target.peers[count].name, labeledPeers[i].name, CONFIG_IMAGE_NAME_LEN);
+            count++;
+        }
+        target.peerCount = (uint8_t)count;
+    }
+}
+
+// Slot accessors for configLoadSlots()/configCommitSlot(); the namespace is opened by the caller
+static size_t readSlot(uint8_t slot, ConfigImage& out) {
+    size_t length = halNvsGetBytesLength(configSlotKeys[slot]);
+    if (length != sizeof(ConfigImage)) return length;
+    return halNvsGetBytes(configSlotKeys[slot], &out, sizeof(out));
+}
+
+static bool writeSlot(uint8_t slot, const ConfigImage& data) {
+    return halNvsPutBytes(configSlotKeys[slot], &data, sizeof(data)) == sizeof(data);
+}
+
+static const ConfigSlotStore slotStore = {readSlot, writeSlot};
+
+static bool writeImage() {
+    if (!halNvsBegin("espnow", false)) {
+        log(LOG_ERROR, "Failed to open NVS for config commit");
+        return false;
+    }
+    int slot = configCommitSlot(slotStore, image, activeSlot);
+    halNvsEnd();
+    if (slot < 0) {
+        log(LOG_ERROR, "Config slot write failed - previous image kept");
+        return false;
+    }
+    activeSlot = slot;
+    committed = image;
+    committedValid = true;
+    cacheStats.flashWrites++;
+    cacheStats.bytesWritten += sizeof(image);
+    return true;
+}
+
+static bool commitRigState() {
+    if (rigStateValid && memcmp(rigState, committedRigState, rigStateLength) == 0) {
+        cacheStats.skippedWrites++;
+        return true;
+    }
+    if (!halNvsBegin("espnow", false)) {
+        log(LOG_ERROR, "Failed to open NVS for rig state");
+        return false;
+    }
+    bool ok = halNvsPutBytes(RIG_STATE_KEY, rigState, rigStateLength) == rigStateLength;
+    halNvsEnd();
+    if (!ok) {
+        log(LOG_ERROR, "Rig state write failed");
+        return false;
+    }
+    memcpy(committedRigState, rigState, rigStateLength);
+    rigStateValid = true;
+    cacheStats.flashWrites++;
+    cacheStats.bytesWritten += rigStateLength;
+    logf(LOG_DEBUG, "Rig state committed to NVS (%u bytes)", (unsigned)rigStateLength);
+    return true;
+}
+
+static void blobKey(const KeyedBlobs& blobs, uint8_t index, char* key, size_t size) {
+    snprintf(key, size, "%s%u", blobs.prefix, index);
+}
+
+static bool commitKeyedBlobs(KeyedBlobs& blobs) {
+    if (!halNvsBegin("espnow", false)) {
+        logf(LOG_ERROR, "Failed to open NVS for %s keys", blobs.prefix);
+        return false;
+    }
+    bool ok = true;
+    for (uint8_t index = 0; index < NVS_KEYED_BLOB_MAX && ok; index++) {
+        if (!(blobs.dirty & (1ul << index))) continue;
+        char key[12];
+        blobKey(blobs, index, key, sizeof(key));
+        if (blobs.length[index] == 0) {
+            ok = !halNvsIsKey(key) || halNvsRemove(key);
+        } else {
+            ok = halNvsPutBytes(key, blobs.data[index], blobs.length[index]) == blobs.length[index];
+            if (ok) {
+                cacheStats.flashWrites++;
+                cacheStats.bytesWritten += blobs.length[index];
+            }
+        }
+        if (ok) blobs.dirty &= ~(1ul << index);
+    }
+    halNvsEnd();
+    if (!ok) logf(LOG_ERROR, "NVS write of %s keys failed", blobs.prefix);
+    return ok;
+}
+
+static void saveKeyedBlob(KeyedBlobs& blobs, uint16_t section, uint8_t index, const void* data, size_t length) {
+    if (index >= NVS_KEYED_BLOB_MAX) return;
+    blobs.data[index] = data;
+    blobs.length[index] = length;
+    blobs.dirty |= (uint32_t)(1ul << index);
+    markNVSDirty(section);
+}
+
+// Stored length if it is at most maxLength and was read whole, else 0
+static size_t loadKeyedBlob(const KeyedBlobs& blobs, uint8_t index, void* data, size_t maxLength) {
+    if (index >= NVS_KEYED_BLOB_MAX || !halNvsBegin("espnow", true)) return 0;
+    char key[12];
+    blobKey(blobs, index, key, sizeof(key));
+    size_t stored = halNvsIsKey(key) ? halNvsGetBytesLength(key) : 0;
+    if (stored > maxLength || halNvsGetBytes(key, data, stored) != stored) stored = 0;
+    halNvsEnd();
+    return stored;
+}
+
+static bool commitPendingSections() {
+    if (pendingSections & NVS_SECTION_SCENES) {
+        if (!commitKeyedBlobs(sceneBanks)) return false;
+        pendingSections &= ~NVS_SECTION_SCENES;
+    }
+    if (pendingSections & NVS_SECTION_REMAPS) {
+        if (!commitKeyedBlobs(programRemaps)) return false;
+        pendingSections &= ~NVS_SECTION_REMAPS;
+    }
+    if (pendingSections & NVS_SECTION_RIG_STATE) {
+        if (!commitRigState()) return false;
+        pendingSections &= ~NVS_SECTION_RIG_STATE;
+    }
+    if (pendingSections == 0) return true;
+
+    unsigned long start = micros();
+    configImageSeal(image);
+    if (committedValid && memcmp(&image, &committed, sizeof(image)) == 0) {
+        cacheStats.skippedWrites++;
+        pendingSections = 0;
+        log(LOG_DEBUG, "Config unchanged - NVS write skipped");
+        return true;
+    }
+    if (!writeImage()) return false;
+    pendingSections = 0;
+
+    uint32_t elapsed = micros() - start;
+    cacheStats.commits++;
+    cacheStats.lastCommitUs = elapsed;
+    cacheStats.totalCommitUs += elapsed;
+    if (elapsed > cacheStats.maxCommitUs) cacheStats.maxCommitUs = elapsed;
+    logf(LOG_INFO, "Config committed to NVS slot %c gen %u (%u bytes) in %lu us", 'A' + activeSlot, image.generation,
+         (unsigned)sizeof(image), (unsigned long)elapsed);
+    return true;
+}
+
+void markNVSDirty(uint16_t sections) {
+    if (pendingSections != 0) cacheStats.coalescedSaves++;
+    captureSections(image, sections);
+    pendingSections |= sections;
+    lastDirtyTime = millis();
+}
+
+// Pairing runs on the WiFi task, which must not touch the image or the pending
+// mask while the loop commits; the peer table is captured here instead
+static void takePeersChanged() {
+    if (__atomic_exchange_n(&peersChanged, false, __ATOMIC_ACQUIRE)) markNVSDirty(NVS_SECTION_PEERS);
+}
+
+void serviceNVSCache() {
+    takePeersChanged();
+    if (pendingSections == 0) return;
+    if (millis() - lastDirtyTime < NVS_COMMIT_QUIET_MS) return;
+    if (!commitPendingSections()) {
+        lastDirtyTime = millis(); // Retry after another quiet period
+    }
+}
+
+bool flushNVSCache() {
+    takePeersChanged();
+    return commitPendingSections();
+}
+
+uint16_t getNVSPendingSections() {
+    return pendingSections | (peersChanged ? NVS_SECTION_PEERS : 0);
+}
+
+const NvsCacheStats& getNVSCacheStats() {
+    return cacheStats;
+}
+
+const NvsBootStats& getNVSBootStats() {
+    return bootStats;
+}
+
+// ---- Migration from the per-key layout (firmware before the packed image) ----
+static const char* const legacyKeys[] = {
+    "logLevel", "channel", "maxClients", "srv_midi_ch", "srv_midi_map", "srv_btn_pc_map", "srv_btn_count", "numClients"
+};
+
+// Reads the old keys into `image` (current globals are the defaults). Returns false if none exist.
+static bool readLegacyConfig() {
+    memset(&image, 0, sizeof(image));
+    captureSections(image, NVS_SECTION_SERVER | NVS_SECTION_MIDI_CHANNEL | NVS_SECTION_MIDI_MAP | NVS_SECTION_BUTTON_MAP);
+    image.logLevel = LOG_INFO;
+    image.wifiChannel = 0;
+    image.peerCount = 0;
+
+    if (!halNvsBegin("espnow", true)) return false;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(legacyKeys) / sizeof(legacyKeys[0]); i++) {
+        if (halNvsIsKey(legacyKeys[i])) { found = true; break; }
+    }
+    if (found) {
+        image.logLevel = halNvsGetUChar("logLevel", LOG_INFO);
+        image.wifiChannel = halNvsGetUChar("channel", 0);
+        image.midiChannel = halNvsGetUChar("srv_midi_ch", 0);
+        if (halNvsGetBytesLength("srv_midi_map") == MAX_RELAY_CHANNELS) {
+            halNvsGetBytes("srv_midi_map", image.relayMap, MAX_RELAY_CHANNELS);
+        }
+        if (halNvsGetBytesLength("srv_btn_pc_map") == sizeof(serverButtonProgramMap)) {
+            halNvsGetBytes("srv_btn_pc_map", image.buttonMap, sizeof(serverButtonProgramMap));
+        }
+        uint8_t buttons = halNvsGetUChar("srv_btn_count", image.buttonCount);
+        if (buttons > 0 && buttons <= CONFIG_IMAGE_BUTTON_SLOTS) image.buttonCount = buttons;
+
+        int storedClients = halNvsGetInt("numClients", 0);
+        for (int i = 0; i < storedClients && i < MAX_CLIENTS; i++) {
+            char key[16];
+            ConfigPeerRecord& peer = image.peers[image.peerCount];
+            snprintf(key, sizeof(key), "peer_%d", i);
+            if (halNvsGetBytes(key, peer.mac, 6) != 6 || memcmp(peer.mac, "\0\0\0\0\0\0", 6) == 0) {
+                memset(&peer, 0, sizeof(peer));
+                continue;
             }
+            char name[MAX_PEER_NAME_LEN + 1];
+            snprintf(key, sizeof(key), "peername_%d", i);
+            if (halNvsGetString(key, name, sizeof(name)) == 0) strcpy(name, "Unknown");
+            strncpy(peer.name, name, CONFIG_IMAGE_NAME_LEN);
+            image.peerCount++;
+        }
+    }
+    halNvsEnd();
+    return found;
+}
+
+static void removeLegacyKeys() {
+    if (!halNvsBegin("espnow", false)) return;
+    for (size_t i = 0; i < sizeof(legacyKeys) / sizeof(legacyKeys[0]); i++) {
+        if (halNvsIsKey(legacyKeys[i])) halNvsRemove(legacyKeys[i]);
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "peer_%d", i);
+        if (halNvsIsKey(key)) halNvsRemove(key);
+        snprintf(key, sizeof(key), "peername_%d", i);
+        if (halNvsIsKey(key)) halNvsRemove(key);
+    }
+    halNvsEnd();
+}
+
+static bool readPackedImage() {
+    if (!halNvsBegin("espnow", true)) return false;
+    int slot = configLoadSlots(slotStore, image);
+    halNvsEnd();
+    if (slot < 0) return false;
+    activeSlot = slot;
+    return true;
+}
+
+// Image from firmware that kept a single "config" key; becomes generation 0
+static bool readSingleSlotImage() {
+    if (!halNvsBegin("espnow", true)) return false;
+    bool ok = false;
+    size_t length = halNvsGetBytesLength(CONFIG_IMAGE_KEY);
+    if (length > 0) {
+        halNvsGetBytes(CONFIG_IMAGE_KEY, &image, sizeof(image));
+        ok = configImageValid(image, length);
+        if (!ok) logf(LOG_WARN, "Ignoring invalid single-slot config image (%u bytes)", (unsigned)length);
+    }
+    halNvsEnd();
+    return ok;
+}
+
+static void removeSingleSlotImage() {
+    if (!halNvsBegin("espnow", false)) return;
+    if (halNvsIsKey(CONFIG_IMAGE_KEY)) halNvsRemove(CONFIG_IMAGE_KEY);
+    halNvsEnd();
+}
+
+// Load all persisted settings with one blob read per slot; migrates older layouts
+// on first boot. The load*FromNVS() functions then apply sections from RAM.
+bool loadConfigImage() {
+    unsigned long start = micros();
+    if (readPackedImage()) {
+        committed = image;
+        committedValid = true;
+        bootStats.source = CONFIG_SOURCE_PACKED;
+        bootStats.packedLoadUs = micros() - start;
+        imageLoaded = true;
+        logf(LOG_INFO, "Config slot %c gen %u loaded in %lu us", 'A' + activeSlot, image.generation,
+             (unsigned long)bootStats.packedLoadUs);
+        return true;
+    }
+
+    if (readSingleSlotImage()) {
+        bootStats.source = CONFIG_SOURCE_PACKED;
+        bootStats.packedLoadUs = micros() - start;
+        imageLoaded = true;
+        if (writeImage()) {
+            removeSingleSlotImage();
+            log(LOG_INFO, "Moved single-slot config image to slot A");
         } else {
-            logf(LOG_ERROR, "Failed to initialize NVS flash: %s", esp_err_to_name(err));
-            return;
+            log(LOG_ERROR, "Config slot migration failed - single-slot image kept");
         }
+        return true;
+    }
+
+    bool legacy = readLegacyConfig();
+    bootStats.legacyLoadUs = micros() - start;
+    imageLoaded = true;
+    if (!legacy) {
+        bootStats.source = CONFIG_SOURCE_DEFAULTS;
+        log(LOG_INFO, "No stored configuration - using defaults");
+        return false;
+    }
+
+    bootStats.source = CONFIG_SOURCE_LEGACY;
+    logf(LOG_INFO, "Read legacy config keys (%u peers) in %lu us", image.peerCount, (unsigned long)bootStats.legacyLoadUs);
+    // writeImage() reads the slot back, so a successful write is already verified
+    if (!writeImage()) {
+        log(LOG_ERROR, "Config migration failed - legacy keys kept");
+        return true;
     }
+    // Time a packed read of the image just written for comparison
+    start = micros();
+    readPackedImage();
+    bootStats.packedLoadUs = micros() - start;
+    removeLegacyKeys();
+    logf(LOG_INFO, "Migrated config to packed image: legacy load %lu us, packed load %lu us",
+         (unsigned long)bootStats.legacyLoadUs, (unsigned long)bootStats.packedLoadUs);
+    return true;
+}
+
+static void ensureConfigLoaded() {
+    if (!imageLoaded) loadConfigImage();
+}
+
+void getConfigSnapshot(ConfigImage& out) {
+    ensureConfigLoaded();
+    out = image;
+    captureSections(out, NVS_SECTION_LOG_LEVEL | NVS_SECTION_SERVER | NVS_SECTION_MIDI_CHANNEL |
+                         NVS_SECTION_MIDI_MAP | NVS_SECTION_BUTTON_MAP | NVS_SECTION_PEERS);
+    configImageSeal(out);
+}
+
+bool importConfigImage(const ConfigImage& snapshot) {
+    if (!configImageValid(snapshot, sizeof(snapshot))) return false;
+    uint16_t generation = image.generation;
+    image = snapshot;
+    image.generation = generation;
+    imageLoaded = true;
+    pendingSections = 0;
+    return writeImage();
+}
+
+// NVS initialization and version management
+void checkNVS() {
+    // First, try to initialize NVS flash (a truncated partition is erased)
+    if (!halNvsInit()) return;
     
     log(LOG_INFO, "NVS flash initialized successfully");
     
     // Now try to open the namespace
-    if (preferences.begin("espnow", true)) {
-        int stored_version = preferences.getInt("version", 0);
-        preferences.end();
+    if (halNvsBegin("espnow", true)) {
+        int stored_version = halNvsGetInt("version", 0);
+        halNvsEnd();
 
         if (stored_version != STORAGE_VERSION) {
             log(LOG_INFO, "NVS version mismatch, updating...");
-            if (preferences.begin("espnow", false)) { // read-write to create/update
-                preferences.putInt("version", STORAGE_VERSION);
-                preferences.end();
+            if (halNvsBegin("espnow", false)) { // read-write to create/update
+                halNvsPutInt("version", STORAGE_VERSION);
+                halNvsEnd();
                 log(LOG_INFO, "NVS storage version updated");
             } else {
                 log(LOG_ERROR, "Failed to update NVS version");
@@ -68,9 +474,9 @@ void checkNVS() {
     } else {
         // Namespace doesn't exist, create it
         log(LOG_WARN, "NVS namespace 'espnow' not found, creating...");
-        if (preferences.begin("espnow", false)) { // read-write to create
-            preferences.putInt("version", STORAGE_VERSION);
-            preferences.end();
+        if (halNvsBegin("espnow", false)) { // read-write to create
+            halNvsPutInt("version", STORAGE_VERSION);
+            halNvsEnd();
             log(LOG_INFO, "NVS namespace created successfully");
         } else {
             log(LOG_ERROR, "Failed to create NVS namespace");
@@ -79,9 +485,9 @@ void checkNVS() {
 }
 
 bool initializeNVS() {
-    if (preferences.begin("espnow", false)) {
-        preferences.putInt("version", STORAGE_VERSION);
-        preferences.end();
+    if (halNvsBegin("espnow", false)) {
+        halNvsPutInt("version", STORAGE_VERSION);
+        halNvsEnd();
         log(LOG_INFO, "NVS initialized successfully");
         return true;
     } else {
@@ -92,33 +498,23 @@ bool initializeNVS() {
 
 // Log level management
 void saveLogLevelToNVS(LogLevel level) {
-    if (preferences.begin("espnow", false)) {
-        preferences.putUChar("logLevel", (uint8_t)level);
-        preferences.end();
-        logf(LOG_INFO, "Log level %s saved to NVS", getLogLevelString(level));
-    } else {
-        log(LOG_ERROR, "Failed to save log level to NVS");
-    }
+    markNVSDirty(NVS_SECTION_LOG_LEVEL);
+    image.logLevel = (uint8_t)level;
+    logf(LOG_DEBUG, "Log level %s queued for NVS", getLogLevelString(level));
 }
 
 LogLevel loadLogLevelFromNVS() {
-    LogLevel level = LOG_INFO; // default
-    
-    // Try to open preferences - if it fails, NVS isn't ready
-    if (preferences.begin("espnow", true)) {
-        level = (LogLevel)preferences.getUChar("logLevel", (uint8_t)LOG_INFO);
-        preferences.end();
-        logf(LOG_DEBUG, "Loaded log level %s from NVS", getLogLevelString(level));
-    } else {
-        log(LOG_WARN, "Failed to load log level from NVS, using default");
-    }
+    ensureConfigLoaded();
+    LogLevel level = (image.logLevel <= LOG_DEBUG) ? (LogLevel)image.logLevel : LOG_INFO;
+    logf(LOG_DEBUG, "Loaded log level %s from NVS", getLogLevelString(level));
     return level;
 }
 
 void clearLogLevelNVS() {
-    if (preferences.begin("espnow", false)) {
-        preferences.remove("logLevel");
-        preferences.end();
+    ensureConfigLoaded();
+    image.logLevel = LOG_INFO;
+    pendingSections |= NVS_SECTION_LOG_LEVEL;
+    if (flushNVSCache()) {
         log(LOG_INFO, "Log level cleared from NVS");
     } else {
         log(LOG_ERROR, "Failed to clear log level from NVS");
@@ -127,184 +523,147 @@ void clearLogLevelNVS() {
 
 // Server-specific NVS management
 void saveServerConfigToNVS() {
-    if (preferences.begin("espnow", false)) {
-        preferences.putUChar("channel", chan);
-        preferences.putUChar("maxClients", MAX_CLIENTS);
-        preferences.end();
-        log(LOG_INFO, "Server configuration saved to NVS");
-    } else {
-        log(LOG_ERROR, "Failed to save server config to NVS");
-    }
+    markNVSDirty(NVS_SECTION_SERVER);
 }
 
 bool loadServerConfigFromNVS() {
-    if (preferences.begin("espnow", true)) {
-        chan = preferences.getUChar("channel", chan);
-        preferences.end();
-        logf(LOG_INFO, "Loaded server config from NVS - Channel: %u", chan);
-        return true;
-    } else {
-        log(LOG_WARN, "Failed to load server config from NVS, using defaults");
+    ensureConfigLoaded();
+    if (image.wifiChannel == 0) {
+        log(LOG_WARN, "No saved server config in NVS, using defaults");
         return false;
     }
+    chan = image.wifiChannel;
+    logf(LOG_INFO, "Loaded server config from NVS - Channel: %u", chan);
+    return true;
 }
 
 void clearServerConfigNVS() {
-    if (preferences.begin("espnow", false)) {
-        preferences.remove("channel");
-        preferences.remove("maxClients");
-        preferences.end();
+    ensureConfigLoaded();
+    image.wifiChannel = 0;
+    pendingSections |= NVS_SECTION_SERVER;
+    if (flushNVSCache()) {
         log(LOG_INFO, "Server configuration cleared from NVS");
     } else {
         log(LOG_ERROR, "Failed to clear server config from NVS");
     }
 }
 
+// Rig state
+void saveRigStateToNVS(const void* data, size_t length) {
+    if (length > RIG_STATE_MAX_LEN) length = RIG_STATE_MAX_LEN;
+    if (length != rigStateLength) rigStateValid = false;
+    memcpy(rigState, data, length);
+    rigStateLength = length;
+    markNVSDirty(NVS_SECTION_RIG_STATE);
+}
+
+size_t loadRigStateFromNVS(void* data, size_t maxLength) {
+    if (!halNvsBegin("espnow", true)) return 0;
+    size_t length = halNvsGetBytesLength(RIG_STATE_KEY);
+    if (length > 0 && length <= RIG_STATE_MAX_LEN && length <= maxLength) {
+        halNvsGetBytes(RIG_STATE_KEY, committedRigState, length);
+        memcpy(rigState, committedRigState, length);
+        memcpy(data, committedRigState, length);
+        rigStateLength = length;
+        rigStateValid = true;
+    } else {
+        length = 0;
+    }
+    halNvsEnd();
+    return length;
+}
+
+// Scene banks and program remap tables
+void saveSceneBankToNVS(uint8_t bank, const void* data, size_t length) {
+    saveKeyedBlob(sceneBanks, NVS_SECTION_SCENES, bank, data, length);
+}
+
+size_t loadSceneBankFromNVS(uint8_t bank, void* data, size_t length) {
+    return loadKeyedBlob(sceneBanks, bank, data, length) == length ? length : 0;
+}
+
+void saveProgramRemapToNVS(uint8_t slot, const void* data, size_t length) {
+    saveKeyedBlob(programRemaps, NVS_SECTION_REMAPS, slot, data, length);
+}
+
+size_t loadProgramRemapFromNVS(uint8_t slot, void* data, size_t maxLength) {
+    return loadKeyedBlob(programRemaps, slot, data, maxLength);
+}
+
 // Peer management (extracted from espnow-pairing.cpp)
 void savePeersToNVS() {
-    preferences.begin("espnow", false);
-    int validCount = 0;
-    logf(LOG_INFO, "Saving up to %d peers to NVS...", numLabeledPeers);
-    for (int i = 0; i < numLabeledPeers; i++) {
-        if (memcmp(labeledPeers[i].mac, "\0\0\0\0\0\0", 6) != 0) {
-            char key[12];
-            sprintf(key, "peer_%d", validCount);
-            preferences.putBytes(key, labeledPeers[i].mac, 6);
-            char nameKey[16];
-            sprintf(nameKey, "peername_%d", validCount);
-            preferences.putString(nameKey, labeledPeers[i].name);
-            logf(LOG_INFO, "Saved Peer: %s", labeledPeers[i].name);
-            printMAC(labeledPeers[i].mac, LOG_DEBUG);
-            validCount++;
-        } else {
-            logf(LOG_ERROR, "Skipped Peer %d - empty or invalid MAC", i);
-        }
-    }
-    preferences.putInt("numClients", validCount);
-    preferences.putInt("version", STORAGE_VERSION);
-    preferences.end();
-    logf(LOG_INFO, "Saved %d peers to NVS", validCount);
+    __atomic_store_n(&peersChanged, true, __ATOMIC_RELEASE);
 }
 
 void loadPeersFromNVS() {
-    preferences.begin("espnow", true);
-    
-    int storedClients = preferences.getInt("numClients", 0);
-    logf(LOG_DEBUG, "numClients in NVS: %d", storedClients);
-    
+    ensureConfigLoaded();
+    int storedClients = image.peerCount;
+    logf(LOG_DEBUG, "Peers in config image: %d", storedClients);
+
     // Reset counters - addPeer will manage them
     numClients = 0;
     numLabeledPeers = 0;
-    
+
     for (int i = 0; i < storedClients && i < MAX_CLIENTS; i++) {
-        char key[12];
-        sprintf(key, "peer_%d", i);
-        uint8_t tempMac[6];
-        size_t bytesRead = preferences.getBytes(key, tempMac, 6);
-        
-        if (bytesRead == 6) {
-            if (memcmp(tempMac, "\0\0\0\0\0\0", 6) != 0) {
-                // Load the peer name first
-                char nameKey[16];
-                sprintf(nameKey, "peername_%d", i);
-                String peerName = preferences.getString(nameKey, "Unknown");
-                
-                // Use the existing addPeer function to add to ESP-NOW and manage arrays
-                // Set save=false since we're loading from NVS, not adding new peers
-                if (addPeer(tempMac, false)) {
-                    // Update the peer name in labeledPeers (addPeer might not have the correct name)
-                    for (int j = 0; j < numLabeledPeers; j++) {
-                        if (memcmp(labeledPeers[j].mac, tempMac, 6) == 0) {
-                            strncpy(labeledPeers[j].name, peerName.c_str(), MAX_PEER_NAME_LEN);
-                            break;
-                        }
-                    }
-                    logf(LOG_DEBUG, "Loaded and added peer (%s) from NVS to ESP-NOW", peerName.c_str());
-                    printMAC(tempMac, LOG_DEBUG);
-                } else {
-                    logf(LOG_ERROR, "Failed to add peer from NVS to ESP-NOW");
-                    printMAC(tempMac, LOG_ERROR);
+        const ConfigPeerRecord& peer = image.peers[i];
+        char peerName[MAX_PEER_NAME_LEN + 1];
+        strncpy(peerName, peer.name, MAX_PEER_NAME_LEN);
+        peerName[MAX_PEER_NAME_LEN] = '\0';
+
+        // Use the existing addPeer function to add to ESP-NOW and manage arrays
+        // Set save=false since we're loading from NVS, not adding new peers
+        if (addPeer(peer.mac, false)) {
+            // Update the peer name in labeledPeers (addPeer might not have the correct name)
+            for (int j = 0; j < numLabeledPeers; j++) {
+                if (memcmp(labeledPeers[j].mac, peer.mac, 6) == 0) {
+                    strncpy(labeledPeers[j].name, peerName, MAX_PEER_NAME_LEN);
+                    break;
                 }
             }
+            logf(LOG_DEBUG, "Loaded and added peer (%s) from NVS to ESP-NOW", peerName);
+            printMAC(peer.mac, LOG_DEBUG);
+        } else {
+            logf(LOG_ERROR, "Failed to add peer from NVS to ESP-NOW");
+            printMAC(peer.mac, LOG_ERROR);
         }
     }
-    
-    preferences.end();
+
     logf(LOG_INFO, "Loaded %d peers from NVS", numClients);
 }
 
 // --- Server MIDI persistence ---
 bool loadServerMidiConfigFromNVS() {
-    if (!preferences.begin("espnow", true)) {
-        log(LOG_WARN, "Failed to open NVS for MIDI config load");
-        return false;
-    }
-    serverMidiChannel = preferences.getUChar("srv_midi_ch", 0); // 0=omni
-    size_t mapSize = sizeof(serverMidiChannelMap);
-    uint8_t temp[MAX_RELAY_CHANNELS];
-    bool haveMap = false;
-    if (preferences.isKey("srv_midi_map")) {
-        size_t len = preferences.getBytesLength("srv_midi_map");
-        if (len == mapSize) {
-            preferences.getBytes("srv_midi_map", temp, mapSize);
-            memcpy(serverMidiChannelMap, temp, mapSize);
-            haveMap = true;
-        }
-    }
-    preferences.end();
+    ensureConfigLoaded();
+    serverMidiChannel = image.midiChannel;
+    bool haveMap = image.relayMapCount == MAX_RELAY_CHANNELS;
+    if (haveMap) memcpy(serverMidiChannelMap, image.relayMap, MAX_RELAY_CHANNELS);
     logf(LOG_INFO, "Loaded server MIDI channel %u%s", serverMidiChannel, haveMap?" with map":" (default map)");
     return true;
 }
 
 void saveServerMidiChannelToNVS() {
-    if (!preferences.begin("espnow", false)) return;
-    preferences.putUChar("srv_midi_ch", serverMidiChannel);
-    preferences.end();
-    logf(LOG_INFO, "Saved server MIDI channel %u", serverMidiChannel);
+    markNVSDirty(NVS_SECTION_MIDI_CHANNEL);
 }
 
 void saveServerMidiMapToNVS() {
-    if (!preferences.begin("espnow", false)) return;
-    preferences.putBytes("srv_midi_map", serverMidiChannelMap, sizeof(serverMidiChannelMap));
-    preferences.end();
-    log(LOG_INFO, "Saved server MIDI map");
+    markNVSDirty(NVS_SECTION_MIDI_MAP);
 }
 
 void clearPeersNVS() {
-    if (preferences.begin("espnow", false)) {
-        // Clear peers by setting numClients to 0 and overwriting with empty data
-        // This avoids remove() issues while achieving the same result
-        uint8_t emptyMAC[6] = {0,0,0,0,0,0};
-        
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            char peerKey[12];
-            char nameKey[16];
-            sprintf(peerKey, "peer_%d", i);
-            sprintf(nameKey, "peername_%d", i);
-            
-            // Overwrite with empty data instead of removing
-            preferences.putBytes(peerKey, emptyMAC, 6);
-            preferences.putString(nameKey, "");
-        }
-        
-        // Set peer count to zero
-        preferences.putInt("numClients", 0);
-        preferences.end();
-        
-        // Remove peers from ESP-NOW peer list
-        for (int i = 0; i < numClients; i++) {
-            esp_now_del_peer(clientMacAddresses[i]);
-        }
-        
-        // Clear in-memory peer data immediately
-        numClients = 0;
-        numLabeledPeers = 0;
-        memset(clientMacAddresses, 0, sizeof(clientMacAddresses));
-        memset(labeledPeers, 0, sizeof(labeledPeers));
-        
-        // Save the cleared state to ensure consistency
-        savePeersToNVS();
-        
+    // Remove peers from ESP-NOW peer list
+    for (int i = 0; i < numClients; i++) {
+        halEspNowDelPeer(clientMacAddresses[i]);
+    }
+
+    // Clear in-memory peer data immediately
+    numClients = 0;
+    numLabeledPeers = 0;
+    memset(clientMacAddresses, 0, sizeof(clientMacAddresses));
+    memset(labeledPeers, 0, sizeof(labeledPeers));
+
+    ensureConfigLoaded();
+    markNVSDirty(NVS_SECTION_PEERS);
+    if (flushNVSCache()) {
         log(LOG_INFO, "All peers cleared from NVS, memory, and ESP-NOW peer list");
     } else {
         log(LOG_ERROR, "Failed to clear peers from NVS");
@@ -313,71 +672,86 @@ void clearPeersNVS() {
 
 // General NVS utilities
 void clearAllNVS() {
-    if (preferences.begin("espnow", false)) {
-        preferences.clear();
-        preferences.end();
+    if (halNvsBegin("espnow", false)) {
+        halNvsClear();
+        halNvsEnd();
+        committedValid = false;
+        activeSlot = -1;
+        rigStateValid = false;
+        sceneBanks.dirty = 0;
+        programRemaps.dirty = 0;
+        pendingSections = 0;
+        peersChanged = false;
         log(LOG_WARN, "All NVS data cleared");
     } else {
         log(LOG_ERROR, "Failed to clear all NVS data");
     }
 }
 
+static const char* configSourceName(uint8_t source) {
+    switch (source) {
+        case CONFIG_SOURCE_PACKED: return "packed image";
+        case CONFIG_SOURCE_LEGACY: return "migrated from legacy keys";
+        default:                   return "defaults";
+    }
+}
+
 void printNVSStats() {
     log(LOG_INFO, "=== NVS STATISTICS ===");
     
-    if (preferences.begin("espnow", true)) {
-        int version = preferences.getInt("version", 0);
-        int storedClients = preferences.getInt("numClients", 0);
-        uint8_t logLevel = preferences.getUChar("logLevel", (uint8_t)LOG_INFO);
-        uint8_t channel = preferences.getUChar("channel", 1);
-        
+    if (halNvsBegin("espnow", true)) {
+        int version = halNvsGetInt("version", 0);
         logf(LOG_INFO, "Storage Version: %d", version);
-        logf(LOG_INFO, "Stored Peers: %d", storedClients);
-        logf(LOG_INFO, "Saved Log Level: %s (%u)", getLogLevelString((LogLevel)logLevel), logLevel);
-        logf(LOG_INFO, "Saved Channel: %u", channel);
         
         // Calculate used space (approximate)
-        size_t usedEntries = preferences.freeEntries();
+        size_t usedEntries = halNvsFreeEntries();
         logf(LOG_INFO, "Available NVS Entries: %zu", usedEntries);
         
-        preferences.end();
+        halNvsEnd();
     } else {
         log(LOG_ERROR, "Failed to access NVS for statistics");
     }
+
+    if (committedValid) {
+        logf(LOG_INFO, "Config Image: v%u, %u bytes, CRC %08lX", committed.version, committed.size, (unsigned long)committed.crc);
+        logf(LOG_INFO, "Active Slot: %c (generation %u)", 'A' + activeSlot, committed.generation);
+        logf(LOG_INFO, "Stored Peers: %u", committed.peerCount);
+        logf(LOG_INFO, "Saved Log Level: %s (%u)", getLogLevelString((LogLevel)committed.logLevel), committed.logLevel);
+        logf(LOG_INFO, "Saved Channel: %u", committed.wifiChannel);
+    } else {
+        log(LOG_INFO, "Config Image: not written yet");
+    }
+    if (rigStateValid) logf(LOG_INFO, "Rig State Record: %u bytes", (unsigned)rigStateLength);
+    logf(LOG_INFO, "Boot Config Source: %s", configSourceName(bootStats.source));
+    if (bootStats.legacyLoadUs > 0) logf(LOG_INFO, "Boot Legacy Key Load: %lu us", (unsigned long)bootStats.legacyLoadUs);
+    if (bootStats.packedLoadUs > 0) logf(LOG_INFO, "Boot Packed Image Load: %lu us", (unsigned long)bootStats.packedLoadUs);
+
+    logf(LOG_INFO, "Pending Sections: 0x%03X", pendingSections);
+    logf(LOG_INFO, "Commits: %lu (%lu saves coalesced, %lu unchanged skipped)", (unsigned long)cacheStats.commits,
+         (unsigned long)cacheStats.coalescedSaves, (unsigned long)cacheStats.skippedWrites);
+    logf(LOG_INFO, "Flash Writes: %lu (%lu bytes)", (unsigned long)cacheStats.flashWrites, (unsigned long)cacheStats.bytesWritten);
+    if (cacheStats.commits > 0) {
+        logf(LOG_INFO, "Commit Time: last %lu us, max %lu us, avg %lu us",
+             (unsigned long)cacheStats.lastCommitUs, (unsigned long)cacheStats.maxCommitUs,
+             (unsigned long)(cacheStats.totalCommitUs / cacheStats.commits));
+    }
     
     log(LOG_INFO, "======================");
 }
 
 // --- Server Button PC Map persistence ---
 void saveServerButtonPcMapToNVS() {
-    if (!preferences.begin("espnow", false)) {
-        log(LOG_ERROR, "Failed to open NVS for button PC map save");
-        return;
-    }
-    preferences.putBytes("srv_btn_pc_map", serverButtonProgramMap, sizeof(serverButtonProgramMap));
-    preferences.putUChar("srv_btn_count", serverButtonCount);
-    preferences.end();
-    logf(LOG_INFO, "Saved %u button PC mappings", serverButtonCount);
+    markNVSDirty(NVS_SECTION_BUTTON_MAP);
 }
 
 bool loadServerButtonPcMapFromNVS() {
-    if (!preferences.begin("espnow", true)) {
-        log(LOG_WARN, "Failed to open NVS for button PC map load");
+    ensureConfigLoaded();
+    if (bootStats.source == CONFIG_SOURCE_DEFAULTS) {
+        log(LOG_INFO, "No saved button PC map - using defaults");
         return false;
     }
-    bool ok = false;
-    if (preferences.isKey("srv_btn_pc_map")) {
-        size_t len = preferences.getBytesLength("srv_btn_pc_map");
-        if (len == sizeof(serverButtonProgramMap)) {
-            preferences.getBytes("srv_btn_pc_map", serverButtonProgramMap, len);
-            ok = true;
-        }
-    }
-    if (preferences.isKey("srv_btn_count")) {
-        uint8_t cnt = preferences.getUChar("srv_btn_count", serverButtonCount);
-        if (cnt > 0 && cnt <= 8) serverButtonCount = cnt; // clamp
-    }
-    preferences.end();
-    if (ok) logf(LOG_INFO, "Loaded button PC map (count=%u)", serverButtonCount); else log(LOG_INFO, "No saved button PC map - using defaults");
-    return ok;
+    memcpy(serverButtonProgramMap, image.buttonMap, sizeof(serverButtonProgramMap));
+    if (image.buttonCount > 0 && image.buttonCount <= 8) serverButtonCount = image.buttonCount; // clamp
+    logf(LOG_INFO, "Loaded button PC map (count=%u)", serverButtonCount);
+    return true;
 }
@@ -18,9 +18,158 @@
 #include <globals.h>
 #include <utils.h>
 #include <espnow-pairing.h>
+#include <otaManager.h>
+#include <nvsManager.h>
+#include <deferredLog.h>
+#include <otaPatch.h>
+#include <fwPush.h>
+#include <ledEngine.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
 
 WebServer server(80);
 
+// ---- Live OTA state ----
+// The web server runs in its own task at loop() priority; the upload handler
+// pauses after every flash chunk so the switching loop keeps getting the CPU.
+static TaskHandle_t liveTask = nullptr;
+static volatile bool liveStopRequested = false;
+static volatile bool liveRebootRequested = false;
+static volatile bool uploadActive = false;
+static volatile bool loopOverBudget = false;  // Set by loop(), read by the upload pacing
+static volatile uint32_t chunkPauseMs = LIVE_OTA_MIN_PAUSE_MS;
+static unsigned long liveStartMs = 0;
+static unsigned long uploadStartMs = 0;
+static uint32_t lastLoopUs = 0;
+static LiveOtaStats liveStats;
+
+static void onLiveUploadStart();
+static void onLiveUploadProgress(size_t current, size_t total);
+static void onLiveUploadEnd(bool success);
+static void finishLiveUpload(bool success, bool rebootOnSuccess);
+
+// ---- Compressed / delta uploads (/patch) ----
+// SWP1 files (otaPatch.h) are decoded while they arrive and written straight to
+// the OTA partition; delta files copy unchanged regions from the running image.
+static OtaPatchDecoder patchDecoder;
+static uint8_t patchResult = OTA_PATCH_NEED_MORE;
+static uint32_t patchReceived = 0;
+static bool patchRefused = false;     // Firmware push owned the spare partition at the start
+
+static bool patchWrite(void*, const uint8_t* data, size_t length) {
+  if (!Update.isRunning()) {
+    const OtaPatchHeader* header = otaPatchHeader(patchDecoder);
+    if (header == nullptr || !Update.begin(header->targetSize)) return false;
+  }
+  return Update.write((uint8_t*)data, length) == length;
+}
+
+static bool patchReadBase(void*, uint32_t offset, uint8_t* data, size_t length) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  return running != nullptr && offset + length <= running->size &&
+         esp_partition_read(running, offset, data, length) == ESP_OK;
+}
+
+static void handlePatchUpload(bool live) {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    // The push streams the staged client image from the partition this would overwrite
+    patchRefused = fwPushActive();
+    if (patchRefused) {
+      LOGQ(LOG_WARN, "Patch upload refused: firmware push running");
+      return;
+    }
+    OtaPatchIo io = {patchWrite, patchReadBase, nullptr};
+    otaPatchBegin(patchDecoder, io);
+    patchResult = OTA_PATCH_NEED_MORE;
+    patchReceived = 0;
+    if (live) onLiveUploadStart();
+  } else if (patchRefused) {
+    return;                                           // Drain the body, nothing is written
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (patchResult != OTA_PATCH_NEED_MORE) return;   // Failed or finished; drain the rest
+    patchReceived += upload.currentSize;
+    patchResult = otaPatchFeed(patchDecoder, upload.buf, upload.currentSize);
+    if (patchResult != OTA_PATCH_NEED_MORE && patchResult != OTA_PATCH_DONE) Update.abort();
+    if (live) {
+      onLiveUploadProgress(patchDecoder.produced, patchDecoder.header.targetSize);
+      liveStats.received = patchReceived;
+    }
+  } else if (upload.status == UPLOAD_FILE_END) {
+    patchResult = otaPatchFinish(patchDecoder);
+    bool ok = patchResult == OTA_PATCH_DONE && Update.end(true);
+    if (!ok && Update.isRunning()) Update.abort();
+    if (ok) {
+      LOGQ(LOG_INFO, "Patch upload: %lu bytes received, %lu bytes written", (unsigned long)patchReceived,
+           (unsigned long)patchDecoder.produced);
+    } else {
+      LOGQ(LOG_ERROR, "Patch upload failed: %s", otaPatchStatusName(patchResult));
+    }
+    if (live) onLiveUploadEnd(ok);
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    if (Update.isRunning()) Update.abort();
+    patchResult = OTA_PATCH_TRUNCATED;
+    if (live) onLiveUploadEnd(false);
+  }
+}
+
+// ---- ElegantOTA uploads (/update) during a firmware push ----
+// ElegantOTA starts its update from GET /ota/start (older releases POST the
+// image to /update) and writes the spare partition the push is streaming from.
+// This handler is registered ahead of ElegantOTA and claims those requests only
+// while a push runs, answering 409; otherwise ElegantOTA handles them.
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+typedef const String& OtaUriArg;
+#else
+typedef String OtaUriArg;
+#endif
+
+class FwPushOtaGuard : public RequestHandler {
+public:
+  bool canHandle(HTTPMethod, OtaUriArg uri) override {
+    return fwPushActive() && (uri == "/update" || uri == "/ota/start");
+  }
+  bool canUpload(OtaUriArg uri) override {
+    return canHandle(HTTP_POST, uri);
+  }
+  bool handle(WebServer& srv, HTTPMethod, OtaUriArg) override {
+    LOGQ(LOG_WARN, "Server update refused: firmware push running");
+    srv.send_P(409, "text/plain", "Firmware push running - update the server when it has finished");
+    return true;
+  }
+  void upload(WebServer&, OtaUriArg, HTTPUpload&) override {}   // Discard the image
+};
+
+static FwPushOtaGuard fwPushOtaGuard;
+
+// ---- Client firmware uploads (/client-fw) ----
+// Staged in the spare OTA partition for fwpush; the server itself is not updated.
+static bool clientStageOk = false;
+static uint32_t clientStageBytes = 0;
+
+static void handleClientFwUpload(bool live) {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    clientStageOk = fwStageBegin();
+    clientStageBytes = 0;
+    if (live) onLiveUploadStart();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (!clientStageOk) return;
+    clientStageOk = fwStageWrite(upload.buf, upload.currentSize);
+    clientStageBytes += upload.currentSize;
+    if (live) onLiveUploadProgress(clientStageBytes, 0);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    clientStageOk = clientStageOk && fwStageEnd();
+    if (!clientStageOk) fwStageAbort();
+    if (live) finishLiveUpload(clientStageOk, false);
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    fwStageAbort();
+    clientStageOk = false;
+    if (live) finishLiveUpload(false, false);
+  }
+}
+
 // === Check if OTA mode should start ===
 bool checkOtaTrigger() {
   pinMode(OTA_BUTTON_PIN, INPUT_PULLUP);
@@ -34,6 +183,74 @@ bool checkOtaTrigger() {
   return false;
 }
 
+// "a.b.c.d" without going through IPAddress::toString() and a heap String
+static void formatIp(const IPAddress& ip, char* out, size_t size) {
+  snprintf(out, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+static const char otaLandingPage[] =
+  "<html><head><style>body{font-family:sans-serif;text-align:center;padding:2em;}h1{color:#333;}p{margin:1em 0;}"
+  "a,input[type=submit]{padding:0.5em 1em;background:#007bff;color:#fff;border:none;border-radius:5px;}"
+  "a:hover,input[type=submit]:hover{background:#0056b3;}</style></head><body>"
+  "<h1>ESP32 OTA Ready</h1>"
+  "<p><b>Firmware Version:</b> " FIRMWARE_VERSION "</p>"
+  "<p><b>IP:</b> %s</p>"
+  "<p><a href='/update'>Go to OTA Update</a></p>"
+  "<form action='/patch' method='POST' enctype='multipart/form-data'><p><b>Compressed / delta image (.swp):</b></p>"
+  "<input type='file' name='patch' accept='.swp'> <input type='submit' value='Upload'></form>"
+  "<form action='/client-fw' method='POST' enctype='multipart/form-data'><p><b>Client firmware (.bin, pushed with 'fwpush start'):</b></p>"
+  "<input type='file' name='client' accept='.bin'> <input type='submit' value='Stage'></form>"
+  "<form action='/reboot' method='POST'><input type='submit' value='Reboot ESP32'></form>"
+  "</body></html>";
+
+// Landing page and reboot route. In live mode the reboot is handed to loop() so
+// pending NVS changes are flushed first. Replies go out with send_P so no
+// String copy of the body is made.
+static void registerOtaRoutes(bool live) {
+  server.on("/", HTTP_GET, [live]() {
+    // Page plus the widest IP; static so it stays off the web server task's stack
+    static char page[sizeof(otaLandingPage) + 16];
+    char ipStr[16];
+    formatIp(live ? WiFi.softAPIP() : WiFi.localIP(), ipStr, sizeof(ipStr));
+    int length = snprintf(page, sizeof(page), otaLandingPage, ipStr);
+    server.send_P(200, "text/html", page, (size_t)length);
+  });
+
+  server.addHandler(&fwPushOtaGuard);   // Before ElegantOTA.begin() adds its routes
+
+  server.on("/patch", HTTP_POST, [live]() {
+    if (patchRefused) {
+      server.send_P(409, "text/plain", "Firmware push running - update the server when it has finished");
+      return;
+    }
+    bool ok = patchResult == OTA_PATCH_DONE;
+    server.send_P(ok ? 200 : 500, "text/plain", ok ? "Update OK - rebooting" : otaPatchStatusName(patchResult));
+    if (!ok) return;
+    if (live) {
+      liveRebootRequested = true;
+      return;
+    }
+    delay(1000);
+    ESP.restart();
+  }, [live]() { handlePatchUpload(live); });
+
+  server.on("/client-fw", HTTP_POST, []() {
+    server.send_P(clientStageOk ? 200 : 500, "text/plain",
+                clientStageOk ? "Client image staged - run 'fwpush start' on the server console" : "Client image upload failed");
+  }, [live]() { handleClientFwUpload(live); });
+
+  server.on("/reboot", HTTP_POST, [live]() {
+    server.send_P(200, "text/plain", "Rebooting...");
+    if (live) {
+      liveRebootRequested = true;
+      return;
+    }
+    log(LOG_INFO, "Reboot requested via web interface");
+    delay(1000);
+    ESP.restart();
+  });
+}
+
 // === Start OTA and WiFiManager ===
 void startOTA() {
   log(LOG_INFO, "=== Starting OTA Setup Mode ===");
@@ -46,31 +263,10 @@ void startOTA() {
 
   log(LOG_INFO, "WiFi connected during OTA setup");
   char ipStr[16];
-  WiFi.localIP().toString().toCharArray(ipStr, sizeof(ipStr));
+  formatIp(WiFi.localIP(), ipStr, sizeof(ipStr));
   logf(LOG_INFO, "IP Address: %s", ipStr);
   
-  server.on("/", HTTP_GET, []() {
-    char ipStr[16];
-    WiFi.localIP().toString().toCharArray(ipStr, sizeof(ipStr));
-    
-    String html = "<html><head><style>body{font-family:sans-serif;text-align:center;padding:2em;}h1{color:#333;}p{margin:1em 0;}a,input[type=submit]{padding:0.5em 1em;background:#007bff;color:#fff;border:none;border-radius:5px;}a:hover,input[type=submit]:hover{background:#0056b3;}</style></head><body>";
-    html += "<h1>ESP32 OTA Ready</h1>";
-    html += "<p><b>Firmware Version:</b> " FIRMWARE_VERSION "</p>";
-    html += "<p><b>IP:</b> ";
-    html += ipStr;
-    html += "</p>";
-    html += "<p><a href='/update'>Go to OTA Update</a></p>";
-    html += "<form action='/reboot' method='POST'><input type='submit' value='Reboot ESP32'></form>";
-    html += "</body></html>";
-    server.send(200, "text/html", html);
-  });
-
-  server.on("/reboot", HTTP_POST, []() {
-    server.send(200, "text/plain", "Rebooting...");
-    log(LOG_INFO, "Reboot requested via web interface");
-    delay(1000);
-    ESP.restart();
-  });
+  registerOtaRoutes(false);
 
   ElegantOTA.begin(&server);
   server.begin();
@@ -109,16 +305,194 @@ void startOTA_AP() {
     server.begin();
     Serial.println("ElegantOTA server started. Connect to the AP and go to http://192.168.4.1/update");
     ElegantOTA.setAutoReboot(true);
+    setLedPattern(LED_FAST_BLINK);
     // 4. Main OTA loop (blocks until timeout or reboot)
     unsigned long start = millis();
     const unsigned long TIMEOUT = 5 * 60 * 1000; // 5 minutes
     while (millis() - start < TIMEOUT) {
         server.handleClient();
         ElegantOTA.loop();   // <-- Add this line!
-        updatePairingLED();   // Update LED feedback
         delay(10);
     }
 
     Serial.println("OTA timeout reached, rebooting...");
     ESP.restart();
-}
\ No newline at end of file
+}
+
+// ---- Live OTA ----
+static void onLiveUploadStart() {
+  memset(&liveStats, 0, sizeof(liveStats));
+  chunkPauseMs = LIVE_OTA_MIN_PAUSE_MS;
+  loopOverBudget = false;
+  uploadStartMs = millis();
+  uploadActive = true;
+  LOGQ(LOG_INFO, "Live OTA: upload started");
+}
+
+// Called by ElegantOTA after each chunk is written to flash (OTA task)
+static void onLiveUploadProgress(size_t current, size_t total) {
+  liveStats.bytes = current;
+  liveStats.received = current;   // Patch uploads overwrite this with the compressed size
+  liveStats.chunks++;
+  // Back off quickly when the loop missed its budget, recover slowly otherwise
+  uint32_t pause = chunkPauseMs;
+  if (loopOverBudget) {
+    pause = pause * 2 > LIVE_OTA_MAX_PAUSE_MS ? LIVE_OTA_MAX_PAUSE_MS : pause * 2;
+    loopOverBudget = false;
+  } else if (pause > LIVE_OTA_MIN_PAUSE_MS) {
+    pause--;
+  }
+  chunkPauseMs = pause;
+  if (pause > liveStats.maxPauseMs) liveStats.maxPauseMs = pause;
+  liveStats.totalPauseMs += pause;
+  vTaskDelay(pdMS_TO_TICKS(pause));
+}
+
+static void onLiveUploadEnd(bool success) {
+  finishLiveUpload(success, true);
+}
+
+static void finishLiveUpload(bool success, bool rebootOnSuccess) {
+  uploadActive = false;
+  liveStats.durationMs = millis() - uploadStartMs;
+  liveStats.success = success;
+  liveStats.completed = true;
+  LOGQ(LOG_INFO, "Live OTA: upload %s, %lu bytes in %lu ms", success ? "complete" : "FAILED",
+       (unsigned long)liveStats.bytes, (unsigned long)liveStats.durationMs);
+  if (success && rebootOnSuccess) liveRebootRequested = true;
+}
+
+static void liveOtaTask(void*) {
+  while (!liveStopRequested) {
+    server.handleClient();
+    ElegantOTA.loop();
+    vTaskDelay(pdMS_TO_TICKS(2));
+  }
+  server.stop();
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  liveTask = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool startLiveOTA() {
+  if (liveTask != nullptr) {
+    log(LOG_INFO, "Live OTA already running");
+    return true;
+  }
+  // AP on the ESP-NOW channel so clients stay reachable during the update
+  WiFi.mode(WIFI_AP_STA);
+  if (!WiFi.softAP(LIVE_OTA_AP_SSID, LIVE_OTA_AP_PASSWORD, chan)) {
+    log(LOG_ERROR, "Live OTA: failed to start access point");
+    WiFi.mode(WIFI_STA);
+    return false;
+  }
+  static bool routesRegistered = false;
+  if (!routesRegistered) {
+    registerOtaRoutes(true);
+    ElegantOTA.begin(&server);
+    ElegantOTA.setAutoReboot(false);
+    ElegantOTA.onStart(onLiveUploadStart);
+    ElegantOTA.onProgress(onLiveUploadProgress);
+    ElegantOTA.onEnd(onLiveUploadEnd);
+    routesRegistered = true;
+  }
+  server.begin();
+
+  liveStopRequested = false;
+  liveRebootRequested = false;
+  liveStartMs = millis();
+  if (xTaskCreate(liveOtaTask, "liveOta", 6144, nullptr, uxTaskPriorityGet(nullptr), &liveTask) != pdPASS) {
+    log(LOG_ERROR, "Live OTA: failed to create task");
+    server.stop();
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_STA);
+    liveTask = nullptr;
+    return false;
+  }
+  serialOtaTrigger = true;   // LED fast blink while OTA is available
+  setLedPattern(LED_FAST_BLINK);
+  char ipStr[16];
+  formatIp(WiFi.softAPIP(), ipStr, sizeof(ipStr));
+  logf(LOG_INFO, "Live OTA: join '%s' (channel %u) and open http://%s/update", LIVE_OTA_AP_SSID, chan, ipStr);
+  return true;
+}
+
+void stopLiveOTA() {
+  if (liveTask == nullptr) {
+    log(LOG_INFO, "Live OTA not running");
+    return;
+  }
+  if (uploadActive) {
+    log(LOG_WARN, "Live OTA: upload in progress - not stopping");
+    return;
+  }
+  liveStopRequested = true;
+  serialOtaTrigger = false;
+  setLedPattern(pairingMode ? LED_FADE : LED_OFF);
+  log(LOG_INFO, "Live OTA stopped");
+}
+
+bool liveOtaActive() {
+  return liveTask != nullptr;
+}
+
+// Called every loop(): measures the loop gap while an upload is running (this
+// is the worst-case delay for a footswitch, MIDI or ESP-NOW event) and handles
+// the post-update reboot outside the web server task.
+void serviceLiveOTA() {
+  if (liveTask == nullptr) return;
+  uint32_t now = micros();
+  if (uploadActive) {
+    if (lastLoopUs != 0) {
+      uint32_t gap = now - lastLoopUs;
+      liveStats.loopSamples++;
+      liveStats.totalGapUs += gap;
+      if (gap > liveStats.maxGapUs) liveStats.maxGapUs = gap;
+      if (gap > LIVE_OTA_LATENCY_BUDGET_US) {
+        liveStats.overBudget++;
+        loopOverBudget = true;
+      }
+    }
+    lastLoopUs = now;
+    return;
+  }
+  lastLoopUs = 0;
+
+  if (liveRebootRequested) {
+    printLiveOtaStatus();
+    log(LOG_WARN, "Live OTA: rebooting into new firmware");
+    flushNVSCache();
+    delay(200);
+    ESP.restart();
+  }
+  if (!liveStats.completed && millis() - liveStartMs > LIVE_OTA_IDLE_TIMEOUT_MS) {
+    log(LOG_INFO, "Live OTA: no upload started - shutting down access point");
+    stopLiveOTA();
+  }
+}
+
+const LiveOtaStats& getLiveOtaStats() {
+  return liveStats;
+}
+
+void printLiveOtaStatus() {
+  log(LOG_INFO, "=== LIVE OTA ===");
+  logf(LOG_INFO, "State: %s", liveTask == nullptr ? "stopped" : (uploadActive ? "uploading" : "waiting for upload"));
+  if (liveStats.chunks == 0) {
+    log(LOG_INFO, "No upload this session");
+    return;
+  }
+  uint32_t elapsed = uploadActive ? millis() - uploadStartMs : liveStats.durationMs;
+  logf(LOG_INFO, "Upload: %lu bytes received, %lu written, %lu chunks in %lu ms%s", (unsigned long)liveStats.received,
+       (unsigned long)liveStats.bytes, (unsigned long)liveStats.chunks, (unsigned long)elapsed,
+       liveStats.completed ? (liveStats.success ? " (complete)" : " (failed)") : "");
+  if (elapsed > 0) logf(LOG_INFO, "Throughput: %lu KB/s received", (unsigned long)(liveStats.received / elapsed));
+  logf(LOG_INFO, "Chunk Pause: current %lu ms, max %lu ms, total %lu ms", (unsigned long)chunkPauseMs,
+       (unsigned long)liveStats.maxPauseMs, (unsigned long)liveStats.totalPauseMs);
+  if (liveStats.loopSamples > 0) {
+    logf(LOG_INFO, "Loop Gap During Upload: avg %lu us, max %lu us, %lu/%lu over %u us budget",
+         (unsigned long)(liveStats.totalGapUs / liveStats.loopSamples), (unsigned long)liveStats.maxGapUs,
+         (unsigned long)liveStats.overBudget, (unsigned long)liveStats.loopSamples, LIVE_OTA_LATENCY_BUDGET_US);
+  }
+}
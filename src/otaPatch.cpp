@@ -0,0 +1,234 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Streaming decoder for SWP1 patch files (also compiled into the host packer).
+#include <otaPatch.h>
+#include <configImage.h>
+#include <string.h>
+
+static_assert(sizeof(OtaPatchHeader) == 28, "OtaPatchHeader must match the file layout");
+static_assert((OTA_PATCH_WINDOW & (OTA_PATCH_WINDOW - 1)) == 0, "OTA_PATCH_WINDOW must be a power of two");
+
+enum DecoderState : uint8_t {
+    STATE_HEADER,
+    STATE_TOKEN,
+    STATE_LITERAL,
+    STATE_MATCH_LO,
+    STATE_MATCH_HI,
+    STATE_BASE_LENGTH,
+    STATE_BASE_OFFSET,
+    STATE_END
+};
+
+void otaPatchBegin(OtaPatchDecoder& decoder, const OtaPatchIo& io) {
+    memset(&decoder.header, 0, sizeof(decoder.header));
+    decoder.io = io;
+    decoder.state = STATE_HEADER;
+    decoder.status = OTA_PATCH_NEED_MORE;
+    decoder.token = 0;
+    decoder.varintShift = 0;
+    decoder.varint = 0;
+    decoder.count = 0;
+    decoder.headerBytes = 0;
+    decoder.payloadUsed = 0;
+    decoder.produced = 0;
+    decoder.crc = 0;
+    decoder.outLength = 0;
+}
+
+const OtaPatchHeader* otaPatchHeader(const OtaPatchDecoder& decoder) {
+    return decoder.state == STATE_HEADER ? nullptr : &decoder.header;
+}
+
+static bool flushOutput(OtaPatchDecoder& d) {
+    if (d.outLength == 0) return true;
+    d.crc = configCrc32(d.out, d.outLength, d.crc);
+    bool ok = d.io.write(d.io.context, d.out, d.outLength);
+    d.outLength = 0;
+    return ok;
+}
+
+static OtaPatchStatus emit(OtaPatchDecoder& d, uint8_t value) {
+    if (d.produced >= d.header.targetSize) return OTA_PATCH_OVERRUN;
+    d.window[d.produced & (OTA_PATCH_WINDOW - 1)] = value;
+    d.produced++;
+    d.out[d.outLength++] = value;
+    if (d.outLength == OTA_PATCH_OUT_CHUNK && !flushOutput(d)) return OTA_PATCH_IO_ERROR;
+    return OTA_PATCH_NEED_MORE;
+}
+
+// The delta only applies to the exact image it was built against
+static OtaPatchStatus checkBase(OtaPatchDecoder& d) {
+    if (d.io.readBase == nullptr) return OTA_PATCH_BASE_MISMATCH;
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < d.header.baseSize; ) {
+        uint32_t chunk = d.header.baseSize - offset;
+        if (chunk > OTA_PATCH_OUT_CHUNK) chunk = OTA_PATCH_OUT_CHUNK;
+        if (!d.io.readBase(d.io.context, offset, d.out, chunk)) return OTA_PATCH_IO_ERROR;
+        crc = configCrc32(d.out, chunk, crc);
+        offset += chunk;
+    }
+    return crc == d.header.baseCrc ? OTA_PATCH_NEED_MORE : OTA_PATCH_BASE_MISMATCH;
+}
+
+static OtaPatchStatus parseHeader(OtaPatchDecoder& d) {
+    const OtaPatchHeader& h = d.header;
+    if (h.magic != OTA_PATCH_MAGIC || h.version != OTA_PATCH_VERSION) return OTA_PATCH_BAD_HEADER;
+    if (h.targetSize == 0 || (h.flags & ~OTA_PATCH_FLAG_DELTA) != 0) return OTA_PATCH_BAD_HEADER;
+    if (h.flags & OTA_PATCH_FLAG_DELTA) return checkBase(d);
+    return OTA_PATCH_NEED_MORE;
+}
+
+static OtaPatchStatus copyFromBase(OtaPatchDecoder& d, int32_t relative) {
+    int64_t source = (int64_t)d.produced + relative;
+    if (!(d.header.flags & OTA_PATCH_FLAG_DELTA) || source < 0 ||
+        source + d.count > (int64_t)d.header.baseSize) return OTA_PATCH_BAD_TOKEN;
+    uint8_t buffer[64];
+    uint32_t offset = (uint32_t)source;
+    while (d.count > 0) {
+        uint32_t chunk = d.count < sizeof(buffer) ? d.count : sizeof(buffer);
+        if (!d.io.readBase(d.io.context, offset, buffer, chunk)) return OTA_PATCH_IO_ERROR;
+        for (uint32_t i = 0; i < chunk; i++) {
+            OtaPatchStatus status = emit(d, buffer[i]);
+            if (status != OTA_PATCH_NEED_MORE) return status;
+        }
+        offset += chunk;
+        d.count -= chunk;
+    }
+    return OTA_PATCH_NEED_MORE;
+}
+
+static OtaPatchStatus completeStream(OtaPatchDecoder& d) {
+    if (!flushOutput(d)) return OTA_PATCH_IO_ERROR;
+    if (d.produced != d.header.targetSize) return OTA_PATCH_TRUNCATED;
+    return d.crc == d.header.targetCrc ? OTA_PATCH_DONE : OTA_PATCH_CRC_MISMATCH;
+}
+
+// Returns true when the varint is complete. A sixth byte, or a fifth carrying
+// bits past 32, sets overflow and is not used.
+static bool readVarint(OtaPatchDecoder& d, uint8_t c, bool& overflow) {
+    overflow = d.varintShift > 28 || (d.varintShift == 28 && (c & 0x70));
+    if (overflow) return false;
+    d.varint |= (uint32_t)(c & 0x7F) << d.varintShift;
+    d.varintShift += 7;
+    return !(c & 0x80);
+}
+
+static OtaPatchStatus step(OtaPatchDecoder& d, uint8_t c) {
+    if (d.state == STATE_HEADER) {
+        ((uint8_t*)&d.header)[d.headerBytes++] = c;
+        if (d.headerBytes < sizeof(OtaPatchHeader)) return OTA_PATCH_NEED_MORE;
+        d.state = STATE_TOKEN;
+        OtaPatchStatus status = parseHeader(d);
+        if (status == OTA_PATCH_NEED_MORE && d.header.payloadSize == 0) return completeStream(d);
+        return status;
+    }
+
+    d.payloadUsed++;
+    OtaPatchStatus status = OTA_PATCH_NEED_MORE;
+    bool overflow = false;
+    switch (d.state) {
+        case STATE_TOKEN:
+            d.token = c;
+            if (c < OTA_PATCH_TOKEN_MATCH) {
+                d.count = (uint32_t)c + 1;
+                d.state = STATE_LITERAL;
+            } else if (c < OTA_PATCH_TOKEN_BASE) {
+                d.state = STATE_MATCH_LO;
+            } else if (c == OTA_PATCH_TOKEN_BASE) {
+                d.varint = 0;
+                d.varintShift = 0;
+                d.state = STATE_BASE_LENGTH;
+            } else {
+                return OTA_PATCH_BAD_TOKEN;
+            }
+            break;
+        case STATE_LITERAL:
+            status = emit(d, c);
+            if (--d.count == 0) d.state = STATE_TOKEN;
+            break;
+        case STATE_MATCH_LO:
+            d.varint = c;
+            d.state = STATE_MATCH_HI;
+            break;
+        case STATE_MATCH_HI: {
+            uint32_t distance = (d.varint | ((uint32_t)c << 8)) + 1;
+            uint32_t length = (uint32_t)(d.token & 0x3F) + OTA_PATCH_MIN_MATCH;
+            if (distance > OTA_PATCH_WINDOW || distance > d.produced) return OTA_PATCH_BAD_TOKEN;
+            for (uint32_t i = 0; i < length && status == OTA_PATCH_NEED_MORE; i++) {
+                status = emit(d, d.window[(d.produced - distance) & (OTA_PATCH_WINDOW - 1)]);
+            }
+            d.state = STATE_TOKEN;
+            break;
+        }
+        case STATE_BASE_LENGTH:
+            if (readVarint(d, c, overflow)) {
+                d.count = d.varint;
+                d.varint = 0;
+                d.varintShift = 0;
+                d.state = STATE_BASE_OFFSET;
+            }
+            break;
+        case STATE_BASE_OFFSET:
+            if (readVarint(d, c, overflow)) {
+                int32_t relative = (int32_t)(d.varint >> 1) ^ -(int32_t)(d.varint & 1);
+                status = copyFromBase(d, relative);
+                d.state = STATE_TOKEN;
+            }
+            break;
+        default:
+            return OTA_PATCH_DONE;
+    }
+    if (overflow) return OTA_PATCH_BAD_TOKEN;
+    if (status != OTA_PATCH_NEED_MORE) return status;
+    if (d.payloadUsed == d.header.payloadSize) {
+        if (d.state != STATE_TOKEN) return OTA_PATCH_TRUNCATED;
+        d.state = STATE_END;
+        return completeStream(d);
+    }
+    return OTA_PATCH_NEED_MORE;
+}
+
+OtaPatchStatus otaPatchFeed(OtaPatchDecoder& decoder, const uint8_t* data, size_t length) {
+    if (decoder.status != OTA_PATCH_NEED_MORE) return (OtaPatchStatus)decoder.status;
+    for (size_t i = 0; i < length; i++) {
+        OtaPatchStatus status = step(decoder, data[i]);
+        if (status != OTA_PATCH_NEED_MORE) {
+            decoder.status = status;
+            return status;   // Bytes after the end of the stream are ignored
+        }
+    }
+    return OTA_PATCH_NEED_MORE;
+}
+
+OtaPatchStatus otaPatchFinish(OtaPatchDecoder& decoder) {
+    if (decoder.status == OTA_PATCH_NEED_MORE) decoder.status = OTA_PATCH_TRUNCATED;
+    return (OtaPatchStatus)decoder.status;
+}
+
+const char* otaPatchStatusName(uint8_t status) {
+    switch (status) {
+        case OTA_PATCH_NEED_MORE:      return "incomplete";
+        case OTA_PATCH_DONE:           return "ok";
+        case OTA_PATCH_BAD_HEADER:     return "bad header";
+        case OTA_PATCH_BASE_MISMATCH:  return "running firmware is not the delta base";
+        case OTA_PATCH_BAD_TOKEN:      return "corrupt stream";
+        case OTA_PATCH_OVERRUN:        return "output larger than header size";
+        case OTA_PATCH_CRC_MISMATCH:   return "CRC mismatch";
+        case OTA_PATCH_TRUNCATED:      return "truncated";
+        case OTA_PATCH_IO_ERROR:       return "flash I/O error";
+        default:                       return "unknown";
+    }
+}
@@ -0,0 +1,317 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <nvsManager.h>
+#include <programRemap.h>
+
+#define REMAP_STORE_VERSION 1
+
+enum RemapEncoding : uint8_t {
+    REMAP_EXCEPT_IDENTITY,              // (program, value) pairs that differ from identity
+    REMAP_EXCEPT_NONE,                  // (program, value) pairs that are sent at all
+    REMAP_RAW                           // Every entry
+};
+
+struct RemapRecordHeader {
+    uint8_t version;
+    uint8_t encoding;                   // RemapEncoding
+    uint8_t mac[6];
+    uint8_t count;                      // Pairs, or PROGRAM_REMAP_PROGRAMS for REMAP_RAW
+};
+
+// The pair encodings are only used while shorter than the raw table
+#define REMAP_RECORD_MAX (sizeof(RemapRecordHeader) + PROGRAM_REMAP_PROGRAMS)
+
+struct RemapSlot {
+    uint8_t mac[6];                     // All zero = free
+    uint8_t table[PROGRAM_REMAP_PROGRAMS];
+};
+
+static_assert(MAX_CLIENTS <= PROGRAM_REMAP_SLOTS, "not every client can have a remap table");
+static_assert(PROGRAM_REMAP_SLOTS <= NVS_KEYED_BLOB_MAX, "too many remap slots for nvsManager");
+
+static RemapSlot slots[PROGRAM_REMAP_SLOTS];
+static uint8_t encoded[PROGRAM_REMAP_SLOTS][REMAP_RECORD_MAX];     // What NVS holds (written at commit time)
+static size_t encodedLength[PROGRAM_REMAP_SLOTS];
+
+static bool macEmpty(const uint8_t* mac) {
+    return memcmp(mac, "\0\0\0\0\0\0", 6) == 0;
+}
+
+static bool pairedClient(int client) {
+    return client >= 0 && client < numClients && client < MAX_CLIENTS;
+}
+
+static int slotOf(const uint8_t* mac) {
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS; s++) {
+        if (!macEmpty(slots[s].mac) && memcmp(slots[s].mac, mac, 6) == 0) return s;
+    }
+    return -1;
+}
+
+static bool slotPaired(int s) {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (memcmp(clientMacAddresses[i], slots[s].mac, 6) == 0) return true;
+    }
+    return false;
+}
+
+static bool identity(const uint8_t* table) {
+    for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+        if (table[p] != p) return false;
+    }
+    return true;
+}
+
+// Slot holding the client's table: its own, or (create) a free one or one whose
+// client is no longer paired, starting from identity
+static int slotFor(int client, bool create) {
+    const uint8_t* mac = clientMacAddresses[client];
+    int slot = slotOf(mac);
+    if (slot >= 0 || !create) return slot;
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS && slot < 0; s++) {
+        if (macEmpty(slots[s].mac)) slot = s;
+    }
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS && slot < 0; s++) {
+        if (!slotPaired(s)) slot = s;
+    }
+    if (slot < 0) return -1;
+    memcpy(slots[slot].mac, mac, 6);
+    for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) slots[slot].table[p] = (uint8_t)p;
+    return slot;
+}
+
+static size_t encodeSlot(const RemapSlot& slot, uint8_t* out) {
+    int changed = 0, sent = 0;
+    for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+        if (slot.table[p] != p) changed++;
+        if (slot.table[p] != PROGRAM_REMAP_NONE) sent++;
+    }
+    RemapRecordHeader header;
+    header.version = REMAP_STORE_VERSION;
+    memcpy(header.mac, slot.mac, 6);
+    uint8_t* body = out + sizeof(header);
+    if (changed * 2 < PROGRAM_REMAP_PROGRAMS || sent * 2 < PROGRAM_REMAP_PROGRAMS) {
+        bool exceptIdentity = changed <= sent;
+        header.encoding = exceptIdentity ? REMAP_EXCEPT_IDENTITY : REMAP_EXCEPT_NONE;
+        header.count = 0;
+        for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+            uint8_t value = slot.table[p];
+            if (exceptIdentity ? value == p : value == PROGRAM_REMAP_NONE) continue;
+            body[header.count * 2] = (uint8_t)p;
+            body[header.count * 2 + 1] = value;
+            header.count++;
+        }
+    } else {
+        header.encoding = REMAP_RAW;
+        header.count = PROGRAM_REMAP_PROGRAMS;
+        memcpy(body, slot.table, PROGRAM_REMAP_PROGRAMS);
+    }
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header) + (header.encoding == REMAP_RAW ? PROGRAM_REMAP_PROGRAMS : header.count * 2u);
+}
+
+static bool decodeSlot(const uint8_t* data, size_t length, RemapSlot& slot) {
+    RemapRecordHeader header;
+    if (length < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    const uint8_t* body = data + sizeof(header);
+    size_t bodyLength = length - sizeof(header);
+    if (header.version != REMAP_STORE_VERSION || macEmpty(header.mac)) return false;
+    if (header.encoding == REMAP_RAW) {
+        if (bodyLength != PROGRAM_REMAP_PROGRAMS) return false;
+        memcpy(slot.table, body, PROGRAM_REMAP_PROGRAMS);
+    } else if (header.encoding == REMAP_EXCEPT_IDENTITY || header.encoding == REMAP_EXCEPT_NONE) {
+        if (bodyLength != header.count * 2u) return false;
+        for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+            slot.table[p] = header.encoding == REMAP_EXCEPT_IDENTITY ? (uint8_t)p : PROGRAM_REMAP_NONE;
+        }
+        for (int k = 0; k < header.count; k++) {
+            if (body[k * 2] >= PROGRAM_REMAP_PROGRAMS) return false;
+            slot.table[body[k * 2]] = body[k * 2 + 1];
+        }
+    } else {
+        return false;
+    }
+    for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+        if (slot.table[p] >= PROGRAM_REMAP_PROGRAMS && slot.table[p] != PROGRAM_REMAP_NONE) return false;
+    }
+    memcpy(slot.mac, header.mac, 6);
+    return true;
+}
+
+// Write the slot back: its encoded table, or no key once it is identity again
+static void persistSlot(int s) {
+    if (identity(slots[s].table)) {
+        memset(&slots[s], 0, sizeof(slots[s]));
+        encodedLength[s] = 0;
+    } else {
+        encodedLength[s] = encodeSlot(slots[s], encoded[s]);
+    }
+    saveProgramRemapToNVS((uint8_t)s, encoded[s], encodedLength[s]);
+}
+
+void loadProgramRemapsFromNVS() {
+    int loaded = 0;
+    size_t bytes = 0;
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS; s++) {
+        size_t length = loadProgramRemapFromNVS((uint8_t)s, encoded[s], REMAP_RECORD_MAX);
+        if (length == 0 || !decodeSlot(encoded[s], length, slots[s])) {
+            memset(&slots[s], 0, sizeof(slots[s]));
+            encodedLength[s] = 0;
+            continue;
+        }
+        encodedLength[s] = length;
+        bytes += length;
+        loaded++;
+    }
+    if (loaded > 0) logf(LOG_INFO, "Program remap tables: %d clients (%u bytes in NVS)", loaded, (unsigned)bytes);
+}
+
+uint8_t programRemapFor(int client, uint8_t program) {
+    if (!pairedClient(client) || program >= PROGRAM_REMAP_PROGRAMS) return program;
+    int s = slotOf(clientMacAddresses[client]);
+    return s < 0 ? program : slots[s].table[program];
+}
+
+bool programRemapActive(int client) {
+    return pairedClient(client) && slotOf(clientMacAddresses[client]) >= 0;
+}
+
+static bool editRange(int client, uint8_t first, uint8_t last, int& slot) {
+    if (!pairedClient(client) || first > last || last >= PROGRAM_REMAP_PROGRAMS) return false;
+    slot = slotFor(client, true);
+    return slot >= 0;
+}
+
+bool programRemapSet(int client, uint8_t first, uint8_t last, uint8_t value) {
+    int s;
+    if ((value >= PROGRAM_REMAP_PROGRAMS && value != PROGRAM_REMAP_NONE) || !editRange(client, first, last, s)) return false;
+    for (int p = first; p <= last; p++) slots[s].table[p] = value;
+    persistSlot(s);
+    return true;
+}
+
+bool programRemapShift(int client, uint8_t first, uint8_t last, int offset) {
+    int s;
+    if (!editRange(client, first, last, s)) return false;
+    for (int p = first; p <= last; p++) {
+        int value = p + offset;
+        slots[s].table[p] = (uint8_t)(value < 0 ? 0 : value > 127 ? 127 : value);
+    }
+    persistSlot(s);
+    return true;
+}
+
+bool programRemapReset(int client, bool sendNothing) {
+    if (!pairedClient(client)) return false;
+    int s = slotFor(client, sendNothing);
+    if (s < 0) return true;             // Already identity
+    for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+        slots[s].table[p] = sendNothing ? PROGRAM_REMAP_NONE : (uint8_t)p;
+    }
+    persistSlot(s);
+    return true;
+}
+
+size_t programRemapStoredBytes(int client) {
+    if (!pairedClient(client)) return 0;
+    int s = slotOf(clientMacAddresses[client]);
+    return s < 0 ? 0 : encodedLength[s];
+}
+
+void programRemapSnapshot(void (*emit)(uint8_t slot, const void* data, size_t length)) {
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS; s++) {
+        if (encodedLength[s] > 0) emit((uint8_t)s, encoded[s], encodedLength[s]);
+    }
+}
+
+// ---- Reports ----
+
+// Runs of programs that are not sent, go to one program, or share one offset
+void printProgramRemap(int client) {
+    if (!pairedClient(client)) {
+        logf(LOG_WARN, "Client %d not paired (0-%d)", client, numClients - 1);
+        return;
+    }
+    logf(LOG_INFO, "=== PROGRAM REMAP: client %d %s ===", client, getPeerName(clientMacAddresses[client]));
+    int s = slotOf(clientMacAddresses[client]);
+    if (s < 0) {
+        log(LOG_INFO, "Identity: every program sent unchanged");
+        return;
+    }
+    const uint8_t* table = slots[s].table;
+    for (int first = 0, last; first < PROGRAM_REMAP_PROGRAMS; first = last + 1) {
+        uint8_t value = table[first];
+        bool constant = value == PROGRAM_REMAP_NONE || (first + 1 < PROGRAM_REMAP_PROGRAMS && table[first + 1] == value);
+        last = first;
+        while (last + 1 < PROGRAM_REMAP_PROGRAMS &&
+               (constant ? table[last + 1] == value
+                         : table[last + 1] != PROGRAM_REMAP_NONE && table[last + 1] - (last + 1) == value - first)) {
+            last++;
+        }
+        char from[12], to[16];
+        snprintf(from, sizeof(from), first == last ? "%d" : "%d-%d", first, last);
+        if (value == PROGRAM_REMAP_NONE) {
+            snprintf(to, sizeof(to), "not sent");
+        } else if (value == first && (first == last || !constant)) {
+            snprintf(to, sizeof(to), "unchanged");
+        } else if (constant || first == last) {
+            snprintf(to, sizeof(to), "%u", value);
+        } else {
+            snprintf(to, sizeof(to), "%u-%u", value, table[last]);
+        }
+        logf(LOG_INFO, "  %-8s -> %s", from, to);
+    }
+    logf(LOG_INFO, "Stored in NVS: %u bytes", (unsigned)encodedLength[s]);
+}
+
+void printProgramRemapList() {
+    log(LOG_INFO, "=== PROGRAM REMAP ===");
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        int s = slotOf(clientMacAddresses[i]);
+        if (s < 0) {
+            logf(LOG_INFO, "  %d %s: identity", i, getPeerName(clientMacAddresses[i]));
+            continue;
+        }
+        int changed = 0, muted = 0;
+        for (int p = 0; p < PROGRAM_REMAP_PROGRAMS; p++) {
+            if (slots[s].table[p] == PROGRAM_REMAP_NONE) muted++;
+            else if (slots[s].table[p] != p) changed++;
+        }
+        logf(LOG_INFO, "  %d %s: %d remapped, %d not sent (%u bytes in NVS)", i, getPeerName(clientMacAddresses[i]),
+             changed, muted, (unsigned)encodedLength[s]);
+    }
+    int orphans = 0;
+    for (int s = 0; s < PROGRAM_REMAP_SLOTS; s++) {
+        if (!macEmpty(slots[s].mac) && !slotPaired(s)) orphans++;
+    }
+    if (orphans > 0) logf(LOG_INFO, "%d tables kept for clients not paired now", orphans);
+}
+
+void printProgramRemapFor(uint8_t program) {
+    logf(LOG_INFO, "Program Change %u goes out as:", program);
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        uint8_t value = programRemapFor(i, program);
+        if (value == PROGRAM_REMAP_NONE) {
+            logf(LOG_INFO, "  %d %s: not sent", i, getPeerName(clientMacAddresses[i]));
+        } else {
+            logf(LOG_INFO, "  %d %s: PC %u", i, getPeerName(clientMacAddresses[i]), value);
+        }
+    }
+}
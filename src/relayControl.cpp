@@ -15,35 +15,84 @@
 #include "relayControl.h"
 #include "globals.h"
 #include "utils.h"
+#include "deferredLog.h"
+#include "rigState.h"
+#include "hal.h"
+#include "espnow.h"
+#include "switchBench.h"
+#include "sessionRecord.h"
+#include "clientMirror.h"
+#include "sceneEngine.h"
+#include "dataStructs.h"
 
 #if HAS_RELAY_OUTPUTS
 
+static uint8_t currentRelayMask = 0;
+static uint32_t relayRestoreUs = 0;     // micros() at the first relay write after boot
+
+// Track the applied mask; currentRelayChannel reports the lowest active channel
+static void recordRelayMask(uint8_t applied) {
+    sessionRecordRelay(applied);
+    currentRelayMask = applied;
+    currentRelayChannel = 0;
+    for (int i = 0; i < 8; i++) {
+        if (applied & (1u << i)) { currentRelayChannel = i + 1; break; }
+    }
+}
+
+// Configure the relay pins and drive them straight to the last persisted state.
+// Called first thing in setup() so a power blip puts the rig back where it was
+// before Wi-Fi, ESP-NOW or peers are brought up.
+void restoreRelayOutputs() {
+    bool restored = loadRigState();
+    uint8_t mask = getRigStateRelayMask();
+    uint8_t* relayPins = parsePinArray(RELAY_OUTPUT_PINS);
+    uint8_t applied = 0;
+    for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
+        relayOutputPins[i] = relayPins[i];
+        if (relayOutputPins[i] == 255) continue;
+        bool on = i < 8 && ((mask >> i) & 1);
+        // Latch the level before enabling the driver so the output never glitches
+        halPinWrite(relayOutputPins[i], on);
+        halPinMode(relayOutputPins[i], HAL_PIN_OUTPUT);
+        if (on) applied |= (uint8_t)(1u << i);
+    }
+    relayRestoreUs = micros();
+    recordRelayMask(applied);
+    logf(LOG_INFO, "Relays %s mask 0x%02X - first relay write %lu us after boot",
+         restored ? "restored to" : "defaulted to", applied, (unsigned long)relayRestoreUs);
+}
+
 void setRelayChannel(uint8_t channel) {
+    // Validate first: a rejected channel leaves the outputs and the recorded mask as they are
+    if (channel > MAX_RELAY_CHANNELS) {
+        logf(LOG_ERROR, "Invalid relay channel: %d (valid: 0-%d)", channel, MAX_RELAY_CHANNELS);
+        return;
+    }
+    if (channel > 0 && relayOutputPins[channel - 1] == 255) {
+        logf(LOG_ERROR, "Invalid relay pin for channel %d", channel);
+        return;
+    }
+
     // Turn off all relays first
     for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
         if (relayOutputPins[i] != 255) {
-            digitalWrite(relayOutputPins[i], LOW);
+            halPinWrite(relayOutputPins[i], false);
         }
     }
     
     // Turn on the specified channel (1-based)
-    if (channel > 0 && channel <= MAX_RELAY_CHANNELS) {
-        if (relayOutputPins[channel - 1] != 255) {
-            digitalWrite(relayOutputPins[channel - 1], HIGH);
-            currentRelayChannel = channel;
-            #ifndef FAST_SWITCHING
-            logf(LOG_INFO, "Relay channel %d activated", channel);
-            #endif
-        } else {
-            logf(LOG_ERROR, "Invalid relay pin for channel %d", channel);
-        }
-    } else if (channel == 0) {
-        currentRelayChannel = 0;
-    #ifndef FAST_SWITCHING
-    log(LOG_INFO, "All relays turned off");
-    #endif
+    if (channel > 0) {
+        halPinWrite(relayOutputPins[channel - 1], true);
+        switchBenchNote(SWITCH_BENCH_RELAY);
+        recordRelayMask((uint8_t)(1u << (channel - 1)));
+        rigStateNoteRelayMask(currentRelayMask);
+        LOGQ(LOG_INFO, "Relay channel %d activated", channel);
     } else {
-        logf(LOG_ERROR, "Invalid relay channel: %d (valid: 0-%d)", channel, MAX_RELAY_CHANNELS);
+        switchBenchNote(SWITCH_BENCH_RELAY);
+        recordRelayMask(0);
+        rigStateNoteRelayMask(0);
+        LOGQ(LOG_INFO, "All relays turned off");
     }
 }
 
@@ -55,6 +104,26 @@ uint8_t getCurrentRelayChannel() {
     return currentRelayChannel;
 }
 
+// Drive several relays at once (bit 0 = channel 1). Bits for unconfigured pins are
+// ignored. currentRelayChannel reports the lowest active channel, 0 if none.
+void setRelayMask(uint8_t mask) {
+    uint8_t applied = 0;
+    for (int i = 0; i < MAX_RELAY_CHANNELS && i < 8; i++) {
+        if (relayOutputPins[i] == 255) continue;
+        bool on = (mask >> i) & 1;
+        halPinWrite(relayOutputPins[i], on);
+        if (on) applied |= (uint8_t)(1u << i);
+    }
+    switchBenchNote(SWITCH_BENCH_RELAY);
+    recordRelayMask(applied);
+    rigStateNoteRelayMask(applied);
+    LOGQ(LOG_INFO, "Relay mask set to 0x%02X", applied);
+}
+
+uint8_t getRelayMask() {
+    return currentRelayMask;
+}
+
 void testRelaySpeed() {
     log(LOG_INFO, "=== RELAY SPEED TEST ===");
     
@@ -94,11 +163,13 @@ void cycleRelays() {
 void printRelayStatus() {
     log(LOG_INFO, "=== RELAY STATUS ===");
     logf(LOG_INFO, "Current Relay Channel: %u", currentRelayChannel);
+    logf(LOG_INFO, "Current Relay Mask: 0x%02X", currentRelayMask);
+    logf(LOG_INFO, "Boot Restore: %lu us after boot", (unsigned long)relayRestoreUs);
     logf(LOG_INFO, "Max Relay Channels: %d", MAX_RELAY_CHANNELS);
     
     for (int i = 0; i < MAX_RELAY_CHANNELS; i++) {
         if (relayOutputPins[i] != 255) {
-            bool state = digitalRead(relayOutputPins[i]);
+            bool state = halPinRead(relayOutputPins[i]);
             logf(LOG_INFO, "Relay %d (Pin %d): %s", i+1, relayOutputPins[i], 
                  state ? "ON" : "OFF");
         }
@@ -114,7 +185,7 @@ void updateFootswitchState() {
     
     for (int i = 0; i < 4; i++) {
         if (footswitchPins[i] != 255) {
-            bool currentState = digitalRead(footswitchPins[i]) == LOW; // Assuming active low
+            bool currentState = !halPinRead(footswitchPins[i]); // Assuming active low
             
             // Update global footswitchPressed for compatibility with existing code
             if (i == 0) {
@@ -123,9 +194,8 @@ void updateFootswitchState() {
             
             // Log state changes
             if (currentState != lastFootswitchStates[i]) {
-                #ifndef FAST_SWITCHING
-                logf(LOG_DEBUG, "Footswitch %d: %s", i+1, currentState ? "PRESSED" : "RELEASED");
-                #endif
+                sessionRecordPin(footswitchPins[i], !currentState);
+                LOGQ(LOG_DEBUG, "Footswitch %d: %s", i+1, currentState ? "PRESSED" : "RELEASED");
                 lastFootswitchStates[i] = currentState;
             }
         }
@@ -134,7 +204,35 @@ void updateFootswitchState() {
 
 bool isFootswitchPressed(uint8_t footswitchIndex) {
     if (footswitchIndex < 4 && footswitchPins[footswitchIndex] != 255) {
-        return digitalRead(footswitchPins[footswitchIndex]) == LOW;
+        return !halPinRead(footswitchPins[footswitchIndex]);
     }
     return false;
 }
+
+// Footswitch 1 press: channel change command (program 1) to every labeled peer
+void handleFootswitchPress() {
+    struct_message command;
+    memset(&command, 0, sizeof(command));
+    command.msgType = COMMAND;
+    command.id = 0;
+    command.commandType = PROGRAM_CHANGE;
+    command.commandValue = 1;
+    if (sceneRecallForProgram(command.commandValue, SCENE_SOURCE_FOOTSWITCH)) return;
+    for (int i = 0; i < numLabeledPeers; i++) {
+        if (clientMirrorCheck(labeledPeers[i].mac, command.commandValue) != CLIENT_MIRROR_SEND) continue;
+        if (espNowSend(labeledPeers[i].mac, &command, sizeof(command)) == HAL_OK) {
+            switchBenchNote(SWITCH_BENCH_CLIENT_TX);
+            rigStateNoteProgram(labeledPeers[i].mac, command.commandValue);
+        }
+        LOGQ(LOG_INFO, "Footswitch pressed: sent channel change command to peer %s", labeledPeers[i].name);
+    }
+}
+
+void serviceFootswitch() {
+    static bool lastPressed = false;
+    updateFootswitchState();
+    if (footswitchPressed && !lastPressed) {
+        handleFootswitchPress();
+    }
+    lastPressed = footswitchPressed;
+}
@@ -0,0 +1,187 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <rigState.h>
+#include <globals.h>
+#include <utils.h>
+#include <nvsManager.h>
+#include <configImage.h>
+#include <commandSender.h>
+#include <deferredLog.h>
+
+#define RIG_STATE_VERSION 1
+#define RIG_PROGRAM_NONE 0xFF   // Nothing sent to this client yet
+
+// Stored record. peerTag identifies the client list the programs are indexed
+// by; if the peers were re-paired since, the programs are discarded.
+struct RigStateRecord {
+    uint8_t version;
+    uint8_t relayMask;
+    uint8_t clientCount;
+    uint8_t reserved;
+    uint32_t peerTag;
+    uint8_t programs[MAX_CLIENTS];
+};
+
+static_assert(sizeof(RigStateRecord) <= RIG_STATE_MAX_LEN, "rig state record too large for NVS slot");
+
+static RigStateRecord state = {RIG_STATE_VERSION, 0, 0, 0, 0, {0}};
+static bool restored = false;
+
+// Resync bookkeeping: bit i = clientMacAddresses[i]
+static uint32_t resyncPending = 0;
+static uint32_t resyncAttempted = 0;
+static volatile uint32_t deliveredMask = 0;   // Set from the WiFi task
+static unsigned long resyncStart = 0;
+static unsigned long lastResync = 0;
+static uint32_t resyncSends = 0;
+static bool resending = false;
+
+static_assert(MAX_CLIENTS <= 32, "resync masks hold at most 32 clients");
+
+static uint32_t currentPeerTag() {
+    return configCrc32(clientMacAddresses, (size_t)numClients * 6);
+}
+
+static int clientIndex(const uint8_t* mac) {
+    for (int i = 0; i < numClients; i++) {
+        if (memcmp(clientMacAddresses[i], mac, 6) == 0) return i;
+    }
+    return -1;
+}
+
+static void persist() {
+    saveRigStateToNVS(&state, sizeof(state));
+}
+
+// Programs are indexed by client position; reset them when the peer list changes
+static void syncPeerList() {
+    uint32_t tag = currentPeerTag();
+    if (state.peerTag == tag && state.clientCount == numClients) return;
+    memset(state.programs, RIG_PROGRAM_NONE, sizeof(state.programs));
+    state.peerTag = tag;
+    state.clientCount = (uint8_t)numClients;
+}
+
+bool loadRigState() {
+    RigStateRecord stored;
+    size_t length = loadRigStateFromNVS(&stored, sizeof(stored));
+    if (length != sizeof(stored) || stored.version != RIG_STATE_VERSION) {
+        memset(state.programs, RIG_PROGRAM_NONE, sizeof(state.programs));
+        if (length > 0) logf(LOG_WARN, "Ignoring rig state record (%u bytes, v%u)", (unsigned)length, stored.version);
+        return false;
+    }
+    state = stored;
+    restored = true;
+    return true;
+}
+
+uint8_t getRigStateRelayMask() {
+    return state.relayMask;
+}
+
+void rigStateNoteRelayMask(uint8_t mask) {
+    if (state.relayMask == mask) return;
+    state.relayMask = mask;
+    persist();
+}
+
+void rigStateNoteProgram(const uint8_t* clientMac, uint8_t program) {
+    int index = clientIndex(clientMac);
+    if (index < 0) return;
+    // A live send supersedes any pending resync for this client
+    if (!resending) resyncPending &= ~(1u << index);
+    syncPeerList();
+    if (state.programs[index] == program) return;
+    state.programs[index] = program;
+    persist();
+}
+
+uint8_t getRigStateProgram(const uint8_t* clientMac) {
+    int index = clientIndex(clientMac);
+    if (index < 0 || state.peerTag != currentPeerTag()) return RIG_PROGRAM_NONE;
+    return state.programs[index];
+}
+
+void beginRigStateResync() {
+    resyncPending = 0;
+    resyncAttempted = 0;
+    deliveredMask = 0;
+    if (!restored) return;
+    if (state.peerTag != currentPeerTag() || state.clientCount != numClients) {
+        log(LOG_WARN, "Peer list changed since rig state was saved - client programs not resent");
+        return;
+    }
+    for (int i = 0; i < numClients; i++) {
+        if (state.programs[i] != RIG_PROGRAM_NONE) resyncPending |= 1u << i;
+    }
+    resyncStart = millis();
+    lastResync = resyncStart - RIG_RESYNC_INTERVAL_MS;   // First pass on the next loop
+    if (resyncPending) logf(LOG_INFO, "Rig state: resyncing programs to %d clients", __builtin_popcount(resyncPending));
+}
+
+void rigStateOnSendResult(const uint8_t* clientMac, bool delivered) {
+    if (!delivered || resyncAttempted == 0) return;
+    int index = clientIndex(clientMac);
+    if (index >= 0) __atomic_fetch_or(&deliveredMask, 1u << index, __ATOMIC_RELAXED);
+}
+
+void serviceRigStateResync() {
+    if (resyncPending == 0) return;
+
+    // A delivery after a resend means the client has its program
+    uint32_t acked = __atomic_exchange_n(&deliveredMask, 0, __ATOMIC_RELAXED) & resyncAttempted & resyncPending;
+    if (acked) {
+        resyncPending &= ~acked;
+        for (int i = 0; i < numClients; i++) {
+            if (acked & (1u << i)) {
+                LOGQ(LOG_INFO, "Rig state: %s resynced to program %u after %lu ms", getPeerName(clientMacAddresses[i]),
+                     state.programs[i], millis() - resyncStart);
+            }
+        }
+        if (resyncPending == 0) return;
+    }
+
+    unsigned long now = millis();
+    if (now - resyncStart > RIG_RESYNC_WINDOW_MS) {
+        logf(LOG_WARN, "Rig state: %d clients unreachable - resync abandoned", __builtin_popcount(resyncPending));
+        resyncPending = 0;
+        return;
+    }
+    if (now - lastResync < RIG_RESYNC_INTERVAL_MS) return;
+    lastResync = now;
+
+    resending = true;
+    for (int i = 0; i < numClients; i++) {
+        if (!(resyncPending & (1u << i))) continue;
+        resyncAttempted |= 1u << i;
+        if (sendCommandToClient(clientMacAddresses[i], PROGRAM_CHANGE, state.programs[i])) resyncSends++;
+    }
+    resending = false;
+}
+
+void printRigState() {
+    log(LOG_INFO, "=== RIG STATE ===");
+    logf(LOG_INFO, "Restored at Boot: %s", restored ? "yes" : "no");
+    logf(LOG_INFO, "Relay Mask: 0x%02X", state.relayMask);
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        const char* pending = (resyncPending & (1u << i)) ? " (resync pending)" : "";
+        if (state.peerTag == currentPeerTag() && state.programs[i] != RIG_PROGRAM_NONE) {
+            logf(LOG_INFO, "  %s: program %u%s", getPeerName(clientMacAddresses[i]), state.programs[i], pending);
+        } else {
+            logf(LOG_INFO, "  %s: no program sent", getPeerName(clientMacAddresses[i]));
+        }
+    }
+    logf(LOG_INFO, "Resync Sends: %lu", (unsigned long)resyncSends);
+}
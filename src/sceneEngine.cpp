@@ -0,0 +1,442 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <deferredLog.h>
+#include <dataStructs.h>
+#include <nvsManager.h>
+#include <relayControl.h>
+#include <rigState.h>
+#include <commandSender.h>
+#include <sceneEngine.h>
+
+#define SCENE_STORE_VERSION 1
+#define SCENE_SLOT_BANK SCENE_BANKS     // NVS bank after the scenes: the client slot table
+
+struct SceneBank {
+    uint8_t version;
+    uint8_t reserved[3];
+    Scene scenes[SCENE_BANK_SIZE];
+};
+
+struct SceneSlotTable {
+    uint8_t version;
+    uint8_t triggers;                   // Inputs recall defined scenes
+    uint8_t reserved[2];
+    uint8_t mac[SCENE_CLIENT_SLOTS][6]; // All zero = free
+};
+
+static_assert(SCENE_COUNT % SCENE_BANK_SIZE == 0, "scene banks must divide the scene count");
+static_assert(SCENE_BANKS + 1 <= SCENE_NVS_MAX_BANKS, "too many scene banks for nvsManager");
+static_assert(MAX_CLIENTS <= SCENE_CLIENT_SLOTS, "scenes cannot hold an action for every client");
+static_assert(MAX_CLIENTS <= 32, "recall masks hold at most 32 clients");
+
+static SceneBank banks[SCENE_BANKS];
+static SceneSlotTable slots;
+static SceneRecallStats stats;
+
+// Recall being timed. Bits are client indexes; outstandingMask and
+// lastDeliveryUs are updated from the send callback.
+static bool recallOpen = false;
+static uint32_t recallStartUs = 0;
+static unsigned long recallStartMs = 0;
+static uint32_t retryMask = 0;
+static volatile uint32_t outstandingMask = 0;
+static volatile uint32_t lastDeliveryUs = 0;
+static uint32_t failuresAtStart = 0;
+static SceneClientAction pending[MAX_CLIENTS];
+
+static const char* const sourceNames[SCENE_SOURCE_COUNT] = {"serial", "MIDI", "button", "footswitch"};
+
+static Scene& sceneAt(uint8_t index) {
+    return banks[index / SCENE_BANK_SIZE].scenes[index % SCENE_BANK_SIZE];
+}
+
+static void clearScene(Scene& scene) {
+    memset(&scene, 0, sizeof(scene));
+    for (int s = 0; s < SCENE_CLIENT_SLOTS; s++) scene.clients[s].type = SCENE_ACTION_NONE;
+}
+
+static void persistBank(uint8_t index) {
+    uint8_t bank = index / SCENE_BANK_SIZE;
+    saveSceneBankToNVS(bank, &banks[bank], sizeof(SceneBank));
+}
+
+static void persistSlots() {
+    saveSceneBankToNVS(SCENE_SLOT_BANK, &slots, sizeof(slots));
+}
+
+static bool macEmpty(const uint8_t* mac) {
+    return memcmp(mac, "\0\0\0\0\0\0", 6) == 0;
+}
+
+static int clientIndex(const uint8_t* mac) {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (memcmp(clientMacAddresses[i], mac, 6) == 0) return i;
+    }
+    return -1;
+}
+
+// Scene slot of a client MAC, -1 if it has none
+static int slotOf(const uint8_t* mac) {
+    for (int s = 0; s < SCENE_CLIENT_SLOTS; s++) {
+        if (memcmp(slots.mac[s], mac, 6) == 0) return s;
+    }
+    return -1;
+}
+
+// Slot for a paired client: its own, a free one, or one whose client is no
+// longer paired (its actions are cleared from every scene)
+static int assignSlot(int client) {
+    const uint8_t* mac = clientMacAddresses[client];
+    int slot = slotOf(mac);
+    if (slot >= 0) return slot;
+    for (int s = 0; s < SCENE_CLIENT_SLOTS && slot < 0; s++) {
+        if (macEmpty(slots.mac[s])) slot = s;
+    }
+    for (int s = 0; s < SCENE_CLIENT_SLOTS && slot < 0; s++) {
+        if (clientIndex(slots.mac[s]) >= 0) continue;
+        slot = s;
+        for (int index = 0; index < SCENE_COUNT; index++) {
+            Scene& scene = sceneAt((uint8_t)index);
+            if (scene.clients[s].type == SCENE_ACTION_NONE) continue;
+            scene.clients[s].type = SCENE_ACTION_NONE;
+            persistBank((uint8_t)index);
+        }
+    }
+    if (slot < 0) return -1;
+    memcpy(slots.mac[slot], mac, 6);
+    persistSlots();
+    return slot;
+}
+
+void loadScenesFromNVS() {
+    int defined = 0;
+    for (uint8_t b = 0; b < SCENE_BANKS; b++) {
+        if (loadSceneBankFromNVS(b, &banks[b], sizeof(SceneBank)) != sizeof(SceneBank) ||
+            banks[b].version != SCENE_STORE_VERSION) {
+            memset(&banks[b], 0, sizeof(SceneBank));
+            banks[b].version = SCENE_STORE_VERSION;
+            for (int i = 0; i < SCENE_BANK_SIZE; i++) clearScene(banks[b].scenes[i]);
+        }
+        for (int i = 0; i < SCENE_BANK_SIZE; i++) {
+            if (banks[b].scenes[i].flags & SCENE_DEFINED) defined++;
+        }
+    }
+    if (loadSceneBankFromNVS(SCENE_SLOT_BANK, &slots, sizeof(slots)) != sizeof(slots) ||
+        slots.version != SCENE_STORE_VERSION) {
+        memset(&slots, 0, sizeof(slots));
+        slots.version = SCENE_STORE_VERSION;
+        slots.triggers = 1;
+    }
+    logf(LOG_INFO, "Scenes: %d of %d defined, triggers %s", defined, SCENE_COUNT, slots.triggers ? "on" : "off");
+}
+
+const Scene* getScene(uint8_t index) {
+    return index < SCENE_COUNT ? &sceneAt(index) : nullptr;
+}
+
+bool sceneDefined(uint8_t index) {
+    return index < SCENE_COUNT && (sceneAt(index).flags & SCENE_DEFINED);
+}
+
+static void setName(Scene& scene, const char* name) {
+    memset(scene.name, 0, sizeof(scene.name));
+    if (name) strncpy(scene.name, name, sizeof(scene.name));
+}
+
+// Scene to edit; an undefined one starts empty and leaves the relays alone
+static Scene* editable(uint8_t index) {
+    if (index >= SCENE_COUNT) return nullptr;
+    Scene& scene = sceneAt(index);
+    if (!(scene.flags & SCENE_DEFINED)) {
+        clearScene(scene);
+        scene.flags = SCENE_DEFINED | SCENE_KEEP_RELAYS;
+    }
+    return &scene;
+}
+
+bool sceneCapture(uint8_t index, const char* name) {
+    if (index >= SCENE_COUNT) return false;
+    Scene& scene = sceneAt(index);
+    clearScene(scene);
+    scene.flags = SCENE_DEFINED;
+#if HAS_RELAY_OUTPUTS
+    scene.relayMask = getRelayMask();
+#else
+    scene.flags |= SCENE_KEEP_RELAYS;
+#endif
+    setName(scene, name);
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        uint8_t program = getRigStateProgram(clientMacAddresses[i]);
+        int slot = assignSlot(i);
+        if (program == 0xFF || slot < 0) continue;
+        scene.clients[slot].type = PROGRAM_CHANGE;
+        scene.clients[slot].value = program;
+    }
+    persistBank(index);
+    return true;
+}
+
+bool sceneSetRelays(uint8_t index, uint8_t mask, bool keep) {
+    Scene* scene = editable(index);
+    if (!scene) return false;
+    scene->relayMask = keep ? 0 : mask;
+    scene->flags = (uint8_t)((scene->flags & ~SCENE_KEEP_RELAYS) | (keep ? SCENE_KEEP_RELAYS : 0));
+    persistBank(index);
+    return true;
+}
+
+bool sceneSetClient(uint8_t index, int client, uint8_t type, uint8_t value) {
+    if (index >= SCENE_COUNT || client < 0 || client >= numClients || client >= MAX_CLIENTS) return false;
+    if (type != PROGRAM_CHANGE && type != ALL_CHANNELS_OFF && type != SCENE_ACTION_NONE) return false;
+    int slot = assignSlot(client);
+    if (slot < 0) return false;
+    Scene* scene = editable(index);
+    scene->clients[slot].type = type;
+    scene->clients[slot].value = type == SCENE_ACTION_NONE ? 0 : value;
+    persistBank(index);
+    return true;
+}
+
+bool sceneSetName(uint8_t index, const char* name) {
+    Scene* scene = editable(index);
+    if (!scene) return false;
+    setName(*scene, name);
+    persistBank(index);
+    return true;
+}
+
+bool sceneDelete(uint8_t index) {
+    if (!sceneDefined(index)) return false;
+    clearScene(sceneAt(index));
+    persistBank(index);
+    return true;
+}
+
+// ---- Recall ----
+
+static void closeRecall(bool complete) {
+    recallOpen = false;
+    stats.totalQueuedUs += stats.lastQueuedUs;
+    if (stats.lastQueuedUs > stats.maxQueuedUs) stats.maxQueuedUs = stats.lastQueuedUs;
+    bool allDelivered = complete && stats.deliveryFailures == failuresAtStart && lastDeliveryUs != 0;
+    if (!allDelivered) return;
+    stats.lastDeliveredUs = lastDeliveryUs - recallStartUs;
+    stats.delivered++;
+    stats.totalDeliveredUs += stats.lastDeliveredUs;
+    if (stats.lastDeliveredUs > stats.maxDeliveredUs) stats.maxDeliveredUs = stats.lastDeliveredUs;
+}
+
+static void sendAction(int i) {
+    uint32_t bit = 1u << i;
+    // Marked before the send: the callback can run before sendCommandToClient() returns
+    __atomic_fetch_or(&outstandingMask, bit, __ATOMIC_RELAXED);
+    bool ok = sendCommandToClient(clientMacAddresses[i], pending[i].type, pending[i].value);
+    if (ok && lastCommandFrameSent()) {
+        stats.framesQueued++;
+        stats.lastQueuedUs = micros() - recallStartUs;
+        return;
+    }
+    __atomic_fetch_and(&outstandingMask, ~bit, __ATOMIC_RELAXED);
+    if (ok) {
+        stats.framesSkipped++;
+    } else {
+        retryMask |= bit;
+        stats.sendRetries++;
+    }
+}
+
+bool recallScene(uint8_t index, SceneSource source) {
+    if (!sceneDefined(index) || source >= SCENE_SOURCE_COUNT) return false;
+    if (recallOpen) closeRecall(false);
+    const Scene& scene = sceneAt(index);
+    recallStartUs = micros();
+    recallStartMs = millis();
+    stats.recalls++;
+    stats.bySource[source]++;
+    stats.lastScene = index;
+    stats.lastRelayUs = 0;
+    stats.lastQueuedUs = 0;
+    stats.lastDeliveredUs = 0;
+    failuresAtStart = stats.deliveryFailures;
+    lastDeliveryUs = 0;
+    retryMask = 0;
+    outstandingMask = 0;
+    recallOpen = true;
+
+#if HAS_RELAY_OUTPUTS
+    if (!(scene.flags & SCENE_KEEP_RELAYS)) {
+        setRelayMask(scene.relayMask);
+        stats.lastRelayUs = micros() - recallStartUs;
+    }
+#endif
+    // One frame per client, queued back to back
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        int slot = slotOf(clientMacAddresses[i]);
+        if (slot < 0 || scene.clients[slot].type == SCENE_ACTION_NONE) continue;
+        pending[i] = scene.clients[slot];
+        sendAction(i);
+    }
+    LOGQ(LOG_INFO, "Scene %u '%.*s' recalled from %s: relays %lu us, client frames queued %lu us", index,
+         SCENE_NAME_LEN, scene.name, sourceNames[source], (unsigned long)stats.lastRelayUs,
+         (unsigned long)stats.lastQueuedUs);
+    return true;
+}
+
+bool sceneRecallForProgram(uint8_t program, SceneSource source) {
+    if (!slots.triggers || !sceneDefined(program)) return false;
+    return recallScene(program, source);
+}
+
+void setSceneTriggersEnabled(bool enabled) {
+    if (slots.triggers == (enabled ? 1 : 0)) return;
+    slots.triggers = enabled ? 1 : 0;
+    persistSlots();
+}
+
+bool sceneTriggersEnabled() {
+    return slots.triggers != 0;
+}
+
+void serviceScenes() {
+    if (!recallOpen) return;
+    if (retryMask) {
+        if (millis() - recallStartMs > SCENE_RECALL_RETRY_MS) {
+            stats.sendsAbandoned += __builtin_popcount(retryMask);
+            retryMask = 0;
+        } else {
+            uint32_t retry = retryMask;
+            retryMask = 0;
+            for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+                if (retry & (1u << i)) sendAction(i);
+            }
+        }
+    }
+    if (retryMask == 0 && __atomic_load_n(&outstandingMask, __ATOMIC_RELAXED) == 0) {
+        closeRecall(true);
+    } else if (millis() - recallStartMs > SCENE_RECALL_TIMEOUT_MS) {
+        closeRecall(false);
+    }
+}
+
+void sceneOnSendResult(const uint8_t* mac, bool delivered) {
+    if (!recallOpen) return;
+    int i = clientIndex(mac);
+    if (i < 0) return;
+    uint32_t bit = 1u << i;
+    if (!(__atomic_fetch_and(&outstandingMask, ~bit, __ATOMIC_RELAXED) & bit)) return;
+    if (delivered) {
+        lastDeliveryUs = micros();
+    } else {
+        __atomic_fetch_add(&stats.deliveryFailures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+const SceneRecallStats& getSceneRecallStats() {
+    return stats;
+}
+
+void resetSceneRecallStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sceneSnapshot(void (*emit)(uint8_t bank, const void* data, size_t length)) {
+    bool any = false;
+    for (uint8_t b = 0; b < SCENE_BANKS; b++) {
+        bool defined = false;
+        for (int i = 0; i < SCENE_BANK_SIZE; i++) defined = defined || (banks[b].scenes[i].flags & SCENE_DEFINED);
+        if (!defined) continue;
+        emit(b, &banks[b], sizeof(SceneBank));
+        any = true;
+    }
+    if (any || !slots.triggers) emit(SCENE_SLOT_BANK, &slots, sizeof(slots));
+}
+
+// ---- Reports ----
+
+static void describeAction(const SceneClientAction& action, char* out, size_t size) {
+    if (action.type == PROGRAM_CHANGE) {
+        snprintf(out, size, "PC %u", action.value);
+    } else if (action.type == ALL_CHANNELS_OFF) {
+        snprintf(out, size, "all off");
+    } else {
+        snprintf(out, size, "-");
+    }
+}
+
+void printScene(uint8_t index) {
+    if (!sceneDefined(index)) {
+        logf(LOG_INFO, "Scene %u is not defined", index);
+        return;
+    }
+    const Scene& scene = sceneAt(index);
+    logf(LOG_INFO, "=== SCENE %u '%.*s' ===", index, SCENE_NAME_LEN, scene.name);
+    if (scene.flags & SCENE_KEEP_RELAYS) {
+        log(LOG_INFO, "Relays: unchanged");
+    } else {
+        logf(LOG_INFO, "Relays: mask 0x%02X", scene.relayMask);
+    }
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        int slot = slotOf(clientMacAddresses[i]);
+        char action[16] = "-";
+        if (slot >= 0) describeAction(scene.clients[slot], action, sizeof(action));
+        logf(LOG_INFO, "  %d %s: %s", i, getPeerName(clientMacAddresses[i]), action);
+    }
+}
+
+void printSceneList() {
+    int defined = 0;
+    log(LOG_INFO, "=== SCENES ===");
+    for (int index = 0; index < SCENE_COUNT; index++) {
+        if (!sceneDefined((uint8_t)index)) continue;
+        const Scene& scene = sceneAt((uint8_t)index);
+        int actions = 0;
+        for (int s = 0; s < SCENE_CLIENT_SLOTS; s++) {
+            if (scene.clients[s].type != SCENE_ACTION_NONE) actions++;
+        }
+        char relays[8] = "keep";
+        if (!(scene.flags & SCENE_KEEP_RELAYS)) snprintf(relays, sizeof(relays), "0x%02X", scene.relayMask);
+        logf(LOG_INFO, "%3d  %-12.*s  relays %-4s  %d client actions", index, SCENE_NAME_LEN, scene.name, relays, actions);
+        defined++;
+    }
+    logf(LOG_INFO, "%d of %d scenes defined; triggers %s (MIDI PC, buttons and footswitch recall scene N for program N)",
+         defined, SCENE_COUNT, slots.triggers ? "on" : "off");
+}
+
+void printSceneStats() {
+    log(LOG_INFO, "=== SCENE RECALL ===");
+    logf(LOG_INFO, "Recalls: %lu (serial %lu, MIDI %lu, button %lu, footswitch %lu)", (unsigned long)stats.recalls,
+         (unsigned long)stats.bySource[SCENE_SOURCE_SERIAL], (unsigned long)stats.bySource[SCENE_SOURCE_MIDI],
+         (unsigned long)stats.bySource[SCENE_SOURCE_BUTTON], (unsigned long)stats.bySource[SCENE_SOURCE_FOOTSWITCH]);
+    if (stats.recalls == 0) return;
+    logf(LOG_INFO, "Last: scene %u, relays %lu us, last frame queued %lu us, all delivered %s%lu us", stats.lastScene,
+         (unsigned long)stats.lastRelayUs, (unsigned long)stats.lastQueuedUs,
+         stats.lastDeliveredUs ? "" : "(pending/failed) ", (unsigned long)stats.lastDeliveredUs);
+    logf(LOG_INFO, "Frames: %lu queued, %lu skipped (client already there), %lu refused and retried, %lu abandoned, "
+         "%lu failed delivery", (unsigned long)stats.framesQueued, (unsigned long)stats.framesSkipped,
+         (unsigned long)stats.sendRetries, (unsigned long)stats.sendsAbandoned, (unsigned long)stats.deliveryFailures);
+    uint32_t closed = stats.recalls - (recallOpen ? 1 : 0);
+    if (closed) {
+        logf(LOG_INFO, "Queued: mean %lu us, max %lu us", (unsigned long)(stats.totalQueuedUs / closed),
+             (unsigned long)stats.maxQueuedUs);
+    }
+    if (stats.delivered) {
+        logf(LOG_INFO, "Delivered: %lu recalls, mean %lu us, max %lu us", (unsigned long)stats.delivered,
+             (unsigned long)(stats.totalDeliveredUs / stats.delivered), (unsigned long)stats.maxDeliveredUs);
+    }
+}
@@ -0,0 +1,232 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <hal.h>
+#include <nvsManager.h>
+#include <relayControl.h>
+#include <sceneEngine.h>
+#include <programRemap.h>
+#include <espnowFrame.h>
+#include <sessionRecord.h>
+
+// Writers (loop task for pins, bytes, relays and TX; WiFi task for RX and send
+// results) reserve space with a compare-and-swap on `used`, fill the record and
+// publish it by storing its type last. The buffer is zeroed at start, so a
+// record still being written reads as type 0 and the export stops before it.
+static uint8_t* sessionBuffer = nullptr;
+static uint32_t used = 0;
+static bool recording = false;
+static uint32_t startUs = 0;
+static uint32_t durationUs = 0;
+static uint32_t droppedRecords = 0;
+static uint32_t skippedRealtime = 0;
+static SessionHeader header;            // Filled at start; counters are added at export
+
+static inline bool active() {
+    return __atomic_load_n(&recording, __ATOMIC_RELAXED);
+}
+
+static uint8_t* claim(size_t size) {
+    uint32_t at = __atomic_load_n(&used, __ATOMIC_RELAXED);
+    do {
+        if (at + size > SESSION_RECORD_BYTES) {
+            __atomic_fetch_add(&droppedRecords, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        }
+    } while (!__atomic_compare_exchange_n(&used, &at, (uint32_t)(at + size), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return sessionBuffer + at;
+}
+
+// Payload in up to two parts, so callers need no staging copy
+static void append(uint8_t type, uint32_t timeUs, const void* first, size_t firstLength,
+                   const void* second = nullptr, size_t secondLength = 0) {
+    size_t length = firstLength + secondLength;
+    uint8_t* record = claim(sizeof(SessionRecordHeader) + length);
+    if (!record) return;
+    SessionRecordHeader h = {0, 0, (uint16_t)length, timeUs - startUs};
+    memcpy(record, &h, sizeof(h));
+    memcpy(record + sizeof(h), first, firstLength);
+    if (secondLength > 0) memcpy(record + sizeof(h) + firstLength, second, secondLength);
+    __atomic_store_n(record, type, __ATOMIC_RELEASE);
+}
+
+static void recordSceneBank(uint8_t bank, const void* data, size_t length) {
+    append(SESSION_SCENE_BANK, micros(), &bank, 1, data, length);
+}
+
+static void recordProgramRemap(uint8_t slot, const void* data, size_t length) {
+    append(SESSION_PROGRAM_REMAP, micros(), &slot, 1, data, length);
+}
+
+bool sessionRecordStart() {
+    sessionRecordStop();
+    delay(2);                   // Let a record being written in the WiFi task finish
+    if (!sessionBuffer) sessionBuffer = (uint8_t*)malloc(SESSION_RECORD_BYTES);
+    if (!sessionBuffer) {
+        logf(LOG_ERROR, "Session recorder: cannot allocate %u bytes", (unsigned)SESSION_RECORD_BYTES);
+        return false;
+    }
+    memset(sessionBuffer, 0, SESSION_RECORD_BYTES);
+    __atomic_store_n(&used, 0, __ATOMIC_RELAXED);
+    droppedRecords = 0;
+    skippedRealtime = 0;
+    durationUs = 0;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SESSION_MAGIC;
+    header.version = SESSION_VERSION;
+    header.headerSize = (uint16_t)sizeof(header);
+    header.startUptimeMs = millis();
+    halStationMac(header.serverMac);
+#if HAS_RELAY_OUTPUTS
+    header.relayMask = getRelayMask();
+#endif
+    header.flags = pairingMode ? SESSION_FLAG_PAIRING : 0;
+    strncpy(header.firmware, FIRMWARE_VERSION, SESSION_FIRMWARE_LEN);
+    getConfigSnapshot(header.config);
+
+    startUs = micros();
+    __atomic_store_n(&recording, true, __ATOMIC_RELEASE);
+
+    // Input levels at the start, so a pedal already held down replays as held
+    for (int i = 0; i < 4; i++) {
+        if (footswitchPins[i] != 255) sessionRecordPin(footswitchPins[i], halPinRead(footswitchPins[i]));
+    }
+    for (int i = 0; i < serverButtonCount && i < 8; i++) {
+        if (serverButtonPins[i] != 255) sessionRecordPin(serverButtonPins[i], halPinRead(serverButtonPins[i]));
+    }
+    sceneSnapshot(recordSceneBank);
+    programRemapSnapshot(recordProgramRemap);
+    return true;
+}
+
+void sessionRecordStop() {
+    if (!__atomic_exchange_n(&recording, false, __ATOMIC_ACQ_REL)) return;
+    durationUs = micros() - startUs;
+}
+
+bool sessionRecordActive() {
+    return __atomic_load_n(&recording, __ATOMIC_ACQUIRE);
+}
+
+void sessionRecordPin(uint8_t pin, bool level) {
+    if (!active()) return;
+    uint8_t payload[2] = {pin, (uint8_t)(level ? 1 : 0)};
+    append(SESSION_PIN, micros(), payload, sizeof(payload));
+}
+
+void sessionRecordMidi(uint8_t data) {
+    if (!active()) return;
+    if (data >= 0xF8) {         // Clock and other real-time bytes never change what the parser does
+        __atomic_fetch_add(&skippedRealtime, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    append(SESSION_MIDI, micros(), &data, 1);
+}
+
+void sessionRecordConsole(const uint8_t* data, size_t length) {
+    if (!active() || length == 0) return;
+    append(SESSION_CONSOLE, micros(), data, length);
+}
+
+void sessionRecordReceive(const uint8_t* mac, const uint8_t* data, int length) {
+    if (!active()) return;
+    if (length < 0 || data == nullptr) length = 0;
+    if (length > ESPNOW_MAX_FRAME_LEN) length = ESPNOW_MAX_FRAME_LEN;
+    append(SESSION_ESPNOW_RX, micros(), mac, 6, data, (size_t)length);
+}
+
+void sessionRecordSent(const uint8_t* mac, bool delivered) {
+    if (!active()) return;
+    uint8_t payload[7];
+    memcpy(payload, mac, 6);
+    payload[6] = delivered ? 1 : 0;
+    append(SESSION_ESPNOW_SENT, micros(), payload, sizeof(payload));
+}
+
+void sessionRecordRelay(uint8_t mask) {
+    if (!active()) return;
+    append(SESSION_RELAY, micros(), &mask, 1);
+}
+
+void sessionRecordTx(const uint8_t* mac, const void* data, size_t length, int result, uint32_t timeUs) {
+    if (!active()) return;
+    uint8_t prefix[SESSION_TX_FRAME];
+    memcpy(prefix, mac, 6);
+    prefix[6] = (uint8_t)result;
+    prefix[7] = (uint8_t)((unsigned)result >> 8);
+    if (length > ESPNOW_MAX_FRAME_LEN) length = ESPNOW_MAX_FRAME_LEN;
+    append(SESSION_TX, timeUs, prefix, sizeof(prefix), data, length);
+}
+
+// Length of the records that are complete, from the start of the buffer
+static size_t completeBytes() {
+    size_t end = __atomic_load_n(&used, __ATOMIC_ACQUIRE);
+    size_t offset = 0;
+    SessionRecordHeader record;
+    const uint8_t* payload;
+    while (sessionNextRecord(sessionBuffer, end, offset, record, payload)) {}
+    return offset;
+}
+
+size_t sessionRecordExport(void (*write)(const void* data, size_t length)) {
+    if (!sessionBuffer) return 0;
+    SessionHeader out = header;
+    size_t records = completeBytes();
+    out.recordBytes = (uint32_t)records;
+    out.droppedRecords = __atomic_load_n(&droppedRecords, __ATOMIC_RELAXED);
+    out.skippedRealtime = __atomic_load_n(&skippedRealtime, __ATOMIC_RELAXED);
+    out.durationUs = sessionRecordActive() ? micros() - startUs : durationUs;
+    write(&out, sizeof(out));
+    write(sessionBuffer, records);
+    return sizeof(out) + records;
+}
+
+void dumpSessionRecord() {
+    if (!sessionBuffer) {
+        log(LOG_WARN, "No session recorded - use 'session start' first");
+        return;
+    }
+    sessionRecordStop();        // A dumped session is complete; the export must not change between passes
+    delay(2);
+    writeConsoleBlock("SESSION", sessionRecordExport);
+}
+
+void printSessionRecordStatus() {
+    log(LOG_INFO, "=== SESSION RECORDER ===");
+    logf(LOG_INFO, "Recording: %s", sessionRecordActive() ? "ON" : "OFF");
+    if (sessionBuffer) {
+        size_t bytes = completeBytes();
+        uint32_t counts[2] = {0, 0};    // Inputs, outputs
+        size_t offset = 0;
+        SessionRecordHeader record;
+        const uint8_t* payload;
+        while (sessionNextRecord(sessionBuffer, bytes, offset, record, payload)) {
+            counts[record.type >= SESSION_RELAY ? 1 : 0]++;
+        }
+        uint32_t elapsed = sessionRecordActive() ? micros() - startUs : durationUs;
+        logf(LOG_INFO, "Records: %lu inputs, %lu outputs over %lu ms", (unsigned long)counts[0],
+             (unsigned long)counts[1], (unsigned long)(elapsed / 1000));
+        logf(LOG_INFO, "Buffer: %u of %u bytes used, %lu records dropped (full)", (unsigned)bytes,
+             (unsigned)SESSION_RECORD_BYTES, (unsigned long)droppedRecords);
+        logf(LOG_INFO, "MIDI real-time bytes skipped: %lu", (unsigned long)skippedRealtime);
+    } else {
+        log(LOG_INFO, "Buffer: not allocated");
+    }
+    log(LOG_INFO, "========================");
+}
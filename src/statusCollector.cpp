@@ -0,0 +1,218 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <Arduino.h>
+#include <globals.h>
+#include <config.h>
+#include <utils.h>
+#include <deferredLog.h>
+#include <dataStructs.h>
+#include <commandSender.h>
+#include <statusCollector.h>
+
+// Reply handed from the receive callback (WiFi task) to the loop
+struct StatusMailbox {
+    uint8_t full;
+    uint8_t length;
+    uint32_t rxUs;
+    uint8_t data[ESPNOW_STATUS_LEN];
+};
+
+static ClientStatus table[MAX_CLIENTS];
+static StatusMailbox mailbox[MAX_CLIENTS];
+static uint32_t requestUs[MAX_CLIENTS];
+static StatusRound currentRound;
+static int nextRequest = 0;
+static uint32_t roundStartUs = 0;
+static uint32_t lastReplyUs = 0;
+static bool printRound = false;
+static uint32_t droppedReplies = 0;     // A second reply arrived before the loop took the first
+
+static int clientIndex(const uint8_t* mac) {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (memcmp(clientMacAddresses[i], mac, 6) == 0) return i;
+    }
+    return -1;
+}
+
+// Table entry of client slot i, cleared if the slot now holds another client
+static ClientStatus& entry(int i) {
+    ClientStatus& s = table[i];
+    if (memcmp(s.mac, clientMacAddresses[i], 6) != 0) {
+        memset(&s, 0, sizeof(s));
+        memcpy(s.mac, clientMacAddresses[i], 6);
+        s.program = 0xFF;
+        s.rssi = CLIENT_STATUS_RSSI_UNKNOWN;
+    }
+    return s;
+}
+
+static uint32_t u32At(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool startStatusCollection(bool printWhenDone) {
+    if (currentRound.active || numClients == 0) return false;
+    currentRound.active = true;
+    currentRound.clients = (uint8_t)(numClients < MAX_CLIENTS ? numClients : MAX_CLIENTS);
+    currentRound.replies = 0;
+    currentRound.startedMs = millis();
+    currentRound.durationUs = 0;
+    nextRequest = 0;
+    roundStartUs = micros();
+    lastReplyUs = roundStartUs;
+    printRound = printWhenDone;
+    LOGQ(LOG_INFO, "Status: asking %u clients", currentRound.clients);
+    return true;
+}
+
+bool statusCollectionActive() {
+    return currentRound.active;
+}
+
+void statusCollectorOnReply(const uint8_t* mac, const EspNowFrame& frame) {
+    int i = clientIndex(mac);
+    if (i < 0) return;
+    StatusMailbox& box = mailbox[i];
+    if (__atomic_load_n(&box.full, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&droppedReplies, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    box.length = frame.length < ESPNOW_STATUS_LEN ? frame.length : ESPNOW_STATUS_LEN;
+    memcpy(box.data, frame.data, box.length);
+    box.rxUs = micros();
+    __atomic_store_n(&box.full, 1, __ATOMIC_RELEASE);
+}
+
+static void applyReply(int i, const StatusMailbox& box) {
+    ClientStatus& s = entry(i);
+    bool asked = currentRound.active && s.state == CLIENT_STATUS_PENDING;
+    s.program = box.data[ESPNOW_MESSAGE_COMMAND_VALUE];
+    if (box.length >= ESPNOW_STATUS_LEN) {
+        s.uptimeMs = u32At(box.data + ESPNOW_STATUS_UPTIME);
+        s.rssi = (int8_t)box.data[ESPNOW_STATUS_RSSI];
+        memcpy(s.firmware, box.data + ESPNOW_STATUS_FIRMWARE, ESPNOW_STATUS_FIRMWARE_LEN);
+        s.firmware[ESPNOW_STATUS_FIRMWARE_LEN] = '\0';
+    } else {
+        s.uptimeMs = u32At(box.data + ESPNOW_MESSAGE_TIMESTAMP);   // Older client: its millis() when it replied
+        s.rssi = CLIENT_STATUS_RSSI_UNKNOWN;
+        s.firmware[0] = '\0';
+    }
+    s.updatedMs = millis();
+    s.state = CLIENT_STATUS_OK;
+    if (asked) {
+        s.replyUs = box.rxUs - requestUs[i];
+        currentRound.replies++;
+        lastReplyUs = box.rxUs;
+    }
+}
+
+static void closeRound(bool complete) {
+    currentRound.durationUs = (complete ? lastReplyUs : micros()) - roundStartUs;
+    currentRound.active = false;
+    for (int i = 0; i < currentRound.clients && i < numClients; i++) {
+        ClientStatus& s = entry(i);
+        if (s.state == CLIENT_STATUS_PENDING || i >= nextRequest) s.state = CLIENT_STATUS_NO_REPLY;
+    }
+    LOGQ(LOG_INFO, "Status: %u of %u clients replied in %lu us", currentRound.replies, currentRound.clients,
+         (unsigned long)currentRound.durationUs);
+    if (printRound) printClientStatusTable();
+}
+
+void serviceStatusCollector() {
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        if (!__atomic_load_n(&mailbox[i].full, __ATOMIC_ACQUIRE)) continue;
+        StatusMailbox box = mailbox[i];
+        __atomic_store_n(&mailbox[i].full, 0, __ATOMIC_RELEASE);
+        applyReply(i, box);
+    }
+    if (!currentRound.active) return;
+
+    // A few requests per pass, and no more awaiting replies than the driver queue
+    // holds; replies are taken from the mailboxes on later passes
+    int pending = 0;
+    for (int i = 0; i < nextRequest; i++) pending += table[i].state == CLIENT_STATUS_PENDING;
+    for (int queued = 0; queued < STATUS_COLLECT_REQUESTS_PER_PASS && pending < STATUS_COLLECT_MAX_PENDING &&
+                         nextRequest < currentRound.clients && nextRequest < numClients;
+         queued++, pending++, nextRequest++) {
+        ClientStatus& s = entry(nextRequest);
+        s.state = CLIENT_STATUS_PENDING;     // Before the send: the reply may arrive before it returns
+        requestUs[nextRequest] = micros();
+        if (!sendCommandToClient(s.mac, STATUS_REQUEST, 0)) s.state = CLIENT_STATUS_SEND_FAILED;
+    }
+
+    bool waiting = nextRequest < currentRound.clients && nextRequest < numClients;
+    for (int i = 0; i < nextRequest && !waiting; i++) waiting = table[i].state == CLIENT_STATUS_PENDING;
+    if (!waiting) {
+        closeRound(true);
+    } else if (millis() - currentRound.startedMs >= STATUS_COLLECT_DEADLINE_MS) {
+        closeRound(false);
+    }
+}
+
+const ClientStatus* getClientStatus(int index) {
+    if (index < 0 || index >= numClients || index >= MAX_CLIENTS) return nullptr;
+    return &entry(index);
+}
+
+const StatusRound& getLastStatusRound() {
+    return currentRound;
+}
+
+static const char* stateName(uint8_t state) {
+    switch (state) {
+        case CLIENT_STATUS_PENDING:     return "waiting";
+        case CLIENT_STATUS_OK:          return "ok";
+        case CLIENT_STATUS_NO_REPLY:    return "no reply";
+        case CLIENT_STATUS_SEND_FAILED: return "send failed";
+        default:                        return "-";
+    }
+}
+
+void printClientStatusTable() {
+    unsigned long now = millis();
+    log(LOG_INFO, "=== CLIENTS ===");
+    log(LOG_INFO, " #  Name                State        Prog  RSSI  Firmware          Uptime      Reply ms  Age s");
+    for (int i = 0; i < numClients && i < MAX_CLIENTS; i++) {
+        const ClientStatus& s = entry(i);
+        char program[5] = "-";
+        char rssi[6] = "-";
+        char uptime[24] = "-";
+        char reply[24] = "-";
+        char age[24] = "-";
+        bool known = s.updatedMs != 0;
+        if (known && s.program != 0xFF) snprintf(program, sizeof(program), "%u", s.program);
+        if (known && s.rssi != CLIENT_STATUS_RSSI_UNKNOWN) snprintf(rssi, sizeof(rssi), "%d", s.rssi);
+        if (known) {
+            uint32_t seconds = s.uptimeMs / 1000;
+            snprintf(uptime, sizeof(uptime), "%lu:%02lu:%02lu", (unsigned long)(seconds / 3600),
+                     (unsigned long)(seconds / 60 % 60), (unsigned long)(seconds % 60));
+            snprintf(age, sizeof(age), "%lu", (unsigned long)((now - s.updatedMs) / 1000));
+        }
+        if (known && s.replyUs) snprintf(reply, sizeof(reply), "%.1f", s.replyUs / 1000.0f);
+        logf(LOG_INFO, "%2d  %-18.18s  %-11s  %4s  %4s  %-16s  %-10s  %8s  %5s", i, getPeerName(s.mac),
+             stateName(s.state), program, rssi, s.firmware[0] ? s.firmware : "-", uptime, reply, age);
+    }
+    if (currentRound.active) {
+        logf(LOG_INFO, "Collecting: %u of %u replied so far", currentRound.replies, currentRound.clients);
+    } else if (currentRound.clients) {
+        logf(LOG_INFO, "Last round: %u of %u replied in %.1f ms, %lu s ago", currentRound.replies,
+             currentRound.clients, currentRound.durationUs / 1000.0f,
+             (unsigned long)((now - currentRound.startedMs) / 1000));
+    } else {
+        log(LOG_INFO, "No status collected yet - 'clients refresh' asks every client");
+    }
+    if (droppedReplies) logf(LOG_INFO, "Replies dropped (mailbox full): %lu", (unsigned long)droppedReplies);
+    log(LOG_INFO, "===============");
+}
@@ -0,0 +1,216 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <switchBench.h>
+#include <globals.h>
+#include <utils.h>
+#include <hal.h>
+#include <relayControl.h>
+#include <midiInput.h>
+#include <controlFrame.h>
+#include <controlProtocol.h>
+#include <clientMirror.h>
+
+#define SWITCH_BENCH_LINEAR 32            // 1 us buckets below this
+#define SWITCH_BENCH_SUB_BUCKETS 16       // Per octave above it (<= 6% wide)
+#define SWITCH_BENCH_MAX_EXP 26           // Samples from 2^26 us (67 s) share the last bucket
+#define SWITCH_BENCH_BUCKETS (SWITCH_BENCH_LINEAR + (SWITCH_BENCH_MAX_EXP - 5) * SWITCH_BENCH_SUB_BUCKETS)
+#define SWITCH_BENCH_MAX_ITERATIONS 60000 // 16-bit bucket counts
+
+enum SwitchBenchOutput : uint8_t { OUT_RELAY, OUT_FIRST_TX, OUT_LAST_TX, OUT_COUNT };
+
+static const char* const inputNames[SWITCH_BENCH_IN_COUNT] = {"footswitch", "midi", "serial"};
+static const char* const outputNames[OUT_COUNT] = {"relay", "first_tx", "last_tx"};
+
+struct LatencyHistogram {
+    uint16_t counts[SWITCH_BENCH_BUCKETS];
+    uint32_t samples;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+};
+
+volatile bool switchBenchActive = false;
+static SwitchBenchClock benchClock = nullptr;
+static uint32_t marks[OUT_COUNT];
+static bool marked[OUT_COUNT];
+static LatencyHistogram histograms[OUT_COUNT];
+
+void switchBenchRecord(SwitchBenchPoint point) {
+    uint32_t now = benchClock();
+    if (point == SWITCH_BENCH_RELAY) {
+        if (!marked[OUT_RELAY]) {
+            marks[OUT_RELAY] = now;
+            marked[OUT_RELAY] = true;
+        }
+        return;
+    }
+    if (!marked[OUT_FIRST_TX]) {
+        marks[OUT_FIRST_TX] = now;
+        marked[OUT_FIRST_TX] = true;
+    }
+    marks[OUT_LAST_TX] = now;
+    marked[OUT_LAST_TX] = true;
+}
+
+static uint16_t bucketOf(uint32_t us) {
+    if (us < SWITCH_BENCH_LINEAR) return (uint16_t)us;
+    int exp = 31 - __builtin_clz(us);
+    if (exp >= SWITCH_BENCH_MAX_EXP) return SWITCH_BENCH_BUCKETS - 1;
+    return (uint16_t)(SWITCH_BENCH_LINEAR + (exp - 5) * SWITCH_BENCH_SUB_BUCKETS + ((us >> (exp - 4)) & 15));
+}
+
+// Lower edge of a bucket
+static uint32_t bucketValue(uint16_t bucket) {
+    if (bucket < SWITCH_BENCH_LINEAR) return bucket;
+    int exp = 5 + (bucket - SWITCH_BENCH_LINEAR) / SWITCH_BENCH_SUB_BUCKETS;
+    uint32_t sub = (bucket - SWITCH_BENCH_LINEAR) % SWITCH_BENCH_SUB_BUCKETS;
+    return (1u << exp) + (sub << (exp - 4));
+}
+
+static void addSample(LatencyHistogram& h, uint32_t us) {
+    h.counts[bucketOf(us)]++;
+    if (h.samples == 0 || us < h.minUs) h.minUs = us;
+    if (us > h.maxUs) h.maxUs = us;
+    h.sumUs += us;
+    h.samples++;
+}
+
+// Nearest-rank percentile (per mille), clamped to the exact extremes
+static uint32_t percentile(const LatencyHistogram& h, uint32_t perMille) {
+    uint32_t rank = (uint32_t)(((uint64_t)h.samples * perMille + 999) / 1000);
+    if (rank == 0) rank = 1;
+    uint32_t seen = 0;
+    for (uint16_t b = 0; b < SWITCH_BENCH_BUCKETS; b++) {
+        seen += h.counts[b];
+        if (seen >= rank) {
+            uint32_t value = bucketValue(b);
+            if (value < h.minUs) value = h.minUs;
+            if (value > h.maxUs) value = h.maxUs;
+            return value;
+        }
+    }
+    return h.maxUs;
+}
+
+int runSwitchBench(uint32_t iterations, const SwitchBenchHooks& hooks) {
+    if (iterations > SWITCH_BENCH_MAX_ITERATIONS) iterations = SWITCH_BENCH_MAX_ITERATIONS;
+    benchClock = hooks.clock;
+    // The footswitch repeats one program: with the mirror on only the first press would transmit
+    bool savedMirror = isClientMirrorEnabled();
+    setClientMirrorEnabled(false);
+    int shortPaths = 0;
+    char line[160];
+    snprintf(line, sizeof(line), "# switchbench firmware=%s source=%s iterations=%lu clients=%d relays=%d",
+             FIRMWARE_VERSION, hooks.source, (unsigned long)iterations, numClients, MAX_RELAY_CHANNELS);
+    hooks.emit(line);
+    hooks.emit("path,samples,min_us,p50_us,p90_us,p99_us,p999_us,max_us,mean_us");
+
+    for (uint8_t input = 0; input < SWITCH_BENCH_IN_COUNT; input++) {
+        memset(histograms, 0, sizeof(histograms));
+        for (uint32_t k = 0; k < iterations; k++) {
+            memset(marked, 0, sizeof(marked));
+            switchBenchActive = true;
+            uint32_t start = benchClock();
+            hooks.inject((SwitchBenchInput)input, k);
+            switchBenchActive = false;
+            for (uint8_t out = 0; out < OUT_COUNT; out++) {
+                if (marked[out]) addSample(histograms[out], marks[out] - start);
+            }
+            yield();
+        }
+        // Paths the input never reaches (e.g. the footswitch drives no relay) get no row
+        for (uint8_t out = 0; out < OUT_COUNT; out++) {
+            const LatencyHistogram& h = histograms[out];
+            if (h.samples == 0) continue;
+            if (h.samples < iterations) {
+                snprintf(line, sizeof(line), "# short: %s_%s got %lu of %lu samples", inputNames[input],
+                         outputNames[out], (unsigned long)h.samples, (unsigned long)iterations);
+                hooks.emit(line);
+                shortPaths++;
+            }
+            snprintf(line, sizeof(line), "%s_%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+                     inputNames[input], outputNames[out], (unsigned long)h.samples, (unsigned long)h.minUs,
+                     (unsigned long)percentile(h, 500), (unsigned long)percentile(h, 900),
+                     (unsigned long)percentile(h, 990), (unsigned long)percentile(h, 999),
+                     (unsigned long)h.maxUs, (unsigned long)(h.sumUs / h.samples));
+            hooks.emit(line);
+        }
+    }
+    setClientMirrorEnabled(savedMirror);
+    return shortPaths;
+}
+
+// ---- On-device run ----
+static uint32_t deviceClock() {
+    return micros();
+}
+
+static void emitToConsole(const char* line) {
+    halConsoleWrite(line, strlen(line));
+    halConsoleWrite("\n", 1);
+}
+
+static void discardOutput(const void*, size_t) {}
+
+static uint8_t benchRelayIndex(uint32_t iteration) {
+    return (uint8_t)(iteration % (MAX_RELAY_CHANNELS > 1 ? 2 : 1));
+}
+
+static void injectAtEntryPoints(SwitchBenchInput input, uint32_t iteration) {
+    uint8_t relay = benchRelayIndex(iteration);
+    switch (input) {
+        case SWITCH_BENCH_IN_FOOTSWITCH:
+            handleFootswitchPress();
+            break;
+        case SWITCH_BENCH_IN_MIDI: {
+            uint8_t channel = serverMidiChannel ? serverMidiChannel : 1;
+            midiInputFeedByte((uint8_t)(0xC0 | ((channel - 1) & 0x0F)));
+            midiInputFeedByte(serverMidiChannelMap[relay] & 0x7F);
+            break;
+        }
+        case SWITCH_BENCH_IN_SERIAL: {
+            uint8_t frame[CONTROL_FRAME_MAX_LEN];
+            uint8_t wire[CONTROL_WIRE_MAX_LEN];
+            frame[0] = (uint8_t)iteration;
+            frame[1] = (uint8_t)(iteration >> 8);
+            frame[2] = CTRL_OP_RELAY_SET;
+            frame[3] = (uint8_t)(relay + 1);
+            size_t length = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN + 1);
+            size_t wireLength = controlFrameToWire(frame, length, wire, sizeof(wire));
+            for (size_t i = 0; i < wireLength; i++) controlProtocolRxByte(wire[i]);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+int runSwitchBenchOnDevice(uint32_t iterations) {
+    LogLevel savedLevel = currentLogLevel;
+#if HAS_RELAY_OUTPUTS
+    uint8_t savedMask = getRelayMask();
+#endif
+    SwitchBenchHooks hooks = {injectAtEntryPoints, deviceClock, emitToConsole, "entry-points"};
+
+    currentLogLevel = LOG_WARN;
+    controlProtocolSetOutput(discardOutput);
+    int shortPaths = runSwitchBench(iterations, hooks);
+    controlProtocolSetOutput(nullptr);
+    currentLogLevel = savedLevel;
+#if HAS_RELAY_OUTPUTS
+    setRelayMask(savedMask);
+#endif
+    return shortPaths;
+}
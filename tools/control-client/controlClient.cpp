@@ -0,0 +1,254 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "controlClient.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t baudConstant(int baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 57600:  return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return B115200;
+    }
+}
+
+bool ControlBatch::add(uint8_t opcode, const uint8_t* payload, uint8_t length) {
+    if (data.size() + 2 + length > CONTROL_FRAME_MAX_PAYLOAD) return false;
+    data.push_back(opcode);
+    data.push_back(length);
+    if (length > 0) data.insert(data.end(), payload, payload + length);
+    entries++;
+    return true;
+}
+
+ControlClient::~ControlClient() {
+    close();
+}
+
+bool ControlClient::open(const char* device, int baud) {
+    close();
+    int handle = ::open(device, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (handle < 0) return false;
+
+    struct termios tio;
+    if (tcgetattr(handle, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudConstant(baud));
+        cfsetospeed(&tio, baudConstant(baud));
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(handle, TCSANOW, &tio);
+    }
+    attach(handle);
+    ownsFd = true;
+    return true;
+}
+
+void ControlClient::attach(int handle) {
+    close();
+    fd = handle;
+    ownsFd = false;
+    rx.clear();
+    pending.clear();
+    pendingPos = 0;
+}
+
+void ControlClient::close() {
+    if (fd >= 0 && ownsFd) ::close(fd);
+    fd = -1;
+    ownsFd = false;
+}
+
+int ControlClient::send(uint8_t opcode, const uint8_t* payload, size_t length) {
+    if (fd < 0 || length > CONTROL_FRAME_MAX_PAYLOAD) return -1;
+    uint8_t frame[CONTROL_FRAME_MAX_LEN];
+    uint8_t wire[CONTROL_WIRE_MAX_LEN];
+    uint16_t seq = nextSeq++;
+    frame[0] = (uint8_t)seq;
+    frame[1] = (uint8_t)(seq >> 8);
+    frame[2] = opcode;
+    if (length > 0) memcpy(frame + CONTROL_FRAME_HEADER_LEN, payload, length);
+    size_t frameLength = controlFrameSeal(frame, CONTROL_FRAME_HEADER_LEN + length);
+    size_t wireLength = controlFrameToWire(frame, frameLength, wire, sizeof(wire));
+
+    size_t written = 0;
+    while (written < wireLength) {
+        ssize_t n = ::write(fd, wire + written, wireLength - written);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        written += (size_t)n;
+    }
+    return seq;
+}
+
+// Feed one received byte; true when it completes a valid response frame.
+// Console text between frames fails the COBS/CRC checks and is dropped.
+bool ControlClient::consume(uint8_t c, std::vector<uint8_t>& frame) {
+    if (c != 0x00) {
+        if (rx.size() < CONTROL_WIRE_MAX_LEN) rx.push_back(c);
+        return false;
+    }
+    if (rx.empty()) return false;
+    uint8_t decoded[CONTROL_FRAME_MAX_LEN];
+    size_t decodedLength;
+    bool ok = cobsDecode(rx.data(), rx.size(), decoded, sizeof(decoded), decodedLength) &&
+              controlFrameValid(decoded, decodedLength) &&
+              decodedLength >= CONTROL_FRAME_MIN_LEN + 1 &&
+              (decoded[2] & CONTROL_RESPONSE_FLAG);
+    rx.clear();
+    if (!ok) {
+        badFrames++;
+        return false;
+    }
+    frame.assign(decoded, decoded + decodedLength);
+    return true;
+}
+
+bool ControlClient::readFrame(std::vector<uint8_t>& frame, int timeoutMs) {
+    // Bytes left over from a previous read may already hold further pipelined responses
+    while (pendingPos < pending.size()) {
+        if (consume(pending[pendingPos++], frame)) return true;
+    }
+    pending.clear();
+    pendingPos = 0;
+
+    int64_t deadline = nowMs() + timeoutMs;
+    uint8_t buf[256];
+    for (;;) {
+        int64_t remaining = deadline - nowMs();
+        if (remaining < 0) return false;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, (int)remaining);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return false;
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) return false;
+        for (ssize_t i = 0; i < n; i++) {
+            if (consume(buf[i], frame)) {
+                pending.assign(buf + i + 1, buf + n);
+                return true;
+            }
+        }
+    }
+}
+
+bool ControlClient::receive(ControlResponse& out, int timeoutMs) {
+    std::vector<uint8_t> frame;
+    if (!readFrame(frame, timeoutMs)) return false;
+    out.seq = (uint16_t)frame[0] | ((uint16_t)frame[1] << 8);
+    out.opcode = frame[2] & ~CONTROL_RESPONSE_FLAG;
+    out.status = frame[3];
+    out.payload.assign(frame.begin() + 4, frame.end() - CONTROL_FRAME_CRC_LEN);
+    return true;
+}
+
+bool ControlClient::request(uint8_t opcode, const uint8_t* payload, size_t length, ControlResponse& out, int timeoutMs) {
+    int seq = send(opcode, payload, length);
+    if (seq < 0) return false;
+    int64_t deadline = nowMs() + timeoutMs;
+    for (;;) {
+        int64_t remaining = deadline - nowMs();
+        if (remaining < 0 || !receive(out, (int)remaining)) return false;
+        if (out.seq == (uint16_t)seq) return true;
+    }
+}
+
+bool ControlClient::simple(uint8_t opcode, const uint8_t* payload, size_t length, ControlResponse* out) {
+    ControlResponse local;
+    ControlResponse& response = out ? *out : local;
+    return request(opcode, payload, length, response) && response.status == CTRL_STATUS_OK;
+}
+
+bool ControlClient::ping(uint32_t* uptimeMs) {
+    ControlResponse response;
+    if (!simple(CTRL_OP_PING, nullptr, 0, &response) || response.payload.size() < 5) return false;
+    if (uptimeMs) {
+        const uint8_t* p = &response.payload[1];
+        *uptimeMs = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    return true;
+}
+
+bool ControlClient::setRelay(uint8_t channel) {
+    return simple(CTRL_OP_RELAY_SET, &channel, 1);
+}
+
+bool ControlClient::setRelayMask(uint8_t mask) {
+    return simple(CTRL_OP_RELAY_MASK, &mask, 1);
+}
+
+bool ControlClient::sendToClient(uint8_t clientIndex, uint8_t commandType, uint8_t value) {
+    uint8_t payload[3] = {clientIndex, commandType, value};
+    return simple(CTRL_OP_SEND_CLIENT, payload, sizeof(payload));
+}
+
+bool ControlClient::sendToAll(uint8_t commandType, uint8_t value) {
+    uint8_t payload[2] = {commandType, value};
+    return simple(CTRL_OP_SEND_ALL, payload, sizeof(payload));
+}
+
+bool ControlClient::setRelayMap(uint8_t relayIndex, uint8_t program) {
+    uint8_t payload[2] = {relayIndex, program};
+    return simple(CTRL_OP_MAP_SET_RELAY, payload, sizeof(payload));
+}
+
+bool ControlClient::setButtonMap(uint8_t buttonIndex, uint8_t program) {
+    uint8_t payload[2] = {buttonIndex, program};
+    return simple(CTRL_OP_MAP_SET_BUTTON, payload, sizeof(payload));
+}
+
+bool ControlClient::saveMaps() {
+    return simple(CTRL_OP_MAP_SAVE, nullptr, 0);
+}
+
+bool ControlClient::batch(const ControlBatch& entries, std::vector<uint8_t>* statuses) {
+    ControlResponse response;
+    if (!simple(CTRL_OP_BATCH, entries.bytes().data(), entries.bytes().size(), &response)) return false;
+    if (response.payload.empty()) return false;
+    if (statuses) statuses->assign(response.payload.begin() + 1, response.payload.end());
+    for (size_t i = 1; i < response.payload.size(); i++) {
+        if (response.payload[i] != CTRL_STATUS_OK) return false;
+    }
+    return true;
+}
+
+const char* controlStatusName(uint8_t status) {
+    switch (status) {
+        case CTRL_STATUS_OK:             return "OK";
+        case CTRL_STATUS_UNKNOWN_OPCODE: return "UNKNOWN_OPCODE";
+        case CTRL_STATUS_BAD_LENGTH:     return "BAD_LENGTH";
+        case CTRL_STATUS_BAD_ARGUMENT:   return "BAD_ARGUMENT";
+        case CTRL_STATUS_FAILED:         return "FAILED";
+        case CTRL_STATUS_UNSUPPORTED:    return "UNSUPPORTED";
+        default:                         return "UNKNOWN";
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Host-side client for the binary control protocol (Linux/macOS, POSIX serial).
+// Console log text on the same port is skipped automatically.
+#pragma once
+#include <controlFrame.h>
+#include <stdint.h>
+#include <vector>
+
+struct ControlResponse {
+    uint16_t seq;
+    uint8_t opcode;                 // Request opcode (response flag stripped)
+    uint8_t status;                 // ControlStatus
+    std::vector<uint8_t> payload;
+};
+
+// Accumulates batch entries for CTRL_OP_BATCH
+class ControlBatch {
+public:
+    bool add(uint8_t opcode, const uint8_t* payload = nullptr, uint8_t length = 0);
+    const std::vector<uint8_t>& bytes() const { return data; }
+    size_t count() const { return entries; }
+private:
+    std::vector<uint8_t> data;
+    size_t entries = 0;
+};
+
+class ControlClient {
+public:
+    ControlClient() {}
+    ~ControlClient();
+
+    // Opens a tty (baud is ignored by USB CDC but set for real UARTs), or adopts an open fd
+    bool open(const char* device, int baud = 115200);
+    void attach(int fd);
+    void close();
+
+    // Pipelining: send() returns the seq immediately; collect responses with receive()
+    int send(uint8_t opcode, const uint8_t* payload = nullptr, size_t length = 0);
+    bool receive(ControlResponse& out, int timeoutMs);
+
+    // Send one request and wait for its response (other responses are discarded)
+    bool request(uint8_t opcode, const uint8_t* payload, size_t length, ControlResponse& out, int timeoutMs = 500);
+
+    // Convenience wrappers; return false on timeout or non-OK status
+    bool ping(uint32_t* uptimeMs = nullptr);
+    bool setRelay(uint8_t channel);
+    bool setRelayMask(uint8_t mask);
+    bool sendToClient(uint8_t clientIndex, uint8_t commandType, uint8_t value);
+    bool sendToAll(uint8_t commandType, uint8_t value);
+    bool setRelayMap(uint8_t relayIndex, uint8_t program);
+    bool setButtonMap(uint8_t buttonIndex, uint8_t program);
+    bool saveMaps();
+    bool batch(const ControlBatch& batch, std::vector<uint8_t>* statuses = nullptr);
+
+    uint32_t discardedFrames() const { return badFrames; }
+
+private:
+    bool consume(uint8_t c, std::vector<uint8_t>& frame);
+    bool readFrame(std::vector<uint8_t>& frame, int timeoutMs);
+    bool simple(uint8_t opcode, const uint8_t* payload, size_t length, ControlResponse* out = nullptr);
+
+    int fd = -1;
+    bool ownsFd = false;
+    uint16_t nextSeq = 1;
+    std::vector<uint8_t> rx;        // Encoded bytes since the last 0x00
+    std::vector<uint8_t> pending;   // Read but not yet consumed
+    size_t pendingPos = 0;
+    uint32_t badFrames = 0;
+};
+
+const char* controlStatusName(uint8_t status);
@@ -0,0 +1,131 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Command-line front end for the control client.
+#include "controlClient.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void usage() {
+    fprintf(stderr,
+            "usage: swctl <device> <command> [args]\n"
+            "  ping\n"
+            "  stats\n"
+            "  relay <channel>            (0 = all off)\n"
+            "  mask <bits>                (e.g. 0x3 = relays 1 and 2)\n"
+            "  send <client> <type> <value>\n"
+            "  sendall <type> <value>\n"
+            "  map                        show MIDI channel and maps\n"
+            "  maprelay <idx> <program>\n"
+            "  mapbutton <idx> <program>\n"
+            "  save                       persist maps to NVS\n"
+            "  pipeline <count>           pipelined ping round-trip timing\n");
+}
+
+static uint32_t u32At(const std::vector<uint8_t>& p, size_t offset) {
+    return (uint32_t)p[offset] | ((uint32_t)p[offset + 1] << 8) |
+           ((uint32_t)p[offset + 2] << 16) | ((uint32_t)p[offset + 3] << 24);
+}
+
+static uint8_t argByte(const char* s) {
+    return (uint8_t)strtoul(s, nullptr, 0);
+}
+
+static double elapsedMs(const struct timespec& a, const struct timespec& b) {
+    return (b.tv_sec - a.tv_sec) * 1000.0 + (b.tv_nsec - a.tv_nsec) / 1e6;
+}
+
+static int report(bool ok) {
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    ControlClient client;
+    if (!client.open(argv[1])) {
+        perror(argv[1]);
+        return 1;
+    }
+    const char* cmd = argv[2];
+    ControlResponse response;
+
+    if (strcmp(cmd, "ping") == 0) {
+        uint32_t uptime = 0;
+        bool ok = client.ping(&uptime);
+        if (ok) printf("uptime %u ms\n", uptime);
+        return report(ok);
+    }
+    if (strcmp(cmd, "stats") == 0) {
+        if (!client.request(CTRL_OP_STATS, nullptr, 0, response) || response.payload.size() < 32) return report(false);
+        const std::vector<uint8_t>& p = response.payload;
+        printf("uptime_ms=%u free_heap=%u min_free_heap=%u clients=%u relay=%u mask=0x%02X log_level=%u\n",
+               u32At(p, 0), u32At(p, 4), u32At(p, 8), p[12], p[13], p[14], p[15]);
+        printf("frames_ok=%u crc_errors=%u framing_errors=%u log_dropped=%u\n",
+               u32At(p, 16), u32At(p, 20), u32At(p, 24), u32At(p, 28));
+        return 0;
+    }
+    if (strcmp(cmd, "relay") == 0 && argc >= 4) return report(client.setRelay(argByte(argv[3])));
+    if (strcmp(cmd, "mask") == 0 && argc >= 4) return report(client.setRelayMask(argByte(argv[3])));
+    if (strcmp(cmd, "send") == 0 && argc >= 6) {
+        return report(client.sendToClient(argByte(argv[3]), argByte(argv[4]), argByte(argv[5])));
+    }
+    if (strcmp(cmd, "sendall") == 0 && argc >= 5) return report(client.sendToAll(argByte(argv[3]), argByte(argv[4])));
+    if (strcmp(cmd, "map") == 0) {
+        if (!client.request(CTRL_OP_MAP_GET, nullptr, 0, response) || response.payload.size() < 2) return report(false);
+        const std::vector<uint8_t>& p = response.payload;
+        size_t relays = p[1];
+        printf("midi_channel=%u\nrelay_map:", p[0]);
+        for (size_t i = 0; i < relays && 2 + i < p.size(); i++) printf(" %u", p[2 + i]);
+        size_t buttonsAt = 2 + relays;
+        printf("\nbutton_map:");
+        for (size_t i = 0; buttonsAt < p.size() && i < p[buttonsAt]; i++) {
+            if (buttonsAt + 1 + i < p.size()) printf(" %u", p[buttonsAt + 1 + i]);
+        }
+        printf("\n");
+        return 0;
+    }
+    if (strcmp(cmd, "maprelay") == 0 && argc >= 5) return report(client.setRelayMap(argByte(argv[3]), argByte(argv[4])));
+    if (strcmp(cmd, "mapbutton") == 0 && argc >= 5) return report(client.setButtonMap(argByte(argv[3]), argByte(argv[4])));
+    if (strcmp(cmd, "save") == 0) return report(client.saveMaps());
+    if (strcmp(cmd, "pipeline") == 0 && argc >= 4) {
+        int count = atoi(argv[3]);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // Keep a bounded window in flight so neither side blocks on a full transmit buffer
+        const int window = 16;
+        int sent = 0;
+        int received = 0;
+        while (received < count) {
+            while (sent < count && sent - received < window) {
+                if (client.send(CTRL_OP_PING) < 0) return report(false);
+                sent++;
+            }
+            if (!client.receive(response, 1000)) break;
+            received++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ms = elapsedMs(start, end);
+        printf("%d/%d responses in %.1f ms (%.0f req/s), %u discarded frames\n",
+               received, count, ms, ms > 0 ? received * 1000.0 / ms : 0.0, client.discardedFrames());
+        return received == count ? 0 : 1;
+    }
+    usage();
+    return 2;
+}
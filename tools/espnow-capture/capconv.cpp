@@ -0,0 +1,229 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Host tool for ESP-NOW captures (include/espnowCapture.h): pulls the pcap out of
+// a logged 'capture dump', lists it, and writes a replay script for the native
+// simulator ('program replay', src/native/replayRunner.cpp).
+#include <espnowCapture.h>
+#include <espnowFrame.h>
+#include <configImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct CaptureEntry {
+    uint64_t timeUs;
+    EspNowCapturePseudo pseudo;
+    uint32_t frameLength;       // On air
+    std::vector<uint8_t> data;  // First bytes kept by the firmware
+};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: capconv extract <serial-log> <out.pcap>\n"
+            "       capconv list <capture>\n"
+            "       capconv replay <capture> <out.replay>\n"
+            "<capture> is a pcap file or a serial log containing a 'capture dump'.\n");
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+// Find the last complete "#PCAP <length> <crc>" block in a serial log
+static bool extractPcap(const std::vector<uint8_t>& log, std::vector<uint8_t>& pcap) {
+    static const char marker[] = "#PCAP ";
+    bool found = false;
+    for (size_t i = 0; i + sizeof(marker) - 1 < log.size(); i++) {
+        if ((i > 0 && log[i - 1] != '\n') || memcmp(&log[i], marker, sizeof(marker) - 1) != 0) continue;
+        size_t eol = i;
+        while (eol < log.size() && log[eol] != '\n') eol++;
+        if (eol >= log.size()) break;
+        std::string line((const char*)&log[i], eol - i);
+        unsigned long length = 0, crc = 0;
+        if (sscanf(line.c_str(), "#PCAP %lu %lx", &length, &crc) != 2 || eol + 1 + length > log.size()) continue;
+        const uint8_t* body = &log[eol + 1];
+        if (configCrc32(body, length) != (uint32_t)crc) {
+            fprintf(stderr, "dump at offset %lu: CRC mismatch (console output mixed in?), skipped\n", (unsigned long)i);
+            continue;
+        }
+        pcap.assign(body, body + length);
+        found = true;
+        i = eol + length;
+    }
+    return found;
+}
+
+static bool loadCapture(const char* path, std::vector<uint8_t>& pcap) {
+    std::vector<uint8_t> raw;
+    if (!readFile(path, raw)) return false;
+    uint32_t magic = 0;
+    if (raw.size() >= 4) memcpy(&magic, raw.data(), 4);
+    if (magic == PCAP_MAGIC_US) {
+        pcap.swap(raw);
+        return true;
+    }
+    if (extractPcap(raw, pcap)) return true;
+    fprintf(stderr, "%s: no pcap header and no intact '#PCAP' dump found\n", path);
+    return false;
+}
+
+static bool parsePcap(const std::vector<uint8_t>& pcap, std::vector<CaptureEntry>& entries) {
+    PcapFileHeader header;
+    if (pcap.size() < sizeof(header)) return false;
+    memcpy(&header, pcap.data(), sizeof(header));
+    if (header.magic != PCAP_MAGIC_US || header.linkType != PCAP_LINKTYPE_USER0) {
+        fprintf(stderr, "not an ESP-NOW capture (magic %08X, link type %u)\n", header.magic, header.linkType);
+        return false;
+    }
+    size_t pos = sizeof(header);
+    while (pos + sizeof(PcapRecordHeader) <= pcap.size()) {
+        PcapRecordHeader record;
+        memcpy(&record, &pcap[pos], sizeof(record));
+        pos += sizeof(record);
+        if (record.inclLen < sizeof(EspNowCapturePseudo) || record.inclLen > record.origLen ||
+            pos + record.inclLen > pcap.size()) {
+            fprintf(stderr, "truncated or corrupt record at offset %lu\n", (unsigned long)(pos - sizeof(record)));
+            return false;
+        }
+        CaptureEntry entry;
+        entry.timeUs = (uint64_t)record.tsSec * 1000000 + record.tsUsec;
+        memcpy(&entry.pseudo, &pcap[pos], sizeof(entry.pseudo));
+        entry.frameLength = record.origLen - sizeof(EspNowCapturePseudo);
+        entry.data.assign(pcap.begin() + pos + sizeof(EspNowCapturePseudo), pcap.begin() + pos + record.inclLen);
+        entries.push_back(entry);
+        pos += record.inclLen;
+    }
+    return true;
+}
+
+static const char* eventName(uint8_t event) {
+    switch (event) {
+        case CAPTURE_TX:        return "tx";
+        case CAPTURE_RX:        return "rx";
+        case CAPTURE_TX_STATUS: return "sent";
+        default:                return "?";
+    }
+}
+
+static const char* frameSummary(const CaptureEntry& e, char* out, size_t size) {
+    if (e.pseudo.event == CAPTURE_TX_STATUS) {
+        snprintf(out, size, "%s", e.pseudo.status == 0 ? "delivered" : "FAILED");
+    } else if (e.data.empty()) {
+        snprintf(out, size, "empty");
+    } else if ((e.data[0] == ESPNOW_MSG_COMMAND || e.data[0] == ESPNOW_MSG_DATA) && e.data.size() >= 4) {
+        snprintf(out, size, "%s type %u value %u", e.data[0] == ESPNOW_MSG_COMMAND ? "COMMAND" : "DATA",
+                 e.data[ESPNOW_MESSAGE_COMMAND_TYPE], e.data[ESPNOW_MESSAGE_COMMAND_VALUE]);
+    } else if (e.data[0] == ESPNOW_MSG_PAIRING) {
+        snprintf(out, size, "PAIRING");
+    } else if (e.data[0] == FW_PUSH_MSG_TYPE && e.data.size() >= 2) {
+        snprintf(out, size, "FW_PUSH op %u", e.data[1]);
+    } else {
+        snprintf(out, size, "type 0x%02X", e.data[0]);
+    }
+    return out;
+}
+
+static void listEntries(const std::vector<CaptureEntry>& entries) {
+    uint64_t first = entries.empty() ? 0 : entries[0].timeUs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CaptureEntry& e = entries[i];
+        char peer[8];
+        if (e.pseudo.peer == CAPTURE_PEER_BROADCAST) snprintf(peer, sizeof(peer), "bcast");
+        else if (e.pseudo.peer == CAPTURE_PEER_UNKNOWN) snprintf(peer, sizeof(peer), "?");
+        else snprintf(peer, sizeof(peer), "%u", e.pseudo.peer);
+        char summary[48];
+        printf("%12.3f ms  %-4s peer %-5s %02X:%02X:%02X:%02X:%02X:%02X  len %3u  status %u  %s%s\n",
+               (e.timeUs - first) / 1000.0, eventName(e.pseudo.event), peer,
+               e.pseudo.mac[0], e.pseudo.mac[1], e.pseudo.mac[2], e.pseudo.mac[3], e.pseudo.mac[4], e.pseudo.mac[5],
+               e.frameLength, e.pseudo.status, frameSummary(e, summary, sizeof(summary)),
+               e.data.size() < e.frameLength ? " (truncated)" : "");
+    }
+    printf("%u records\n", (unsigned)entries.size());
+}
+
+// One event per line, time relative to the first record:
+//   <us> <tx|rx|sent> <peer> <status> <length> <mac> <hex bytes or ->
+static bool writeReplay(const std::vector<CaptureEntry>& entries, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "# espnow-replay 1\n");
+    uint64_t first = entries.empty() ? 0 : entries[0].timeUs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CaptureEntry& e = entries[i];
+        fprintf(f, "%llu %s %u %u %u %02X:%02X:%02X:%02X:%02X:%02X ", (unsigned long long)(e.timeUs - first),
+                eventName(e.pseudo.event), e.pseudo.peer, e.pseudo.status, e.frameLength,
+                e.pseudo.mac[0], e.pseudo.mac[1], e.pseudo.mac[2], e.pseudo.mac[3], e.pseudo.mac[4], e.pseudo.mac[5]);
+        if (e.data.empty()) fputc('-', f);
+        for (size_t k = 0; k < e.data.size(); k++) fprintf(f, "%02X", e.data[k]);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    const char* cmd = argv[1];
+    std::vector<uint8_t> pcap;
+
+    if (strcmp(cmd, "extract") == 0 && argc >= 4) {
+        std::vector<uint8_t> log;
+        if (!readFile(argv[2], log)) return 1;
+        if (!extractPcap(log, pcap)) {
+            fprintf(stderr, "%s: no intact '#PCAP' dump found\n", argv[2]);
+            return 1;
+        }
+        FILE* f = fopen(argv[3], "wb");
+        if (!f || fwrite(pcap.data(), 1, pcap.size(), f) != pcap.size()) {
+            perror(argv[3]);
+            if (f) fclose(f);
+            return 1;
+        }
+        fclose(f);
+        printf("%s: %u bytes\n", argv[3], (unsigned)pcap.size());
+        return 0;
+    }
+
+    std::vector<CaptureEntry> entries;
+    if (!loadCapture(argv[2], pcap) || !parsePcap(pcap, entries)) return 1;
+    if (strcmp(cmd, "list") == 0) {
+        listEntries(entries);
+        return 0;
+    }
+    if (strcmp(cmd, "replay") == 0 && argc >= 4) {
+        if (!writeReplay(entries, argv[3])) return 1;
+        printf("%s: %u events\n", argv[3], (unsigned)entries.size());
+        return 0;
+    }
+    usage();
+    return 2;
+}
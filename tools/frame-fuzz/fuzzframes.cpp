@@ -0,0 +1,173 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Fuzz target for the ESP-NOW frame parser (include/espnowFrame.h).
+//
+// Built with -DFRAME_FUZZ_LIBFUZZER it is a libFuzzer target. Otherwise main()
+// mutates a corpus of valid frames (bit flips, truncation, extension, random
+// bytes), runs every case through the same entry point and reports throughput
+// and the reject breakdown. Each case sits in a heap block of exactly its
+// length, so an AddressSanitizer build catches any read past the frame.
+#include <espnowFrame.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static uint32_t results[ESPNOW_RX_REASON_COUNT];
+static volatile uint32_t sink;
+
+// Read every field the firmware reads for the accepted type
+static void touchFields(const EspNowFrame& frame) {
+    uint32_t sum = 0;
+    switch (frame.type) {
+        case ESPNOW_MSG_DATA:
+        case ESPNOW_MSG_COMMAND:
+            sum += espNowFrameU8(frame, ESPNOW_MESSAGE_ID) + espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_TYPE) +
+                   espNowFrameU8(frame, ESPNOW_MESSAGE_COMMAND_VALUE) + espNowFrameU8(frame, ESPNOW_MESSAGE_TARGET_CHANNEL) +
+                   espNowFrameU32(frame, ESPNOW_MESSAGE_READING_ID) + espNowFrameU32(frame, ESPNOW_MESSAGE_TIMESTAMP);
+            break;
+        case ESPNOW_MSG_PAIRING:
+            for (size_t i = 1; i < ESPNOW_PAIRING_LEN; i++) sum += espNowFrameU8(frame, i);
+            break;
+        case FW_PUSH_MSG_TYPE:
+            if (frame.data[1] == FW_OP_STATUS) {
+                FwPushStatus status;
+                memcpy(&status, frame.data, sizeof(status));
+                sum += status.base + (uint32_t)status.received;
+            }
+            break;
+    }
+    sink += sum;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    EspNowFrame frame;
+    EspNowReject result = espNowFrameParse(data, (int)size, frame);
+    results[result]++;
+    if (result == ESPNOW_RX_OK) {
+        if (frame.data != data || frame.length != size) abort();
+        touchFields(frame);
+    } else if (frame.data != nullptr) {
+        abort();
+    }
+    return 0;
+}
+
+#ifndef FRAME_FUZZ_LIBFUZZER
+
+static uint32_t rngState = 0x2545F491u;
+
+static uint32_t nextRandom() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static std::vector<std::vector<uint8_t> > seedFrames() {
+    std::vector<std::vector<uint8_t> > seeds;
+    std::vector<uint8_t> message(ESPNOW_MESSAGE_LEN, 0);
+    message[0] = ESPNOW_MSG_COMMAND;
+    message[ESPNOW_MESSAGE_COMMAND_VALUE] = 5;
+    seeds.push_back(message);
+    message[0] = ESPNOW_MSG_DATA;
+    seeds.push_back(message);
+    std::vector<uint8_t> pairing(ESPNOW_PAIRING_LEN, 'a');
+    pairing[0] = ESPNOW_MSG_PAIRING;
+    pairing[ESPNOW_PAIRING_ID] = 1;
+    seeds.push_back(pairing);
+    FwPushStatus status;
+    memset(&status, 0, sizeof(status));
+    status.header.msgType = FW_PUSH_MSG_TYPE;
+    status.header.op = FW_OP_STATUS;
+    seeds.push_back(std::vector<uint8_t>((uint8_t*)&status, (uint8_t*)&status + sizeof(status)));
+    FwPushOffer offer;
+    memset(&offer, 0, sizeof(offer));
+    offer.header.msgType = FW_PUSH_MSG_TYPE;
+    offer.header.op = FW_OP_OFFER;
+    offer.version = FW_PUSH_PROTOCOL_VERSION;
+    seeds.push_back(std::vector<uint8_t>((uint8_t*)&offer, (uint8_t*)&offer + sizeof(offer)));
+    return seeds;
+}
+
+static std::vector<uint8_t> mutate(const std::vector<uint8_t>& seed) {
+    std::vector<uint8_t> frame = seed;
+    switch (nextRandom() % 5) {
+        case 0:                                         // Truncate, possibly to nothing
+            frame.resize(nextRandom() % (frame.size() + 1));
+            break;
+        case 1: {                                       // Flip a few bits
+            int flips = 1 + nextRandom() % 4;
+            for (int i = 0; i < flips; i++) frame[nextRandom() % frame.size()] ^= (uint8_t)(1u << (nextRandom() % 8));
+            break;
+        }
+        case 2:                                         // Extend with junk, sometimes past the ESP-NOW limit
+            frame.resize(frame.size() + nextRandom() % 240, (uint8_t)nextRandom());
+            break;
+        case 3:                                         // Random type byte
+            frame[0] = (uint8_t)nextRandom();
+            break;
+        default:                                        // Random bytes
+            frame.resize(nextRandom() % 64);
+            for (size_t i = 0; i < frame.size(); i++) frame[i] = (uint8_t)nextRandom();
+            break;
+    }
+    return frame;
+}
+
+static uint64_t hostNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+    uint32_t total = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 10000000u;
+    if (argc > 2) rngState = (uint32_t)strtoul(argv[2], nullptr, 0) | 1u;
+    const size_t batchSize = 4096;
+    std::vector<std::vector<uint8_t> > seeds = seedFrames();
+    std::vector<uint8_t*> batch(batchSize);
+    std::vector<size_t> lengths(batchSize);
+    uint64_t parseNs = 0;
+    uint64_t bytes = 0;
+
+    for (uint32_t done = 0; done < total;) {
+        size_t count = total - done < batchSize ? total - done : batchSize;
+        for (size_t i = 0; i < count; i++) {
+            std::vector<uint8_t> frame = mutate(seeds[nextRandom() % seeds.size()]);
+            lengths[i] = frame.size();
+            batch[i] = (uint8_t*)malloc(frame.size() ? frame.size() : 1);
+            if (!frame.empty()) memcpy(batch[i], frame.data(), frame.size());
+            bytes += frame.size();
+        }
+        uint64_t start = hostNs();
+        for (size_t i = 0; i < count; i++) LLVMFuzzerTestOneInput(batch[i], lengths[i]);
+        parseNs += hostNs() - start;
+        for (size_t i = 0; i < count; i++) free(batch[i]);
+        done += (uint32_t)count;
+    }
+
+    double seconds = parseNs / 1e9;
+    printf("%u frames (%llu bytes) in %.3f s: %.1f M frames/s, %.1f ns/frame, %.0f MB/s\n",
+           total, (unsigned long long)bytes, seconds, seconds > 0 ? total / seconds / 1e6 : 0.0,
+           total ? (double)parseNs / total : 0.0, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+    for (int reason = 0; reason < ESPNOW_RX_REASON_COUNT; reason++) {
+        if (results[reason] > 0) printf("  %-14s %10u\n", espNowRejectName(reason), results[reason]);
+    }
+    return 0;
+}
+
+#endif
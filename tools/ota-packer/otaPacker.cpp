@@ -0,0 +1,228 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Encoder for compressed / delta OTA images (format in include/otaPatch.h) and
+// the check that rebuilds a packed file with the firmware's decoder. Shared by
+// the otapack CLI and the native runner.
+#include "otaPacker.h"
+#include <configImage.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+// ---- Encoder ----
+#define HASH_BITS 18
+#define MAX_CANDIDATES 64
+#define MIN_BASE_MATCH 8
+
+static uint32_t hashAt(const Bytes& data, size_t pos, size_t bytes) {
+    uint32_t h = 0;
+    for (size_t i = 0; i < bytes; i++) h = (h * 2654435761u) ^ data[pos + i];
+    return (h * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Hash chains over every position of a buffer
+struct MatchIndex {
+    std::vector<int32_t> head;
+    std::vector<int32_t> prev;
+    size_t bytes;
+
+    MatchIndex(size_t size, size_t hashBytes) : head(1u << HASH_BITS, -1), prev(size, -1), bytes(hashBytes) {}
+
+    void insert(const Bytes& data, size_t pos) {
+        if (pos + bytes > data.size()) return;
+        uint32_t h = hashAt(data, pos, bytes);
+        prev[pos] = head[h];
+        head[h] = (int32_t)pos;
+    }
+};
+
+static size_t matchLength(const Bytes& a, size_t aPos, const Bytes& b, size_t bPos, size_t limit) {
+    size_t n = 0;
+    while (n < limit && aPos + n < a.size() && bPos + n < b.size() && a[aPos + n] == b[bPos + n]) n++;
+    return n;
+}
+
+static size_t varintSize(uint32_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; n++; }
+    return n;
+}
+
+static void putVarint(Bytes& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void flushLiterals(Bytes& out, const Bytes& target, size_t start, size_t end) {
+    while (start < end) {
+        size_t n = end - start;
+        if (n > OTA_PATCH_MAX_LITERAL) n = OTA_PATCH_MAX_LITERAL;
+        out.push_back((uint8_t)(n - 1));
+        out.insert(out.end(), target.begin() + start, target.begin() + start + n);
+        start += n;
+    }
+}
+
+static Bytes encode(const Bytes& target, const Bytes* base, OtaPackStats& stats) {
+    Bytes out;
+    memset(&stats, 0, sizeof(stats));
+    MatchIndex window(target.size(), OTA_PATCH_MIN_MATCH);
+    MatchIndex baseIndex(base ? base->size() : 0, MIN_BASE_MATCH);
+    if (base) {
+        for (size_t i = 0; i < base->size(); i++) baseIndex.insert(*base, i);
+    }
+
+    int32_t lastDelta = 0;   // Firmware changes tend to shift whole regions by a constant
+    size_t literalStart = 0;
+    size_t pos = 0;
+    while (pos < target.size()) {
+        // Best window match
+        size_t bestLength = 0, bestDistance = 0;
+        if (pos + OTA_PATCH_MIN_MATCH <= target.size()) {
+            int32_t candidate = window.head[hashAt(target, pos, OTA_PATCH_MIN_MATCH)];
+            for (int tries = 0; candidate >= 0 && tries < MAX_CANDIDATES; tries++) {
+                size_t distance = pos - (size_t)candidate;
+                if (distance > OTA_PATCH_WINDOW) break;
+                size_t length = matchLength(target, (size_t)candidate, target, pos, OTA_PATCH_MAX_MATCH);
+                if (length > bestLength) { bestLength = length; bestDistance = distance; }
+                candidate = window.prev[candidate];
+            }
+        }
+        long windowGain = bestLength >= OTA_PATCH_MIN_MATCH ? (long)bestLength - 3 : 0;
+
+        // Best base copy
+        size_t baseLength = 0;
+        int32_t baseDelta = 0;
+        if (base) {
+            int64_t same = (int64_t)pos + lastDelta;
+            if (same >= 0 && (size_t)same < base->size()) {
+                baseLength = matchLength(*base, (size_t)same, target, pos, SIZE_MAX);
+                baseDelta = lastDelta;
+            }
+            if (pos + MIN_BASE_MATCH <= target.size()) {
+                int32_t candidate = baseIndex.head[hashAt(target, pos, MIN_BASE_MATCH)];
+                for (int tries = 0; candidate >= 0 && tries < MAX_CANDIDATES; tries++) {
+                    size_t length = matchLength(*base, (size_t)candidate, target, pos, SIZE_MAX);
+                    if (length > baseLength) {
+                        baseLength = length;
+                        baseDelta = (int32_t)((int64_t)candidate - (int64_t)pos);
+                    }
+                    candidate = baseIndex.prev[candidate];
+                }
+            }
+        }
+        long baseCost = 1 + (long)varintSize((uint32_t)baseLength) + (long)varintSize(zigzag(baseDelta));
+        long baseGain = baseLength >= MIN_BASE_MATCH ? (long)baseLength - baseCost : 0;
+
+        size_t advance = 1;
+        if (baseGain > 0 && baseGain >= windowGain) {
+            flushLiterals(out, target, literalStart, pos);
+            out.push_back(OTA_PATCH_TOKEN_BASE);
+            putVarint(out, (uint32_t)baseLength);
+            putVarint(out, zigzag(baseDelta));
+            lastDelta = baseDelta;
+            stats.baseCopies++;
+            stats.baseBytes += baseLength;
+            advance = baseLength;
+            literalStart = pos + advance;
+        } else if (windowGain > 0) {
+            flushLiterals(out, target, literalStart, pos);
+            out.push_back((uint8_t)(OTA_PATCH_TOKEN_MATCH | (bestLength - OTA_PATCH_MIN_MATCH)));
+            out.push_back((uint8_t)(bestDistance - 1));
+            out.push_back((uint8_t)((bestDistance - 1) >> 8));
+            stats.windowMatches++;
+            advance = bestLength;
+            literalStart = pos + advance;
+        } else {
+            stats.literals++;
+        }
+        for (size_t i = 0; i < advance; i++) window.insert(target, pos + i);
+        pos += advance;
+    }
+    flushLiterals(out, target, literalStart, target.size());
+    return out;
+}
+
+// ---- Verification with the firmware decoder ----
+struct VerifyContext {
+    const Bytes* base;
+    Bytes rebuilt;
+};
+
+static bool sinkWrite(void* context, const uint8_t* data, size_t length) {
+    VerifyContext* ctx = (VerifyContext*)context;
+    ctx->rebuilt.insert(ctx->rebuilt.end(), data, data + length);
+    return true;
+}
+
+static bool sinkReadBase(void* context, uint32_t offset, uint8_t* data, size_t length) {
+    VerifyContext* ctx = (VerifyContext*)context;
+    if (!ctx->base || (size_t)offset + length > ctx->base->size()) return false;
+    memcpy(data, ctx->base->data() + offset, length);
+    return true;
+}
+
+// Feeds the file in upload-sized pieces, as the web server does
+bool otaPackVerify(const Bytes& file, const Bytes* base, const Bytes& expected) {
+    static OtaPatchDecoder decoder;
+    VerifyContext ctx = {base, Bytes()};
+    OtaPatchIo io = {sinkWrite, base ? sinkReadBase : nullptr, &ctx};
+    otaPatchBegin(decoder, io);
+    OtaPatchStatus status = OTA_PATCH_NEED_MORE;
+    for (size_t pos = 0; pos < file.size() && status == OTA_PATCH_NEED_MORE; pos += 1436) {
+        size_t n = file.size() - pos < 1436 ? file.size() - pos : 1436;
+        status = otaPatchFeed(decoder, file.data() + pos, n);
+    }
+    status = otaPatchFinish(decoder);
+    if (status != OTA_PATCH_DONE) {
+        fprintf(stderr, "verify: decoder reported %s\n", otaPatchStatusName(status));
+        return false;
+    }
+    if (ctx.rebuilt != expected) {
+        fprintf(stderr, "verify: rebuilt image differs from expected\n");
+        return false;
+    }
+    return true;
+}
+
+Bytes otaPackImage(const Bytes& target, const Bytes* base, OtaPackStats& stats) {
+    Bytes payload = encode(target, base, stats);
+    OtaPatchHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = OTA_PATCH_MAGIC;
+    header.version = OTA_PATCH_VERSION;
+    header.flags = base ? OTA_PATCH_FLAG_DELTA : 0;
+    header.targetSize = (uint32_t)target.size();
+    header.targetCrc = configCrc32(target.data(), target.size());
+    if (base) {
+        header.baseSize = (uint32_t)base->size();
+        header.baseCrc = configCrc32(base->data(), base->size());
+    }
+    header.payloadSize = (uint32_t)payload.size();
+
+    Bytes file(sizeof(header) + payload.size());
+    memcpy(file.data(), &header, sizeof(header));
+    if (!payload.empty()) memcpy(file.data() + sizeof(header), payload.data(), payload.size());
+    return file;
+}
@@ -0,0 +1,35 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Encoder for compressed / delta OTA images (format in include/otaPatch.h).
+// Host only: it indexes the whole image and base in RAM.
+#pragma once
+#include <otaPatch.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct OtaPackStats {
+    size_t literals, windowMatches, baseCopies, baseBytes;
+};
+
+// Header plus token stream; a delta when base is given
+std::vector<uint8_t> otaPackImage(const std::vector<uint8_t>& target, const std::vector<uint8_t>* base,
+                                  OtaPackStats& stats);
+
+// Rebuild a packed file with the firmware decoder, fed in upload-sized pieces,
+// and compare it with the expected image. Reasons for a failure go to stderr.
+bool otaPackVerify(const std::vector<uint8_t>& file, const std::vector<uint8_t>* base,
+                   const std::vector<uint8_t>& expected);
@@ -0,0 +1,105 @@
+// Copyright (c) Craig Millard and contributors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Host packer for compressed / delta OTA images (format in include/otaPatch.h).
+// Every file written is rebuilt with the firmware's decoder and compared before
+// the tool reports success.
+#include "otaPacker.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static void usage() {
+    fprintf(stderr,
+            "usage: otapack <new.bin> <out.swp>                    compressed image\n"
+            "       otapack --base <old.bin> <new.bin> <out.swp>   delta against the running firmware\n"
+            "       otapack --verify [--base <old.bin>] <in.swp> <expected.bin>\n");
+}
+
+static bool readFile(const char* path, Bytes& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static bool writeFile(const char* path, const Bytes& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* basePath = nullptr;
+    bool verifyOnly = false;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            basePath = argv[++i];
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verifyOnly = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() != 2) {
+        usage();
+        return 2;
+    }
+
+    Bytes base;
+    if (basePath && !readFile(basePath, base)) return 1;
+
+    if (verifyOnly) {
+        Bytes file, expected;
+        if (!readFile(args[0], file) || !readFile(args[1], expected)) return 1;
+        bool ok = otaPackVerify(file, basePath ? &base : nullptr, expected);
+        printf("%s\n", ok ? "OK" : "FAILED");
+        return ok ? 0 : 1;
+    }
+
+    Bytes target;
+    if (!readFile(args[0], target)) return 1;
+    if (target.empty()) {
+        fprintf(stderr, "%s: empty image\n", args[0]);
+        return 1;
+    }
+
+    OtaPackStats stats;
+    Bytes file = otaPackImage(target, basePath ? &base : nullptr, stats);
+    if (!otaPackVerify(file, basePath ? &base : nullptr, target)) return 1;
+    if (!writeFile(args[1], file)) return 1;
+
+    printf("%s: %zu -> %zu bytes (%.1f%%), %s\n", args[1], target.size(), file.size(),
+           100.0 * file.size() / target.size(), basePath ? "delta" : "compressed");
+    printf("  %zu literal bytes, %zu window matches, %zu base copies (%zu bytes)\n",
+           stats.literals, stats.windowMatches, stats.baseCopies, stats.baseBytes);
+    return 0;
+}